@@ -37,8 +37,7 @@ uint64_t block_dev_test() {
     struct block_request req = {
         .is_read = 1,
         .sector = 0,
-        .buffer = buffer,
-        .wait_queue = NULL
+        .buffer = buffer
     };
     block_test->request(dev, &req);
     for (uint64_t i = 0; i < 16; i += 1) {
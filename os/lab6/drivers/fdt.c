@@ -1,8 +1,11 @@
 #include <device/fdt.h>
 #include <device.h>
+#include <device/loader.h>
 #include <kdebug.h>
 #include <mm.h>
 
+const struct fdt_header *g_fdt = NULL;
+
 struct driver_resource fdt_mem = {
     .resource_type = DRIVER_RESOURCE_MEM
 };
@@ -63,6 +66,7 @@ void fdt_loader(const struct fdt_header *fdt, struct device_driver *driver_list[
     device_add_resource(dev, &fdt_mem);
 
     fdt = (const struct fdt_header *)fdt_mem.map_address;
+    g_fdt = fdt;
     
     union fdt_walk_pointer first_pointer = {
         .address = (uint64_t)fdt + fdt32_to_cpu(fdt->off_dt_struct)
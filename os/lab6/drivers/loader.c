@@ -5,12 +5,14 @@
 #include <device/reset/sifive_test.h>
 #include <device/irq/plic.h>
 #include <device/serial/uart8250.h>
+#include <device/rtc/goldfish_rtc.h>
 #include <device/virtio.h>
 
 struct device_driver *driver_list[] = {
     &test_driver,
     &plic_driver,
     &uart8250_driver,
+    &goldfish_rtc_driver,
     &virtio_driver,
     NULL
 };
@@ -0,0 +1,3 @@
+#include <device/rtc.h>
+
+struct rtc_device *g_rtc_dev = NULL;
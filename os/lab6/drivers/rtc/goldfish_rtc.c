@@ -0,0 +1,62 @@
+#include <device/rtc/goldfish_rtc.h>
+#include <device/fdt.h>
+#include <mm.h>
+
+struct driver_resource goldfish_rtc_mmio_res = {
+    .resource_start = 0x101000,
+    .resource_end = 0x102000,
+    .resource_type = DRIVER_RESOURCE_MEM
+};
+
+uint64_t goldfish_rtc_read_time(struct device *dev) { // 取得纳秒时间戳
+    volatile struct goldfish_rtc_regs *rtc = (volatile struct goldfish_rtc_regs *)goldfish_rtc_mmio_res.map_address;
+    uint32_t low = rtc->time_low;   // 读低32位时锁存高32位
+    uint32_t high = rtc->time_high;
+    return ((uint64_t)high << 32) | (uint64_t)low;
+}
+
+void goldfish_rtc_set_time(struct device *dev, uint64_t now) { // now为纳秒时间戳
+    volatile struct goldfish_rtc_regs *rtc = (volatile struct goldfish_rtc_regs *)goldfish_rtc_mmio_res.map_address;
+    rtc->time_high = (uint32_t)(now >> 32);
+    rtc->time_low = (uint32_t)now;
+}
+
+struct rtc_device goldfish_rtc_device = {
+    .read_time = goldfish_rtc_read_time,
+    .set_time = goldfish_rtc_set_time
+};
+
+void *goldfish_rtc_get_interface(struct device *dev, uint64_t flag) {
+    if(flag & RTC_INTERFACE_BIT) return &goldfish_rtc_device;
+    return NULL;
+}
+
+uint64_t goldfish_rtc_device_probe(struct device *dev) {
+    device_init(dev);
+    struct fdt_property *reg = fdt_get_prop(device_get_fdt(dev), device_get_fdt_node(dev), "reg");
+    if (reg) { // reg = <address-hi address-lo size-hi size-lo>
+        goldfish_rtc_mmio_res.resource_start = (uint64_t)fdt_get_prop_num_value(reg, 0) << 32;
+        goldfish_rtc_mmio_res.resource_start += fdt_get_prop_num_value(reg, 1);
+        goldfish_rtc_mmio_res.resource_end = goldfish_rtc_mmio_res.resource_start;
+        goldfish_rtc_mmio_res.resource_end += (uint64_t)fdt_get_prop_num_value(reg, 2) << 32;
+        goldfish_rtc_mmio_res.resource_end += fdt_get_prop_num_value(reg, 3);
+    }
+    device_set_data(dev, NULL);
+    goldfish_rtc_device.dev = dev;
+    device_set_interface(dev, RTC_INTERFACE_BIT, goldfish_rtc_get_interface);
+    device_register(dev, "goldfish rtc", GOLDFISH_RTC_MAJOR, NULL);
+    device_add_resource(dev, &goldfish_rtc_mmio_res);
+    setup_rtc_dev(dev);
+    return 0;
+}
+
+struct driver_match_table goldfish_rtc_match_table[] = {
+    { .compatible = "google,goldfish-rtc" },
+    { NULL }
+};
+
+struct device_driver goldfish_rtc_driver = {
+    .driver_name = "MaPl Goldfish RTC driver",
+    .match_table = goldfish_rtc_match_table,
+    .device_probe = goldfish_rtc_device_probe
+};
@@ -3,6 +3,8 @@
 #include <kdebug.h>
 #include <riscv.h>
 #include <sched.h>
+#include <workqueue.h>
+#include <fs/poll.h>
 
 struct driver_resource uart8250_mmio_res = {
     .resource_start = 0x10000000,
@@ -15,24 +17,75 @@ uint8_t uart8250_rx_buffer[UART8250_BUFF_LEN];
 uint64_t uart8250_rx_buffer_start = 0;
 uint64_t uart8250_rx_buffer_end = 0;
 uint64_t uart8250_rx_buffer_empty = 1;
-struct task_struct *uart8250_rx_buffer_wait = NULL;
+DECLARE_WAIT_QUEUE_HEAD(uart8250_rx_buffer_wait);
+struct linked_list_node uart8250_rx_pending = { &uart8250_rx_pending, &uart8250_rx_pending }; // 等待数据的异步读请求
 
+// 缓冲区溢出时打印缓冲区内容，耗时较长，放到工作队列中执行
+void uart8250_rx_overflow_work(struct work_struct *work) {
+    kprintf("buffer: ");
+    for(uint64_t i=0;i<UART8250_BUFF_LEN;i++) {
+        kputchar(uart8250_rx_buffer[(i + uart8250_rx_buffer_end) % UART8250_BUFF_LEN]);
+    }
+    kputchar('\n');
+}
+
+struct work_struct uart8250_rx_overflow = {
+    .entry = { &uart8250_rx_overflow.entry, &uart8250_rx_overflow.entry },
+    .func = uart8250_rx_overflow_work
+};
+
+// 从缓冲区取出最多 size 字节，返回取出的字节数，调用者需关中断
+static uint64_t uart8250_rx_take(char *buffer, uint64_t size) {
+    uint64_t n = 0;
+    while (n < size && !uart8250_rx_buffer_empty) {
+        buffer[n++] = uart8250_rx_buffer[uart8250_rx_buffer_start];
+        uart8250_rx_buffer_start = (uart8250_rx_buffer_start + 1) % UART8250_BUFF_LEN;
+        if (uart8250_rx_buffer_start == uart8250_rx_buffer_end) { // empty
+            uart8250_rx_buffer_empty = 1;
+        }
+    }
+    return n;
+}
+
+// 按提交顺序用缓冲区中的数据完成异步读请求，调用者需关中断
+static void uart8250_rx_complete() {
+    while (!linked_list_empty(&uart8250_rx_pending) && !uart8250_rx_buffer_empty) {
+        struct serial_request *request = container_of(linked_list_first(&uart8250_rx_pending), struct serial_request, list);
+        linked_list_remove(&request->list);
+        request->actual = uart8250_rx_take(request->buffer, request->size);
+        request->end_io(request);
+    }
+}
+
+// 下半部：完成等待数据的异步读请求
+void uart8250_rx_tasklet_func(uint64_t data) {
+    uint64_t flag = irq_save();
+    uart8250_rx_complete();
+    irq_restore(flag);
+}
+
+struct tasklet_struct uart8250_rx_tasklet = {
+    .func = uart8250_rx_tasklet_func
+};
+
+// 上半部只把 FIFO 中的数据读入缓冲区
 void uart8250_rx_irq_handler(struct device *dev) {
     struct uart_qemu_regs *regs = (struct uart_qemu_regs *)uart8250_mmio_res.map_address;
-    wake_up(&uart8250_rx_buffer_wait);
     while (regs->LSR & (1 << LSR_DR)) {
         uart8250_rx_buffer_empty = 0;
         uart8250_rx_buffer[uart8250_rx_buffer_end] = regs->RBR_THR_DLL;
         uart8250_rx_buffer_end = (uart8250_rx_buffer_end + 1) % UART8250_BUFF_LEN;
         if (uart8250_rx_buffer_start == uart8250_rx_buffer_end) { // full
-            kprintf("buffer: ");
-            for(uint64_t i=0;i<UART8250_BUFF_LEN;i++) {
-                kputchar(uart8250_rx_buffer[(i + uart8250_rx_buffer_end) % UART8250_BUFF_LEN]);
-            }
-            kputchar('\n');
+            schedule_work(&uart8250_rx_overflow);
             uart8250_rx_buffer_start = (uart8250_rx_buffer_start + 1) % UART8250_BUFF_LEN;
         }
     }
+    if (!uart8250_rx_buffer_empty) {
+        if (!linked_list_empty(&uart8250_rx_pending)) {
+            tasklet_schedule(&uart8250_rx_tasklet);
+        }
+        wake_up(&uart8250_rx_buffer_wait);
+    }
 }
 
 struct irq_descriptor uart8250_rx_irq = {
@@ -64,13 +117,16 @@ void uart8250_init(struct device *dev) {
 uint64_t uart8250_request(struct device *dev, void *buffer, uint64_t size, uint64_t is_read) {
     char *char_buffer = (char *)buffer;
     if (is_read) {
-        for (uint64_t i = 0; i < size; i += 1) {
-            if (uart8250_rx_buffer_empty) sleep_on(&uart8250_rx_buffer_wait);
-            char_buffer[i] = uart8250_rx_buffer[uart8250_rx_buffer_start];
-            uart8250_rx_buffer_start = (uart8250_rx_buffer_start + 1) % UART8250_BUFF_LEN;
-            if (uart8250_rx_buffer_start == uart8250_rx_buffer_end) { // empty
-                uart8250_rx_buffer_empty = 1;
-            }
+        for (uint64_t i = 0; i < size; ) {
+            // 多个读者独占等待，每次只唤醒一个，读完后若仍有数据再唤醒下一个
+            wait_event_exclusive(uart8250_rx_buffer_wait, !uart8250_rx_buffer_empty);
+            // 系统调用开中断执行，醒来后数据可能已被下半部取走，关中断后重新检查
+            uint64_t flag = irq_save();
+            i += uart8250_rx_take(char_buffer + i, 1);
+            irq_restore(flag);
+        }
+        if (!uart8250_rx_buffer_empty) {
+            wake_up(&uart8250_rx_buffer_wait);
         }
         return size;
     } else {// !is_read
@@ -83,8 +139,53 @@ uint64_t uart8250_request(struct device *dev, void *buffer, uint64_t size, uint6
     }
 }
 
+// 异步读：缓冲区中已有数据时立即完成，否则排队等待接收中断
+int64_t uart8250_submit(struct device *dev, struct serial_request *request) {
+    request->actual = 0;
+    uint64_t flag = irq_save();
+    linked_list_insert_before(&uart8250_rx_pending, &request->list);
+    uart8250_rx_complete();
+    irq_restore(flag);
+    return 0;
+}
+
+uint64_t uart8250_cancel(struct device *dev, struct serial_request *request) {
+    uint64_t flag = irq_save();
+    struct linked_list_node *node;
+    for_each_linked_list_node(node, &uart8250_rx_pending) {
+        if (node == &request->list) {
+            linked_list_remove(node);
+            irq_restore(flag);
+            return 1;
+        }
+    }
+    irq_restore(flag);
+    return 0;
+}
+
+uint64_t uart8250_read_nonblock(struct device *dev, void *buffer, uint64_t size) {
+    uint64_t flag = irq_save();
+    uint64_t n = uart8250_rx_take(buffer, size);
+    irq_restore(flag);
+    return n;
+}
+
+// 发送是轮询的，总是可写；读者和 poll() 等在同一个等待队列上，接收中断时都被唤醒
+uint32_t uart8250_poll(struct device *dev, struct file *file, struct poll_table *pt) {
+    poll_wait(file, &uart8250_rx_buffer_wait, pt);
+    uint32_t mask = POLLOUT | POLLWRNORM;
+    if (!uart8250_rx_buffer_empty) {
+        mask |= POLLIN | POLLRDNORM;
+    }
+    return mask;
+}
+
 struct serial_device uart8250_serial_device = {
-    .request = uart8250_request
+    .request = uart8250_request,
+    .submit = uart8250_submit,
+    .cancel = uart8250_cancel,
+    .read_nonblock = uart8250_read_nonblock,
+    .poll = uart8250_poll
 };
 
 void *uart8250_get_interface(struct device *dev, uint64_t flag) {
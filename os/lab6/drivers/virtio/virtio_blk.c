@@ -5,6 +5,7 @@
 #include <assert.h>
 #include <sched.h>
 #include <mm.h>
+#include <errno.h>
 
 uint64_t virtio_blk_get_hash(struct hash_table_node *node) {
     struct virtio_blk_qmap *qmap = container_of(node, struct virtio_blk_qmap, hash_node);
@@ -26,11 +27,15 @@ struct hash_table virtio_blk_table = {
     .is_equal = virtio_blk_is_equal
 };
 
-void virtio_block_irq_handler(struct device *dev) {
-    struct virtio_blk_data *data = device_get_data(dev);
-    struct virtq *virtio_blk_queue = &data->virtio_blk_queue;
-    uint32_t interrupt_status = data->virtio_device->interrupt_status;
+static int64_t virtio_block_dispatch(struct virtio_blk_data *data, struct virtio_blk_qmap *qmap);
 
+// 下半部：找到已完成的请求，唤醒等待者或调用完成回调，再提交排队的请求
+void virtio_block_complete(uint64_t data) {
+    struct device *dev = (struct device *)data;
+    struct virtio_blk_data *blk_data = device_get_data(dev);
+    struct virtq *virtio_blk_queue = &blk_data->virtio_blk_queue;
+
+    uint64_t flag = irq_save();
     struct virtq_used_elem *used_elem = virtq_get_used_elem(virtio_blk_queue);
     while (used_elem) {
         struct virtio_blk_qmap qmap_search = {
@@ -39,11 +44,38 @@ void virtio_block_irq_handler(struct device *dev) {
         virtq_free_desc_chain(virtio_blk_queue, used_elem->id);
         struct hash_table_node *node = hash_table_get(&virtio_blk_table, &qmap_search.hash_node);
         struct virtio_blk_qmap * qmap = container_of(node, struct virtio_blk_qmap, hash_node);
-        wake_up(&qmap->request->wait_queue);
+        struct block_request *request = qmap->request;
         hash_table_del(&virtio_blk_table, &qmap->hash_node);
+        request->error = qmap->req.status == VIRTIO_BLK_S_OK ? 0 : -EIO;
+        request->done = 1;
+        kfree(qmap);
+        if (request->end_io) {
+            request->end_io(request);
+        } else {
+            wake_up(&request->wait);
+        }
+        // 释放的描述符交给排队的请求
+        while (!linked_list_empty(&blk_data->pending)) {
+            qmap = container_of(linked_list_first(&blk_data->pending), struct virtio_blk_qmap, pending);
+            if (virtio_block_dispatch(blk_data, qmap)) {
+                break;
+            }
+            linked_list_remove(&qmap->pending);
+        }
+        // 每处理一个请求打开一次中断，缩短关中断时间
+        irq_restore(flag);
+        flag = irq_save();
         used_elem = virtq_get_used_elem(virtio_blk_queue);
     }
+    irq_restore(flag);
+}
+
+// 上半部：只应答中断
+void virtio_block_irq_handler(struct device *dev) {
+    struct virtio_blk_data *data = device_get_data(dev);
+    uint32_t interrupt_status = data->virtio_device->interrupt_status;
     data->virtio_device->interrupt_ack = interrupt_status;
+    tasklet_schedule(&data->complete_tasklet);
 }
 
 struct irq_descriptor virtio_block_irq = {
@@ -91,50 +123,83 @@ void virtio_blk_config(struct virtio_blk_data *data, uint64_t is_legacy) {
     device->status |= VIRTIO_STATUS_DRIVER_OK;
 }
 
-void virtio_block_request(struct device *dev, struct block_request *request) {
-    struct virtio_blk_data *data = device_get_data(dev);
+// 为请求分配三个描述符（请求头、数据、状态）并通知设备，调用者需关中断
+// 描述符不足时返回 -EBUSY，已分配的描述符被归还
+static int64_t virtio_block_dispatch(struct virtio_blk_data *data, struct virtio_blk_qmap *qmap) {
     struct virtio_device *device = data->virtio_device;
     struct virtq *virtio_blk_queue = &data->virtio_blk_queue;
-
-    struct virtio_blk_req req = {
-        .type = request->is_read ? VIRTIO_BLK_T_IN : VIRTIO_BLK_T_OUT,
-        .reserved = 0,
-        .sector = request->sector,
-        .status = 0
-    };
-
-    uint16_t idx, head;
-    head = idx = virtq_get_desc(virtio_blk_queue);
-    assert(idx != 0xff);
-    virtio_blk_queue->desc[idx].addr = PHYSICAL(((uint64_t)&req));
-    virtio_blk_queue->desc[idx].len = 16;
-    virtio_blk_queue->desc[idx].flags = VIRTQ_DESC_F_NEXT;
-    idx = virtq_get_desc(virtio_blk_queue);
-    assert(idx != 0xff);
-    virtio_blk_queue->desc[idx].addr = PHYSICAL(((uint64_t)request->buffer));
-    virtio_blk_queue->desc[idx].len = 512;
-    virtio_blk_queue->desc[idx].flags = VIRTQ_DESC_F_NEXT | (request->is_read ? VIRTQ_DESC_F_WRITE : 0);
-    idx = virtq_get_desc(virtio_blk_queue);
-    assert(idx != 0xff);
-    virtio_blk_queue->desc[idx].addr = PHYSICAL(((uint64_t)&(req.status)));
-    virtio_blk_queue->desc[idx].len = sizeof(req.status);
-    virtio_blk_queue->desc[idx].flags = VIRTQ_DESC_F_WRITE;
-    virtio_blk_queue->desc[idx].next = 0;
-    
-    struct virtio_blk_qmap qmap = {
-        .desp_idx = head,
-        .request = request
-    };
-    hash_table_set(&virtio_blk_table, &qmap.hash_node);
-    
-    virtq_put_avail(virtio_blk_queue, head);
+    struct block_request *request = qmap->request;
+
+    uint16_t idx[3];
+    for (uint64_t i = 0; i < 3; i += 1) {
+        idx[i] = virtq_get_desc(virtio_blk_queue);
+        if (idx[i] == 0xff) {
+            while (i--) {
+                virtq_free_desc(virtio_blk_queue, idx[i]);
+            }
+            return -EBUSY;
+        }
+    }
+    virtio_blk_queue->desc[idx[0]].addr = PHYSICAL(((uint64_t)&qmap->req));
+    virtio_blk_queue->desc[idx[0]].len = 16;
+    virtio_blk_queue->desc[idx[0]].flags = VIRTQ_DESC_F_NEXT;
+    virtio_blk_queue->desc[idx[0]].next = idx[1];
+    virtio_blk_queue->desc[idx[1]].addr = PHYSICAL(((uint64_t)request->buffer));
+    virtio_blk_queue->desc[idx[1]].len = 512;
+    virtio_blk_queue->desc[idx[1]].flags = VIRTQ_DESC_F_NEXT | (request->is_read ? VIRTQ_DESC_F_WRITE : 0);
+    virtio_blk_queue->desc[idx[1]].next = idx[2];
+    virtio_blk_queue->desc[idx[2]].addr = PHYSICAL(((uint64_t)&(qmap->req.status)));
+    virtio_blk_queue->desc[idx[2]].len = sizeof(qmap->req.status);
+    virtio_blk_queue->desc[idx[2]].flags = VIRTQ_DESC_F_WRITE;
+    virtio_blk_queue->desc[idx[2]].next = 0;
+
+    qmap->desp_idx = idx[0];
+    hash_table_set(&virtio_blk_table, &qmap->hash_node);
+
+    virtq_put_avail(virtio_blk_queue, idx[0]);
     device->queue_notify = 0;
+    return 0;
+}
+
+// 异步提交请求：描述符不足时排队，由下半部在有请求完成后提交
+int64_t virtio_block_submit(struct device *dev, struct block_request *request) {
+    struct virtio_blk_data *data = device_get_data(dev);
+
+    request->done = 0;
+    request->error = 0;
+    init_waitqueue_head(&request->wait);
 
-    sleep_on(&request->wait_queue);
+    struct virtio_blk_qmap *qmap = kmalloc(sizeof(struct virtio_blk_qmap));
+    if (!qmap) {
+        return -ENOMEM;
+    }
+    qmap->request = request;
+    qmap->req.type = request->is_read ? VIRTIO_BLK_T_IN : VIRTIO_BLK_T_OUT;
+    qmap->req.reserved = 0;
+    qmap->req.sector = request->sector;
+    qmap->req.status = 0xff;
+
+    uint64_t flag = irq_save();
+    if (!linked_list_empty(&data->pending) || virtio_block_dispatch(data, qmap)) {
+        linked_list_insert_before(&data->pending, &qmap->pending);
+    }
+    irq_restore(flag);
+    return 0;
+}
+
+void virtio_block_request(struct device *dev, struct block_request *request) {
+    request->end_io = NULL;
+    int64_t ret = virtio_block_submit(dev, request);
+    if (ret) {
+        request->error = ret;
+        return;
+    }
+    wait_event(request->wait, request->done);
 }
 
 struct block_device virtio_block_device = {
-    .request = virtio_block_request
+    .request = virtio_block_request,
+    .submit = virtio_block_submit
 };
 
 void *virtio_block_get_interface(struct device *dev, uint64_t flag) {
@@ -146,6 +211,8 @@ void virtio_block_init(struct device *dev, struct virtio_device *device, uint64_
     struct virtio_blk_data *data = kmalloc(sizeof(struct virtio_blk_data));
     memset(data, 0, sizeof(struct virtio_blk_data));
     data->virtio_device = device;
+    tasklet_init(&data->complete_tasklet, virtio_block_complete, (uint64_t)dev);
+    linked_list_init(&data->pending);
     device_set_data(dev, data);
     virtio_blk_config(data, is_legacy);
     hash_table_init(&virtio_blk_table);
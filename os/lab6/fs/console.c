@@ -0,0 +1,98 @@
+/**
+ * @file console.c
+ * @brief 实现控制台文件
+ *
+ * 控制台文件读写串口，启动时安装为进程 0 的描述符 0、1、2，之后创建的进程都
+ * 继承它们。读返回接收缓冲区中已有的数据，没有数据时阻塞到至少读到一个字节，
+ * 以 O_NONBLOCK 打开时返回 -EAGAIN；可以用 poll() 和 epoll 等待输入。
+ */
+#include <fs/file.h>
+#include <fs/poll.h>
+#include <device.h>
+#include <device/serial.h>
+#include <device/serial/uart8250.h>
+#include <errno.h>
+#include <kdebug.h>
+#include <uaccess.h>
+
+#define CONSOLE_BUF_SIZE 64                 /**< 每次读写串口的字节数 */
+
+static struct device *console_dev;
+static struct serial_device *console_serial;
+
+static int64_t console_read(struct file *file, void *buf, uint64_t count, uint64_t *pos)
+{
+    char kbuf[CONSOLE_BUF_SIZE];
+    if (!count) {
+        return 0;
+    }
+    uint64_t size = count < sizeof(kbuf) ? count : sizeof(kbuf);
+    uint64_t n = console_serial->read_nonblock(console_dev, kbuf, size);
+    if (!n) {
+        if (file->f_flags & O_NONBLOCK) {
+            return -EAGAIN;
+        }
+        /* 阻塞到读到一个字节，再取出其后已经到达的数据 */
+        console_serial->request(console_dev, kbuf, 1, 1);
+        n = 1 + console_serial->read_nonblock(console_dev, kbuf + 1, size - 1);
+    }
+    /* 调用者已检查过用户地址，内核缓冲区也可以直接拷贝 */
+    uint64_t left = __copy_user(buf, kbuf, n);
+    return left == n ? -EFAULT : (int64_t)(n - left);
+}
+
+static int64_t console_write(struct file *file, const void *buf, uint64_t count, uint64_t *pos)
+{
+    char kbuf[CONSOLE_BUF_SIZE];
+    uint64_t done = 0;
+    while (done < count) {
+        uint64_t size = count - done < sizeof(kbuf) ? count - done : sizeof(kbuf);
+        uint64_t left = __copy_user(kbuf, (const char *)buf + done, size);
+        console_serial->request(console_dev, kbuf, size - left, 0);
+        done += size - left;
+        if (left) {
+            return done ? (int64_t)done : -EFAULT;
+        }
+    }
+    return done;
+}
+
+static uint32_t console_poll(struct file *file, struct poll_table *pt)
+{
+    return console_serial->poll(console_dev, file, pt);
+}
+
+/** 控制台文件的操作 */
+const struct file_operations console_file_operations = {
+    .read = console_read,
+    .write = console_write,
+    .poll = console_poll,
+};
+
+/**
+ * @brief 打开控制台，安装为当前进程的描述符 0、1、2
+ *
+ * 在 sched_init() 之后、创建其他进程之前调用。没有串口时不做任何事。
+ */
+void console_init()
+{
+    console_dev = get_dev_by_major_minor(UART8250_MAJOR, 1);
+    if (!console_dev) {
+        kputs("console: no serial device");
+        return;
+    }
+    console_serial = console_dev->get_interface(console_dev, SERIAL_INTERFACE_BIT);
+    struct file *file = alloc_file(NULL, O_RDWR, &console_file_operations);
+    if (!file) {
+        kputs("console: out of memory");
+        return;
+    }
+    for (int fd = 0; fd < 3; ++fd) {
+        if (fd) {
+            get_file(file);
+        }
+        if (fd_install(file) != fd) {
+            kprintf("console: fd %u is in use\n", (uint64_t)fd);
+        }
+    }
+}
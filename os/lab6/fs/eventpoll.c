@@ -0,0 +1,494 @@
+/**
+ * @file eventpoll.c
+ * @brief 实现 epoll
+ *
+ * epoll 实例是一个打开的文件，private_data 指向 struct eventpoll。每个被监视的
+ * 描述符对应一个 epitem，添加时调用一次文件的 poll 登记等待队列，回调
+ * ep_poll_callback() 在文件就绪时把 epitem 挂到就绪链表上并唤醒 epoll_wait()。
+ * epoll_wait() 只重新检查就绪链表上的项：水平触发的项仍就绪时放回就绪链表，
+ * 下次继续报告；边沿触发的项要等到下次被唤醒；EPOLLONESHOT 的项报告一次后停用。
+ *
+ * epitem 持有被监视文件的引用，关闭描述符不会自动删除监视，需要 EPOLL_CTL_DEL
+ * 或关闭 epoll 实例。为避免引用成环，epoll 实例不能被另一个 epoll 实例监视。
+ *
+ * 就绪链表在中断中修改，只在关中断时访问；epoll_ctl() 和 epoll_wait() 遍历或
+ * 修改 epitem 时持有实例的互斥锁，可以在拷贝到用户内存时睡眠。
+ */
+#include <fs/poll.h>
+#include <clock.h>
+#include <errno.h>
+#include <mm.h>
+#include <mutex.h>
+#include <sched.h>
+#include <timer.h>
+#include <uaccess.h>
+
+/** 停用（EPOLLONESHOT 已报告）时保留的标志 */
+#define EP_PRIVATE_BITS      (EPOLLONESHOT | EPOLLET)
+/** epoll_wait() 一次最多返回的事件数 */
+#define EP_MAX_EVENTS        (PAGE_SIZE / sizeof(struct epoll_event))
+
+/** epoll 实例 */
+struct eventpoll {
+    struct mutex mtx;                               /**< 保护 items 和 epitem 的内容 */
+    struct linked_list_node items;                  /**< 所有 epitem */
+    struct linked_list_node rdllist;                /**< 就绪的 epitem，关中断访问 */
+    struct wait_queue_head wq;                      /**< epoll_wait() 的等待者 */
+    struct wait_queue_head poll_wait;               /**< 对实例本身 poll() 的等待者 */
+};
+
+/** 被监视的描述符 */
+struct epitem {
+    struct linked_list_node node;                   /**< eventpoll::items 链表节点 */
+    struct linked_list_node rdllink;                /**< 就绪链表节点，不在链表上时指向自己 */
+    struct eventpoll *ep;
+    struct file *file;                              /**< 持有一个引用 */
+    int32_t fd;
+    int32_t nwait;                                  /**< 登记的等待队列数，分配失败时为 -1 */
+    struct epoll_event event;
+    struct linked_list_node pwqlist;                /**< 登记的等待队列 eppoll_entry */
+};
+
+/** 挂在被监视文件等待队列上的等待者 */
+struct eppoll_entry {
+    struct linked_list_node llink;                  /**< epitem::pwqlist 链表节点 */
+    struct epitem *epi;
+    struct wait_queue_head *whead;
+    struct wait_queue_entry wait;
+};
+
+/** 添加 epitem 时传给文件 poll 的登记方式 */
+struct ep_pqueue {
+    struct poll_table pt;
+    struct epitem *epi;
+};
+
+static const struct file_operations eventpoll_fops;
+
+static uint64_t ep_is_linked(struct linked_list_node *node)
+{
+    return !linked_list_empty(node);
+}
+
+/**
+ * @brief 把 epitem 挂到就绪链表上并唤醒等待者，调用者需关中断
+ */
+static void ep_set_ready(struct epitem *epi)
+{
+    struct eventpoll *ep = epi->ep;
+    if (!ep_is_linked(&epi->rdllink)) {
+        linked_list_push(&ep->rdllist, &epi->rdllink);
+    }
+    wake_up(&ep->wq);
+    wake_up_all(&ep->poll_wait);
+}
+
+/**
+ * @brief 被监视文件的等待队列被唤醒时的回调，关中断执行
+ */
+static uint64_t ep_poll_callback(struct wait_queue_entry *wait)
+{
+    struct epitem *epi = container_of(wait, struct eppoll_entry, wait)->epi;
+    if (epi->event.events & ~EP_PRIVATE_BITS) {
+        ep_set_ready(epi);
+    }
+    return 1;
+}
+
+/**
+ * @brief poll_wait() 的回调，在被监视文件的等待队列上挂入等待者
+ */
+static void ep_ptable_queue_proc(struct file *file, struct wait_queue_head *whead, struct poll_table *pt)
+{
+    struct epitem *epi = container_of(pt, struct ep_pqueue, pt)->epi;
+    if (epi->nwait < 0) {
+        return;
+    }
+    struct eppoll_entry *pwq = kmalloc(sizeof(struct eppoll_entry));
+    if (!pwq) {
+        epi->nwait = -1;
+        return;
+    }
+    pwq->epi = epi;
+    pwq->whead = whead;
+    init_waitqueue_func_entry(&pwq->wait, ep_poll_callback);
+    add_wait_queue(whead, &pwq->wait);
+    linked_list_push(&epi->pwqlist, &pwq->llink);
+    ++epi->nwait;
+}
+
+/**
+ * @brief 取 epitem 的就绪事件，不登记等待队列
+ */
+static uint32_t ep_item_poll(struct epitem *epi)
+{
+    return vfs_poll(epi->file, NULL) & epi->event.events;
+}
+
+/**
+ * @brief 查找描述符对应的 epitem，调用者需持有 ep->mtx
+ */
+static struct epitem *ep_find(struct eventpoll *ep, struct file *file, int32_t fd)
+{
+    struct linked_list_node *node;
+    for_each_linked_list_node(node, &ep->items) {
+        struct epitem *epi = container_of(node, struct epitem, node);
+        if (epi->file == file && epi->fd == fd) {
+            return epi;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 删除 epitem，调用者需持有 ep->mtx
+ */
+static void ep_remove(struct eventpoll *ep, struct epitem *epi)
+{
+    /* 先移除等待者，此后回调不会再把 epitem 挂到就绪链表上 */
+    while (!linked_list_empty(&epi->pwqlist)) {
+        struct eppoll_entry *pwq = container_of(linked_list_shift(&epi->pwqlist), struct eppoll_entry, llink);
+        remove_wait_queue(pwq->whead, &pwq->wait);
+        kfree(pwq);
+    }
+    uint64_t flag = irq_save();
+    if (ep_is_linked(&epi->rdllink)) {
+        linked_list_remove(&epi->rdllink);
+    }
+    irq_restore(flag);
+    linked_list_remove(&epi->node);
+    fput(epi->file);
+    kfree(epi);
+}
+
+/**
+ * @brief 添加监视，调用者需持有 ep->mtx
+ */
+static int64_t ep_insert(struct eventpoll *ep, const struct epoll_event *event, struct file *file, int32_t fd)
+{
+    struct epitem *epi = kmalloc(sizeof(struct epitem));
+    if (!epi) {
+        return -ENOMEM;
+    }
+    linked_list_init(&epi->rdllink);
+    linked_list_init(&epi->pwqlist);
+    epi->ep = ep;
+    get_file(file);
+    epi->file = file;
+    epi->fd = fd;
+    epi->nwait = 0;
+    epi->event = *event;
+    linked_list_push(&ep->items, &epi->node);
+
+    struct ep_pqueue epq = { .pt.qproc = ep_ptable_queue_proc, .epi = epi };
+    uint32_t revents = vfs_poll(file, &epq.pt) & event->events;
+    if (epi->nwait < 0) {
+        ep_remove(ep, epi);
+        return -ENOMEM;
+    }
+    /* 登记之后发生的事件已由回调处理，这里只处理登记之前就已就绪的情况 */
+    if (revents) {
+        uint64_t flag = irq_save();
+        ep_set_ready(epi);
+        irq_restore(flag);
+    }
+    return 0;
+}
+
+/**
+ * @brief 修改关心的事件，调用者需持有 ep->mtx
+ */
+static void ep_modify(struct eventpoll *ep, struct epitem *epi, const struct epoll_event *event)
+{
+    uint64_t flag = irq_save();
+    epi->event = *event;
+    irq_restore(flag);
+    if (ep_item_poll(epi)) {
+        flag = irq_save();
+        ep_set_ready(epi);
+        irq_restore(flag);
+    }
+}
+
+/**
+ * @brief 把就绪的事件拷贝到用户内存
+ *
+ * 取下整个就绪链表逐项重新检查。水平触发且仍就绪的项放回就绪链表尾部，
+ * 本次不再检查；没有处理完的项放回就绪链表头部。
+ *
+ * @return 拷贝的事件数；一个也没有拷贝就出错时返回 -EFAULT
+ */
+static int64_t ep_send_events(struct eventpoll *ep, struct epoll_event *uevents, uint64_t maxevents)
+{
+    struct linked_list_node txlist;
+    linked_list_init(&txlist);
+    mutex_lock(&ep->mtx);
+    uint64_t flag = irq_save();
+    while (!linked_list_empty(&ep->rdllist)) {
+        linked_list_push(&txlist, linked_list_shift(&ep->rdllist));
+    }
+    irq_restore(flag);
+
+    int64_t count = 0;
+    while (!linked_list_empty(&txlist) && (uint64_t)count < maxevents) {
+        struct epitem *epi = container_of(linked_list_first(&txlist), struct epitem, rdllink);
+        flag = irq_save();
+        linked_list_remove(&epi->rdllink);
+        linked_list_init(&epi->rdllink);
+        irq_restore(flag);
+
+        uint32_t revents = ep_item_poll(epi);
+        if (!revents) {
+            continue;
+        }
+        struct epoll_event event = { .events = revents, .data = epi->event.data };
+        if (copy_to_user(&uevents[count], &event, sizeof(event))) {
+            flag = irq_save();
+            if (!ep_is_linked(&epi->rdllink)) {
+                linked_list_unshift(&txlist, &epi->rdllink);
+            }
+            irq_restore(flag);
+            if (!count) {
+                count = -EFAULT;
+            }
+            break;
+        }
+        ++count;
+        if (epi->event.events & EPOLLONESHOT) {
+            epi->event.events &= EP_PRIVATE_BITS;
+        } else if (!(epi->event.events & EPOLLET)) {
+            flag = irq_save();
+            if (!ep_is_linked(&epi->rdllink)) {
+                linked_list_push(&ep->rdllist, &epi->rdllink);
+            }
+            irq_restore(flag);
+        }
+    }
+
+    flag = irq_save();
+    while (!linked_list_empty(&txlist)) {
+        linked_list_unshift(&ep->rdllist, linked_list_pop(&txlist));
+    }
+    if (!linked_list_empty(&ep->rdllist)) {
+        wake_up(&ep->wq);                   /* 还有就绪的项，交给下一个等待者 */
+    }
+    irq_restore(flag);
+    mutex_unlock(&ep->mtx);
+    return count;
+}
+
+/**
+ * @brief 等待就绪事件
+ *
+ * @param timeout 超时时间（毫秒），为负时不超时，为 0 时不睡眠
+ * @return 拷贝的事件数，超时返回 0；线程组正在退出时返回 -EINTR
+ */
+static int64_t ep_poll(struct eventpoll *ep, struct epoll_event *uevents, uint64_t maxevents, int64_t timeout)
+{
+    uint64_t deadline = timeout > 0 ? get_cycles() + usec_to_cycles(timeout * 1000) : 0;
+    struct wait_queue_entry wait;
+    init_waitqueue_entry(&wait, current);
+    while (1) {
+        int64_t ret = ep_send_events(ep, uevents, maxevents);
+        if (ret || !timeout) {
+            return ret;
+        }
+        if (group_exit_pending()) {
+            return -EINTR;
+        }
+        uint64_t flag = irq_save();
+        prepare_to_wait_exclusive(&ep->wq, &wait, TASK_INTERRUPTIBLE);
+        if (linked_list_empty(&ep->rdllist)) {
+            if (deadline) {
+                sleep_until(deadline);
+            } else {
+                schedule();
+            }
+        }
+        finish_wait(&ep->wq, &wait);
+        irq_restore(flag);
+        if (deadline && get_cycles() >= deadline) {
+            timeout = 0;                    /* 超时，最后检查一遍 */
+        }
+    }
+}
+
+/**
+ * @brief 关闭 epoll 实例时删除所有监视
+ */
+static void ep_release(struct file *file)
+{
+    struct eventpoll *ep = file->private_data;
+    mutex_lock(&ep->mtx);
+    while (!linked_list_empty(&ep->items)) {
+        ep_remove(ep, container_of(linked_list_first(&ep->items), struct epitem, node));
+    }
+    mutex_unlock(&ep->mtx);
+    kfree(ep);
+}
+
+/**
+ * @brief 就绪链表不为空时 epoll 实例可读
+ */
+static uint32_t ep_eventpoll_poll(struct file *file, struct poll_table *pt)
+{
+    struct eventpoll *ep = file->private_data;
+    poll_wait(file, &ep->poll_wait, pt);
+    return linked_list_empty(&ep->rdllist) ? 0 : POLLIN | POLLRDNORM;
+}
+
+static const struct file_operations eventpoll_fops = {
+    .poll = ep_eventpoll_poll,
+    .release = ep_release,
+};
+
+/**
+ * @brief 取描述符对应的 epoll 实例
+ *
+ * @return 描述符无效时返回 NULL 且 *err 为 -EBADF，不是 epoll 实例时为 -EINVAL；
+ *         否则用完后需对 *file 调用 fput()
+ */
+static struct eventpoll *ep_get(uint64_t epfd, struct file **file, int64_t *err)
+{
+    *file = fget(epfd);
+    if (!*file) {
+        *err = -EBADF;
+        return NULL;
+    }
+    if ((*file)->f_op != &eventpoll_fops) {
+        fput(*file);
+        *err = -EINVAL;
+        return NULL;
+    }
+    return (*file)->private_data;
+}
+
+/**
+ * @brief 实现系统调用 epoll_create()
+ *
+ * @param 参数1 int size 大于 0 即可，没有其他作用
+ * @return 新 epoll 实例的描述符
+ */
+long sys_epoll_create(struct trapframe *tf)
+{
+    if ((int32_t)tf->gpr.a0 <= 0) {
+        return -EINVAL;
+    }
+    struct eventpoll *ep = kmalloc(sizeof(struct eventpoll));
+    if (!ep) {
+        return -ENOMEM;
+    }
+    mutex_init(&ep->mtx);
+    linked_list_init(&ep->items);
+    linked_list_init(&ep->rdllist);
+    init_waitqueue_head(&ep->wq);
+    init_waitqueue_head(&ep->poll_wait);
+    struct file *file = alloc_file(NULL, O_RDWR, &eventpoll_fops);
+    if (!file) {
+        kfree(ep);
+        return -ENOMEM;
+    }
+    file->private_data = ep;
+    int64_t ret = fd_install(file);
+    if (ret < 0) {
+        fput(file);
+    }
+    return ret;
+}
+
+/**
+ * @brief 实现系统调用 epoll_ctl()
+ *
+ * @param 参数1 int epfd epoll 实例
+ * @param 参数2 int op EPOLL_CTL_ADD、EPOLL_CTL_DEL 或 EPOLL_CTL_MOD
+ * @param 参数3 int fd 被监视的描述符，必须实现了 poll，不能是 epoll 实例
+ * @param 参数4 struct epoll_event *event 关心的事件和用户数据，EPOLL_CTL_DEL 时忽略
+ * @return 成功返回 0；已添加时返回 -EEXIST，未添加时返回 -ENOENT，
+ *         文件不支持 poll 时返回 -EPERM
+ */
+long sys_epoll_ctl(struct trapframe *tf)
+{
+    uint64_t op = tf->gpr.a1;
+    int32_t fd = tf->gpr.a2;
+    struct epoll_event event = { 0 };
+    if (op != EPOLL_CTL_DEL && copy_from_user(&event, (const void *)tf->gpr.a3, sizeof(event))) {
+        return -EFAULT;
+    }
+    /* POLLERR 和 POLLHUP 总是报告 */
+    event.events |= EPOLLERR | EPOLLHUP;
+
+    int64_t ret;
+    struct file *epfile;
+    struct eventpoll *ep = ep_get(tf->gpr.a0, &epfile, &ret);
+    if (!ep) {
+        return ret;
+    }
+    struct file *file = fget(fd);
+    if (!file) {
+        fput(epfile);
+        return -EBADF;
+    }
+    if (file->f_op == &eventpoll_fops) {
+        ret = -EINVAL;
+    } else if (!file->f_op->poll) {
+        ret = -EPERM;
+    } else {
+        mutex_lock(&ep->mtx);
+        struct epitem *epi = ep_find(ep, file, fd);
+        switch (op) {
+        case EPOLL_CTL_ADD:
+            ret = epi ? -EEXIST : ep_insert(ep, &event, file, fd);
+            break;
+        case EPOLL_CTL_DEL:
+            ret = epi ? 0 : -ENOENT;
+            if (epi) {
+                ep_remove(ep, epi);
+            }
+            break;
+        case EPOLL_CTL_MOD:
+            ret = epi ? 0 : -ENOENT;
+            if (epi) {
+                ep_modify(ep, epi, &event);
+            }
+            break;
+        default:
+            ret = -EINVAL;
+            break;
+        }
+        mutex_unlock(&ep->mtx);
+    }
+    fput(file);
+    fput(epfile);
+    return ret;
+}
+
+/**
+ * @brief 实现系统调用 epoll_wait()
+ *
+ * @param 参数1 int epfd epoll 实例
+ * @param 参数2 struct epoll_event *events 写入就绪的事件
+ * @param 参数3 int maxevents 最多返回的事件数，不超过一页
+ * @param 参数4 int timeout 超时时间（毫秒），为负时不超时，为 0 时立即返回
+ * @return 就绪的事件数，超时返回 0
+ */
+long sys_epoll_wait(struct trapframe *tf)
+{
+    struct epoll_event *uevents = (struct epoll_event *)tf->gpr.a1;
+    int64_t maxevents = (int32_t)tf->gpr.a2;
+    int64_t timeout = (int32_t)tf->gpr.a3;
+    if (maxevents <= 0 || (uint64_t)maxevents > EP_MAX_EVENTS) {
+        return -EINVAL;
+    }
+    if (!access_ok(uevents, maxevents * sizeof(struct epoll_event))) {
+        return -EFAULT;
+    }
+    int64_t ret;
+    struct file *epfile;
+    struct eventpoll *ep = ep_get(tf->gpr.a0, &epfile, &ret);
+    if (!ep) {
+        return ret;
+    }
+    ret = ep_poll(ep, uevents, maxevents, timeout);
+    fput(epfile);
+    return ret;
+}
@@ -0,0 +1,802 @@
+/**
+ * @file file.c
+ * @brief 实现打开的文件对象、文件描述符表和文件相关的系统调用
+ *
+ * 单处理器上关中断即可保护描述符表和引用计数；读写文件可能睡眠，期间只持有
+ * fget() 得到的引用。读写位置在读写完成后更新，共享同一文件的线程并发读写时
+ * 可能读写到相同的位置。
+ */
+#include <fs/file.h>
+#include <errno.h>
+#include <mm.h>
+#include <sched.h>
+#include <string.h>
+#include <uaccess.h>
+#include <vma.h>
+
+/**
+ * @brief 创建打开的文件，引用计数为 1
+ *
+ * @param inode 文件的 inode，持有它的一个新引用；可以为 NULL
+ * @param flags open() 标志
+ * @param f_op 文件操作
+ * @return 内存不足时返回 NULL
+ */
+struct file *alloc_file(struct vfs_inode *inode, uint32_t flags, const struct file_operations *f_op)
+{
+    struct file *file = kmalloc(sizeof(struct file));
+    if (!file) {
+        return NULL;
+    }
+    file->f_inode = inode;
+    file->f_pos = 0;
+    file->f_flags = flags;
+    file->f_count = 1;
+    file->f_op = f_op;
+    file->private_data = NULL;
+    if (inode) {
+        vfs_ref_inode(inode);
+    }
+    return file;
+}
+
+/**
+ * @brief 增加文件的引用计数
+ */
+void get_file(struct file *file)
+{
+    uint64_t flag = irq_save();
+    ++file->f_count;
+    irq_restore(flag);
+}
+
+/**
+ * @brief 减少文件的引用计数，降为 0 时释放文件
+ */
+void fput(struct file *file)
+{
+    uint64_t flag = irq_save();
+    uint64_t last = !--file->f_count;
+    irq_restore(flag);
+    if (!last) {
+        return;
+    }
+    if (file->f_op->release) {
+        file->f_op->release(file);
+    }
+    if (file->f_inode) {
+        vfs_free_inode(file->f_inode);
+    }
+    kfree(file);
+}
+
+/**
+ * @brief 取文件表中描述符 fd 对应的文件并持有一个引用
+ *
+ * @param files 文件表
+ * @param fd 文件描述符
+ * @return 描述符无效时返回 NULL，否则用完后需调用 fput()
+ */
+struct file *fget_files(struct files_struct *files, uint64_t fd)
+{
+    uint64_t flag = irq_save();
+    struct file *file = fd < files->max_fds ? files->fd[fd] : NULL;
+    if (file) {
+        ++file->f_count;
+    }
+    irq_restore(flag);
+    return file;
+}
+
+/**
+ * @brief 取当前进程的描述符 fd 对应的文件并持有一个引用
+ *
+ * @see fget_files()
+ */
+struct file *fget(uint64_t fd)
+{
+    return fget_files(current->files, fd);
+}
+
+/**
+ * @brief 把描述符数组扩展到至少 nr 个，调用者需关中断
+ *
+ * @return 成功返回 0，超过 NR_OPEN 时返回 -EMFILE，内存不足时返回 -ENOMEM
+ */
+static int64_t expand_files(struct files_struct *files, uint64_t nr)
+{
+    if (nr > NR_OPEN) {
+        return -EMFILE;
+    }
+    uint64_t max_fds = files->max_fds;
+    while (max_fds < nr) {
+        max_fds *= 2;
+    }
+    struct file **fd = kmalloc(max_fds * sizeof(struct file *));
+    if (!fd) {
+        return -ENOMEM;
+    }
+    memcpy(fd, files->fd, files->max_fds * sizeof(struct file *));
+    memset(fd + files->max_fds, 0, (max_fds - files->max_fds) * sizeof(struct file *));
+    if (files->fd != files->fd_array) {
+        kfree(files->fd);
+    }
+    files->fd = fd;
+    files->max_fds = max_fds;
+    return 0;
+}
+
+/**
+ * @brief 把文件安装到当前进程最小的空闲描述符
+ *
+ * 成功时描述符接管调用者持有的引用。
+ *
+ * @param file 文件
+ * @return 成功返回描述符；描述符用完时返回 -EMFILE，内存不足时返回 -ENOMEM
+ */
+int64_t fd_install(struct file *file)
+{
+    struct files_struct *files = current->files;
+    uint64_t flag = irq_save();
+    uint64_t fd = 0;
+    while (fd < files->max_fds && files->fd[fd]) {
+        ++fd;
+    }
+    if (fd == files->max_fds) {
+        int64_t ret = expand_files(files, fd + 1);
+        if (ret) {
+            irq_restore(flag);
+            return ret;
+        }
+    }
+    files->fd[fd] = file;
+    irq_restore(flag);
+    return fd;
+}
+
+/**
+ * @brief 关闭当前进程的描述符 fd
+ *
+ * @return 成功返回 0，描述符无效时返回 -EBADF
+ */
+int64_t close_fd(uint64_t fd)
+{
+    struct files_struct *files = current->files;
+    uint64_t flag = irq_save();
+    struct file *file = fd < files->max_fds ? files->fd[fd] : NULL;
+    if (file) {
+        files->fd[fd] = NULL;
+    }
+    irq_restore(flag);
+    if (!file) {
+        return -EBADF;
+    }
+    fput(file);
+    return 0;
+}
+
+/**
+ * @brief fork() 时复制文件表，新描述符与原描述符共享打开的文件
+ *
+ * @param to 新文件表，已由调用者分配，count 已初始化
+ * @param from 原文件表
+ * @return 成功返回 0，内存不足时返回 -ENOMEM
+ */
+int64_t dup_files(struct files_struct *to, struct files_struct *from)
+{
+    to->max_fds = NR_OPEN_DEFAULT;
+    to->fd = to->fd_array;
+    memset(to->fd_array, 0, sizeof(to->fd_array));
+    uint64_t flag = irq_save();
+    /* 只复制到最后一个打开的描述符，其后的空闲部分不必扩展 */
+    uint64_t nr = from->max_fds;
+    while (nr > NR_OPEN_DEFAULT && !from->fd[nr - 1]) {
+        --nr;
+    }
+    if (nr > to->max_fds && expand_files(to, nr)) {
+        irq_restore(flag);
+        return -ENOMEM;
+    }
+    for (uint64_t fd = 0; fd < nr; ++fd) {
+        to->fd[fd] = from->fd[fd];
+        if (to->fd[fd]) {
+            ++to->fd[fd]->f_count;
+        }
+    }
+    irq_restore(flag);
+    return 0;
+}
+
+/**
+ * @brief 关闭文件表中的所有文件并释放扩展的描述符数组，不释放文件表本身
+ *
+ * 只在文件表的最后一个引用被释放时调用。
+ */
+void close_files(struct files_struct *files)
+{
+    for (uint64_t fd = 0; fd < files->max_fds; ++fd) {
+        if (files->fd[fd]) {
+            fput(files->fd[fd]);
+            files->fd[fd] = NULL;
+        }
+    }
+    if (files->fd != files->fd_array) {
+        kfree(files->fd);
+        files->fd = files->fd_array;
+        files->max_fds = NR_OPEN_DEFAULT;
+    }
+}
+
+/**
+ * @brief 在 *pos 处读写 inode 文件的多段缓冲区，ramfs 的文件不能增长，超出文件大小的部分不读写
+ *
+ * 缓冲区是用户内存时可能在中途出错，读写到出错处为止。写入的内容同时更新到页缓存中。
+ *
+ * @return 读写的字节数；写时位置已在文件末尾返回 -ENOSPC，一个字节也没有读写
+ *         就出错时返回 -EFAULT
+ */
+static int64_t vfs_file_rw_iter(struct file *file, const struct iovec *iov, uint64_t iovcnt, uint64_t *pos, uint64_t is_read)
+{
+    uint64_t size = vfs_get_stat(file->f_inode)->size;
+    if (!is_read && (file->f_flags & O_APPEND)) {
+        *pos = size;
+    }
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < iovcnt; ++i) {
+        total += iov[i].iov_len;
+    }
+    if (!total) {
+        return 0;
+    }
+    if (*pos >= size) {
+        return is_read ? 0 : -ENOSPC;
+    }
+    uint64_t count = vfs_inode_request_vec(file->f_inode, iov, iovcnt, *pos, is_read);
+    if (!count) {
+        return -EFAULT;
+    }
+    if (!is_read) {
+        filemap_update(file->f_inode, *pos, count);
+    }
+    *pos += count;
+    return count;
+}
+
+static int64_t vfs_file_read(struct file *file, void *buf, uint64_t count, uint64_t *pos)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = count };
+    return vfs_file_rw_iter(file, &iov, 1, pos, 1);
+}
+
+static int64_t vfs_file_write(struct file *file, const void *buf, uint64_t count, uint64_t *pos)
+{
+    struct iovec iov = { .iov_base = (void *)buf, .iov_len = count };
+    return vfs_file_rw_iter(file, &iov, 1, pos, 0);
+}
+
+static int64_t vfs_file_readv(struct file *file, const struct iovec *iov, uint64_t iovcnt, uint64_t *pos)
+{
+    return vfs_file_rw_iter(file, iov, iovcnt, pos, 1);
+}
+
+static int64_t vfs_file_writev(struct file *file, const struct iovec *iov, uint64_t iovcnt, uint64_t *pos)
+{
+    return vfs_file_rw_iter(file, iov, iovcnt, pos, 0);
+}
+
+/** 文件系统中普通文件的操作 */
+const struct file_operations vfs_file_operations = {
+    .read = vfs_file_read,
+    .write = vfs_file_write,
+    .readv = vfs_file_readv,
+    .writev = vfs_file_writev,
+};
+
+/**
+ * @brief 从 pos 处读文件，不使用也不更新文件的读写位置
+ *
+ * @return 读的字节数，0 表示文件结束；失败时返回负的错误码，文件不能定位时返回 -ESPIPE
+ */
+int64_t file_pread(struct file *file, void *buf, uint64_t count, uint64_t pos)
+{
+    if ((file->f_flags & O_ACCMODE) == O_WRONLY || !file->f_op->read) {
+        return -EBADF;
+    }
+    if (!file->f_inode) {
+        return -ESPIPE;
+    }
+    return file->f_op->read(file, buf, count, &pos);
+}
+
+/**
+ * @brief 向 pos 处写文件，不使用也不更新文件的读写位置
+ *
+ * @return 写的字节数；失败时返回负的错误码，文件不能定位时返回 -ESPIPE
+ */
+int64_t file_pwrite(struct file *file, const void *buf, uint64_t count, uint64_t pos)
+{
+    if ((file->f_flags & O_ACCMODE) == O_RDONLY || !file->f_op->write) {
+        return -EBADF;
+    }
+    if (!file->f_inode) {
+        return -ESPIPE;
+    }
+    return file->f_op->write(file, buf, count, &pos);
+}
+
+/**
+ * @brief 从文件的读写位置读，并前移读写位置
+ *
+ * @return 读的字节数，0 表示文件结束；失败时返回负的错误码
+ */
+int64_t file_read(struct file *file, void *buf, uint64_t count)
+{
+    if ((file->f_flags & O_ACCMODE) == O_WRONLY || !file->f_op->read) {
+        return -EBADF;
+    }
+    uint64_t pos = file->f_pos;
+    int64_t ret = file->f_op->read(file, buf, count, &pos);
+    if (ret >= 0) {
+        file->f_pos = pos;
+    }
+    return ret;
+}
+
+/**
+ * @brief 向文件的读写位置写，并前移读写位置
+ *
+ * @return 写的字节数；失败时返回负的错误码
+ */
+int64_t file_write(struct file *file, const void *buf, uint64_t count)
+{
+    if ((file->f_flags & O_ACCMODE) == O_RDONLY || !file->f_op->write) {
+        return -EBADF;
+    }
+    uint64_t pos = file->f_pos;
+    int64_t ret = file->f_op->write(file, buf, count, &pos);
+    if (ret >= 0) {
+        file->f_pos = pos;
+    }
+    return ret;
+}
+
+/**
+ * @brief 逐段调用 read 或 write，遇到读写不满一段时停止
+ */
+static int64_t loop_rw_iter(struct file *file, const struct iovec *iov, uint64_t iovcnt, uint64_t *pos, uint64_t is_read)
+{
+    int64_t done = 0;
+    for (uint64_t i = 0; i < iovcnt; ++i) {
+        if (!iov[i].iov_len) {
+            continue;
+        }
+        int64_t ret = is_read ? file->f_op->read(file, iov[i].iov_base, iov[i].iov_len, pos) :
+                                file->f_op->write(file, iov[i].iov_base, iov[i].iov_len, pos);
+        if (ret < 0) {
+            return done ? done : ret;
+        }
+        done += ret;
+        if ((uint64_t)ret < iov[i].iov_len) {
+            break;
+        }
+    }
+    return done;
+}
+
+static int64_t do_rw_iter(struct file *file, const struct iovec *iov, uint64_t iovcnt, uint64_t *pos, uint64_t is_read)
+{
+    uint64_t mode = file->f_flags & O_ACCMODE;
+    if (is_read ? mode == O_WRONLY || !file->f_op->read : mode == O_RDONLY || !file->f_op->write) {
+        return -EBADF;
+    }
+    if (pos && !file->f_inode) {
+        return -ESPIPE;
+    }
+    uint64_t local_pos = pos ? *pos : file->f_pos;
+    int64_t (*iter)(struct file *, const struct iovec *, uint64_t, uint64_t *) =
+        is_read ? file->f_op->readv : file->f_op->writev;
+    int64_t ret = iter ? iter(file, iov, iovcnt, &local_pos) : loop_rw_iter(file, iov, iovcnt, &local_pos, is_read);
+    if (ret >= 0) {
+        if (pos) {
+            *pos = local_pos;
+        } else {
+            file->f_pos = local_pos;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief 依次读到多段缓冲区
+ *
+ * @param file 文件
+ * @param iov 缓冲区段，必须在内核中或已检查过的用户地址
+ * @param iovcnt 段数
+ * @param pos 为 NULL 时从文件的读写位置读并前移读写位置；否则从 *pos 处读并前移 *pos
+ * @return 读的字节数，0 表示文件结束；失败时返回负的错误码
+ */
+int64_t file_readv(struct file *file, const struct iovec *iov, uint64_t iovcnt, uint64_t *pos)
+{
+    return do_rw_iter(file, iov, iovcnt, pos, 1);
+}
+
+/**
+ * @brief 依次写入多段缓冲区
+ *
+ * @see file_readv()
+ * @return 写的字节数；失败时返回负的错误码
+ */
+int64_t file_writev(struct file *file, const struct iovec *iov, uint64_t iovcnt, uint64_t *pos)
+{
+    return do_rw_iter(file, iov, iovcnt, pos, 0);
+}
+
+/**
+ * @brief 实现系统调用 open()
+ *
+ * @param 参数1 const char *path 文件路径
+ * @param 参数2 uint32_t flags O_RDONLY、O_WRONLY 或 O_RDWR，可以或上 O_APPEND、O_NONBLOCK
+ * @return 成功返回描述符；文件不存在时返回 -ENOENT，打开目录写时返回 -EISDIR，
+ *         标志无效时返回 -EINVAL，描述符用完时返回 -EMFILE，路径长度达到 PATH_MAX
+ *         时返回 -ENAMETOOLONG
+ */
+long sys_open(struct trapframe *tf)
+{
+    uint32_t flags = tf->gpr.a1;
+    if ((flags & ~(O_ACCMODE | O_APPEND | O_NONBLOCK)) || (flags & O_ACCMODE) == O_ACCMODE) {
+        return -EINVAL;
+    }
+    char *path = kmalloc(PATH_MAX);
+    if (!path) {
+        return -ENOMEM;
+    }
+    int64_t len = strncpy_from_user(path, (const char *)tf->gpr.a0, PATH_MAX);
+    struct vfs_inode *inode = len >= 0 && len < PATH_MAX ? vfs_get_inode(path, NULL) : NULL;
+    kfree(path);
+    if (!inode) {
+        return len < 0 ? len : len == PATH_MAX ? -ENAMETOOLONG : -ENOENT;
+    }
+    vfs_ref_inode(inode);
+    int64_t ret;
+    struct file *file = NULL;
+    if ((flags & O_ACCMODE) != O_RDONLY && vfs_is_dir(inode)) {
+        ret = -EISDIR;
+    } else if (!(file = alloc_file(inode, flags, &vfs_file_operations))) {
+        ret = -ENOMEM;
+    } else if ((ret = fd_install(file)) < 0) {
+        fput(file);
+    }
+    vfs_free_inode(inode);
+    return ret;
+}
+
+/**
+ * @brief 实现系统调用 close()
+ *
+ * @param 参数1 int fd 文件描述符
+ */
+long sys_close(struct trapframe *tf)
+{
+    return close_fd(tf->gpr.a0);
+}
+
+/**
+ * @brief 取打开文件的属性
+ *
+ * @param 参数1 int fd 文件描述符
+ * @param 参数2 struct vfs_stat *stat 写入文件属性
+ */
+long sys_stat(struct trapframe *tf)
+{
+    struct vfs_stat *buf = (struct vfs_stat *)tf->gpr.a1;
+    struct file *file = fget(tf->gpr.a0);
+    if (!file) {
+        return -EBADF;
+    }
+    int64_t ret = -EINVAL;
+    if (file->f_inode) {
+        ret = copy_to_user(buf, vfs_get_stat(file->f_inode), sizeof(struct vfs_stat)) ? -EFAULT : 0;
+    }
+    fput(file);
+    return ret;
+}
+
+/**
+ * @brief 实现系统调用 read()
+ *
+ * @param 参数1 int fd 文件描述符
+ * @param 参数2 void *buf 缓冲区
+ * @param 参数3 uint64_t count 最多读的字节数
+ * @return 读的字节数，0 表示文件结束
+ */
+long sys_read(struct trapframe *tf)
+{
+    void *buf = (void *)tf->gpr.a1;
+    uint64_t count = tf->gpr.a2;
+    if (!access_ok(buf, count)) {
+        return -EFAULT;
+    }
+    struct file *file = fget(tf->gpr.a0);
+    if (!file) {
+        return -EBADF;
+    }
+    int64_t ret = file_read(file, buf, count);
+    fput(file);
+    return ret;
+}
+
+/**
+ * @brief 实现系统调用 write()
+ *
+ * @param 参数1 int fd 文件描述符
+ * @param 参数2 const void *buf 缓冲区
+ * @param 参数3 uint64_t count 要写的字节数
+ * @return 写的字节数
+ */
+long sys_write(struct trapframe *tf)
+{
+    const void *buf = (const void *)tf->gpr.a1;
+    uint64_t count = tf->gpr.a2;
+    if (!access_ok(buf, count)) {
+        return -EFAULT;
+    }
+    struct file *file = fget(tf->gpr.a0);
+    if (!file) {
+        return -EBADF;
+    }
+    int64_t ret = file_write(file, buf, count);
+    fput(file);
+    return ret;
+}
+
+/**
+ * @brief 实现系统调用 lseek()
+ *
+ * 读写位置可以超过文件末尾，此后读返回 0。
+ *
+ * @param 参数1 int fd 文件描述符
+ * @param 参数2 int64_t offset 偏移
+ * @param 参数3 int whence SEEK_SET、SEEK_CUR 或 SEEK_END
+ * @return 新的读写位置；文件不能定位时返回 -ESPIPE，结果为负或 whence 无效时返回 -EINVAL
+ */
+long sys_lseek(struct trapframe *tf)
+{
+    int64_t offset = tf->gpr.a1;
+    uint64_t whence = tf->gpr.a2;
+    struct file *file = fget(tf->gpr.a0);
+    if (!file) {
+        return -EBADF;
+    }
+    int64_t ret;
+    if (!file->f_inode) {
+        ret = -ESPIPE;
+    } else {
+        switch (whence) {
+        case SEEK_SET:
+            ret = offset;
+            break;
+        case SEEK_CUR:
+            ret = file->f_pos + offset;
+            break;
+        case SEEK_END:
+            ret = vfs_get_stat(file->f_inode)->size + offset;
+            break;
+        default:
+            ret = -EINVAL;
+            break;
+        }
+        if (ret >= 0) {
+            file->f_pos = ret;
+        } else {
+            ret = -EINVAL;
+        }
+    }
+    fput(file);
+    return ret;
+}
+
+/**
+ * @brief 实现系统调用 dup()
+ *
+ * 新描述符是最小的空闲描述符，与 fd 共享打开的文件和读写位置。
+ *
+ * @param 参数1 int fd 文件描述符
+ * @return 新描述符
+ */
+long sys_dup(struct trapframe *tf)
+{
+    struct file *file = fget(tf->gpr.a0);
+    if (!file) {
+        return -EBADF;
+    }
+    int64_t ret = fd_install(file);
+    if (ret < 0) {
+        fput(file);
+    }
+    return ret;
+}
+
+/**
+ * @brief 复制并检查用户态的 iovec 数组
+ *
+ * @param uvec 用户态的 iovec 数组
+ * @param iovcnt 段数
+ * @param iov 成功时写入 kmalloc() 分配的副本，用完后需 kfree()
+ * @return 成功返回 0；段数超过 IOV_MAX 或总长度溢出时返回 -EINVAL，
+ *         地址不在用户地址空间时返回 -EFAULT
+ */
+int64_t import_iovec(const struct iovec *uvec, uint64_t iovcnt, struct iovec **iov)
+{
+    if (iovcnt > IOV_MAX) {
+        return -EINVAL;
+    }
+    struct iovec *vec = kmalloc(iovcnt * sizeof(struct iovec));
+    if (!vec) {
+        return -ENOMEM;
+    }
+    if (copy_from_user(vec, uvec, iovcnt * sizeof(struct iovec))) {
+        kfree(vec);
+        return -EFAULT;
+    }
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < iovcnt; ++i) {
+        if (!access_ok(vec[i].iov_base, vec[i].iov_len)) {
+            kfree(vec);
+            return -EFAULT;
+        }
+        total += vec[i].iov_len;
+        if ((int64_t)total < 0) {
+            kfree(vec);
+            return -EINVAL;
+        }
+    }
+    *iov = vec;
+    return 0;
+}
+
+/**
+ * @brief readv()、writev()、preadv() 和 pwritev() 的公共部分
+ *
+ * @param positional 为 1 时第 4 个参数为偏移，不使用也不更新文件的读写位置
+ */
+static long do_vec_syscall(struct trapframe *tf, uint64_t is_read, uint64_t positional)
+{
+    int64_t offset = tf->gpr.a3;
+    if (positional && offset < 0) {
+        return -EINVAL;
+    }
+    struct file *file = fget(tf->gpr.a0);
+    if (!file) {
+        return -EBADF;
+    }
+    if (!tf->gpr.a2) {
+        fput(file);
+        return 0;
+    }
+    struct iovec *iov;
+    int64_t ret = import_iovec((const struct iovec *)tf->gpr.a1, tf->gpr.a2, &iov);
+    if (ret) {
+        fput(file);
+        return ret;
+    }
+    uint64_t pos = offset;
+    ret = is_read ? file_readv(file, iov, tf->gpr.a2, positional ? &pos : NULL) :
+                    file_writev(file, iov, tf->gpr.a2, positional ? &pos : NULL);
+    fput(file);
+    kfree(iov);
+    return ret;
+}
+
+/**
+ * @brief 实现系统调用 readv()
+ *
+ * 从文件的读写位置依次读到各段缓冲区，前一段读满后才读下一段。
+ *
+ * @param 参数1 int fd 文件描述符
+ * @param 参数2 const struct iovec *iov 缓冲区段
+ * @param 参数3 int iovcnt 段数，最多 IOV_MAX
+ * @return 读的字节数，0 表示文件结束
+ */
+long sys_readv(struct trapframe *tf)
+{
+    return do_vec_syscall(tf, 1, 0);
+}
+
+/**
+ * @brief 实现系统调用 writev()
+ *
+ * @param 参数1 int fd 文件描述符
+ * @param 参数2 const struct iovec *iov 缓冲区段
+ * @param 参数3 int iovcnt 段数，最多 IOV_MAX
+ * @return 写的字节数
+ */
+long sys_writev(struct trapframe *tf)
+{
+    return do_vec_syscall(tf, 0, 0);
+}
+
+/**
+ * @brief 实现系统调用 preadv()
+ *
+ * @param 参数1 int fd 文件描述符
+ * @param 参数2 const struct iovec *iov 缓冲区段
+ * @param 参数3 int iovcnt 段数，最多 IOV_MAX
+ * @param 参数4 int64_t offset 文件偏移，不使用也不更新文件的读写位置
+ * @return 读的字节数，0 表示文件结束
+ */
+long sys_preadv(struct trapframe *tf)
+{
+    return do_vec_syscall(tf, 1, 1);
+}
+
+/**
+ * @brief 实现系统调用 pwritev()
+ *
+ * @param 参数1 int fd 文件描述符
+ * @param 参数2 const struct iovec *iov 缓冲区段
+ * @param 参数3 int iovcnt 段数，最多 IOV_MAX
+ * @param 参数4 int64_t offset 文件偏移，不使用也不更新文件的读写位置
+ * @return 写的字节数
+ */
+long sys_pwritev(struct trapframe *tf)
+{
+    return do_vec_syscall(tf, 0, 1);
+}
+
+/**
+ * @brief 实现系统调用 pread()
+ *
+ * @param 参数1 int fd 文件描述符
+ * @param 参数2 void *buf 缓冲区
+ * @param 参数3 uint64_t count 最多读的字节数
+ * @param 参数4 int64_t offset 文件偏移，不使用也不更新文件的读写位置
+ * @return 读的字节数，0 表示文件结束
+ */
+long sys_pread(struct trapframe *tf)
+{
+    void *buf = (void *)tf->gpr.a1;
+    uint64_t count = tf->gpr.a2;
+    int64_t offset = tf->gpr.a3;
+    if (offset < 0) {
+        return -EINVAL;
+    }
+    if (!access_ok(buf, count)) {
+        return -EFAULT;
+    }
+    struct file *file = fget(tf->gpr.a0);
+    if (!file) {
+        return -EBADF;
+    }
+    int64_t ret = file_pread(file, buf, count, offset);
+    fput(file);
+    return ret;
+}
+
+/**
+ * @brief 实现系统调用 pwrite()
+ *
+ * @param 参数1 int fd 文件描述符
+ * @param 参数2 const void *buf 缓冲区
+ * @param 参数3 uint64_t count 要写的字节数
+ * @param 参数4 int64_t offset 文件偏移，不使用也不更新文件的读写位置
+ * @return 写的字节数
+ */
+long sys_pwrite(struct trapframe *tf)
+{
+    const void *buf = (const void *)tf->gpr.a1;
+    uint64_t count = tf->gpr.a2;
+    int64_t offset = tf->gpr.a3;
+    if (offset < 0) {
+        return -EINVAL;
+    }
+    if (!access_ok(buf, count)) {
+        return -EFAULT;
+    }
+    struct file *file = fget(tf->gpr.a0);
+    if (!file) {
+        return -EBADF;
+    }
+    int64_t ret = file_pwrite(file, buf, count, offset);
+    fput(file);
+    return ret;
+}
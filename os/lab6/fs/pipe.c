@@ -0,0 +1,330 @@
+/**
+ * @file pipe.c
+ * @brief 实现匿名管道
+ *
+ * 读者和写者都在可中断睡眠中等待，睡眠前放开管道的互斥锁。读返回已有的数据，
+ * 管道为空且没有写端时返回 0；写要写完全部数据才返回，没有读端时返回 -EPIPE。
+ * 以 O_NONBLOCK 打开时，本来要睡眠的读写返回 -EAGAIN 或已读写的字节数。
+ */
+#include <fs/pipe.h>
+#include <fs/poll.h>
+#include <errno.h>
+#include <mm.h>
+#include <sched.h>
+#include <uaccess.h>
+
+static const struct file_operations pipe_fops;
+
+/**
+ * @brief 取管道文件的管道
+ *
+ * @return 不是管道时返回 NULL
+ */
+struct pipe_inode_info *get_pipe_info(struct file *file)
+{
+    return file->f_op == &pipe_fops ? file->private_data : NULL;
+}
+
+/**
+ * @brief 等待管道中有数据，调用者需持有管道的互斥锁，睡眠期间放开
+ *
+ * @param nonblock 为 1 时不睡眠
+ * @return 有数据时返回 1，没有写端时返回 0；需要睡眠但 nonblock 为 1 时返回 -EAGAIN，
+ *         线程组正在退出时返回 -EINTR
+ */
+int64_t pipe_wait_readable(struct pipe_inode_info *pipe, uint64_t nonblock)
+{
+    while (pipe_empty(pipe)) {
+        if (!pipe->writers) {
+            return 0;
+        }
+        if (nonblock) {
+            return -EAGAIN;
+        }
+        if (group_exit_pending()) {
+            return -EINTR;
+        }
+        mutex_unlock(&pipe->mutex);
+        wait_event_interruptible(pipe->rd_wait, !pipe_empty(pipe) || !pipe->writers || group_exit_pending());
+        mutex_lock(&pipe->mutex);
+    }
+    return 1;
+}
+
+/**
+ * @brief 等待管道中有空闲的缓冲区，调用者需持有管道的互斥锁，睡眠期间放开
+ *
+ * @param nonblock 为 1 时不睡眠
+ * @return 有空闲缓冲区时返回 1；没有读端时返回 -EPIPE，需要睡眠但 nonblock 为 1 时
+ *         返回 -EAGAIN，线程组正在退出时返回 -EINTR
+ */
+int64_t pipe_wait_writable(struct pipe_inode_info *pipe, uint64_t nonblock)
+{
+    while (pipe->readers && pipe_full(pipe)) {
+        if (nonblock) {
+            return -EAGAIN;
+        }
+        if (group_exit_pending()) {
+            return -EINTR;
+        }
+        /* 环满时读者可能还在等待被唤醒 */
+        wake_up(&pipe->rd_wait);
+        mutex_unlock(&pipe->mutex);
+        wait_event_interruptible(pipe->wr_wait, !pipe_full(pipe) || !pipe->readers || group_exit_pending());
+        mutex_lock(&pipe->mutex);
+    }
+    return pipe->readers ? 1 : -EPIPE;
+}
+
+/**
+ * @brief 释放环中最早的缓冲区，调用者需持有管道的互斥锁
+ */
+void pipe_buf_release(struct pipe_inode_info *pipe)
+{
+    free_page(pipe->bufs[pipe->tail % PIPE_BUFFERS].page);
+    ++pipe->tail;
+}
+
+/**
+ * @brief 把数据拷贝到管道中，调用者需持有管道的互斥锁
+ *
+ * 能追加到最后一个缓冲区时先追加，其余部分拷贝到新分配的页中。
+ *
+ * @param buf 数据，用户态地址需已检查过
+ * @param count 字节数
+ * @param nonblock 为 1 时环满不睡眠
+ * @return 拷贝的字节数；一个字节也没有拷贝时返回负的错误码
+ */
+int64_t pipe_copy_in(struct pipe_inode_info *pipe, const void *buf, uint64_t count, uint64_t nonblock)
+{
+    uint64_t done = 0;
+    int64_t ret = 0;
+    while (done < count) {
+        if (!pipe->readers) {
+            ret = -EPIPE;
+            break;
+        }
+        if (!pipe_empty(pipe)) {
+            struct pipe_buffer *last = &pipe->bufs[(pipe->head - 1) % PIPE_BUFFERS];
+            uint64_t end = last->offset + last->len;
+            if ((last->flags & PIPE_BUF_FLAG_CAN_MERGE) && end < PAGE_SIZE) {
+                uint64_t n = count - done < PAGE_SIZE - end ? count - done : PAGE_SIZE - end;
+                uint64_t left = __copy_user((void *)VIRTUAL(last->page + end), (const char *)buf + done, n);
+                last->len += n - left;
+                done += n - left;
+                if (left) {
+                    ret = -EFAULT;
+                    break;
+                }
+                continue;
+            }
+        }
+        if (pipe_full(pipe)) {
+            if ((ret = pipe_wait_writable(pipe, nonblock)) < 0) {
+                break;
+            }
+            continue;
+        }
+        uint64_t page = get_free_page();
+        if (!page) {
+            ret = -ENOMEM;
+            break;
+        }
+        uint64_t n = count - done < PAGE_SIZE ? count - done : PAGE_SIZE;
+        uint64_t left = __copy_user((void *)VIRTUAL(page), (const char *)buf + done, n);
+        if (left == n) {
+            free_page(page);
+            ret = -EFAULT;
+            break;
+        }
+        pipe->bufs[pipe->head % PIPE_BUFFERS] = (struct pipe_buffer) {
+            .page = page, .offset = 0, .len = n - left, .flags = PIPE_BUF_FLAG_CAN_MERGE
+        };
+        ++pipe->head;
+        done += n - left;
+        if (left) {
+            ret = -EFAULT;
+            break;
+        }
+    }
+    return done ? (int64_t)done : ret;
+}
+
+/**
+ * @brief 从管道中读出数据，不等待，调用者需持有管道的互斥锁
+ *
+ * @param buf 缓冲区，用户态地址需已检查过
+ * @param count 最多读的字节数
+ * @return 读的字节数；一个字节也没有读出就出错时返回 -EFAULT
+ */
+int64_t pipe_copy_out(struct pipe_inode_info *pipe, void *buf, uint64_t count)
+{
+    uint64_t done = 0;
+    while (done < count && !pipe_empty(pipe)) {
+        struct pipe_buffer *pbuf = &pipe->bufs[pipe->tail % PIPE_BUFFERS];
+        uint64_t n = count - done < pbuf->len ? count - done : pbuf->len;
+        uint64_t left = __copy_user((char *)buf + done, (const void *)VIRTUAL(pbuf->page + pbuf->offset), n);
+        pbuf->offset += n - left;
+        pbuf->len -= n - left;
+        done += n - left;
+        if (!pbuf->len) {
+            pipe_buf_release(pipe);
+        }
+        if (left) {
+            return done ? (int64_t)done : -EFAULT;
+        }
+    }
+    return done;
+}
+
+static int64_t pipe_read(struct file *file, void *buf, uint64_t count, uint64_t *pos)
+{
+    struct pipe_inode_info *pipe = file->private_data;
+    if (!count) {
+        return 0;
+    }
+    mutex_lock(&pipe->mutex);
+    int64_t ret = pipe_wait_readable(pipe, file->f_flags & O_NONBLOCK);
+    if (ret > 0) {
+        ret = pipe_copy_out(pipe, buf, count);
+    }
+    mutex_unlock(&pipe->mutex);
+    if (ret > 0) {
+        wake_up(&pipe->wr_wait);
+    }
+    return ret;
+}
+
+static int64_t pipe_write(struct file *file, const void *buf, uint64_t count, uint64_t *pos)
+{
+    struct pipe_inode_info *pipe = file->private_data;
+    if (!count) {
+        return 0;
+    }
+    mutex_lock(&pipe->mutex);
+    int64_t ret = pipe_copy_in(pipe, buf, count, file->f_flags & O_NONBLOCK);
+    mutex_unlock(&pipe->mutex);
+    if (ret > 0) {
+        wake_up(&pipe->rd_wait);
+    }
+    return ret;
+}
+
+/**
+ * @brief 读端有数据时可读，写端关闭后报告 POLLHUP；写端有空闲缓冲区时可写，读端
+ *        关闭后报告 POLLERR
+ */
+static uint32_t pipe_poll(struct file *file, struct poll_table *pt)
+{
+    struct pipe_inode_info *pipe = file->private_data;
+    uint32_t mask = 0;
+    if ((file->f_flags & O_ACCMODE) == O_RDONLY) {
+        poll_wait(file, &pipe->rd_wait, pt);
+        if (!pipe_empty(pipe)) {
+            mask |= POLLIN | POLLRDNORM;
+        }
+        if (!pipe->writers) {
+            mask |= POLLHUP;
+        }
+    } else {
+        poll_wait(file, &pipe->wr_wait, pt);
+        if (!pipe_full(pipe)) {
+            mask |= POLLOUT | POLLWRNORM;
+        }
+        if (!pipe->readers) {
+            mask |= POLLERR;
+        }
+    }
+    return mask;
+}
+
+/**
+ * @brief 关闭一端，唤醒另一端的等待者；两端都关闭后释放管道
+ */
+static void pipe_release(struct file *file)
+{
+    struct pipe_inode_info *pipe = file->private_data;
+    mutex_lock(&pipe->mutex);
+    if ((file->f_flags & O_ACCMODE) == O_RDONLY) {
+        --pipe->readers;
+    } else {
+        --pipe->writers;
+    }
+    uint64_t last = !pipe->readers && !pipe->writers;
+    mutex_unlock(&pipe->mutex);
+    if (!last) {
+        wake_up_all(&pipe->rd_wait);
+        wake_up_all(&pipe->wr_wait);
+        return;
+    }
+    while (!pipe_empty(pipe)) {
+        pipe_buf_release(pipe);
+    }
+    kfree(pipe);
+}
+
+static const struct file_operations pipe_fops = {
+    .read = pipe_read,
+    .write = pipe_write,
+    .poll = pipe_poll,
+    .release = pipe_release,
+};
+
+/**
+ * @brief 实现系统调用 pipe2()
+ *
+ * @param 参数1 int fds[2] 写入读端和写端的描述符
+ * @param 参数2 uint32_t flags 0 或 O_NONBLOCK
+ * @return 成功返回 0；标志无效时返回 -EINVAL，描述符用完时返回 -EMFILE
+ */
+long sys_pipe2(struct trapframe *tf)
+{
+    int32_t *ufds = (int32_t *)tf->gpr.a0;
+    uint32_t flags = tf->gpr.a1;
+    if (flags & ~O_NONBLOCK) {
+        return -EINVAL;
+    }
+    if (!access_ok(ufds, 2 * sizeof(int32_t))) {
+        return -EFAULT;
+    }
+    struct pipe_inode_info *pipe = kmalloc(sizeof(struct pipe_inode_info));
+    if (!pipe) {
+        return -ENOMEM;
+    }
+    mutex_init(&pipe->mutex);
+    init_waitqueue_head(&pipe->rd_wait);
+    init_waitqueue_head(&pipe->wr_wait);
+    pipe->head = pipe->tail = 0;
+    pipe->readers = pipe->writers = 1;
+
+    struct file *rfile = alloc_file(NULL, O_RDONLY | flags, &pipe_fops);
+    struct file *wfile = rfile ? alloc_file(NULL, O_WRONLY | flags, &pipe_fops) : NULL;
+    if (!wfile) {
+        if (rfile) {
+            kfree(rfile);
+        }
+        kfree(pipe);
+        return -ENOMEM;
+    }
+    rfile->private_data = wfile->private_data = pipe;
+
+    int32_t fds[2];
+    int64_t ret = fds[0] = fd_install(rfile);
+    if (ret < 0) {
+        fput(rfile);
+        fput(wfile);
+        return ret;
+    }
+    ret = fds[1] = fd_install(wfile);
+    if (ret < 0) {
+        close_fd(fds[0]);
+        fput(wfile);
+        return ret;
+    }
+    if (copy_to_user(ufds, fds, sizeof(fds))) {
+        close_fd(fds[0]);
+        close_fd(fds[1]);
+        return -EFAULT;
+    }
+    return 0;
+}
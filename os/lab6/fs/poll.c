@@ -0,0 +1,214 @@
+/**
+ * @file poll.c
+ * @brief 实现系统调用 poll()
+ *
+ * 第一遍检查时在每个文件的等待队列上挂入一个等待者，之后进程睡眠，任何一个文件
+ * 的等待队列被唤醒都会唤醒进程重新检查所有描述符。已有描述符就绪或不等待时
+ * 不再登记等待队列。
+ */
+#include <fs/poll.h>
+#include <clock.h>
+#include <errno.h>
+#include <mm.h>
+#include <sched.h>
+#include <timer.h>
+#include <uaccess.h>
+
+/** 挂在一个文件等待队列上的等待者 */
+struct poll_table_entry {
+    struct file *file;                              /**< 持有一个引用，防止等待期间文件被释放 */
+    struct wait_queue_head *wq;
+    struct wait_queue_entry wait;
+    struct poll_wqueues *pwq;
+};
+
+#define POLL_TABLE_ENTRIES ((PAGE_SIZE - 2 * sizeof(uint64_t)) / sizeof(struct poll_table_entry))
+
+/** 等待者按页分配 */
+struct poll_table_page {
+    struct poll_table_page *next;
+    uint64_t nr;                                    /**< 已用的项数 */
+    struct poll_table_entry entries[POLL_TABLE_ENTRIES];
+};
+
+/** 一次 poll() 的所有等待者 */
+struct poll_wqueues {
+    struct poll_table pt;
+    struct task_struct *task;                       /**< 调用 poll() 的进程 */
+    struct poll_table_page *table;                  /**< 最后分配的一页在链表头 */
+    uint64_t triggered;                             /**< 上次检查之后是否有等待队列被唤醒 */
+    int64_t error;                                  /**< 分配等待者失败时为 -ENOMEM */
+};
+
+/**
+ * @brief 等待队列被唤醒时的回调，关中断执行
+ */
+static uint64_t pollwake(struct wait_queue_entry *wait)
+{
+    struct poll_table_entry *entry = container_of(wait, struct poll_table_entry, wait);
+    entry->pwq->triggered = 1;
+    return wake_up_process(entry->pwq->task);
+}
+
+/**
+ * @brief poll_wait() 的回调，在 wq 上挂入等待者
+ */
+static void __pollwait(struct file *file, struct wait_queue_head *wq, struct poll_table *pt)
+{
+    struct poll_wqueues *pwq = container_of(pt, struct poll_wqueues, pt);
+    struct poll_table_page *table = pwq->table;
+    if (!table || table->nr == POLL_TABLE_ENTRIES) {
+        table = kmalloc(sizeof(struct poll_table_page));
+        if (!table) {
+            pwq->error = -ENOMEM;
+            return;
+        }
+        table->nr = 0;
+        table->next = pwq->table;
+        pwq->table = table;
+    }
+    struct poll_table_entry *entry = &table->entries[table->nr++];
+    get_file(file);
+    entry->file = file;
+    entry->wq = wq;
+    entry->pwq = pwq;
+    init_waitqueue_func_entry(&entry->wait, pollwake);
+    add_wait_queue(wq, &entry->wait);
+}
+
+static void poll_initwait(struct poll_wqueues *pwq)
+{
+    pwq->pt.qproc = __pollwait;
+    pwq->task = current;
+    pwq->table = NULL;
+    pwq->triggered = 0;
+    pwq->error = 0;
+}
+
+/**
+ * @brief 移除所有等待者并释放文件引用
+ */
+static void poll_freewait(struct poll_wqueues *pwq)
+{
+    struct poll_table_page *table = pwq->table;
+    while (table) {
+        for (uint64_t i = 0; i < table->nr; ++i) {
+            remove_wait_queue(table->entries[i].wq, &table->entries[i].wait);
+            fput(table->entries[i].file);
+        }
+        struct poll_table_page *next = table->next;
+        kfree(table);
+        table = next;
+    }
+}
+
+/**
+ * @brief 检查一个描述符
+ *
+ * @return 发生的事件；描述符无效时为 POLLNVAL，fd 为负时为 0
+ */
+static uint32_t do_pollfd(struct pollfd *pfd, struct poll_table *pt)
+{
+    if (pfd->fd < 0) {
+        return 0;
+    }
+    struct file *file = fget(pfd->fd);
+    if (!file) {
+        return POLLNVAL;
+    }
+    uint32_t mask = vfs_poll(file, pt);
+    fput(file);
+    return mask & ((uint16_t)pfd->events | POLLERR | POLLHUP);
+}
+
+/**
+ * @brief 检查所有描述符，没有就绪的描述符时睡眠到被唤醒或超时
+ *
+ * @param fds 描述符项，内核中的副本
+ * @param nfds 描述符项数
+ * @param timeout 超时时间（毫秒），为负时不超时，为 0 时不睡眠
+ * @return 就绪的描述符数，超时返回 0；线程组正在退出时返回 -EINTR
+ */
+static int64_t do_poll(struct pollfd *fds, uint64_t nfds, int64_t timeout)
+{
+    uint64_t deadline = timeout > 0 ? get_cycles() + usec_to_cycles(timeout * 1000) : 0;
+    struct poll_wqueues pwq;
+    poll_initwait(&pwq);
+    struct poll_table *pt = timeout ? &pwq.pt : NULL;
+    int64_t count = 0;
+    while (1) {
+        /* 先清除 triggered 再检查，检查期间发生的唤醒不会丢失 */
+        pwq.triggered = 0;
+        for (uint64_t i = 0; i < nfds; ++i) {
+            fds[i].revents = do_pollfd(&fds[i], pt);
+            if (fds[i].revents) {
+                ++count;
+                pt = NULL;
+            }
+        }
+        pt = NULL;
+        if (count || !timeout) {
+            break;
+        }
+        if (pwq.error) {
+            count = pwq.error;
+            break;
+        }
+        if (group_exit_pending()) {
+            count = -EINTR;
+            break;
+        }
+        uint64_t flag = irq_save();
+        if (!pwq.triggered) {
+            if (deadline) {
+                sleep_until(deadline);
+            } else {
+                current->state = TASK_INTERRUPTIBLE;
+                schedule();
+            }
+        }
+        irq_restore(flag);
+        if (deadline && get_cycles() >= deadline) {
+            timeout = 0;                    /* 超时，最后检查一遍 */
+        }
+    }
+    poll_freewait(&pwq);
+    return count;
+}
+
+/**
+ * @brief 实现系统调用 poll()
+ *
+ * @param 参数1 struct pollfd *fds 描述符项，返回时 revents 为发生的事件
+ * @param 参数2 uint64_t nfds 描述符项数，最多 NR_OPEN
+ * @param 参数3 int timeout 超时时间（毫秒），为负时不超时，为 0 时立即返回
+ * @return 就绪的描述符数，超时返回 0
+ */
+long sys_poll(struct trapframe *tf)
+{
+    struct pollfd *ufds = (struct pollfd *)tf->gpr.a0;
+    uint64_t nfds = tf->gpr.a1;
+    int64_t timeout = (int32_t)tf->gpr.a2;
+    if (nfds > NR_OPEN) {
+        return -EINVAL;
+    }
+    struct pollfd *fds = NULL;
+    uint64_t size = nfds * sizeof(struct pollfd);
+    if (nfds) {
+        if (!(fds = kmalloc(size))) {
+            return -ENOMEM;
+        }
+        if (copy_from_user(fds, ufds, size)) {
+            kfree(fds);
+            return -EFAULT;
+        }
+    }
+    int64_t ret = do_poll(fds, nfds, timeout);
+    if (ret >= 0 && nfds && copy_to_user(ufds, fds, size)) {
+        ret = -EFAULT;
+    }
+    if (fds) {
+        kfree(fds);
+    }
+    return ret;
+}
@@ -3,6 +3,8 @@
 #include <kdebug.h>
 #include <string.h>
 #include <mm.h>
+#include <preempt.h>
+#include <uaccess.h>
 
 #define RAMFS_INODE_NUM (PAGE_SIZE / (sizeof(struct ramfs_inode)))
 
@@ -35,13 +37,48 @@ struct vfs_dir_entry *ramfs_dir_inode(struct vfs_inode *inode, uint64_t dir_idx)
 void ramfs_inode_request(struct vfs_inode *inode, void *buffer, uint64_t length, uint64_t offset, uint64_t is_read) {
     struct ramfs_inode *real_inode = (struct ramfs_inode *)inode->inode_data;
     if (offset + length > real_inode->length || offset < 0 || length < 0) return;
-    if (is_read) {
-        memcpy(buffer, real_inode->data + offset, length);
-    } else {
-        memcpy(real_inode->data + offset, buffer, length);
+    /* 按页拷贝，大文件拷贝期间可以被调度 */
+    while (length) {
+        uint64_t chunk = length < PAGE_SIZE ? length : PAGE_SIZE;
+        if (is_read) {
+            memcpy(buffer, real_inode->data + offset, chunk);
+        } else {
+            memcpy(real_inode->data + offset, buffer, chunk);
+        }
+        buffer = (char *)buffer + chunk;
+        offset += chunk;
+        length -= chunk;
+        cond_resched();
     }
 }
 
+/* 一次调用读写多段缓冲区，按页拷贝，大文件拷贝期间可以被调度 */
+/* 缓冲区可以是用户内存，访问出错时停止，返回已读写的字节数 */
+uint64_t ramfs_inode_request_vec(struct vfs_inode *inode, const struct iovec *iov, uint64_t iovcnt, uint64_t offset, uint64_t is_read) {
+    struct ramfs_inode *real_inode = (struct ramfs_inode *)inode->inode_data;
+    uint64_t done = 0;
+    for (uint64_t i = 0; i < iovcnt && offset < real_inode->length; i += 1) {
+        char *buffer = iov[i].iov_base;
+        uint64_t length = real_inode->length - offset < iov[i].iov_len ? real_inode->length - offset : iov[i].iov_len;
+        while (length) {
+            uint64_t chunk = length < PAGE_SIZE ? length : PAGE_SIZE;
+            uint64_t left = is_read ? __copy_user(buffer, real_inode->data + offset, chunk) :
+                                      __copy_user(real_inode->data + offset, buffer, chunk);
+            if (left) {
+                return done + chunk - left;
+            }
+            buffer += chunk;
+            offset += chunk;
+            length -= chunk;
+            done += chunk;
+            if (chunk == PAGE_SIZE) {
+                cond_resched();
+            }
+        }
+    }
+    return done;
+}
+
 void ramfs_set_inode(struct vfs_interface *fs, void *data, uint64_t length, uint64_t inode_idx, uint64_t inode_type) {
     struct ramfs_inode *real_inode = (struct ramfs_inode *)fs->fs_data;
     real_inode += inode_idx;
@@ -56,6 +93,23 @@ void ramfs_set_inode(struct vfs_interface *fs, void *data, uint64_t length, uint
     memcpy(real_inode->data, data, length);
 }
 
+/* 直接引用 data 而不拷贝，用于内核映像中较大的只读文件 */
+void ramfs_map_inode(struct vfs_interface *fs, void *data, uint64_t length, uint64_t inode_idx) {
+    struct ramfs_inode *real_inode = (struct ramfs_inode *)fs->fs_data;
+    real_inode += inode_idx;
+    real_inode->data = data;
+    real_inode->length = length;
+    real_inode->type = RAMFS_INODE_FILE;
+    real_inode->stat.gid = 0;
+    real_inode->stat.uid = 0;
+    real_inode->stat.size = length;
+    real_inode->stat.time = 0;
+}
+
+extern char ramfs_hello_start[], ramfs_hello_end[];
+extern char ramfs_threads_start[], ramfs_threads_end[];
+extern char ramfs_shmmap_start[], ramfs_shmmap_end[];
+
 void ramfs_init_fs(struct vfs_interface *fs) {
     fs->fs_data = kmalloc(PAGE_SIZE);
     fs->ref_cnt = 0;
@@ -67,11 +121,17 @@ void ramfs_init_fs(struct vfs_interface *fs) {
     struct vfs_dir_entry ramfs_dir[] = {
         {.name = ".",        .inode_idx = 0},
         {.name = "..",       .inode_idx = 0},
-        {.name = "test.txt", .inode_idx = 1}
+        {.name = "test.txt", .inode_idx = 1},
+        {.name = "hello",    .inode_idx = 2},
+        {.name = "threads",  .inode_idx = 3},
+        {.name = "shmmap",   .inode_idx = 4}
     };
     ramfs_set_inode(fs, ramfs_dir, sizeof(ramfs_dir), 0, RAMFS_INODE_DIR);
     const char *ramfs_test_txt = "hello ramfs\n";
     ramfs_set_inode(fs, (void *)ramfs_test_txt, strlen(ramfs_test_txt), 1, RAMFS_INODE_FILE);
+    ramfs_map_inode(fs, ramfs_hello_start, ramfs_hello_end - ramfs_hello_start, 2);
+    ramfs_map_inode(fs, ramfs_threads_start, ramfs_threads_end - ramfs_threads_start, 3);
+    ramfs_map_inode(fs, ramfs_shmmap_start, ramfs_shmmap_end - ramfs_shmmap_start, 4);
     fs->root = vfs_new_inode(fs, 0);
 }
 
@@ -82,5 +142,6 @@ struct vfs_interface ramfs_interface = {
     .get_stat = ramfs_get_stat,
     .is_dir = ramfs_is_dir,
     .dir_inode = ramfs_dir_inode,
-    .inode_request = ramfs_inode_request
+    .inode_request = ramfs_inode_request,
+    .inode_request_vec = ramfs_inode_request_vec
 };
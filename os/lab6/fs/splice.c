@@ -0,0 +1,576 @@
+/**
+ * @file splice.c
+ * @brief 实现系统调用 splice() 和 vmsplice()
+ *
+ * 管道缓冲区引用物理页，splice() 在文件和管道之间移动数据时尽量只传递页的引用：
+ * 文件系统中的文件读入管道时直接引用页缓存中的页，管道之间移动缓冲区本身，
+ * vmsplice() 把用户进程的整页写保护后交给管道，之后进程再写这一页会触发写时复制。
+ * 管道写入其他文件和 vmsplice() 读管道需要拷贝。
+ *
+ * mem_map[] 是 8 位计数，引用数达到 MAX_PAGE_REF 的页不再共享，改为拷贝到
+ * 管道私有的新页中，否则反复 splice 同一页会使计数回绕。
+ */
+#include <fs/pipe.h>
+#include <errno.h>
+#include <mm.h>
+#include <sched.h>
+#include <string.h>
+#include <uaccess.h>
+#include <vma.h>
+#include <shm.h>
+#include <io_uring.h>
+
+/**
+ * @brief 取页的一个引用，引用数已达到 MAX_PAGE_REF 时不取
+ *
+ * @return 取得引用返回 1，否则返回 0
+ */
+static uint64_t splice_get_page(uint64_t page)
+{
+    uint64_t flag = irq_save();
+    uint64_t ok = mem_map[MAP_NR(page)] < MAX_PAGE_REF;
+    if (ok) {
+        ++mem_map[MAP_NR(page)];
+    }
+    irq_restore(flag);
+    return ok;
+}
+
+/**
+ * @brief 文件系统中的文件读入管道，缓冲区引用页缓存中的页
+ *
+ * 只在管道一个缓冲区也没有填入时等待空间。
+ *
+ * @return 读入的字节数，0 表示文件结束；失败时返回负的错误码
+ */
+static int64_t splice_file_to_pipe(struct file *in, uint64_t *pos, struct pipe_inode_info *pipe, uint64_t len,
+                                   uint64_t nonblock)
+{
+    uint64_t size = vfs_get_stat(in->f_inode)->size;
+    uint64_t done = 0;
+    int64_t ret = 0;
+    mutex_lock(&pipe->mutex);
+    while (done < len && *pos < size) {
+        if ((ret = pipe_wait_writable(pipe, nonblock || done)) < 0) {
+            break;
+        }
+        uint64_t page = filemap_get_page(in->f_inode, *pos / PAGE_SIZE);
+        if (!page) {
+            ret = -ENOMEM;
+            break;
+        }
+        uint64_t offset = *pos % PAGE_SIZE;
+        uint64_t n = PAGE_SIZE - offset;
+        n = n < size - *pos ? n : size - *pos;
+        n = n < len - done ? n : len - done;
+        /* 页缓存的页被多个文件共享，不能追加写 */
+        uint64_t flags = 0;
+        uint64_t flag = irq_save();
+        uint64_t shared = mem_map[MAP_NR(page)] <= MAX_PAGE_REF;    /* 已计入 filemap_get_page() 的引用 */
+        irq_restore(flag);
+        if (!shared) {
+            uint64_t copy = get_free_page();
+            if (copy) {
+                memcpy((void *)VIRTUAL(copy + offset), (const void *)VIRTUAL(page + offset), n);
+            }
+            free_page(page);
+            if (!copy) {
+                ret = -ENOMEM;
+                break;
+            }
+            page = copy;
+            flags = PIPE_BUF_FLAG_CAN_MERGE;
+        }
+        pipe->bufs[pipe->head % PIPE_BUFFERS] = (struct pipe_buffer) {
+            .page = page, .offset = offset, .len = n, .flags = flags
+        };
+        ++pipe->head;
+        *pos += n;
+        done += n;
+    }
+    mutex_unlock(&pipe->mutex);
+    if (done) {
+        wake_up(&pipe->rd_wait);
+        return done;
+    }
+    return ret;
+}
+
+/**
+ * @brief 没有页缓存的文件读入管道，每次读一页到管道私有的新页中
+ *
+ * 读不满一页时停止。
+ *
+ * @return 读入的字节数，0 表示文件结束；失败时返回负的错误码
+ */
+static int64_t splice_read_to_pipe(struct file *in, uint64_t *pos, struct pipe_inode_info *pipe, uint64_t len,
+                                   uint64_t nonblock)
+{
+    uint64_t done = 0;
+    int64_t ret = 0;
+    while (done < len) {
+        uint64_t page = get_free_page();
+        if (!page) {
+            ret = -ENOMEM;
+            break;
+        }
+        /* 读可能阻塞，不持有管道的锁 */
+        uint64_t n = len - done < PAGE_SIZE ? len - done : PAGE_SIZE;
+        ret = in->f_op->read(in, (void *)VIRTUAL(page), n, pos);
+        if (ret <= 0) {
+            free_page(page);
+            break;
+        }
+        mutex_lock(&pipe->mutex);
+        int64_t err = pipe_wait_writable(pipe, nonblock);
+        if (err < 0) {
+            mutex_unlock(&pipe->mutex);
+            free_page(page);
+            ret = err;
+            break;
+        }
+        pipe->bufs[pipe->head % PIPE_BUFFERS] = (struct pipe_buffer) {
+            .page = page, .offset = 0, .len = ret, .flags = PIPE_BUF_FLAG_CAN_MERGE
+        };
+        ++pipe->head;
+        mutex_unlock(&pipe->mutex);
+        wake_up(&pipe->rd_wait);
+        done += ret;
+        if ((uint64_t)ret < n) {
+            break;
+        }
+    }
+    return done ? (int64_t)done : ret;
+}
+
+/**
+ * @brief 管道中的数据写入文件
+ *
+ * @return 写的字节数，0 表示管道没有写端且为空；失败时返回负的错误码
+ */
+static int64_t splice_pipe_to_file(struct pipe_inode_info *pipe, struct file *out, uint64_t *pos, uint64_t len,
+                                   uint64_t nonblock)
+{
+    uint64_t done = 0;
+    mutex_lock(&pipe->mutex);
+    int64_t ret = pipe_wait_readable(pipe, nonblock);
+    while (ret > 0 && done < len && !pipe_empty(pipe)) {
+        struct pipe_buffer *pbuf = &pipe->bufs[pipe->tail % PIPE_BUFFERS];
+        uint64_t n = len - done < pbuf->len ? len - done : pbuf->len;
+        int64_t written = out->f_op->write(out, (const void *)VIRTUAL(pbuf->page + pbuf->offset), n, pos);
+        if (written < 0) {
+            ret = written;
+            break;
+        }
+        pbuf->offset += written;
+        pbuf->len -= written;
+        done += written;
+        if (!pbuf->len) {
+            pipe_buf_release(pipe);
+        }
+        if ((uint64_t)written < n) {
+            break;
+        }
+    }
+    mutex_unlock(&pipe->mutex);
+    if (done) {
+        wake_up(&pipe->wr_wait);
+        return done;
+    }
+    return ret > 0 ? 0 : ret;
+}
+
+/**
+ * @brief 按地址顺序锁住两个管道，避免两个进程反向 splice 时死锁
+ */
+static void pipe_double_lock(struct pipe_inode_info *a, struct pipe_inode_info *b)
+{
+    if (a > b) {
+        struct pipe_inode_info *t = a;
+        a = b;
+        b = t;
+    }
+    mutex_lock(&a->mutex);
+    mutex_lock(&b->mutex);
+}
+
+static void pipe_double_unlock(struct pipe_inode_info *a, struct pipe_inode_info *b)
+{
+    mutex_unlock(&a->mutex);
+    mutex_unlock(&b->mutex);
+}
+
+/**
+ * @brief 把缓冲区从一个管道移到另一个管道
+ *
+ * 整个缓冲区直接移动；只移动一部分时两个缓冲区共享页，各持有一个引用，
+ * 移出的部分不能再追加写，否则会覆盖留在原管道中的数据。页的引用数已达到
+ * MAX_PAGE_REF 时把移出的部分拷贝到新页中。
+ *
+ * @return 移动的字节数，0 表示输入管道没有写端且为空；失败时返回负的错误码
+ */
+static int64_t splice_pipe_to_pipe(struct pipe_inode_info *ipipe, struct pipe_inode_info *opipe, uint64_t len,
+                                   uint64_t nonblock)
+{
+    int64_t ret;
+    /* 一次只能等待一个管道，等待时不持有另一个管道的锁 */
+    while (1) {
+        mutex_lock(&ipipe->mutex);
+        ret = pipe_wait_readable(ipipe, nonblock);
+        mutex_unlock(&ipipe->mutex);
+        if (ret <= 0) {
+            return ret;
+        }
+        mutex_lock(&opipe->mutex);
+        ret = pipe_wait_writable(opipe, nonblock);
+        mutex_unlock(&opipe->mutex);
+        if (ret < 0) {
+            return ret;
+        }
+        pipe_double_lock(ipipe, opipe);
+        if (!opipe->readers) {
+            pipe_double_unlock(ipipe, opipe);
+            return -EPIPE;
+        }
+        if (!pipe_empty(ipipe) && !pipe_full(opipe)) {
+            break;
+        }
+        pipe_double_unlock(ipipe, opipe);
+    }
+
+    uint64_t done = 0;
+    ret = 0;
+    while (done < len && !pipe_empty(ipipe) && !pipe_full(opipe)) {
+        struct pipe_buffer *ibuf = &ipipe->bufs[ipipe->tail % PIPE_BUFFERS];
+        struct pipe_buffer *obuf = &opipe->bufs[opipe->head % PIPE_BUFFERS];
+        if (ibuf->len <= len - done) {
+            *obuf = *ibuf;
+            ++ipipe->tail;
+        } else {
+            uint64_t n = len - done;
+            if (splice_get_page(ibuf->page)) {
+                *obuf = (struct pipe_buffer) {
+                    .page = ibuf->page, .offset = ibuf->offset, .len = n,
+                    .flags = ibuf->flags & ~PIPE_BUF_FLAG_CAN_MERGE
+                };
+            } else {
+                uint64_t page = get_free_page();
+                if (!page) {
+                    ret = -ENOMEM;
+                    break;
+                }
+                memcpy((void *)VIRTUAL(page), (const void *)VIRTUAL(ibuf->page + ibuf->offset), n);
+                *obuf = (struct pipe_buffer) {
+                    .page = page, .offset = 0, .len = n, .flags = PIPE_BUF_FLAG_CAN_MERGE
+                };
+            }
+            ibuf->offset += n;
+            ibuf->len -= n;
+        }
+        ++opipe->head;
+        done += obuf->len;
+    }
+    pipe_double_unlock(ipipe, opipe);
+    wake_up(&ipipe->wr_wait);
+    wake_up(&opipe->rd_wait);
+    return done ? (int64_t)done : ret;
+}
+
+/**
+ * @brief 取 splice() 中非管道一端的读写位置
+ *
+ * @param uoff 用户态的偏移，为 NULL 时使用文件的读写位置
+ * @param pos 写入读写位置
+ * @return 成功返回 0；文件不能定位时返回 -ESPIPE，偏移为负时返回 -EINVAL
+ */
+static int64_t splice_get_pos(struct file *file, const int64_t *uoff, uint64_t *pos)
+{
+    if (!uoff) {
+        *pos = file->f_pos;
+        return 0;
+    }
+    if (!file->f_inode) {
+        return -ESPIPE;
+    }
+    int64_t off;
+    if (get_user(off, uoff)) {
+        return -EFAULT;
+    }
+    if (off < 0) {
+        return -EINVAL;
+    }
+    *pos = off;
+    return 0;
+}
+
+/**
+ * @brief 写回 splice() 中非管道一端的读写位置
+ */
+static int64_t splice_put_pos(struct file *file, int64_t *uoff, uint64_t pos)
+{
+    if (!uoff) {
+        file->f_pos = pos;
+        return 0;
+    }
+    return put_user((int64_t)pos, uoff);
+}
+
+static int64_t do_splice(struct file *in, int64_t *off_in, struct file *out, int64_t *off_out, uint64_t len,
+                         uint32_t flags)
+{
+    if ((in->f_flags & O_ACCMODE) == O_WRONLY || (out->f_flags & O_ACCMODE) == O_RDONLY) {
+        return -EBADF;
+    }
+    struct pipe_inode_info *ipipe = get_pipe_info(in);
+    struct pipe_inode_info *opipe = get_pipe_info(out);
+    uint64_t nonblock = flags & SPLICE_F_NONBLOCK;
+    uint64_t pos;
+    int64_t ret;
+    if (ipipe && opipe) {
+        if (off_in || off_out) {
+            return -ESPIPE;
+        }
+        if (ipipe == opipe) {
+            return -EINVAL;
+        }
+        return splice_pipe_to_pipe(ipipe, opipe, len, nonblock || (in->f_flags & O_NONBLOCK) ||
+                                                          (out->f_flags & O_NONBLOCK));
+    }
+    if (ipipe) {
+        if (off_in) {
+            return -ESPIPE;
+        }
+        if (!out->f_op->write) {
+            return -EINVAL;
+        }
+        if ((ret = splice_get_pos(out, off_out, &pos))) {
+            return ret;
+        }
+        ret = splice_pipe_to_file(ipipe, out, &pos, len, nonblock || (in->f_flags & O_NONBLOCK));
+        if (ret > 0 && splice_put_pos(out, off_out, pos)) {
+            ret = -EFAULT;
+        }
+        return ret;
+    }
+    if (opipe) {
+        if (off_out) {
+            return -ESPIPE;
+        }
+        if (!in->f_op->read) {
+            return -EINVAL;
+        }
+        if ((ret = splice_get_pos(in, off_in, &pos))) {
+            return ret;
+        }
+        nonblock = nonblock || (out->f_flags & O_NONBLOCK);
+        ret = in->f_op == &vfs_file_operations ? splice_file_to_pipe(in, &pos, opipe, len, nonblock) :
+                                                 splice_read_to_pipe(in, &pos, opipe, len, nonblock);
+        if (ret > 0 && splice_put_pos(in, off_in, pos)) {
+            ret = -EFAULT;
+        }
+        return ret;
+    }
+    return -EINVAL;
+}
+
+/**
+ * @brief 实现系统调用 splice()
+ *
+ * 在文件和管道之间或两个管道之间移动数据，至少一端是管道。
+ *
+ * @param 参数1 int fd_in 输入的文件描述符
+ * @param 参数2 int64_t *off_in 输入文件的偏移，返回时前移；为 NULL 时使用并前移文件的读写位置，
+ *              输入是管道时必须为 NULL
+ * @param 参数3 int fd_out 输出的文件描述符
+ * @param 参数4 int64_t *off_out 输出文件的偏移，同 off_in
+ * @param 参数5 uint64_t len 最多移动的字节数
+ * @param 参数6 uint32_t flags SPLICE_F_*，只有 SPLICE_F_NONBLOCK 起作用
+ * @return 移动的字节数，0 表示输入结束；两端都不是管道或是同一个管道时返回 -EINVAL，
+ *         管道一端给出偏移时返回 -ESPIPE
+ */
+long sys_splice(struct trapframe *tf)
+{
+    int64_t *off_in = (int64_t *)tf->gpr.a1;
+    int64_t *off_out = (int64_t *)tf->gpr.a3;
+    uint64_t len = tf->gpr.a4;
+    uint32_t flags = tf->gpr.a5;
+    if (!len) {
+        return 0;
+    }
+    struct file *in = fget(tf->gpr.a0);
+    if (!in) {
+        return -EBADF;
+    }
+    struct file *out = fget(tf->gpr.a2);
+    if (!out) {
+        fput(in);
+        return -EBADF;
+    }
+    int64_t ret = do_splice(in, off_in, out, off_out, len, flags);
+    fput(out);
+    fput(in);
+    return ret;
+}
+
+/**
+ * @brief 把用户进程的一整页交给管道
+ *
+ * 页加一个引用并写保护，进程之后再写这一页时触发写时复制，管道中的数据不变。
+ * 调用者需持有管道的互斥锁，且管道未满。
+ *
+ * @param addr 页对齐的用户态地址
+ * @return 成功返回 1；页不能交给管道时返回 0，由调用者改为拷贝；地址无效时返回 -EFAULT
+ */
+static int64_t vmsplice_gift_page(struct pipe_inode_info *pipe, uint64_t addr)
+{
+    uint8_t c;
+    /* 先访问一次，缺页在这里处理 */
+    if (get_user(c, (const uint8_t *)addr)) {
+        return -EFAULT;
+    }
+    (void)c;
+    /* 共享映射和 io_uring 队列页与其他进程或内核共享，写保护后进程再写会把它们复制开 */
+    if (in_shm_area(current->mm, addr) || (addr >= VDSO_BASE && addr < IO_URING_END)) {
+        return 0;
+    }
+    uint64_t flag = irq_save();
+    uint64_t *pte = find_pte(addr);
+    if (!pte || (*pte & (PAGE_VALID | PAGE_USER)) != (PAGE_VALID | PAGE_USER)) {
+        irq_restore(flag);
+        return 0;
+    }
+    uint64_t page = GET_PAGE_ADDR(*pte);
+    /* LOW_MEM 以下的页不计引用，不能靠引用计数触发写时复制 */
+    if (page < LOW_MEM || page >= HIGH_MEM || !splice_get_page(page)) {
+        irq_restore(flag);
+        return 0;
+    }
+    *pte &= ~PAGE_WRITABLE;
+    invalidate();
+    irq_restore(flag);
+    pipe->bufs[pipe->head % PIPE_BUFFERS] = (struct pipe_buffer) {
+        .page = page, .offset = 0, .len = PAGE_SIZE, .flags = 0
+    };
+    ++pipe->head;
+    return 1;
+}
+
+/**
+ * @brief 把用户内存写入管道，整页交给管道，其余部分拷贝
+ *
+ * @return 写的字节数；失败时返回负的错误码
+ */
+static int64_t vmsplice_to_pipe(struct pipe_inode_info *pipe, const struct iovec *iov, uint64_t nr_segs,
+                                uint64_t nonblock)
+{
+    uint64_t done = 0;
+    int64_t ret = 0;
+    mutex_lock(&pipe->mutex);
+    for (uint64_t i = 0; i < nr_segs && ret >= 0; ++i) {
+        uint64_t addr = (uint64_t)iov[i].iov_base;
+        uint64_t left = iov[i].iov_len;
+        while (left) {
+            if (!(addr & (PAGE_SIZE - 1)) && left >= PAGE_SIZE) {
+                if ((ret = pipe_wait_writable(pipe, nonblock)) < 0) {
+                    break;
+                }
+                if ((ret = vmsplice_gift_page(pipe, addr)) < 0) {
+                    break;
+                }
+                if (ret) {
+                    addr += PAGE_SIZE;
+                    left -= PAGE_SIZE;
+                    done += PAGE_SIZE;
+                    continue;
+                }
+            }
+            /* 拷贝到下一个页边界，之后的整页仍可以交给管道 */
+            uint64_t n = PAGE_SIZE - (addr & (PAGE_SIZE - 1));
+            n = n < left ? n : left;
+            ret = pipe_copy_in(pipe, (const void *)addr, n, nonblock);
+            if (ret < 0) {
+                break;
+            }
+            addr += ret;
+            left -= ret;
+            done += ret;
+            if ((uint64_t)ret < n) {
+                ret = -EFAULT;
+                break;
+            }
+        }
+    }
+    mutex_unlock(&pipe->mutex);
+    if (done) {
+        wake_up(&pipe->rd_wait);
+        return done;
+    }
+    return ret;
+}
+
+/**
+ * @brief 从管道读到用户内存，只在一个字节也没有读到时等待
+ *
+ * @return 读的字节数，0 表示管道没有写端且为空；失败时返回负的错误码
+ */
+static int64_t vmsplice_from_pipe(struct pipe_inode_info *pipe, const struct iovec *iov, uint64_t nr_segs,
+                                  uint64_t nonblock)
+{
+    uint64_t done = 0;
+    mutex_lock(&pipe->mutex);
+    int64_t ret = pipe_wait_readable(pipe, nonblock);
+    for (uint64_t i = 0; i < nr_segs && ret > 0; ++i) {
+        ret = pipe_copy_out(pipe, iov[i].iov_base, iov[i].iov_len);
+        if (ret > 0) {
+            done += ret;
+        }
+        if ((uint64_t)ret < iov[i].iov_len) {
+            break;
+        }
+    }
+    mutex_unlock(&pipe->mutex);
+    if (done) {
+        wake_up(&pipe->wr_wait);
+        return done;
+    }
+    return ret > 0 ? 0 : ret;
+}
+
+/**
+ * @brief 实现系统调用 vmsplice()
+ *
+ * fd 是管道的写端时把各段用户内存写入管道，页对齐的整页不拷贝，直接交给管道，
+ * 进程之后修改这些页不影响管道中的数据；fd 是读端时从管道拷贝到各段缓冲区。
+ *
+ * @param 参数1 int fd 管道的描述符
+ * @param 参数2 const struct iovec *iov 用户内存段
+ * @param 参数3 uint64_t nr_segs 段数，最多 IOV_MAX
+ * @param 参数4 uint32_t flags SPLICE_F_*，只有 SPLICE_F_NONBLOCK 起作用
+ * @return 读写的字节数；fd 不是管道时返回 -EBADF
+ */
+long sys_vmsplice(struct trapframe *tf)
+{
+    uint64_t nr_segs = tf->gpr.a2;
+    uint32_t flags = tf->gpr.a3;
+    struct file *file = fget(tf->gpr.a0);
+    if (!file) {
+        return -EBADF;
+    }
+    struct pipe_inode_info *pipe = get_pipe_info(file);
+    if (!pipe) {
+        fput(file);
+        return -EBADF;
+    }
+    struct iovec *iov = NULL;
+    int64_t ret = nr_segs ? import_iovec((const struct iovec *)tf->gpr.a1, nr_segs, &iov) : 0;
+    if (ret || !nr_segs) {
+        fput(file);
+        return ret;
+    }
+    uint64_t nonblock = (flags & SPLICE_F_NONBLOCK) || (file->f_flags & O_NONBLOCK);
+    ret = (file->f_flags & O_ACCMODE) == O_RDONLY ? vmsplice_from_pipe(pipe, iov, nr_segs, nonblock) :
+                                                    vmsplice_to_pipe(pipe, iov, nr_segs, nonblock);
+    kfree(iov);
+    fput(file);
+    return ret;
+}
@@ -51,6 +51,22 @@ void vfs_inode_request(struct vfs_inode *inode, void *buffer, uint64_t length, u
     inode->fs->inode_request(inode, buffer, length, offset, is_read);
 }
 
+/* 文件系统没有实现 inode_request_vec 时逐段调用 inode_request */
+uint64_t vfs_inode_request_vec(struct vfs_inode *inode, const struct iovec *iov, uint64_t iovcnt, uint64_t offset, uint64_t is_read) {
+    if (inode->fs->inode_request_vec) {
+        return inode->fs->inode_request_vec(inode, iov, iovcnt, offset, is_read);
+    }
+    uint64_t size = vfs_get_stat(inode)->size;
+    uint64_t done = 0;
+    for (uint64_t i = 0; i < iovcnt && offset < size; i += 1) {
+        uint64_t length = size - offset < iov[i].iov_len ? size - offset : iov[i].iov_len;
+        inode->fs->inode_request(inode, iov[i].iov_base, length, offset, is_read);
+        offset += length;
+        done += length;
+    }
+    return done;
+}
+
 struct vfs_dir_entry *vfs_inode_dir_entry(struct vfs_inode *inode, uint64_t dir_idx) {
     return inode->fs->dir_inode(inode, dir_idx);
 }
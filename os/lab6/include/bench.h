@@ -0,0 +1,21 @@
+/**
+ * @file bench.h
+ * @brief 声明性能测试函数
+ *
+ * 性能测试在用户态运行，由 shell 命令 bench 调用。
+ */
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+void bench_syscall();
+void bench_vdso();
+void bench_context_switch();
+void bench_cyclictest();
+void bench_io_uring();
+void bench_readv();
+void bench_poll();
+void bench_pipe();
+void bench_shm();
+void bench_ipc();
+
+#endif /* end of include guard: __BENCH_H__ */
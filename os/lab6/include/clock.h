@@ -9,9 +9,98 @@
 #include <stddef.h>
 #include <sbi.h>
 
+#define TIMEBASE_FREQ 10000000                    /**< 设备树中没有 timebase-frequency 时使用的默认时钟频率（QEMU 为 10MHz） */
+#define HZ            100                         /**< 调度时钟节拍频率 */
+
+#define NSEC_PER_SEC  1000000000ULL
+#define USEC_PER_SEC  1000000ULL
+
+/** 时间（秒 + 纳秒） */
+struct timespec {
+    int64_t tv_sec;
+    int64_t tv_nsec;
+};
+
+/** 时间（秒 + 微秒） */
+struct timeval {
+    int64_t tv_sec;
+    int64_t tv_usec;
+};
+
+/// @{ @name clock_gettime() 支持的时钟
+#define CLOCK_REALTIME  0                         /**< UNIX 时间，由 RTC 在启动时校准 */
+#define CLOCK_MONOTONIC 1                         /**< 开机后经过的时间 */
+/// @}
+
 extern volatile size_t ticks;
+extern uint64_t timebase_freq;                    /**< rdtime 的计数频率（Hz） */
+extern uint64_t cyc2ns_mult;                      /**< 纳秒 = 时钟周期数 * cyc2ns_mult >> 32 */
+extern uint64_t ns2cyc_mult;                      /**< 时钟周期数 = 纳秒 * ns2cyc_mult >> 32 */
+extern uint64_t realtime_offset;                  /**< CLOCK_REALTIME 与 CLOCK_MONOTONIC 之差（纳秒） */
+
+/**
+ * @brief 获取开机后经过的时钟周期数
+ * @return uint64_t
+ */
+static inline uint64_t get_cycles()
+{
+    uint64_t n;
+    __asm__ __volatile__("rdtime %0" : "=r"(n));
+    return n;
+}
+
+/*
+ * 时钟频率在启动时才能确定，为避免在热路径上做除法，换算使用 32 位定点数乘法，
+ * 128 位乘积的高位由 mulhu 指令直接得到。
+ */
+
+/** 纳秒转换为时钟周期数（向上取整） */
+static inline uint64_t nsec_to_cycles(uint64_t ns)
+{
+    return ((unsigned __int128)ns * ns2cyc_mult + 0xFFFFFFFF) >> 32;
+}
+
+/** 时钟周期数转换为纳秒 */
+static inline uint64_t cycles_to_nsec(uint64_t cycles)
+{
+    return ((unsigned __int128)cycles * cyc2ns_mult) >> 32;
+}
+
+/** 微秒转换为时钟周期数（向上取整） */
+static inline uint64_t usec_to_cycles(uint64_t us)
+{
+    return nsec_to_cycles(us * 1000);
+}
+
+/** 时钟周期数转换为微秒 */
+static inline uint64_t cycles_to_usec(uint64_t cycles)
+{
+    return cycles_to_nsec(cycles) / 1000;
+}
+
+/** struct timeval 转换为时钟周期数 */
+static inline uint64_t timeval_to_cycles(const struct timeval *tv)
+{
+    return (uint64_t)tv->tv_sec * timebase_freq + usec_to_cycles(tv->tv_usec);
+}
+
+/** 时钟周期数转换为 struct timeval */
+static inline void cycles_to_timeval(uint64_t cycles, struct timeval *tv)
+{
+    tv->tv_sec = cycles / timebase_freq;
+    tv->tv_usec = cycles_to_usec(cycles % timebase_freq);
+}
+
+/** 开机后经过的纳秒数 */
+static inline uint64_t ktime_get_ns()
+{
+    return cycles_to_nsec(get_cycles());
+}
 
 void clock_init();
+uint64_t ktime_get_real_ns();
+uint64_t clock_handler();
 void clock_set_next_event();
+void clock_program_event(uint64_t deadline);
 
 #endif
@@ -11,13 +11,21 @@
 struct block_request {
     uint64_t is_read;
     uint64_t sector;
-    void *buffer;
-    struct task_struct * wait_queue;
+    void *buffer;                   /* 内核线性映射区的地址，不能跨页 */
+    uint64_t done;                  /* 请求是否已完成，由驱动设置 */
+    int64_t error;                  /* 0 或 -EIO，由驱动设置 */
+    struct wait_queue_head wait;    /* 等待请求完成，由驱动初始化 */
+    /* 异步请求的完成回调，在下半部中关中断调用，不能睡眠；为 NULL 时唤醒 wait */
+    void (*end_io)(struct block_request *request);
+    void *private;                  /* 供 end_io 使用 */
 };
 
 struct block_device {
     struct device *dev;
+    /* 同步请求，等待请求完成后返回 */
     void (*request)(struct device *dev, struct block_request *request);
+    /* 异步请求，提交后立即返回，完成时调用 request->end_io；失败时返回负的错误码 */
+    int64_t (*submit)(struct device *dev, struct block_request *request);
 };
 
 #endif
@@ -5,6 +5,7 @@
 #include <device/fdt.h>
 
 extern struct device_driver *driver_list[];
+extern const struct fdt_header *g_fdt;  /* 已映射到内核地址空间的设备树，fdt_loader() 之前为 NULL */
 
 void fdt_loader(const struct fdt_header *fdt, struct device_driver *driver_list[]);
 
@@ -0,0 +1,26 @@
+#ifndef DEVICE_RTC_H
+#define DEVICE_RTC_H
+
+#include <stddef.h>
+#include <device.h>
+
+#define RTC_INTERFACE_BIT (1 << 13)
+
+/* 所有时间都以纳秒级 UNIX 时间戳表示 */
+struct rtc_device {
+    struct device *dev;
+    uint64_t (*read_time)(struct device *dev);
+    void (*set_time)(struct device *dev, uint64_t now);
+};
+
+extern struct rtc_device *g_rtc_dev;
+static inline void setup_rtc_dev(struct device *dev) {
+    if (dev) {
+        g_rtc_dev = dev->get_interface(dev, RTC_INTERFACE_BIT);
+    }
+}
+static inline struct rtc_device *get_rtc_device() {
+    return g_rtc_dev;
+}
+
+#endif
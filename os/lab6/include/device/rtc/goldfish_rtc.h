@@ -0,0 +1,23 @@
+#ifndef GOLDFISH_RTC
+#define GOLDFISH_RTC
+
+#include <device/rtc.h>
+
+#define GOLDFISH_RTC_MAJOR 0x1010
+
+struct goldfish_rtc_regs {
+    // time 先读低32位 https://github.com/qemu/qemu/blob/v6.2.0-rc2/hw/rtc/goldfish_rtc.c#L106-L113
+    // alarm 先写高32位 https://github.com/qemu/qemu/blob/v6.2.0-rc2/hw/rtc/goldfish_rtc.c#L154-L160
+    uint32_t time_low;          // 0x00 R/W: 低32位时间
+    uint32_t time_high;         // 0x04 R/W: 高32位时间
+    uint32_t alarm_low;         // 0x08 R/W: 低32位闹钟
+    uint32_t alarm_high;        // 0x0c R/W: 高32位闹钟
+    uint32_t irq_enabled;       // 0x10   W: 启用中断
+    uint32_t clear_alarm;       // 0x14   W: 清除闹钟
+    uint32_t alarm_status;      // 0x18   R: 闹钟状态(1:闹钟有效)
+    uint32_t clear_interrupt;   // 0x1c   W: 清除中断
+};
+
+extern struct device_driver goldfish_rtc_driver;
+
+#endif
@@ -3,12 +3,36 @@
 
 #include <stddef.h>
 #include <device.h>
+#include <utils/linked_list.h>
 
 #define SERIAL_INTERFACE_BIT (1 << 6)
 
+struct file;
+struct poll_table;
+
+/* 异步读请求：有数据可读时即完成，最多读 size 字节 */
+struct serial_request {
+    void *buffer;                   /* 内核线性映射区的地址 */
+    uint64_t size;
+    uint64_t actual;                /* 实际读到的字节数，由驱动设置 */
+    /* 完成回调，关中断调用，不能睡眠 */
+    void (*end_io)(struct serial_request *request);
+    void *private;                  /* 供 end_io 使用 */
+    struct linked_list_node list;   /* 等待数据的请求队列，驱动使用 */
+};
+
 struct serial_device {
     struct device *dev;
+    /* 同步读写，读满 size 字节后返回 */
     uint64_t (*request)(struct device *dev, void *buffer, uint64_t size, uint64_t is_read);
+    /* 异步读，提交后立即返回，完成时调用 request->end_io */
+    int64_t (*submit)(struct device *dev, struct serial_request *request);
+    /* 取消尚未完成的异步读，返回是否取消成功 */
+    uint64_t (*cancel)(struct device *dev, struct serial_request *request);
+    /* 非阻塞读，取出接收缓冲区中已有的最多 size 字节，返回取出的字节数 */
+    uint64_t (*read_nonblock)(struct device *dev, void *buffer, uint64_t size);
+    /* 返回 POLL* 就绪状态，并用 poll_wait() 登记接收数据时唤醒的等待队列 */
+    uint32_t (*poll)(struct device *dev, struct file *file, struct poll_table *pt);
 };
 
 #endif
@@ -3,6 +3,7 @@
 
 #include <device/virtio/virtio_mmio.h>
 #include <device/block.h>
+#include <workqueue.h>
 
 #define VIRTIO_BLK_F_BARRIER    (1 << 0)
 #define VIRTIO_BLK_F_SIZE_MAX   (1 << 1)
@@ -22,13 +23,8 @@
 struct virtio_blk_data {
     struct virtio_device *virtio_device;
     struct virtq virtio_blk_queue;
-};
-
-struct virtio_blk_qmap {
-    uint16_t desp_idx;
-    struct block_request *request;
-
-    struct hash_table_node hash_node;
+    struct tasklet_struct complete_tasklet;     /* 下半部：处理已完成的请求 */
+    struct linked_list_node pending;            /* 描述符不足时排队等待的请求 */
 };
 
 struct virtio_blk_config {
@@ -79,6 +75,16 @@ struct virtio_blk_req {
     uint8_t status;
 };
 
+/* 请求提交到设备后的描述符映射，请求头和状态字节需在请求完成前一直有效 */
+struct virtio_blk_qmap {
+    uint16_t desp_idx;
+    struct block_request *request;
+    struct virtio_blk_req req;
+
+    struct hash_table_node hash_node;
+    struct linked_list_node pending;
+};
+
 uint64_t virtio_block_device_probe(struct device *dev, struct virtio_device *device, uint64_t is_legacy);
 
 #endif /* VIRTIO_BLK_H */
@@ -0,0 +1,75 @@
+/**
+ * @file elf.h
+ * @brief 定义 ELF64 文件格式的数据结构和常量
+ *
+ * 只包含 execve() 加载静态链接的可执行文件所需的部分。
+ */
+#ifndef __ELF_H__
+#define __ELF_H__
+
+#include <stddef.h>
+
+/// @{ @name e_ident 下标和取值
+#define EI_NIDENT     16
+#define EI_MAG0       0
+#define EI_MAG1       1
+#define EI_MAG2       2
+#define EI_MAG3       3
+#define EI_CLASS      4
+#define EI_DATA       5
+#define ELFMAG0       0x7f
+#define ELFMAG1       'E'
+#define ELFMAG2       'L'
+#define ELFMAG3       'F'
+#define ELFCLASS64    2                                 /**< 64 位 */
+#define ELFDATA2LSB   1                                 /**< 小端 */
+/// @}
+
+#define ET_EXEC       2                                 /**< 可执行文件 */
+#define EM_RISCV      243                               /**< RISC-V */
+
+/// @{ @name 程序头类型和标志
+#define PT_NULL       0
+#define PT_LOAD       1                                 /**< 需要加载的段 */
+#define PF_X          0x1                               /**< 可执行 */
+#define PF_W          0x2                               /**< 可写 */
+#define PF_R          0x4                               /**< 可读 */
+/// @}
+
+/// @{ @name 辅助向量类型
+#define AT_NULL       0                                 /**< 辅助向量结束 */
+#define AT_PAGESZ     6                                 /**< 页大小 */
+#define AT_ENTRY      9                                 /**< 程序入口 */
+/// @}
+
+/** ELF 文件头 */
+typedef struct {
+    uint8_t  e_ident[EI_NIDENT];                        /**< 魔数和文件类别 */
+    uint16_t e_type;                                    /**< 文件类型 */
+    uint16_t e_machine;                                 /**< 目标体系结构 */
+    uint32_t e_version;
+    uint64_t e_entry;                                   /**< 程序入口虚拟地址 */
+    uint64_t e_phoff;                                   /**< 程序头表的文件偏移 */
+    uint64_t e_shoff;                                   /**< 节头表的文件偏移 */
+    uint32_t e_flags;
+    uint16_t e_ehsize;                                  /**< 文件头大小 */
+    uint16_t e_phentsize;                               /**< 程序头大小 */
+    uint16_t e_phnum;                                   /**< 程序头个数 */
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+} Elf64_Ehdr;
+
+/** ELF 程序头，描述一个段 */
+typedef struct {
+    uint32_t p_type;                                    /**< 段类型 */
+    uint32_t p_flags;                                   /**< 访问权限 */
+    uint64_t p_offset;                                  /**< 段在文件中的偏移 */
+    uint64_t p_vaddr;                                   /**< 段的虚拟地址 */
+    uint64_t p_paddr;
+    uint64_t p_filesz;                                  /**< 段在文件中的大小 */
+    uint64_t p_memsz;                                   /**< 段在内存中的大小，超出 p_filesz 的部分清零（.bss） */
+    uint64_t p_align;
+} Elf64_Phdr;
+
+#endif /* end of include guard: __ELF_H__ */
@@ -12,8 +12,12 @@
  * 将 errno 简单的实现为全局变量。
  *
  * 本文件中的编号与最新的 Linux 内核一致。
+ *
+ * 本文件也被 uaccess.S 包含，C 语言声明需放在 __ASSEMBLER__ 之外。
  */
+#ifndef __ASSEMBLER__
 extern int errno;
+#endif
 
 #define    EPERM         1 /**< Operation not permitted */
 #define    ENOENT         2 /**< No such file or directory */
@@ -45,7 +49,11 @@ extern int errno;
 #define    ENOSPC        28 /**< No space left on device */
 #define    ESPIPE        29 /**< Illegal seek */
 #define    EROFS        30 /**< Read-only file system */
+#define    EPIPE        32 /**< Broken pipe */
+#define    ENAMETOOLONG 36 /**< File name too long */
 #define ENOSYS      38 /**< Invalid system call number */
+#define    ETIME       62 /**< Timer expired */
 #define    ERESTART    85 /**< Interrupted system call should be restarted */
+#define    ETIMEDOUT  110 /**< Connection timed out */
 
 #endif /** end of include guard: __ERRNO_H__ */
@@ -0,0 +1,89 @@
+/**
+ * @file file.h
+ * @brief 声明打开的文件对象和文件描述符表操作
+ *
+ * 每次 open() 创建一个 struct file，记录 inode、读写位置和打开方式。文件描述符
+ * 表 files_struct 中保存的是 struct file 的指针，fork() 和 dup() 得到的描述符
+ * 与原描述符指向同一个 struct file，共享读写位置。
+ *
+ * 描述符表初始时使用内嵌的 NR_OPEN_DEFAULT 个槽位，用完后按两倍扩展，最多
+ * NR_OPEN 个。描述符表只在关中断时修改；读写文件期间用 fget() 持有文件的引用，
+ * 其他线程关闭该描述符不会释放正在使用的文件。
+ */
+#ifndef __FILE_H__
+#define __FILE_H__
+
+#include <stddef.h>
+#include <fs/vfs.h>
+
+struct files_struct;
+struct poll_table;
+
+/// @{ @name open() 标志，取值与 Linux 相同
+#define O_RDONLY             0x0000             /**< 只读 */
+#define O_WRONLY             0x0001             /**< 只写 */
+#define O_RDWR               0x0002             /**< 读写 */
+#define O_ACCMODE            0x0003             /**< 访问方式的掩码 */
+#define O_CREAT              0x0040             /**< 不存在时创建，只用于 shm_open() */
+#define O_EXCL               0x0080             /**< 与 O_CREAT 一起使用，已存在时失败 */
+#define O_APPEND             0x0400             /**< 每次写之前把读写位置移到文件末尾 */
+#define O_NONBLOCK           0x0800             /**< 读写会阻塞时返回 -EAGAIN */
+/// @}
+
+/// @{ @name lseek() 的 whence
+#define SEEK_SET             0                  /**< 相对文件开头 */
+#define SEEK_CUR             1                  /**< 相对当前位置 */
+#define SEEK_END             2                  /**< 相对文件末尾 */
+/// @}
+
+struct file;
+
+/**
+ * @brief 文件操作
+ *
+ * read 和 write 从 *pos 处读写最多 count 字节并更新 *pos，返回读写的字节数或负的错误码。
+ * readv 和 writev 同样从 *pos 处依次读写 iov 中的各段；为 NULL 时逐段调用 read 和 write。
+ * poll 返回 POLL* 就绪状态，并用 poll_wait() 登记等待队列，见 fs/poll.h；为 NULL 时
+ * 文件总是可读写。其他为 NULL 的操作不被支持。
+ */
+struct file_operations {
+    int64_t (*read)(struct file *file, void *buf, uint64_t count, uint64_t *pos);
+    int64_t (*write)(struct file *file, const void *buf, uint64_t count, uint64_t *pos);
+    int64_t (*readv)(struct file *file, const struct iovec *iov, uint64_t iovcnt, uint64_t *pos);
+    int64_t (*writev)(struct file *file, const struct iovec *iov, uint64_t iovcnt, uint64_t *pos);
+    uint32_t (*poll)(struct file *file, struct poll_table *pt);
+    void (*release)(struct file *file);                     /**< 最后一个引用被释放时调用 */
+};
+
+/** 打开的文件 */
+struct file {
+    struct vfs_inode *f_inode;                              /**< 文件的 inode，没有 inode 的文件为 NULL */
+    uint64_t f_pos;                                         /**< 读写位置 */
+    uint32_t f_flags;                                       /**< open() 标志 */
+    uint32_t f_count;                                       /**< 引用计数，描述符和 fget() 各持有一个 */
+    const struct file_operations *f_op;
+    void *private_data;                                     /**< 文件类型私有的数据 */
+};
+
+extern const struct file_operations vfs_file_operations;
+extern const struct file_operations console_file_operations;
+
+struct file *alloc_file(struct vfs_inode *inode, uint32_t flags, const struct file_operations *f_op);
+void get_file(struct file *file);
+void fput(struct file *file);
+struct file *fget_files(struct files_struct *files, uint64_t fd);
+struct file *fget(uint64_t fd);
+int64_t fd_install(struct file *file);
+int64_t close_fd(uint64_t fd);
+int64_t file_read(struct file *file, void *buf, uint64_t count);
+int64_t file_write(struct file *file, const void *buf, uint64_t count);
+int64_t file_pread(struct file *file, void *buf, uint64_t count, uint64_t pos);
+int64_t file_pwrite(struct file *file, const void *buf, uint64_t count, uint64_t pos);
+int64_t file_readv(struct file *file, const struct iovec *iov, uint64_t iovcnt, uint64_t *pos);
+int64_t file_writev(struct file *file, const struct iovec *iov, uint64_t iovcnt, uint64_t *pos);
+int64_t import_iovec(const struct iovec *uvec, uint64_t iovcnt, struct iovec **iov);
+int64_t dup_files(struct files_struct *to, struct files_struct *from);
+void close_files(struct files_struct *files);
+void console_init();
+
+#endif /* end of include guard: __FILE_H__ */
@@ -0,0 +1,81 @@
+/**
+ * @file pipe.h
+ * @brief 声明管道和 splice
+ *
+ * 管道是 PIPE_BUFFERS 个缓冲区组成的环，每个缓冲区引用一个物理页中的一段数据。
+ * write() 把数据拷贝到管道私有的页中，能追加到最后一个缓冲区时不占用新的槽位；
+ * splice() 和 vmsplice() 让缓冲区直接引用页缓存或用户进程的页，只增加页的引用
+ * 计数，不拷贝数据。读完一个缓冲区后释放它对页的引用。
+ *
+ * 管道的读端和写端是两个打开的文件，private_data 都指向 pipe_inode_info。读写时
+ * 持有管道的互斥锁，数据不足或空间不足时放开锁，在等待队列上睡眠。
+ *
+ * 用法：
+ * ```
+ *     int fds[2];
+ *     syscall(NR_pipe2, fds, 0);
+ *     if (!syscall(NR_fork)) {
+ *         syscall(NR_close, fds[1]);
+ *         while ((n = syscall(NR_read, fds[0], buf, sizeof(buf))) > 0) ...
+ *     }
+ *     syscall(NR_close, fds[0]);
+ *     syscall(NR_write, fds[1], data, size);
+ * ```
+ */
+#ifndef __PIPE_H__
+#define __PIPE_H__
+
+#include <stddef.h>
+#include <mutex.h>
+#include <wait.h>
+#include <fs/file.h>
+
+#define PIPE_BUFFERS         16                 /**< 环中的缓冲区数，管道最多容纳这么多页 */
+
+/// @{ @name splice() 和 vmsplice() 标志，取值与 Linux 相同
+#define SPLICE_F_MOVE        0x01               /**< 尽量移动页而不是拷贝，总是如此，忽略 */
+#define SPLICE_F_NONBLOCK    0x02               /**< 管道操作不阻塞 */
+#define SPLICE_F_MORE        0x04               /**< 后面还有数据，忽略 */
+#define SPLICE_F_GIFT        0x08               /**< vmsplice() 把页交给管道，总是如此，忽略 */
+/// @}
+
+#define PIPE_BUF_FLAG_CAN_MERGE 0x01            /**< 页为该缓冲区独有，写可以追加到数据之后 */
+
+/** 管道中的一个缓冲区 */
+struct pipe_buffer {
+    uint64_t page;                          /**< 物理页地址，缓冲区持有页的一个引用 */
+    uint32_t offset;                        /**< 数据在页内的起始位置 */
+    uint32_t len;                           /**< 数据长度 */
+    uint32_t flags;                         /**< PIPE_BUF_FLAG_* */
+};
+
+/** 管道 */
+struct pipe_inode_info {
+    struct mutex mutex;                     /**< 保护缓冲区环 */
+    struct wait_queue_head rd_wait;         /**< 等待数据的读者 */
+    struct wait_queue_head wr_wait;         /**< 等待空间的写者 */
+    uint32_t head;                          /**< 下一个写入的缓冲区，只增不减 */
+    uint32_t tail;                          /**< 下一个读出的缓冲区，只增不减 */
+    uint32_t readers;                       /**< 读端的打开文件数 */
+    uint32_t writers;                       /**< 写端的打开文件数 */
+    struct pipe_buffer bufs[PIPE_BUFFERS];  /**< 下标为 head、tail 对 PIPE_BUFFERS 取模 */
+};
+
+static inline uint64_t pipe_empty(const struct pipe_inode_info *pipe)
+{
+    return pipe->head == pipe->tail;
+}
+
+static inline uint64_t pipe_full(const struct pipe_inode_info *pipe)
+{
+    return pipe->head - pipe->tail >= PIPE_BUFFERS;
+}
+
+struct pipe_inode_info *get_pipe_info(struct file *file);
+int64_t pipe_wait_readable(struct pipe_inode_info *pipe, uint64_t nonblock);
+int64_t pipe_wait_writable(struct pipe_inode_info *pipe, uint64_t nonblock);
+void pipe_buf_release(struct pipe_inode_info *pipe);
+int64_t pipe_copy_in(struct pipe_inode_info *pipe, const void *buf, uint64_t count, uint64_t nonblock);
+int64_t pipe_copy_out(struct pipe_inode_info *pipe, void *buf, uint64_t count);
+
+#endif /* end of include guard: __PIPE_H__ */
@@ -0,0 +1,117 @@
+/**
+ * @file poll.h
+ * @brief 声明文件就绪通知：poll() 和 epoll
+ *
+ * 可能阻塞的文件（控制台等）实现 file_operations::poll：用 poll_wait() 登记状态
+ * 变化时会被唤醒的等待队列，并返回当前的就绪状态。poll() 和 epoll 在这些等待
+ * 队列上挂入自己的等待者，文件就绪时经回调得知，不需要轮询。没有实现 poll 的
+ * 文件总是可读写。
+ *
+ * poll() 每次调用都要检查并登记所有描述符，代价与描述符数成正比。epoll 只在
+ * epoll_ctl() 时登记一次；文件的等待队列被唤醒时回调把对应的项挂到就绪链表上，
+ * epoll_wait() 只检查就绪链表，代价与就绪的描述符数成正比，一个事件循环可以
+ * 同时等待大量描述符。
+ *
+ * 用法：
+ * ```
+ *     int ep = syscall(NR_epoll_create, 1);
+ *     struct epoll_event ev = { .events = EPOLLIN, .data = fd };
+ *     syscall(NR_epoll_ctl, ep, EPOLL_CTL_ADD, fd, &ev);
+ *     while (1) {
+ *         struct epoll_event events[8];
+ *         int n = syscall(NR_epoll_wait, ep, events, 8, timeout_ms);
+ *         ...                             // n 为 0 时超时
+ *     }
+ * ```
+ */
+#ifndef __POLL_H__
+#define __POLL_H__
+
+#include <stddef.h>
+#include <wait.h>
+#include <fs/file.h>
+
+/// @{ @name 事件，取值与 Linux 相同，epoll 的 EPOLLIN 等与之相同
+#define POLLIN               0x0001             /**< 可读 */
+#define POLLPRI              0x0002             /**< 有紧急数据 */
+#define POLLOUT              0x0004             /**< 可写 */
+#define POLLERR              0x0008             /**< 出错，总是报告 */
+#define POLLHUP              0x0010             /**< 对端关闭，总是报告 */
+#define POLLNVAL             0x0020             /**< 描述符无效，总是报告 */
+#define POLLRDNORM           0x0040             /**< 有普通数据可读 */
+#define POLLWRNORM           0x0100             /**< 可写普通数据 */
+/// @}
+
+/** 没有实现 poll 的文件的就绪状态 */
+#define DEFAULT_POLLMASK     (POLLIN | POLLOUT | POLLRDNORM | POLLWRNORM)
+
+/** poll() 的描述符项 */
+struct pollfd {
+    int32_t fd;                             /**< 文件描述符，为负时忽略该项 */
+    int16_t events;                         /**< 关心的事件 */
+    int16_t revents;                        /**< 返回发生的事件 */
+};
+
+struct poll_table;
+
+/**
+ * @brief 登记等待队列的回调函数
+ *
+ * @param file 被检查的文件
+ * @param wq 文件状态变化时被唤醒的等待队列，生存期不短于文件
+ * @param pt poll_wait() 的参数
+ */
+typedef void (*poll_queue_proc)(struct file *file, struct wait_queue_head *wq, struct poll_table *pt);
+
+/** 传给 file_operations::poll 的登记方式，为 NULL 时只检查状态 */
+struct poll_table {
+    poll_queue_proc qproc;
+};
+
+/**
+ * @brief 在 file_operations::poll 中登记文件的等待队列
+ *
+ * 一个文件可以登记多个等待队列，例如读、写各一个。
+ */
+static inline void poll_wait(struct file *file, struct wait_queue_head *wq, struct poll_table *pt)
+{
+    if (pt && pt->qproc) {
+        pt->qproc(file, wq, pt);
+    }
+}
+
+/**
+ * @brief 取文件的就绪状态，pt 不为 NULL 时同时登记等待队列
+ *
+ * @return POLL* 事件
+ */
+static inline uint32_t vfs_poll(struct file *file, struct poll_table *pt)
+{
+    return file->f_op->poll ? file->f_op->poll(file, pt) : DEFAULT_POLLMASK;
+}
+
+/// @{ @name epoll 事件标志
+#define EPOLLIN              POLLIN
+#define EPOLLPRI             POLLPRI
+#define EPOLLOUT             POLLOUT
+#define EPOLLERR             POLLERR
+#define EPOLLHUP             POLLHUP
+#define EPOLLRDNORM          POLLRDNORM
+#define EPOLLWRNORM          POLLWRNORM
+#define EPOLLONESHOT         (1U << 30)         /**< 报告一次后停用，需 EPOLL_CTL_MOD 重新启用 */
+#define EPOLLET              (1U << 31)         /**< 边沿触发：只在被唤醒后报告一次 */
+/// @}
+
+/// @{ @name epoll_ctl() 的操作
+#define EPOLL_CTL_ADD        1                  /**< 添加描述符 */
+#define EPOLL_CTL_DEL        2                  /**< 删除描述符 */
+#define EPOLL_CTL_MOD        3                  /**< 修改关心的事件 */
+/// @}
+
+/** epoll 事件，布局与 RISC-V 上的 Linux 相同 */
+struct epoll_event {
+    uint32_t events;                        /**< EPOLL* 事件 */
+    uint64_t data;                          /**< 用户数据，原样返回 */
+};
+
+#endif /* end of include guard: __POLL_H__ */
@@ -6,6 +6,15 @@
 struct vfs_inode;
 struct vfs_stat;
 
+/* 分散/聚集读写的一段缓冲区，与 Linux 的 struct iovec 相同 */
+struct iovec {
+    void *iov_base;
+    uint64_t iov_len;
+};
+
+#define IOV_MAX 64 /* readv() 等系统调用一次最多处理的缓冲区段数 */
+#define PATH_MAX 256 /* 路径的最大长度，含结尾的 '\0' */
+
 struct vfs_interface {
     void *fs_data;
     struct vfs_inode *root;
@@ -16,6 +25,8 @@ struct vfs_interface {
     uint64_t (*is_dir)(struct vfs_inode *inode);
     struct vfs_dir_entry *(*dir_inode)(struct vfs_inode *inode, uint64_t dir_idx);
     void (*inode_request)(struct vfs_inode *inode, void *buffer, uint64_t length, uint64_t offset, uint64_t is_read);
+    /* 从 offset 处连续读写 iov 中的各段，超出文件大小的部分不读写，返回读写的字节数；可以为 NULL */
+    uint64_t (*inode_request_vec)(struct vfs_inode *inode, const struct iovec *iov, uint64_t iovcnt, uint64_t offset, uint64_t is_read);
     uint64_t ref_cnt;
 };
 
@@ -54,6 +65,7 @@ void vfs_free_inode(struct vfs_inode *inode);
 /* vsf提供的inode操作 */
 struct vfs_stat *vfs_get_stat(struct vfs_inode *inode);
 void vfs_inode_request(struct vfs_inode *inode, void *buffer, uint64_t length, uint64_t offset, uint64_t is_read);
+uint64_t vfs_inode_request_vec(struct vfs_inode *inode, const struct iovec *iov, uint64_t iovcnt, uint64_t offset, uint64_t is_read);
 uint64_t vfs_is_dir(struct vfs_inode *inode);
 struct vfs_dir_entry *vfs_inode_dir_entry(struct vfs_inode *inode, uint64_t dir_idx);
 
@@ -0,0 +1,38 @@
+/**
+ * @file futex.h
+ * @brief 声明快速用户态互斥（futex）
+ *
+ * futex 是用户内存中一个 4 字节对齐的 int。无竞争时用户程序只用原子指令操作它，
+ * 不进入内核；有竞争时用 FUTEX_WAIT 睡眠，用 FUTEX_WAKE 唤醒睡眠者。
+ *
+ * 用法（简化的互斥锁，0 表示空闲，1 表示被持有，2 表示有等待者）：
+ * ```
+ *     lock:   if (cas(&f, 0, 1) != 0)
+ *                 while (xchg(&f, 2) != 0)
+ *                     futex(&f, FUTEX_WAIT, 2, NULL);
+ *     unlock: if (xchg(&f, 0) == 2)
+ *                 futex(&f, FUTEX_WAKE, 1);
+ * ```
+ */
+#ifndef __FUTEX_H__
+#define __FUTEX_H__
+
+#include <stddef.h>
+#include <clock.h>
+
+/// @{ @name futex 操作
+#define FUTEX_WAIT           0                  /**< *uaddr == val 时睡眠，直到被唤醒或超时 */
+#define FUTEX_WAKE           1                  /**< 最多唤醒 val 个等待者 */
+#define FUTEX_REQUEUE        3                  /**< 唤醒 val 个等待者，把最多 val2 个等待者移到 uaddr2 */
+#define FUTEX_CMP_REQUEUE    4                  /**< 同 FUTEX_REQUEUE，但要求 *uaddr == val3 */
+#define FUTEX_PRIVATE_FLAG   128                /**< 兼容 Linux，本内核的 futex 总以物理地址为键，忽略此标志 */
+#define FUTEX_CMD_MASK       (~FUTEX_PRIVATE_FLAG)
+/// @}
+
+void futex_init();
+long do_futex(int *uaddr, int op, int val, const struct timespec *timeout,
+              int *uaddr2, int val2, int val3);
+long futex_wake(int *uaddr, int nr_wake);
+void futex_clear_tid(int *uaddr);
+
+#endif /* end of include guard: __FUTEX_H__ */
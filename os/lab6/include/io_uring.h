@@ -0,0 +1,175 @@
+/**
+ * @file io_uring.h
+ * @brief 声明 io_uring：用户态与内核共享的提交队列和完成队列
+ *
+ * 每个 I/O 系统调用都要陷入一次内核并同步等待完成，高 IOPS 的负载大部分时间花在
+ * 陷入和返回上。io_uring 在用户地址空间的固定地址映射两页共享内存：
+ * - 提交队列（SQ）：用户态填写 SQE 后移动 tail，内核取走后移动 head；
+ * - 完成队列（CQ）：内核写入 CQE 后移动 tail，用户态读取后移动 head。
+ *
+ * 用户态一次 io_uring_enter() 可以提交任意多个请求并等待若干个完成，也可以用
+ * IORING_SETUP_SQPOLL 让内核线程轮询提交队列，提交不需要陷入内核。读写 virtio
+ * 块设备和串口的请求异步完成：提交后立即返回，由设备中断的下半部写入 CQE。
+ *
+ * 用法：
+ * ```
+ *     struct io_uring_params p = { .flags = 0 };
+ *     syscall(NR_io_uring_setup, 32, &p);
+ *     struct io_uring_sqe *sqe = io_uring_get_sqe(IO_URING_RINGS);
+ *     sqe->opcode = IORING_OP_BLOCK_READ; ...
+ *     io_uring_sq_advance(IO_URING_RINGS, 1);
+ *     syscall(NR_io_uring_enter, 1, 1, IORING_ENTER_GETEVENTS);
+ *     struct io_uring_cqe *cqe = io_uring_peek_cqe(IO_URING_RINGS);
+ *     ...
+ *     io_uring_cq_advance(IO_URING_RINGS, 1);
+ * ```
+ *
+ * 每个地址空间最多有一对队列，随地址空间在最后一个使用者退出或 execve() 时释放。
+ * fork() 得到的子进程没有队列，CLONE_VM 创建的线程共享队列。
+ */
+#ifndef __IO_URING_H__
+#define __IO_URING_H__
+
+#include <stddef.h>
+#include <vdso.h>
+
+#define IO_URING_BASE        VDSO_END                       /**< 队列地址，紧接 vDSO 之后 */
+#define IO_URING_SQES        (IO_URING_BASE + 0x1000)       /**< SQE 数组所在页 */
+#define IO_URING_END         (IO_URING_BASE + 0x2000)
+
+#define IORING_MAX_ENTRIES   64                             /**< SQ 最大长度，SQE 数组占满一页 */
+#define IORING_MAX_CQ_ENTRIES (2 * IORING_MAX_ENTRIES)      /**< CQ 长度是 SQ 的两倍 */
+
+/// @{ @name io_uring_setup() 标志
+#define IORING_SETUP_SQPOLL  (1U << 1)                      /**< 由内核线程轮询提交队列 */
+/// @}
+
+/// @{ @name io_uring_enter() 标志
+#define IORING_ENTER_GETEVENTS (1U << 0)                    /**< 等待 min_complete 个完成 */
+#define IORING_ENTER_SQ_WAKEUP (1U << 1)                    /**< 唤醒睡眠的轮询线程 */
+/// @}
+
+/// @{ @name 提交队列标志，由内核设置
+#define IORING_SQ_NEED_WAKEUP (1U << 0)                     /**< 轮询线程已睡眠，需用 IORING_ENTER_SQ_WAKEUP 唤醒 */
+/// @}
+
+/// @{ @name 操作码
+#define IORING_OP_NOP        0                              /**< 空操作，直接完成 */
+#define IORING_OP_READ       1                              /**< 从文件 fd 的 off 处读 len 字节到 addr */
+#define IORING_OP_WRITE      2                              /**< 将 addr 处的 len 字节写入文件 fd 的 off 处 */
+#define IORING_OP_BLOCK_READ 3                              /**< 读块设备第 off 个扇区到 addr，len 为扇区大小 */
+#define IORING_OP_BLOCK_WRITE 4                             /**< 将 addr 写入块设备第 off 个扇区，len 为扇区大小 */
+#define IORING_OP_CHAR_READ  5                              /**< 从串口读最多 len 字节，有数据时即完成 */
+#define IORING_OP_CHAR_WRITE 6                              /**< 向串口写 len 字节 */
+#define IORING_OP_TIMEOUT    7                              /**< addr 指向相对超时 timespec；off 不为 0 时 off 个其他请求完成也会结束 */
+#define IORING_OP_LAST       8
+/// @}
+
+#define IORING_BLOCK_SIZE    512                            /**< 块设备请求的扇区大小 */
+
+/** 提交队列项 */
+struct io_uring_sqe {
+    uint8_t  opcode;                                        /**< IORING_OP_* */
+    uint8_t  flags;                                         /**< 保留，必须为 0 */
+    uint16_t ioprio;                                        /**< 保留 */
+    int32_t  fd;                                            /**< 文件描述符 */
+    uint64_t off;                                           /**< 文件偏移、扇区号或超时的完成数 */
+    uint64_t addr;                                          /**< 缓冲区或 timespec 地址 */
+    uint32_t len;                                           /**< 缓冲区长度 */
+    uint32_t op_flags;                                      /**< 保留 */
+    uint64_t user_data;                                     /**< 原样复制到 CQE，用于识别请求 */
+    uint64_t __pad[3];                                      /**< 填充到 64 字节 */
+};
+
+/** 完成队列项 */
+struct io_uring_cqe {
+    uint64_t user_data;                                     /**< 请求的 user_data */
+    int32_t  res;                                           /**< 结果，失败时为负的错误码 */
+    uint32_t flags;
+};
+
+/**
+ * @brief 队列控制字段和 CQE 数组，位于 IO_URING_BASE
+ *
+ * head 由消费者写、tail 由生产者写，对方只读。
+ */
+struct io_uring_rings {
+    uint32_t sq_head;                                       /**< 内核已取走的 SQE 数 */
+    uint32_t sq_tail;                                       /**< 用户态已提交的 SQE 数 */
+    uint32_t sq_ring_mask;
+    uint32_t sq_ring_entries;
+    uint32_t sq_flags;                                      /**< IORING_SQ_* */
+    uint32_t cq_head;                                       /**< 用户态已读取的 CQE 数 */
+    uint32_t cq_tail;                                       /**< 内核已写入的 CQE 数 */
+    uint32_t cq_ring_mask;
+    uint32_t cq_ring_entries;
+    uint32_t cq_overflow;                                   /**< CQ 满时被丢弃的 CQE 数 */
+    uint32_t __pad[6];                                      /**< 填充到 64 字节 */
+    struct io_uring_cqe cqes[IORING_MAX_CQ_ENTRIES];
+};
+
+/** io_uring_setup() 的参数 */
+struct io_uring_params {
+    uint32_t sq_entries;                                    /**< 输出：SQ 长度 */
+    uint32_t cq_entries;                                    /**< 输出：CQ 长度 */
+    uint32_t flags;                                         /**< 输入：IORING_SETUP_* */
+    uint32_t sq_thread_idle;                                /**< 输入：轮询线程空闲多少毫秒后睡眠，0 表示默认值 */
+    uint64_t rings;                                         /**< 输出：struct io_uring_rings 的地址 */
+    uint64_t sqes;                                          /**< 输出：SQE 数组的地址 */
+};
+
+#define IO_URING_RINGS       ((struct io_uring_rings *)IO_URING_BASE)
+
+/**
+ * @brief 取下一个空闲的 SQE
+ *
+ * @return SQ 已满时返回 NULL
+ */
+static inline struct io_uring_sqe *io_uring_get_sqe(struct io_uring_rings *rings)
+{
+    uint32_t head = __atomic_load_n(&rings->sq_head, __ATOMIC_ACQUIRE);
+    if (rings->sq_tail - head >= rings->sq_ring_entries) {
+        return NULL;
+    }
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)IO_URING_SQES + (rings->sq_tail & rings->sq_ring_mask);
+    __builtin_memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+/** 提交 nr 个已填写的 SQE */
+static inline void io_uring_sq_advance(struct io_uring_rings *rings, uint32_t nr)
+{
+    __atomic_store_n(&rings->sq_tail, rings->sq_tail + nr, __ATOMIC_RELEASE);
+}
+
+/** CQ 中尚未读取的 CQE 数 */
+static inline uint32_t io_uring_cq_ready(struct io_uring_rings *rings)
+{
+    return __atomic_load_n(&rings->cq_tail, __ATOMIC_ACQUIRE) - rings->cq_head;
+}
+
+/**
+ * @brief 取下一个 CQE，不移动 head
+ *
+ * @return CQ 为空时返回 NULL
+ */
+static inline struct io_uring_cqe *io_uring_peek_cqe(struct io_uring_rings *rings)
+{
+    if (!io_uring_cq_ready(rings)) {
+        return NULL;
+    }
+    return &rings->cqes[rings->cq_head & rings->cq_ring_mask];
+}
+
+/** 释放 nr 个已读取的 CQE */
+static inline void io_uring_cq_advance(struct io_uring_rings *rings, uint32_t nr)
+{
+    __atomic_store_n(&rings->cq_head, rings->cq_head + nr, __ATOMIC_RELEASE);
+}
+
+struct mm_struct;
+
+void io_uring_fork(struct mm_struct *mm);
+void io_uring_release(struct mm_struct *mm);
+
+#endif /* end of include guard: __IO_URING_H__ */
@@ -0,0 +1,137 @@
+/**
+ * @file ipc.h
+ * @brief 声明基于端口的同步消息传递
+ *
+ * 端口是一个文件描述符，服务进程在端口上接收，客户进程向端口发送。消息是
+ * IPC_MSG_WORDS 个字，放在系统调用的 a1-a4 中传递，内核直接写入对方的 trapframe，
+ * 不经过用户内存；系统调用快速路径返回时从 trapframe 恢复 a1-a4，接收方在这几个
+ * 寄存器中取得消息。
+ *
+ * 发送和接收是同步的（会合）：先到的一方在端口上睡眠，等另一方到来。ipc_call()
+ * 发送后等待回复，接收方得到的标识是调用者的 TID，用 ipc_reply() 或
+ * ipc_reply_wait() 回复；ipc_send() 不等待回复，接收方得到的标识为 0。
+ *
+ * 客户进程调用时服务进程已在 ipc_receive() 中等待，或服务进程回复时客户进程已在
+ * 等待回复，内核不经过 schedule() 的扫描，直接切换到对方。典型的服务进程循环：
+ * ```
+ *     struct ipc_msg msg;
+ *     long token = ipc_receive(port, &msg);
+ *     while (token >= 0) {
+ *         ... 处理 msg，写入回复 ...
+ *         token = ipc_reply_wait(port, token, &msg);
+ *     }
+ * ```
+ * 客户进程：
+ * ```
+ *     struct ipc_msg msg = { { 1, 2, 3, 4 } };
+ *     ipc_call(port, &msg);                      // 返回时 msg 为回复
+ * ```
+ *
+ * 这些函数直接返回负的错误码，不设置 errno。
+ */
+#ifndef __IPC_H__
+#define __IPC_H__
+
+#include <stddef.h>
+#include <syscall.h>
+
+#define IPC_MSG_WORDS        4                              /**< 短消息的字数，对应 a1-a4 */
+
+/// @{ @name 进程的 IPC 状态
+#define IPC_IDLE             0                              /**< 不在 IPC 中 */
+#define IPC_RECEIVING        1                              /**< 在端口上等待消息 */
+#define IPC_SENDING          2                              /**< 在端口上等待接收方，不等待回复 */
+#define IPC_CALLING          3                              /**< 在端口上等待接收方，之后等待回复 */
+#define IPC_WAIT_REPLY       4                              /**< 消息已被取走，等待 ipc_partner 回复 */
+/// @}
+
+/** 短消息 */
+struct ipc_msg {
+    uint64_t w[IPC_MSG_WORDS];
+};
+
+/**
+ * @brief 发起 IPC 系统调用，a1-a4 传入并传回消息
+ *
+ * @param number 系统调用号
+ * @param arg0 放在 a0 的参数
+ * @param msg 放在 a1-a4 的消息，返回时为 a1-a4 的值
+ * @param arg5 放在 a5 的参数
+ */
+static inline long ipc_syscall(long number, long arg0, struct ipc_msg *msg, long arg5)
+{
+    register long a0 asm("a0") = arg0;
+    register uint64_t a1 asm("a1") = msg->w[0];
+    register uint64_t a2 asm("a2") = msg->w[1];
+    register uint64_t a3 asm("a3") = msg->w[2];
+    register uint64_t a4 asm("a4") = msg->w[3];
+    register long a5 asm("a5") = arg5;
+    register long a7 asm("a7") = number;
+    __asm__ __volatile__ ("ecall\n\t"
+            :"+r"(a0), "+r"(a1), "+r"(a2), "+r"(a3), "+r"(a4), "+r"(a5), "+r"(a7)
+            :
+            :"memory", "ra", "t0", "t1", "t2", "t3", "t4", "t5", "t6", "a6");
+    msg->w[0] = a1;
+    msg->w[1] = a2;
+    msg->w[2] = a3;
+    msg->w[3] = a4;
+    return a0;
+}
+
+/**
+ * @brief 向端口发送消息并等待回复
+ *
+ * @param msg 要发送的消息，返回时为回复
+ * @return 成功返回 0；被中断时返回 -EINTR，服务进程未回复就退出时返回 -EPIPE
+ */
+static inline long ipc_call(long port, struct ipc_msg *msg)
+{
+    return ipc_syscall(NR_ipc_call, port, msg, 0);
+}
+
+/**
+ * @brief 向端口发送消息，等到被接收后返回，不等待回复
+ */
+static inline long ipc_send(long port, struct ipc_msg *msg)
+{
+    return ipc_syscall(NR_ipc_send, port, msg, 0);
+}
+
+/**
+ * @brief 从端口接收消息
+ *
+ * @param msg 写入收到的消息
+ * @return 回复用的标识，ipc_send() 发送的消息为 0；失败时返回负的错误码
+ */
+static inline long ipc_receive(long port, struct ipc_msg *msg)
+{
+    return ipc_syscall(NR_ipc_receive, port, msg, 0);
+}
+
+/**
+ * @brief 回复 ipc_call() 的调用者，不阻塞
+ *
+ * @param token ipc_receive() 返回的标识
+ */
+static inline long ipc_reply(long token, struct ipc_msg *msg)
+{
+    return ipc_syscall(NR_ipc_reply, token, msg, 0);
+}
+
+/**
+ * @brief 回复调用者并接收下一条消息
+ *
+ * @param token 要回复的标识，为 0 时只接收
+ * @param msg 回复的消息，返回时为收到的消息
+ * @return 下一条消息的标识；回复失败或接收失败时返回负的错误码
+ */
+static inline long ipc_reply_wait(long port, long token, struct ipc_msg *msg)
+{
+    return ipc_syscall(NR_ipc_reply_wait, port, msg, token);
+}
+
+struct task_struct;
+
+void ipc_exit(struct task_struct *p);
+
+#endif /* end of include guard: __IPC_H__ */
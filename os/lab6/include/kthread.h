@@ -0,0 +1,21 @@
+/**
+ * @file kthread.h
+ * @brief 声明内核线程接口
+ *
+ * 内核线程只运行在 S 态，没有用户态地址空间，和普通进程一样参与调度。
+ * 所有内核线程共用页目录 kernel_pg_dir，其中只有内核区的映射。
+ */
+#ifndef __KTHREAD_H__
+#define __KTHREAD_H__
+
+#include <stddef.h>
+
+struct task_struct;
+
+extern uint64_t *kernel_pg_dir;
+
+void kthread_init();
+struct task_struct *kthread_create(int (*fn)(void *), void *arg);
+void kthread_exit(int code);
+
+#endif /* end of include guard: __KTHREAD_H__ */
@@ -20,6 +20,12 @@
  *                     |      |       |
  *                     |      v       |
  *                     |              |
+ *     0xBF004000----->+--------------+
+ *                     |   io_uring   |
+ *     0xBF002000----->+--------------+
+ *                     |     vDSO     |
+ *     0xBF000000----->+--------------+
+ *                     |              |
  *                     |              |
  *                     |      ^       |
  *                     |      |       |
@@ -57,6 +63,7 @@
 #define PAGING_MEMORY   (1024 * 1024 * 128)         /**< 系统物理内存大小 (bytes) */
 #define PAGING_PAGES    (PAGING_MEMORY >> 12)       /**< 系统物理内存页数 */
 #define MAP_NR(addr)    (((addr)-MEM_START) >> 12)  /**< 物理地址 addr 在 mem_map[] 中的下标 */
+#define MAX_PAGE_REF    250                         /**< mem_map[] 是 8 位计数，共享页的引用数达到此值后不再增加 */
 /// @}
 
 /// @{ @name 虚拟
@@ -124,9 +131,13 @@ void mem_test();
 void mem_init();
 void free_page(uint64_t addr);
 void free_page_tables(uint64_t from, uint64_t size);
+void free_pg_dir(uint64_t *dir);
 int copy_page_tables(uint64_t from, uint64_t *to_pg_dir, uint64_t to, uint64_t size);
 uint64_t get_free_page(void);
 void write_verify(uint64_t addr);
+void un_wp_page(uint64_t *table_entry);
+uint64_t *find_pte(uint64_t addr);
+uint64_t *get_pte(uint64_t *dir, uint64_t addr);
 void get_empty_page(uint64_t addr, uint16_t flag);
 uint64_t put_page(uint64_t page, uint64_t addr, uint16_t flag);
 void show_page_tables();
@@ -135,15 +146,15 @@ void active_mapping();
 void * kmalloc_i(uint64_t size);       /* 通用内核内存分配函数 */
 uint64_t kfree_s_i(void * obj, uint64_t size);      /* 释放指定对象占用的内存 */
 static inline void * kmalloc(uint64_t size) {
-    disable_interrupt();
+    uint64_t flag = irq_save();
     void *ptr = kmalloc_i(size);
-    enable_interrupt();
+    irq_restore(flag);
     return ptr;
 }
 static inline uint64_t kfree_s(void * obj, uint64_t size) {
-    disable_interrupt();
+    uint64_t flag = irq_save();
     uint64_t real_size = kfree_s_i(obj, size);
-    enable_interrupt();
+    irq_restore(flag);
     return real_size;
 }
 #define kfree(ptr) kfree_s((ptr), 0)
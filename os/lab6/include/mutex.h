@@ -0,0 +1,59 @@
+/**
+ * @file mutex.h
+ * @brief 声明支持优先级继承的睡眠互斥锁
+ *
+ * 互斥锁被占用时加锁的进程在锁的等待队列上睡眠。持有者的有效实时优先级
+ * （task_struct::prio）不低于所有等待者中的最高优先级，且沿等待链传递：持有者
+ * 自己也在等待另一把锁时，那把锁的持有者同样被提升。这样低优先级进程持有锁时
+ * 不会被中等优先级进程长时间抢占，高优先级等待者不会因此饿死。
+ *
+ * 解锁时直接把锁交给优先级最高的等待者，等待者被唤醒时已经持有锁。
+ *
+ * 用法：
+ * ```
+ *     DEFINE_MUTEX(lock);
+ *
+ *     mutex_lock(&lock);
+ *     ...
+ *     mutex_unlock(&lock);
+ * ```
+ * 互斥锁只能在进程上下文中使用，不能在中断处理函数中加锁。
+ */
+#ifndef __MUTEX_H__
+#define __MUTEX_H__
+
+#include <stddef.h>
+#include <wait.h>
+#include <utils/linked_list.h>
+
+struct task_struct;
+
+/** 互斥锁 */
+struct mutex {
+    struct task_struct *owner;                      /**< 持有者，未被占用时为 NULL */
+    struct wait_queue_head wait;                    /**< 等待者 */
+    struct linked_list_node held_entry;             /**< 持有者 pi_mutexes 链表节点 */
+};
+
+#define MUTEX_INITIALIZER(name) { .owner = NULL, .wait = WAIT_QUEUE_HEAD_INITIALIZER((name).wait), .held_entry = { NULL, NULL } }
+#define DEFINE_MUTEX(name) struct mutex name = MUTEX_INITIALIZER(name)
+
+static inline void mutex_init(struct mutex *lock)
+{
+    lock->owner = NULL;
+    init_waitqueue_head(&lock->wait);
+    linked_list_init(&lock->held_entry);
+}
+
+/** 互斥锁是否被占用 */
+static inline uint64_t mutex_is_locked(struct mutex *lock)
+{
+    return lock->owner != NULL;
+}
+
+void mutex_lock(struct mutex *lock);
+uint64_t mutex_trylock(struct mutex *lock);
+void mutex_unlock(struct mutex *lock);
+void pi_adjust_prio(struct task_struct *p);
+
+#endif /* end of include guard: __MUTEX_H__ */
@@ -0,0 +1,50 @@
+/**
+ * @file pid.h
+ * @brief 声明 PID 分配器和进程注册表
+ *
+ * PID 由位图分配，从上一次分配的 PID 之后循环查找空闲位，刚释放的 PID 不会
+ * 马上被复用。所有进程挂在 task_list 链表上，并按 PID 挂入散列表，查找进程
+ * 不需要遍历进程表，进程数只受 PID_MAX 和内存限制。
+ */
+#ifndef __PID_H__
+#define __PID_H__
+
+#include <stddef.h>
+#include <utils/hash_table.h>
+#include <utils/linked_list.h>
+
+#define PID_MAX              32768                          /**< PID 上限（不含） */
+#define RESERVED_PIDS        1                              /**< PID 回绕后从这里开始查找，进程 0 的 PID 不会被释放 */
+
+struct task_struct;
+
+/** 进程在 PID 散列表中的节点 */
+struct pid_link {
+    struct hash_table_node hash_node;
+    uint32_t nr;                                            /**< PID */
+    struct task_struct *task;
+};
+
+/** 所有进程组成的链表，修改时需关中断 */
+extern struct linked_list_node task_list;
+/** 进程数 */
+extern uint64_t nr_tasks;
+
+/**
+ * @brief 遍历所有进程
+ *
+ * 遍历期间需关中断，不能嵌套使用。
+ */
+#define for_each_task(p)                                                        \
+    for (struct linked_list_node *__node = task_list.next;                     \
+         __node != &task_list && ((p) = container_of(__node, struct task_struct, tasks), 1); \
+         __node = __node->next)
+
+void pid_init();
+uint32_t alloc_pid();
+void free_pid(uint32_t nr);
+void register_task(struct task_struct *p);
+void unregister_task(struct task_struct *p);
+struct task_struct *find_task_by_pid(uint32_t nr);
+
+#endif /* end of include guard: __PID_H__ */
@@ -0,0 +1,55 @@
+/**
+ * @file preempt.h
+ * @brief 声明内核抢占接口
+ *
+ * 系统调用开中断执行，进程在内核态也可以被抢占。时间片耗尽时时钟中断设置
+ * need_resched，中断返回时若被中断的是用户态，或者是抢占计数 preempt_count 为 0
+ * 的内核态，则调用 schedule() 切换进程。
+ *
+ * 不能被其他进程打断的代码放在 preempt_disable() 和 preempt_enable() 之间，
+ * preempt_enable() 使计数归零时会处理期间积累的调度请求。关中断或禁止抢占
+ * 执行的长循环应在循环之间调用 cond_resched() 主动让出处理器。
+ *
+ * 用法：
+ * ```
+ *     preempt_disable();
+ *     ...                  // 不会切换到其他进程
+ *     preempt_enable();
+ *
+ *     for (...) {
+ *         ...
+ *         cond_resched();  // 可能切换到其他进程
+ *     }
+ * ```
+ */
+#ifndef __PREEMPT_H__
+#define __PREEMPT_H__
+
+#include <sched.h>
+
+void preempt_schedule();
+uint64_t cond_resched();
+
+/** 当前进程是否需要重新调度 */
+static inline uint64_t need_resched()
+{
+    return current->need_resched;
+}
+
+/** 禁止抢占，可以嵌套 */
+static inline void preempt_disable()
+{
+    ++current->preempt_count;
+    __asm__ __volatile__("" ::: "memory");
+}
+
+/** 允许抢占，计数归零且有调度请求时立即调度 */
+static inline void preempt_enable()
+{
+    __asm__ __volatile__("" ::: "memory");
+    if (!--current->preempt_count && current->need_resched) {
+        preempt_schedule();
+    }
+}
+
+#endif /* end of include guard: __PREEMPT_H__ */
@@ -61,6 +61,11 @@
 #define SSTATUS64_SD 0x8000000000000000
 /// @}
 
+/// @{ @name STVEC 寄存器模式
+#define STVEC_MODE_DIRECT   0x0            /**< 所有中断和异常跳转到 BASE */
+#define STVEC_MODE_VECTORED 0x1            /**< 中断跳转到 BASE + 4 * cause，异常跳转到 BASE */
+/// @}
+
 /// @{ @name RISCV 权限模式
 #define USER       0
 #define SUPERVISOR 1
@@ -146,6 +151,10 @@
 
 #define disable_interrupt() clear_csr(sstatus, SSTATUS_SIE)
 #define enable_interrupt() set_csr(sstatus, SSTATUS_SIE)
+/** 关闭中断，返回关闭前的 SIE 位，配合 irq_restore() 使用 */
+#define irq_save() (clear_csr(sstatus, SSTATUS_SIE) & SSTATUS_SIE)
+/** 恢复 irq_save() 保存的 SIE 位 */
+#define irq_restore(flag) set_csr(sstatus, (flag))
 
 /**
  * @file riscv.h
@@ -43,11 +43,10 @@
 #include <riscv.h>
 #include <kdebug.h>
 #include <fs/vfs.h>
-
-#define NR_TASKS             512                              /**< 系统最大进程数 */
-
-#define LAST_TASK tasks[NR_TASKS - 1]                         /**< tasks[] 数组最后一项 */
-#define FIRST_TASK tasks[0]                                   /**< tasks[] 数组第一项 */
+#include <timer.h>
+#include <wait.h>
+#include <clock.h>
+#include <pid.h>
 
 /// @{ @name 进程状态
 #define TASK_RUNNING         0                                /**< 正在运行 */
@@ -57,19 +56,143 @@
 #define TASK_STOPPED         4                                /**< 进程停止 */
 /// @}
 
+/// @{ @name 进程标志
+#define PF_KTHREAD           0x01                             /**< 内核线程 */
+/// @}
+
+/// @{ @name 调度策略
+#define SCHED_NORMAL         0                                /**< 普通进程，按时间片公平调度 */
+#define SCHED_FIFO           1                                /**< 实时进程，先进先出，直到阻塞或让出处理器 */
+#define SCHED_RR             2                                /**< 实时进程，同优先级间时间片轮转 */
+/// @}
+
+/// @{ @name sched_switch_mode() 参数，选择进程切换的方式，用于对比切换开销
+#define SWITCH_CALLEE_SAVED  0                                /**< __switch()，只保存 ra、sp、s0-s11 */
+#define SWITCH_FULL_FRAME    1                                /**< __switch_full()，优化前经完整 trapframe 切换 */
+/// @}
+
+#define MAX_RT_PRIO          100                              /**< 实时优先级范围为 1 ~ MAX_RT_PRIO - 1，数值越大优先级越高 */
+#define RR_TIMESLICE         (100 * HZ / 1000)                /**< SCHED_RR 时间片（100ms） */
+
+/** sched_setscheduler() 参数 */
+struct sched_param {
+    int sched_priority;                                       /**< 实时优先级，普通进程为 0 */
+};
+
+/// @{ @name getrusage() 统计对象
+#define RUSAGE_SELF          0                                /**< 当前进程 */
+#define RUSAGE_CHILDREN      (-1)                             /**< 已回收的子进程 */
+/// @}
+
+/** getrusage() 返回的资源使用情况 */
+struct rusage {
+    struct timeval ru_utime;                                  /**< 用户态耗时 */
+    struct timeval ru_stime;                                  /**< 内核态耗时 */
+    int64_t ru_nvcsw;                                         /**< 主动切换次数 */
+    int64_t ru_nivcsw;                                        /**< 被动切换次数 */
+};
+
+/// @{ @name clone() 标志
+#define CLONE_VM             0x00000100                       /**< 共享地址空间和 VMA */
+#define CLONE_FILES          0x00000400                       /**< 共享打开的文件表 */
+#define CLONE_THREAD         0x00010000                       /**< 加入当前线程组，需同时指定 CLONE_VM */
+#define CLONE_SETTLS         0x00080000                       /**< 将新线程的 tp 设置为 tls 参数 */
+#define CLONE_PARENT_SETTID  0x00100000                       /**< 将新线程的 TID 写入 parent_tid */
+#define CLONE_CHILD_CLEARTID 0x00200000                       /**< 新线程退出时将 child_tid 清零并以 FUTEX_WAKE 唤醒 */
+#define CLONE_CHILD_SETTID   0x01000000                       /**< 将新线程的 TID 写入 child_tid */
+/// @}
+
+#define NR_OPEN_DEFAULT      8                                /**< 文件表内嵌的描述符数 */
+#define NR_OPEN              (PAGE_SIZE / sizeof(struct file *)) /**< 每个进程最多打开的文件数，描述符数组不超过一页 */
+
+struct file;
+
+/**
+ * @brief 打开的文件表，CLONE_FILES 创建的任务共享
+ *
+ * fd 初始指向 fd_array，描述符用完时扩展为 kmalloc() 分配的更大数组，见 fs/file.c。
+ */
+struct files_struct {
+    uint32_t count;                                           /**< 引用计数 */
+    uint32_t max_fds;                                         /**< fd 数组的长度 */
+    struct file **fd;                                         /**< 描述符数组，空闲描述符为 NULL */
+    struct file *fd_array[NR_OPEN_DEFAULT];
+};
+
+/**
+ * @brief 用户地址空间，CLONE_VM 创建的任务共享
+ *
+ * mm_users 是使用该地址空间的任务数，降为 0 时释放用户区的页和 VMA；
+ * mm_count 还包括尚未被回收的僵尸任务，降为 0 时释放页目录。
+ */
+struct mm_struct {
+    uint32_t mm_users;                                        /**< 使用者数 */
+    uint32_t mm_count;                                        /**< 引用计数 */
+    uint64_t *pg_dir;                                         /**< 页目录 */
+    struct linked_list_node mmap;                             /**< 虚拟内存区域链表，见 vma.h */
+    struct vdso_data *vdso_data;                              /**< vDSO 数据页，见 vdso.h */
+    struct io_ring_ctx *io_uring;                             /**< io_uring 队列，见 io_uring.h */
+    struct linked_list_node shm_areas;                        /**< 共享内存映射链表，见 shm.h */
+};
+
+/// @{ @name waitpid() 选项
+#define WNOHANG              1                                /**< 没有已终止的子进程时立即返回 0 */
+/// @}
+
+#define WEXITSTATUS(status)  (((status) >> 8) & 0xFF)         /**< 从 waitpid() 返回的状态中取出子进程返回码 */
+
+/** times() 返回的耗时，单位为时钟节拍 */
+struct tms {
+    uint64_t tms_utime;                                       /**< 用户态耗时 */
+    uint64_t tms_stime;                                       /**< 内核态耗时 */
+    uint64_t tms_cutime;                                      /**< 已回收子进程的用户态耗时 */
+    uint64_t tms_cstime;                                      /**< 已回收子进程的内核态耗时 */
+};
+
 /// @{ 进程内存布局
 #define START_CODE 0x10000                                    /**< 代码段起始地址 */
 #define START_STACK 0xBFFFFFF0                                /**< 堆起始地址（最高地址处） */
 #define START_KERNEL 0xC0000000                               /**< 内核区起始地址 */
 /// @}
 
-typedef struct trapframe context;                             /**< 处理器上下文 */
+/**
+ * @brief 进程切换时保存的处理器上下文
+ *
+ * 进程切换总是发生在 switch_to() 函数调用中，caller-saved 寄存器已由调用者保存，
+ * 只需保存 ra、sp 和 callee-saved 寄存器 s0-s11。用户态的处理器状态保存在
+ * 内核栈顶的 trapframe 中，见 task_pt_regs()。
+ */
+struct context {
+    uint64_t ra;
+    uint64_t sp;
+    uint64_t s[12];
+};
+
+struct mutex;
+struct syscall_stats;
+
+#define SCHED_HIST_BUCKETS   16                               /**< 延迟直方图桶数，第 0 桶统计 1 微秒以下，第 i 桶统计 [2^(i-1), 2^i) 微秒 */
+
+/** 进程调度统计，时间均为时钟周期数 */
+struct sched_info {
+    uint64_t run_delay;                                       /**< 在就绪队列中等待的总时间 */
+    uint64_t last_queued;                                     /**< 最近一次进入就绪队列的时间 */
+    uint64_t pcount;                                          /**< 被调度运行的次数 */
+    uint64_t nvcsw;                                           /**< 因睡眠主动让出处理器的次数 */
+    uint64_t nivcsw;                                          /**< 被抢占或调用 sched_yield() 的次数 */
+    uint32_t woken;                                           /**< 最近一次入队是否因为被唤醒 */
+    uint32_t delay_hist[SCHED_HIST_BUCKETS];                  /**< 就绪队列等待时间直方图 */
+    uint32_t wakeup_hist[SCHED_HIST_BUCKETS];                 /**< 唤醒到运行的延迟直方图 */
+};
 
 /** 进程控制块 PCB(Process Control Block) */
 struct task_struct {
     uint32_t exit_code;           /**< 返回码 */
-    uint32_t pid;                 /**< 进程 ID */
+    uint32_t pid;                 /**< 进程 ID（线程 ID） */
+    uint32_t tgid;                /**< 线程组 ID，即组长的 pid，getpid() 的返回值 */
     uint32_t pgid;                /**< 进程组 */
+    struct pid_link pid_link;     /**< PID 散列表节点 */
+    struct linked_list_node tasks; /**< 进程链表节点 */
     uint64_t start_code;          /**< 代码段起始地址 */
     uint64_t start_rodata;        /**< 只读数据段起始地址 */
     uint64_t start_data;          /**< 数据段起始地址 */
@@ -78,18 +201,48 @@ struct task_struct {
     uint64_t start_stack;         /**< 堆起始地址 */
     uint64_t start_kernel;        /**< 内核区起始地址 */
     uint32_t state;               /**< 进程调度状态 */
+    uint32_t flags;               /**< 进程标志 */
+    uint32_t preempt_count;       /**< 抢占计数，不为 0 时不能在内核态被抢占 */
+    uint32_t need_resched;        /**< 时间片耗尽，需要重新调度 */
+    uint32_t policy;              /**< 调度策略 */
+    uint32_t rt_priority;         /**< 实时优先级，普通进程为 0 */
+    uint32_t prio;                /**< 有效实时优先级，可能因优先级继承高于 rt_priority */
+    uint32_t time_slice;          /**< SCHED_RR 剩余时间片 */
+    uint64_t rt_seq;              /**< 进入实时就绪队列的序号，同优先级时先入队者先运行 */
+    struct linked_list_node rt_node; /**< 实时就绪队列节点，不在队列中时指向自己 */
+    uint32_t rt_queue;            /**< 所在实时就绪队列的优先级 */
+    struct mutex *blocked_on;     /**< 正在等待的互斥锁 */
+    struct linked_list_node pi_mutexes; /**< 持有的互斥锁 */
     uint32_t counter;             /**< 时间片大小 */
     uint32_t priority;            /**< 进程优先级 */
-    struct vfs_inode *fd[4];
+    struct files_struct *files;   /**< 打开的文件表，内核线程为 NULL */
+    struct mm_struct *mm;         /**< 用户地址空间，内核线程为 NULL */
+    struct task_struct *group_leader; /**< 线程组组长 */
+    struct linked_list_node thread_group; /**< 线程组链表节点，组长退出后仍留在链表中直到被回收 */
+    uint32_t group_exit;          /**< 线程组正在退出（只在组长中有效） */
+    int32_t group_exit_code;      /**< 线程组的返回码（只在组长中有效） */
+    struct task_struct *group_exec_task; /**< 正在 execve() 中等待其他线程退出的线程，不受 group_exit 影响（只在组长中有效） */
+    int *set_child_tid;           /**< 第一次运行时写入 TID 的用户地址，见 CLONE_CHILD_SETTID */
+    int *clear_child_tid;         /**< 退出时清零的用户地址，见 CLONE_CHILD_CLEARTID */
     struct task_struct *p_pptr;   /**< 父进程 */
-    struct task_struct *p_cptr;   /**< 子进程 */
-    struct task_struct *p_ysptr;  /**< 创建时间最晚的兄弟进程 */
-    struct task_struct *p_osptr;  /**< 创建时间最早的兄弟进程 */
-    uint32_t utime,stime;         /**< 用户态、内核态耗时 */
-    uint32_t cutime,cstime;       /**< 进程及其子进程内核、用户态总耗时 */
+    struct task_struct *p_cptr;   /**< 最年轻（最晚创建）的子进程 */
+    struct task_struct *p_ysptr;  /**< 紧接着自己创建的兄弟进程 */
+    struct task_struct *p_osptr;  /**< 紧挨着自己之前创建的兄弟进程 */
+    struct wait_queue_head wait_chldexit; /**< 在 waitpid() 中等待子进程退出 */
+    uint64_t utime,stime;         /**< 用户态、内核态耗时（时钟周期数） */
+    uint64_t cutime,cstime;       /**< 已回收的子进程用户态、内核态总耗时（时钟周期数） */
+    struct sched_info sched_info; /**< 调度统计 */
+    struct syscall_stats *syscall_stats; /**< 系统调用统计，第一次统计时分配 */
     size_t start_time;            /**< 进程创建的时间 */
-    uint64_t *pg_dir;             /**< 页目录地址 */
-    context context;              /**< 处理器状态 */
+    struct timer_list real_timer; /**< ITIMER_REAL 间隔定时器 */
+    uint64_t it_real_incr;        /**< ITIMER_REAL 周期（时钟周期数） */
+    uint64_t it_real_overrun;     /**< ITIMER_REAL 未读取的到期次数 */
+    uint32_t ipc_state;           /**< 端口 IPC 状态，见 ipc.h */
+    int64_t ipc_result;           /**< IPC 完成时的返回值，由对方写入 */
+    struct task_struct *ipc_partner; /**< 等待其回复的服务进程（IPC_WAIT_REPLY） */
+    struct linked_list_node ipc_node; /**< 端口等待队列节点 */
+    uint64_t *pg_dir;             /**< 页目录地址，等于 mm->pg_dir，内核线程为 kernel_pg_dir */
+    struct context context;       /**< 进程切换时的处理器上下文 */
 };
 
 /**
@@ -126,16 +279,108 @@ union task_union {
     char stack[PAGE_SIZE];                                    /**< 内核态堆栈 */
 };
 
+/** 进程从用户态陷入内核时，trapframe 位于内核栈顶 */
+#define task_pt_regs(p) ((struct trapframe *)((char *)(p) + PAGE_SIZE) - 1)
+
 extern struct task_struct *current;
-extern struct task_struct *tasks[NR_TASKS];
+extern struct task_struct *child_reaper;
 extern union task_union init_task;
 
+/** 是否是线程组组长 */
+static inline uint64_t thread_group_leader(struct task_struct *p)
+{
+    return p->group_leader == p;
+}
+
+/** 线程组中是否只剩 p 自己 */
+static inline uint64_t thread_group_empty(struct task_struct *p)
+{
+    return linked_list_empty(&p->thread_group);
+}
+
+/**
+ * @brief 将进程加入父进程 p_pptr 的子进程链表，作为最年轻的子进程
+ *
+ * 子进程链表由 p_cptr 指向最年轻的子进程，兄弟进程间由 p_osptr、p_ysptr 双向
+ * 链接。调用者需关中断。
+ *
+ * @param p 进程
+ */
+static inline void set_links(struct task_struct *p)
+{
+    p->p_ysptr = NULL;
+    p->p_osptr = p->p_pptr->p_cptr;
+    if (p->p_osptr) {
+        p->p_osptr->p_ysptr = p;
+    }
+    p->p_pptr->p_cptr = p;
+}
+
+/**
+ * @brief 将进程移出父进程的子进程链表，调用者需关中断
+ *
+ * @param p 进程
+ */
+static inline void remove_links(struct task_struct *p)
+{
+    if (p->p_osptr) {
+        p->p_osptr->p_ysptr = p->p_ysptr;
+    }
+    if (p->p_ysptr) {
+        p->p_ysptr->p_osptr = p->p_osptr;
+    } else {
+        p->p_pptr->p_cptr = p->p_osptr;
+    }
+}
+
 void sched_init();
 void schedule();
-void save_context(context *context);
-context* push_context(char *stack, context *context);
-void switch_to(size_t task);
-void interruptible_sleep_on(struct task_struct **p);
-void sleep_on(struct task_struct **p);
-void wake_up(struct task_struct **p);
+void yield();
+void switch_to(struct task_struct *next);
+void __switch(struct context *prev, struct context *next);
+void __switch_full(struct context *prev, struct context *next);
+uint64_t wake_up_process(struct task_struct *p);
+void rt_enqueue(struct task_struct *p);
+void rt_requeue(struct task_struct *p);
+void rt_dequeue(struct task_struct *p);
+void scheduler_tick();
+void acct_user_to_kernel();
+void acct_kernel_to_user();
+void sched_info_queued(struct task_struct *p, uint64_t woken);
+void sched_info_switch(struct task_struct *prev, struct task_struct *next);
+void sched_stats_dump();
+uint64_t hist_bucket(uint64_t cycles);
+void print_hist(const char *name, const uint32_t *hist);
+void do_exit(int code) __attribute__((noreturn));
+void do_group_exit(int code) __attribute__((noreturn));
+int64_t de_thread();
+void reaper_init();
+long do_waitpid(int64_t pid, int *stat_addr, uint64_t options);
+struct mm_struct *mm_alloc();
+void mmput(struct mm_struct *mm);
+void mmdrop(struct mm_struct *mm);
+void put_files_struct(struct files_struct *files);
+
+/**
+ * @brief 当前线程组是否正在退出
+ *
+ * 本内核没有信号机制，exit_group() 只能标记线程组并唤醒可中断睡眠的线程。
+ * 在可中断睡眠的循环中应检查本函数，返回 -EINTR，让线程尽快回到用户态。
+ */
+static inline uint64_t group_exit_pending()
+{
+    struct task_struct *leader = current->group_leader;
+    return leader->group_exit && leader->group_exec_task != current;
+}
+
+/**
+ * @brief 返回用户态前检查线程组是否正在退出，是则结束当前线程
+ */
+static inline void group_exit_check()
+{
+    if (group_exit_pending()) {
+        enable_interrupt();
+        do_exit(current->group_leader->group_exit_code);
+    }
+}
 #endif /* end of include guard: __SCHED_H__ */
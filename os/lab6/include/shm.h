@@ -0,0 +1,135 @@
+/**
+ * @file shm.h
+ * @brief 声明命名共享内存对象和单生产者单消费者环形队列
+ *
+ * fork() 得到的进程以写时复制的方式共享物理页，第一次写就会分开，不能用来交换
+ * 数据。共享内存对象是一组物理页，shm_open() 按名字创建或打开它，得到一个文件
+ * 描述符；mmap() 把对象的页直接映射到调用者的 [SHM_BASE, SHM_END) 中，每个映射
+ * 的页表项各持有页的一个引用。映射建立时就填好页表项，不会缺页；fork() 的子进程
+ * 继承映射，父子进程的页表项都保持可写，不做写时复制。
+ *
+ * 对象在名字被 shm_unlink() 删除且所有描述符关闭后释放，已建立的映射仍持有页的
+ * 引用，直到 munmap() 或地址空间释放。
+ *
+ * 用法：
+ * ```
+ *     int fd = syscall(NR_shm_open, "/ring", O_RDWR | O_CREAT, 16 * 4096);
+ *     struct shm_ring *ring = (void *)syscall(NR_mmap, 0, 16 * 4096, PROT_READ | PROT_WRITE,
+ *                                             MAP_SHARED, fd, 0);
+ *     shm_ring_init(ring, 16 * 4096, sizeof(uint64_t));
+ *     if (!syscall(NR_fork)) {
+ *         const uint64_t *v;
+ *         while (!(v = shm_ring_peek(ring))) ...
+ *         shm_ring_release(ring);
+ *     }
+ *     uint64_t *slot;
+ *     while (!(slot = shm_ring_reserve(ring))) ...
+ *     *slot = 42;
+ *     shm_ring_commit(ring);
+ * ```
+ */
+#ifndef __SHM_H__
+#define __SHM_H__
+
+#include <stddef.h>
+#include <mm.h>
+#include <vdso.h>
+
+#define SHM_BASE             0xB0000000                     /**< 共享内存映射区起始地址 */
+#define SHM_END              VDSO_BASE                      /**< 共享内存映射区结束地址，紧接 vDSO 之下 */
+#define SHM_NAME_MAX         32                             /**< 对象名的最大长度（含 '\0'） */
+#define SHM_MAX_PAGES        (PAGE_SIZE / sizeof(uint64_t)) /**< 每个对象最多的页数，页数组不超过一页 */
+
+/// @{ @name mmap() 参数，取值与 Linux 相同
+#define PROT_READ            0x1
+#define PROT_WRITE           0x2
+#define MAP_SHARED           0x01                           /**< 只支持共享映射 */
+/// @}
+
+/**
+ * @brief 单生产者单消费者环形队列，放在共享内存中
+ *
+ * 队列由定长的项组成，项数为 2 的幂。tail 只由生产者写，head 只由消费者写，
+ * 两者在不同的缓存行，稳态下收发都不需要系统调用。
+ */
+struct shm_ring {
+    uint32_t head;                                          /**< 消费者已取走的项数 */
+    uint32_t __pad0[15];
+    uint32_t tail;                                          /**< 生产者已写入的项数 */
+    uint32_t __pad1[15];
+    uint32_t mask;                                          /**< 项数 - 1 */
+    uint32_t entry_size;                                    /**< 每项的字节数 */
+    uint32_t __pad2[14];
+    char entries[];
+};
+
+/**
+ * @brief 在 size 字节的共享内存上建立空队列，由一方在另一方使用之前调用
+ *
+ * @return 放不下一项时返回 NULL
+ */
+static inline struct shm_ring *shm_ring_init(void *mem, uint64_t size, uint32_t entry_size)
+{
+    struct shm_ring *ring = mem;
+    if (!entry_size || size < sizeof(struct shm_ring) + entry_size) {
+        return NULL;
+    }
+    uint64_t nr = (size - sizeof(struct shm_ring)) / entry_size;
+    uint32_t entries = 1;
+    while ((uint64_t)entries * 2 <= nr) {
+        entries *= 2;
+    }
+    ring->head = ring->tail = 0;
+    ring->mask = entries - 1;
+    ring->entry_size = entry_size;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return ring;
+}
+
+/**
+ * @brief 生产者取下一个空闲项
+ *
+ * @return 队列已满时返回 NULL
+ */
+static inline void *shm_ring_reserve(struct shm_ring *ring)
+{
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (ring->tail - head > ring->mask) {
+        return NULL;
+    }
+    return ring->entries + (uint64_t)(ring->tail & ring->mask) * ring->entry_size;
+}
+
+/** 生产者提交 shm_ring_reserve() 取得的项 */
+static inline void shm_ring_commit(struct shm_ring *ring)
+{
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 消费者取最早的一项，不移动 head
+ *
+ * @return 队列为空时返回 NULL
+ */
+static inline void *shm_ring_peek(struct shm_ring *ring)
+{
+    if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == ring->head) {
+        return NULL;
+    }
+    return ring->entries + (uint64_t)(ring->head & ring->mask) * ring->entry_size;
+}
+
+/** 消费者释放 shm_ring_peek() 取得的项 */
+static inline void shm_ring_release(struct shm_ring *ring)
+{
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+struct mm_struct;
+
+uint64_t in_shm_area(struct mm_struct *mm, uint64_t addr);
+int64_t copy_shm_areas(struct mm_struct *to, struct mm_struct *from);
+void shm_fork(struct mm_struct *mm);
+void exit_shm_areas(struct mm_struct *mm);
+
+#endif /* end of include guard: __SHM_H__ */
@@ -4,12 +4,16 @@
  */
 #ifndef __SYSCALL_H__
 #define __SYSCALL_H__
+/* 本文件也被 trapentry.S 包含，C 语言声明需放在 __ASSEMBLER__ 之外 */
+#ifndef __ASSEMBLER__
 #include <trap.h>
 typedef long (*fn_ptr)(struct trapframe *);                 /**< 系统调用指针类型 */
 extern fn_ptr syscall_table[];
+extern const uint8_t syscall_need_full_frame[];
 extern long test_fork;
+#endif
 /// @{ @name 系统调用号
-#define NR_syscalls  13                                     /**< 系统调用数量 */
+#define NR_syscalls  60                                     /**< 系统调用数量 */
 #define NR_fork      1
 #define NR_test_fork 2
 #define NR_getpid    3
@@ -22,8 +26,57 @@ extern long test_fork;
 #define NR_read  10
 #define NR_reset 11
 #define NR_usleep 12
+#define NR_nanosleep  13
+#define NR_setitimer  14
+#define NR_getitimer  15
+#define NR_clock_gettime 16
+#define NR_sched_yield 17
+#define NR_sched_setscheduler 18
+#define NR_sched_getscheduler 19
+#define NR_getrusage  20
+#define NR_times      21
+#define NR_sched_stats 22
+#define NR_exit       23
+#define NR_waitpid    24
+#define NR_execve     25
+#define NR_clone      26
+#define NR_exit_group 27
+#define NR_gettid     28
+#define NR_futex      29
+#define NR_io_uring_setup 30
+#define NR_io_uring_enter 31
+#define NR_syscall_stats 32
+#define NR_write     33
+#define NR_lseek     34
+#define NR_dup       35
+#define NR_readv     36
+#define NR_writev    37
+#define NR_preadv    38
+#define NR_pwritev   39
+#define NR_pread     40
+#define NR_pwrite    41
+#define NR_poll      42
+#define NR_epoll_create 43
+#define NR_epoll_ctl 44
+#define NR_epoll_wait 45
+#define NR_pipe2     46
+#define NR_splice    47
+#define NR_vmsplice  48
+#define NR_shm_open  49
+#define NR_shm_unlink 50
+#define NR_mmap      51
+#define NR_munmap    52
+#define NR_ipc_port_create 53
+#define NR_ipc_send  54
+#define NR_ipc_call  55
+#define NR_ipc_receive 56
+#define NR_ipc_reply 57
+#define NR_ipc_reply_wait 58
+#define NR_sched_switch_mode 59
 /// @}
 
+#ifndef __ASSEMBLER__
 long syscall(long number, ...);
+#endif
 
 #endif /* end of include guard: __SYSCALL_H__ */
@@ -0,0 +1,106 @@
+/**
+ * @file syscall_stats.h
+ * @brief 声明系统调用统计和跟踪
+ *
+ * 打开统计后，每次系统调用返回时按系统调用号累计调用次数、出错次数（返回负值）、
+ * 总耗时、最大耗时和耗时直方图，全系统一份，每个进程一份。耗时用 rdtime 测量，
+ * 从开中断执行系统调用开始到系统调用返回为止，包括其间睡眠和被抢占的时间。
+ *
+ * 跟踪模式把指定进程（或线程组）的每次系统调用记录到环形缓冲区，读取时每条记录
+ * 打印一行，缓冲区满时覆盖最早的记录。
+ *
+ * 统计和跟踪默认关闭，关闭时系统调用路径上只多一次判断。不返回的 exit() 和
+ * exit_group() 不会被统计；成功的 execve() 已重置寄存器，跟踪记录中的参数为 0。
+ *
+ * 用法：
+ * ```
+ *     syscall(NR_syscall_stats, SYSCALL_STATS_ON, 0);
+ *     ...
+ *     syscall(NR_syscall_stats, SYSCALL_STATS_DUMP, 0);     // 全系统
+ *     syscall(NR_syscall_stats, SYSCALL_STATS_DUMP, pid);   // 单个进程
+ *     syscall(NR_syscall_stats, SYSCALL_TRACE, pid);
+ *     ...
+ *     syscall(NR_syscall_stats, SYSCALL_TRACE_DUMP, 0);
+ * ```
+ */
+#ifndef __SYSCALL_STATS_H__
+#define __SYSCALL_STATS_H__
+
+#include <stddef.h>
+#include <syscall.h>
+#include <sched.h>
+#include <clock.h>
+#include <mm.h>
+
+/// @{ @name syscall_stats() 命令
+#define SYSCALL_STATS_OFF    0              /**< 停止统计 */
+#define SYSCALL_STATS_ON     1              /**< 开始统计 */
+#define SYSCALL_STATS_RESET  2              /**< 清空全系统和所有进程的统计以及跟踪缓冲区 */
+#define SYSCALL_STATS_DUMP   3              /**< 打印统计，参数为 PID，0 表示全系统 */
+#define SYSCALL_TRACE        4              /**< 跟踪参数指定的进程，参数为线程组 ID 时跟踪整个线程组，0 表示停止跟踪 */
+#define SYSCALL_TRACE_DUMP   5              /**< 打印并清空跟踪缓冲区 */
+/// @}
+
+#define SYSCALL_HIST_BUCKETS SCHED_HIST_BUCKETS    /**< 耗时直方图桶数，划分同 hist_bucket() */
+#define SYSCALL_TRACE_SIZE   128                   /**< 跟踪缓冲区的记录数，必须是 2 的幂 */
+
+/** 一个系统调用号的统计，时间均为时钟周期数 */
+struct syscall_stat {
+    uint32_t count;                         /**< 调用次数 */
+    uint32_t errors;                        /**< 返回负值的次数 */
+    uint64_t total;                         /**< 总耗时 */
+    uint64_t max;                           /**< 最大耗时 */
+    uint32_t hist[SYSCALL_HIST_BUCKETS];    /**< 耗时直方图 */
+};
+
+/** 每段统计的系统调用号数，一段不超过一页 */
+#define SYSCALL_STATS_PER_PART (PAGE_SIZE / sizeof(struct syscall_stat))
+/** 统计的段数 */
+#define SYSCALL_STATS_PARTS ((NR_syscalls + SYSCALL_STATS_PER_PART - 1) / SYSCALL_STATS_PER_PART)
+
+/**
+ * 按系统调用号分段的统计，kmalloc() 一次不能分配超过一页。每个进程的一份在
+ * 第一次统计时分配，各段在段内的系统调用第一次被统计时分配。
+ */
+struct syscall_stats {
+    struct syscall_stat *part[SYSCALL_STATS_PARTS];     /**< 未分配的段为 NULL */
+};
+
+/**
+ * @brief 取系统调用号 nr 的统计
+ *
+ * @return 所在的段未分配时返回 NULL
+ */
+static inline struct syscall_stat *syscall_stat_of(const struct syscall_stats *stats, uint64_t nr)
+{
+    struct syscall_stat *part = stats->part[nr / SYSCALL_STATS_PER_PART];
+    return part ? &part[nr % SYSCALL_STATS_PER_PART] : NULL;
+}
+
+/** 一条跟踪记录 */
+struct syscall_trace_entry {
+    uint64_t stamp;                         /**< 系统调用开始的时间（时钟周期数） */
+    uint32_t pid;                           /**< 线程 ID */
+    uint32_t nr;                            /**< 系统调用号 */
+    uint64_t args[3];                       /**< 前三个参数 */
+    int64_t  ret;                           /**< 返回值 */
+    uint64_t latency;                       /**< 耗时（时钟周期数） */
+};
+
+extern uint64_t syscall_stats_enabled;
+extern uint32_t syscall_trace_pid;
+
+/**
+ * @brief 系统调用开始时调用
+ *
+ * @return 统计和跟踪都关闭时返回 0，否则返回当前时间，传给 syscall_stats_end()
+ */
+static inline uint64_t syscall_stats_begin()
+{
+    return syscall_stats_enabled || syscall_trace_pid ? get_cycles() : 0;
+}
+
+void syscall_stats_end(uint64_t nr, const struct trapframe *tf, uint64_t start, long ret);
+void syscall_stats_release(struct task_struct *p);
+
+#endif /* end of include guard: __SYSCALL_STATS_H__ */
@@ -0,0 +1,67 @@
+/**
+ * @file timer.h
+ * @brief 声明内核定时器接口
+ *
+ * 定时器以 rdtime 读出的绝对时钟周期数作为到期时间，由分层时间轮管理，
+ * 添加和删除定时器都是 O(1) 的。定时器回调函数在时钟中断中执行，此时中断
+ * 处于关闭状态，回调函数不能睡眠。
+ *
+ * 用法：
+ * ```
+ *     struct timer_list timer;
+ *     init_timer(&timer, callback, data);
+ *     timer_mod(&timer, get_cycles() + usec_to_cycles(1000));
+ *     timer_del(&timer);
+ * ```
+ */
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#include <stddef.h>
+#include <clock.h>
+#include <utils/linked_list.h>
+
+struct task_struct;
+
+/** 内核定时器 */
+struct timer_list {
+    struct linked_list_node entry;                 /**< 时间轮槽位链表节点，未挂入时间轮时 next 为 NULL */
+    uint64_t expires;                              /**< 到期时间（时钟周期数） */
+    void (*function)(struct timer_list *timer);    /**< 到期回调函数 */
+    uint64_t data;                                 /**< 回调函数私有数据 */
+};
+
+/// @{ @name 间隔定时器
+#define ITIMER_REAL 0                              /**< 以真实时间计时，目前只支持这一种 */
+
+struct itimerval {
+    struct timeval it_interval;                    /**< 周期，为 0 表示单次定时器 */
+    struct timeval it_value;                       /**< 距离下一次到期的时间，为 0 表示关闭定时器 */
+};
+/// @}
+
+static inline void init_timer(struct timer_list *timer, void (*function)(struct timer_list *), uint64_t data)
+{
+    timer->entry.next = NULL;
+    timer->entry.prev = NULL;
+    timer->expires = 0;
+    timer->function = function;
+    timer->data = data;
+}
+
+/** 定时器是否在时间轮中等待到期 */
+static inline uint64_t timer_pending(const struct timer_list *timer)
+{
+    return timer->entry.next != NULL;
+}
+
+void timers_init();
+void timer_add(struct timer_list *timer);
+uint64_t timer_del(struct timer_list *timer);
+uint64_t timer_mod(struct timer_list *timer, uint64_t expires);
+void timer_run(uint64_t now);
+uint64_t timer_next_event();
+uint64_t sleep_until(uint64_t deadline);
+void it_real_fn(struct timer_list *timer);
+
+#endif /* end of include guard: __TIMER_H__ */
@@ -60,8 +60,12 @@ struct trapframe {
 extern void set_stack(char *stack);
 extern void __trapret();
 extern void __alltraps();
+extern void __vectors();
 
 struct trapframe * trap(struct trapframe *tf);
+struct trapframe * timer_interrupt_handler(struct trapframe *tf);
+struct trapframe * external_interrupt_handler(struct trapframe *tf);
+long syscall_fast_handler(struct trapframe *tf);
 void set_stvec();
 void print_trapframe(struct trapframe *tf);
 void print_regs(struct pushregs *gpr);
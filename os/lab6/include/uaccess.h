@@ -0,0 +1,143 @@
+/**
+ * @file uaccess.h
+ * @brief 声明内核访问用户内存的函数
+ *
+ * 系统调用不能直接解引用用户传入的指针：地址可能指向内核、未映射的区域或
+ * 只读页。这里的函数先用 access_ok() 检查地址范围，再用 kernel/uaccess.S 中
+ * 的汇编函数拷贝；拷贝中的缺页异常先由 do_page_fault() 处理（按需调页、写时
+ * 复制），无法处理时经异常修复表返回失败，不会使内核崩溃。
+ *
+ * 用法：
+ * ```
+ *     struct timespec ts;
+ *     if (copy_from_user(&ts, uptr, sizeof(ts))) {
+ *         return -EFAULT;
+ *     }
+ * ```
+ */
+#ifndef __UACCESS_H__
+#define __UACCESS_H__
+
+#include <stddef.h>
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+
+/** 异常修复表项，由 uaccess.S 中的 USER 宏生成 */
+struct exception_table_entry {
+    uint64_t insn;                          /**< 可能出错的指令地址 */
+    uint64_t fixup;                         /**< 出错后继续执行的地址 */
+};
+
+extern const struct exception_table_entry __start___ex_table[];
+extern const struct exception_table_entry __stop___ex_table[];
+
+uint64_t __copy_user(void *to, const void *from, uint64_t n);
+int64_t __strncpy_from_user(char *dst, const char *src, int64_t count);
+uint64_t __strnlen_user(const char *s, uint64_t n);
+
+/**
+ * @brief [addr, addr + size) 是否在用户地址空间内
+ */
+static inline uint64_t access_ok(const void *addr, uint64_t size)
+{
+    uint64_t start = (uint64_t)addr;
+    return start + size >= start && start + size <= START_KERNEL;
+}
+
+/**
+ * @brief 从内核拷贝 n 字节到用户内存
+ *
+ * @return 未能拷贝的字节数，成功时返回 0
+ */
+static inline uint64_t copy_to_user(void *to, const void *from, uint64_t n)
+{
+    if (!access_ok(to, n)) {
+        return n;
+    }
+    return __copy_user(to, from, n);
+}
+
+/**
+ * @brief 从用户内存拷贝 n 字节到内核，未能拷贝的部分清零
+ *
+ * @return 未能拷贝的字节数，成功时返回 0
+ */
+static inline uint64_t copy_from_user(void *to, const void *from, uint64_t n)
+{
+    uint64_t left = access_ok(from, n) ? __copy_user(to, from, n) : n;
+    if (left) {
+        memset((char *)to + n - left, 0, left);
+    }
+    return left;
+}
+
+/**
+ * @brief 从用户内存拷贝以 '\0' 结尾的字符串
+ *
+ * @param dst 内核缓冲区
+ * @param src 用户态字符串
+ * @param count 最多拷贝的字节数，含 '\0'
+ * @return 字符串长度（不含 '\0'）；前 count 字节中没有 '\0' 时返回 count，dst 不以
+ *         '\0' 结尾；地址无效时返回 -EFAULT
+ */
+static inline int64_t strncpy_from_user(char *dst, const char *src, int64_t count)
+{
+    uint64_t addr = (uint64_t)src;
+    if (addr >= START_KERNEL) {
+        return -EFAULT;
+    }
+    if (count > 0 && (uint64_t)count > START_KERNEL - addr) {
+        count = START_KERNEL - addr;
+    }
+    return __strncpy_from_user(dst, src, count);
+}
+
+/**
+ * @brief 求用户态字符串的长度
+ *
+ * @param s 用户态字符串
+ * @param n 最多检查的字节数
+ * @return 字符串长度（含 '\0'）；前 n 字节中没有 '\0' 时返回大于 n 的值；地址无效时返回 0
+ */
+static inline uint64_t strnlen_user(const char *s, uint64_t n)
+{
+    uint64_t addr = (uint64_t)s;
+    if (addr >= START_KERNEL) {
+        return 0;
+    }
+    uint64_t limit = n < START_KERNEL - addr ? n : START_KERNEL - addr;
+    uint64_t len = __strnlen_user(s, limit);
+    /* 字符串延伸到内核地址空间 */
+    return len > limit && limit < n ? 0 : len;
+}
+
+/**
+ * @brief 读一个用户态变量
+ *
+ * @param x 写入读到的值
+ * @param ptr 用户态地址，类型决定读的大小
+ * @return 成功返回 0，失败返回 -EFAULT
+ */
+#define get_user(x, ptr)                                                    \
+({                                                                          \
+    uint64_t __gu_buf[(sizeof(*(ptr)) + 7) / 8];                            \
+    int64_t __gu_err = copy_from_user(__gu_buf, (ptr), sizeof(*(ptr))) ? -EFAULT : 0; \
+    (x) = *(const __typeof__(*(ptr)) *)__gu_buf;                            \
+    __gu_err;                                                               \
+})
+
+/**
+ * @brief 写一个用户态变量
+ *
+ * @param x 要写的值
+ * @param ptr 用户态地址，类型决定写的大小
+ * @return 成功返回 0，失败返回 -EFAULT
+ */
+#define put_user(x, ptr)                                                    \
+({                                                                          \
+    __typeof__(*(ptr)) __pu_val = (x);                                      \
+    copy_to_user((ptr), &__pu_val, sizeof(*(ptr))) ? -EFAULT : 0;           \
+})
+
+#endif /* end of include guard: __UACCESS_H__ */
@@ -0,0 +1,77 @@
+#ifndef BITOPS_H
+#define BITOPS_H
+
+#include <stddef.h>
+
+/*
+ * 位运算工具函数
+ *
+ * RV64GC 没有 Zbb 扩展，__builtin_ctzll() 等内建函数会被编译为 libgcc 调用，
+ * 而内核不链接 libgcc，因此这里使用 DeBruijn 序列实现。
+ */
+
+/* DeBruijn序列 */
+static const uint8_t debruijn[64] = {
+    63,  0, 58,  1, 59, 47, 53,  2,
+    60, 39, 48, 27, 54, 33, 42,  3,
+    61, 51, 37, 40, 49, 18, 28, 20,
+    55, 30, 34, 11, 43, 14, 22,  4,
+    62, 57, 46, 52, 38, 26, 32, 41,
+    50, 36, 17, 19, 29, 10, 13, 21,
+    56, 45, 25, 31, 35, 16,  9, 12,
+    44, 24, 15,  8, 23,  7,  6,  5
+};
+
+/**
+ * @brief 快速log2(向上取整)
+ *
+ * 计算下一个大于n的2的幂次(向上取整)，如n = 9 <= 2 ** 4，返回4。
+ *
+ * @param n   64位无符号整数
+ * @return ceil(log2(n))
+ * @note n = 0 时返回 63
+ */
+static inline uint8_t q_log2_ceil(uint64_t n) {
+    n -= 1;
+    n |= n >> 1;
+    n |= n >> 2;
+    n |= n >> 4;
+    n |= n >> 8;
+    n |= n >> 16;
+    n |= n >> 32;
+    return debruijn[((uint64_t)((n + 1) * 0x07EDD5E59A4E28C2)) >> 58];
+}
+
+/**
+ * @brief 快速计算素因子中所含2的个数
+ *
+ * 设n = (2*k+1) * 2 ** p，返回p。也就是 n 最低的置位比特的下标。
+ *
+ * @param n   64位无符号整数
+ * @return 素因子中所含2的个数
+ * @note n = 0 时返回 63
+ */
+static inline uint8_t q_pow2_factor(uint64_t n) {
+    return debruijn[((uint64_t)((n & -n) * 0x07EDD5E59A4E28C2)) >> 58];
+}
+
+/**
+ * @brief 快速log2(向下取整)
+ *
+ * 即 n 最高的置位比特的下标，如n = 9，返回3。
+ *
+ * @param n   64位无符号整数
+ * @return floor(log2(n))
+ * @note n = 0 时返回 63
+ */
+static inline uint8_t q_log2_floor(uint64_t n) {
+    n |= n >> 1;
+    n |= n >> 2;
+    n |= n >> 4;
+    n |= n >> 8;
+    n |= n >> 16;
+    n |= n >> 32;
+    return q_pow2_factor(n - (n >> 1));
+}
+
+#endif
@@ -0,0 +1,74 @@
+/**
+ * @file vdso.h
+ * @brief 声明 vDSO：映射到每个用户地址空间的数据页和代码页
+ *
+ * 读取 PID、PPID、时间这类只读取一个字段的系统调用，开销主要在陷入和返回。
+ * 内核把一个只读的数据页和一个只读可执行的代码页映射到每个用户地址空间的固定地址：
+ * - 数据页属于地址空间，记录进程的 PID、PPID、CPU 编号和计时参数，由内核更新；
+ * - 代码页位于内核映像中，所有进程共享，其中的函数读取数据页和 rdtime，不进入内核。
+ *
+ * 代码页开头是跳转表，用户程序用 VDSO_CALL() 按偏移调用：
+ * ```
+ *     long pid = ((long (*)(void))VDSO_CALL(VDSO_GETPID))();
+ *     struct timespec ts;
+ *     ((long (*)(long, struct timespec *))VDSO_CALL(VDSO_CLOCK_GETTIME))(CLOCK_MONOTONIC, &ts);
+ * ```
+ *
+ * 数据页中的计时参数由顺序锁保护：内核更新前后各把 seq 加一，读者在 seq 为偶数且
+ * 读取前后 seq 不变时才使用读到的值。
+ *
+ * 数据页描述创建地址空间的进程，CLONE_VM 但不带 CLONE_THREAD 创建的进程与创建者
+ * 共享数据页，只能用系统调用获取自己的 PID。
+ */
+#ifndef __VDSO_H__
+#define __VDSO_H__
+
+/* 本文件也被 vdso_text.S 包含，C 语言声明需放在 __ASSEMBLER__ 之外 */
+#define VDSO_BASE            0xBF000000                     /**< 数据页地址，START_KERNEL 之下 16M，用户栈 VMA 之下 */
+#define VDSO_DATA            VDSO_BASE
+#define VDSO_TEXT            (VDSO_BASE + 0x1000)           /**< 代码页地址 */
+#define VDSO_END             (VDSO_BASE + 0x2000)
+
+/// @{ @name 数据页各字段的偏移，与 struct vdso_data 一致，供 vdso_text.S 使用
+#define VDSO_DATA_SEQ        0
+#define VDSO_DATA_PID        4
+#define VDSO_DATA_PPID       8
+#define VDSO_DATA_CPU        12
+#define VDSO_DATA_FREQ       16
+#define VDSO_DATA_MULT       24
+#define VDSO_DATA_RT_OFFSET  32
+/// @}
+
+/// @{ @name 跳转表中各函数的偏移
+#define VDSO_GETPID          0                              /**< long getpid(void) */
+#define VDSO_GETPPID         4                              /**< long getppid(void) */
+#define VDSO_GETCPU          8                              /**< long getcpu(void) */
+#define VDSO_CLOCK_GETTIME   12                             /**< long clock_gettime(long clk_id, struct timespec *tp) */
+/// @}
+
+#define VDSO_CALL(offset)    ((void *)(VDSO_TEXT + (offset)))
+
+#ifndef __ASSEMBLER__
+#include <stddef.h>
+
+struct mm_struct;
+struct task_struct;
+
+/** vDSO 数据页 */
+struct vdso_data {
+    uint32_t seq;                                           /**< 顺序锁，奇数表示内核正在更新 */
+    uint32_t pid;                                           /**< 线程组 ID */
+    uint32_t ppid;                                          /**< 父进程的线程组 ID */
+    uint32_t cpu;                                           /**< CPU 编号 */
+    uint64_t timebase_freq;                                 /**< rdtime 的计数频率（Hz） */
+    uint64_t cyc2ns_mult;                                   /**< 纳秒 = 时钟周期数 * cyc2ns_mult >> 32 */
+    uint64_t realtime_offset;                               /**< CLOCK_REALTIME 与 CLOCK_MONOTONIC 之差（纳秒） */
+};
+
+void vdso_map(struct mm_struct *mm, uint64_t page);
+void vdso_fork(struct mm_struct *mm, uint64_t page);
+void vdso_update_ids(struct task_struct *p);
+void vdso_update_clock(struct vdso_data *vd);
+#endif
+
+#endif /* end of include guard: __VDSO_H__ */
@@ -0,0 +1,53 @@
+/**
+ * @file vma.h
+ * @brief 声明虚拟内存区域（VMA）、缺页处理和页缓存
+ *
+ * 由 execve() 加载的进程用一组 VMA 描述用户地址空间。每个 VMA 是一段按页对齐、
+ * 访问权限相同的虚拟地址，由文件映射（代码段、数据段）或匿名映射（.bss、栈）。
+ * 建立 VMA 时不分配物理页，第一次访问时由缺页异常按需调入：
+ * - 只读的文件映射页来自页缓存，运行同一程序的进程共享同一物理页；
+ * - 可写的文件映射页是私有副本，超出文件内容的部分清零；
+ * - 匿名映射页是清零的物理页。
+ *
+ * 没有 VMA 的进程（进程 0 及其派生的运行内核映像的进程）保持原来的行为，
+ * 缺页异常只处理数据段的写时复制。
+ *
+ * VMA 属于地址空间 mm_struct，同一线程组的线程共享。
+ */
+#ifndef __VMA_H__
+#define __VMA_H__
+
+#include <stddef.h>
+#include <fs/vfs.h>
+#include <utils/linked_list.h>
+
+struct mm_struct;
+
+/// @{ @name VMA 访问权限
+#define VM_READ              0x1
+#define VM_WRITE             0x2
+#define VM_EXEC              0x4
+/// @}
+
+/** 虚拟内存区域 */
+struct vm_area_struct {
+    uint64_t vm_start;                      /**< 起始地址，按页对齐 */
+    uint64_t vm_end;                        /**< 结束地址（不含），按页对齐 */
+    uint64_t vm_flags;                      /**< 访问权限 */
+    struct vfs_inode *vm_file;              /**< 映射的文件，匿名映射为 NULL */
+    uint64_t vm_pgoff;                      /**< vm_start 对应的文件偏移，按页对齐 */
+    uint64_t vm_file_end;                   /**< 可写文件映射中文件内容的结束地址，之后的部分清零 */
+    struct linked_list_node vm_list;        /**< 进程 VMA 链表节点，按地址升序排列 */
+};
+
+struct vm_area_struct *find_vma(struct mm_struct *mm, uint64_t addr);
+int64_t insert_vma(struct mm_struct *mm, uint64_t start, uint64_t end, uint64_t flags,
+                   struct vfs_inode *file, uint64_t pgoff, uint64_t file_end);
+int64_t copy_vmas(struct mm_struct *to, struct mm_struct *from);
+void exit_vmas(struct mm_struct *mm);
+int64_t do_page_fault(uint64_t addr, uint64_t cause);
+void filemap_init();
+uint64_t filemap_get_page(struct vfs_inode *inode, uint64_t index);
+void filemap_update(struct vfs_inode *inode, uint64_t offset, uint64_t count);
+
+#endif /* end of include guard: __VMA_H__ */
@@ -0,0 +1,136 @@
+/**
+ * @file wait.h
+ * @brief 声明等待队列
+ *
+ * 等待队列由链表串起所有等待者，每个等待者是一个 wait_queue_entry，通常放在
+ * 等待进程的内核栈上。唤醒时按顺序调用各等待者的回调函数：非独占等待者全部
+ * 唤醒，独占等待者（WQ_FLAG_EXCLUSIVE）最多唤醒 nr_exclusive 个，避免多个进程
+ * 争抢同一资源时的惊群效应。
+ *
+ * 用法：
+ * ```
+ *     wait_event(wq, data_ready);   // 等待者
+ *
+ *     data_ready = 1;               // 唤醒者
+ *     wake_up(&wq);
+ * ```
+ * wait_event() 等宏使用了 current 和 schedule()，调用者需包含 sched.h。
+ */
+#ifndef __WAIT_H__
+#define __WAIT_H__
+
+#include <stddef.h>
+#include <riscv.h>
+#include <utils/linked_list.h>
+
+struct task_struct;
+struct wait_queue_entry;
+
+/**
+ * @brief 唤醒回调函数
+ * @return 是否真正唤醒了等待者，独占等待者只有返回非 0 时才计数
+ */
+typedef uint64_t (*wait_queue_func_t)(struct wait_queue_entry *wait);
+
+#define WQ_FLAG_EXCLUSIVE 0x01                      /**< 独占等待 */
+
+/** 等待者 */
+struct wait_queue_entry {
+    uint64_t flags;
+    struct task_struct *task;                       /**< 等待的进程 */
+    wait_queue_func_t func;                         /**< 唤醒回调函数 */
+    struct linked_list_node entry;                  /**< 等待队列链表节点 */
+};
+
+/** 等待队列头 */
+struct wait_queue_head {
+    struct linked_list_node task_list;
+};
+
+#define WAIT_QUEUE_HEAD_INITIALIZER(name) { .task_list = { &(name).task_list, &(name).task_list } }
+#define DECLARE_WAIT_QUEUE_HEAD(name) struct wait_queue_head name = WAIT_QUEUE_HEAD_INITIALIZER(name)
+
+uint64_t default_wake_function(struct wait_queue_entry *wait);
+
+static inline void init_waitqueue_head(struct wait_queue_head *wq)
+{
+    linked_list_init(&wq->task_list);
+}
+
+static inline void init_waitqueue_entry(struct wait_queue_entry *wait, struct task_struct *task)
+{
+    wait->flags = 0;
+    wait->task = task;
+    wait->func = default_wake_function;
+    linked_list_init(&wait->entry);
+}
+
+static inline void init_waitqueue_func_entry(struct wait_queue_entry *wait, wait_queue_func_t func)
+{
+    wait->flags = 0;
+    wait->task = NULL;
+    wait->func = func;
+    linked_list_init(&wait->entry);
+}
+
+/** 等待队列中是否有等待者 */
+static inline uint64_t waitqueue_active(struct wait_queue_head *wq)
+{
+    return !linked_list_empty(&wq->task_list);
+}
+
+void add_wait_queue(struct wait_queue_head *wq, struct wait_queue_entry *wait);
+void add_wait_queue_exclusive(struct wait_queue_head *wq, struct wait_queue_entry *wait);
+void remove_wait_queue(struct wait_queue_head *wq, struct wait_queue_entry *wait);
+void prepare_to_wait(struct wait_queue_head *wq, struct wait_queue_entry *wait, uint64_t state);
+void prepare_to_wait_exclusive(struct wait_queue_head *wq, struct wait_queue_entry *wait, uint64_t state);
+void finish_wait(struct wait_queue_head *wq, struct wait_queue_entry *wait);
+void __wake_up(struct wait_queue_head *wq, uint64_t nr_exclusive);
+
+#define wake_up(wq)     __wake_up((wq), 1)          /**< 唤醒所有非独占等待者和一个独占等待者 */
+#define wake_up_nr(wq, nr) __wake_up((wq), (nr))    /**< 唤醒所有非独占等待者和 nr 个独占等待者 */
+#define wake_up_all(wq) __wake_up((wq), 0)          /**< 唤醒所有等待者 */
+
+/**
+ * 检查条件前先将进程挂入等待队列并设置状态，唤醒发生在检查条件之后时进程
+ * 也会被置为 TASK_RUNNING，不会丢失唤醒。整个过程关闭中断，只在 schedule()
+ * 中切换到其他进程。
+ */
+#define __wait_event(wq, condition, state, prepare)                         \
+do {                                                                        \
+    struct wait_queue_entry __wait;                                         \
+    init_waitqueue_entry(&__wait, current);                                 \
+    uint64_t __flag = irq_save();                                           \
+    while (1) {                                                             \
+        prepare(&(wq), &__wait, (state));                                   \
+        if (condition)                                                      \
+            break;                                                          \
+        schedule();                                                         \
+    }                                                                       \
+    finish_wait(&(wq), &__wait);                                            \
+    irq_restore(__flag);                                                    \
+} while (0)
+
+/** 不可中断地等待，直到 condition 为真 */
+#define wait_event(wq, condition)                                           \
+do {                                                                        \
+    if (!(condition))                                                       \
+        __wait_event(wq, condition, TASK_UNINTERRUPTIBLE, prepare_to_wait); \
+} while (0)
+
+/** 可中断地等待，直到 condition 为真 */
+#define wait_event_interruptible(wq, condition)                             \
+do {                                                                        \
+    if (!(condition))                                                       \
+        __wait_event(wq, condition, TASK_INTERRUPTIBLE, prepare_to_wait);   \
+} while (0)
+
+/** 独占地等待，直到 condition 为真，每次唤醒只唤醒一个独占等待者 */
+#define wait_event_exclusive(wq, condition)                                 \
+do {                                                                        \
+    if (!(condition))                                                       \
+        __wait_event(wq, condition, TASK_UNINTERRUPTIBLE,                   \
+                     prepare_to_wait_exclusive);                            \
+} while (0)
+
+#endif /* end of include guard: __WAIT_H__ */
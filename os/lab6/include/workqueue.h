@@ -0,0 +1,79 @@
+/**
+ * @file workqueue.h
+ * @brief 声明工作队列和 tasklet 接口
+ *
+ * 中断处理函数（上半部）只应读取设备状态、应答中断，把其余工作推迟到下半部：
+ * - tasklet 在中断返回前执行，此时中断打开，不能睡眠，适合短小的处理；
+ * - 工作队列由内核线程执行，可以睡眠，适合耗时的处理。
+ *
+ * 用法：
+ * ```
+ *     struct work_struct work;
+ *     INIT_WORK(&work, work_func);
+ *     schedule_work(&work);         // 在系统工作队列中执行 work_func(&work)
+ *
+ *     struct tasklet_struct tasklet;
+ *     tasklet_init(&tasklet, tasklet_func, data);
+ *     tasklet_schedule(&tasklet);   // 在中断返回前执行 tasklet_func(data)
+ * ```
+ */
+#ifndef __WORKQUEUE_H__
+#define __WORKQUEUE_H__
+
+#include <stddef.h>
+#include <wait.h>
+#include <utils/linked_list.h>
+
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct *work);
+
+/** 工作 */
+struct work_struct {
+    struct linked_list_node entry;                  /**< 工作队列链表节点 */
+    work_func_t func;                               /**< 工作函数 */
+    uint64_t pending;                               /**< 是否已在工作队列中等待执行 */
+};
+
+/** 工作队列，每个工作队列有一个执行工作的内核线程 */
+struct workqueue_struct {
+    struct linked_list_node worklist;               /**< 等待执行的工作 */
+    struct wait_queue_head more_work;               /**< 内核线程在此等待新的工作 */
+    struct task_struct *worker;                     /**< 执行工作的内核线程 */
+};
+
+static inline void INIT_WORK(struct work_struct *work, work_func_t func)
+{
+    linked_list_init(&work->entry);
+    work->func = func;
+    work->pending = 0;
+}
+
+#define TASKLET_STATE_SCHED 0x01                    /**< 已在 tasklet 链表中等待执行 */
+
+/** tasklet，同一个 tasklet 不会同时执行多次 */
+struct tasklet_struct {
+    struct tasklet_struct *next;
+    uint64_t state;
+    void (*func)(uint64_t data);
+    uint64_t data;
+};
+
+static inline void tasklet_init(struct tasklet_struct *t, void (*func)(uint64_t), uint64_t data)
+{
+    t->next = NULL;
+    t->state = 0;
+    t->func = func;
+    t->data = data;
+}
+
+extern struct workqueue_struct *system_wq;
+
+void workqueue_init();
+struct workqueue_struct *create_workqueue();
+uint64_t queue_work(struct workqueue_struct *wq, struct work_struct *work);
+uint64_t schedule_work(struct work_struct *work);
+void tasklet_schedule(struct tasklet_struct *t);
+void tasklet_action();
+uint64_t in_softirq();
+
+#endif /* end of include guard: __WORKQUEUE_H__ */
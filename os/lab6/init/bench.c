@@ -0,0 +1,644 @@
+/**
+ * @file bench.c
+ * @brief 实现性能测试
+ *
+ * 用 rdtime 计时（用户态可读，见 clock_init()），多次重复取平均值。
+ */
+#include <bench.h>
+#include <clock.h>
+#include <syscall.h>
+#include <sched.h>
+#include <vdso.h>
+#include <io_uring.h>
+#include <fs/file.h>
+#include <fs/poll.h>
+#include <string.h>
+#include <shm.h>
+#include <ipc.h>
+#include <lib/stdio.h>
+
+#define BENCH_ROUNDS 10000                          /**< 每项测试重复次数 */
+#define CYCLIC_INTERVAL 1000                        /**< cyclictest 睡眠间隔（微秒） */
+#define CYCLIC_LOOPS 200                            /**< 实时进程 cyclictest 次数 */
+#define CYCLIC_LOOPS_NORMAL 20                      /**< 普通进程 cyclictest 次数，每次可能要等一个时间片 */
+#define CYCLIC_LOAD_SECONDS 8                       /**< 背景负载持续时间（秒） */
+#define IO_BENCH_BATCH 32                           /**< io_uring 每批提交的请求数 */
+#define IO_BENCH_ROUNDS 100                         /**< io_uring 块设备测试的批数 */
+#define RECORD_BENCH_COUNT 32                       /**< 分散读测试每批读的记录数 */
+#define RECORD_BENCH_SIZE 32                        /**< 分散读测试的记录大小（字节） */
+#define RECORD_BENCH_ROUNDS 1000                    /**< 分散读测试的批数 */
+#define POLL_BENCH_FDS 256                          /**< 就绪通知测试的描述符数 */
+#define POLL_BENCH_ROUNDS 1000                      /**< 就绪通知测试的次数 */
+#define PIPE_BENCH_CHUNK (16 * 4096)                /**< 管道测试每次写的字节数，整页对齐 */
+#define PIPE_BENCH_ROUNDS 64                        /**< 管道测试的写次数，共 4 MiB */
+#define SHM_BENCH_SIZE (4 * 4096)                   /**< 共享内存队列的大小 */
+#define SHM_BENCH_MSGS 20000                        /**< 共享内存测试的消息数，每条 8 字节 */
+#define IPC_BENCH_ROUNDS 10000                      /**< 端口 IPC 测试的往返次数 */
+
+/** io_uring 块设备测试的缓冲区，按扇区对齐，不跨页 */
+static char io_bench_buffers[IO_BENCH_BATCH][IORING_BLOCK_SIZE] __attribute__((aligned(IORING_BLOCK_SIZE)));
+/** 分散读测试的记录缓冲区 */
+static char record_bench_buffers[RECORD_BENCH_COUNT][RECORD_BENCH_SIZE];
+/** 就绪通知测试的描述符项 */
+static struct pollfd poll_bench_fds[POLL_BENCH_FDS];
+/** 管道测试的写缓冲区，页对齐以便 vmsplice() 整页交给管道 */
+static char pipe_bench_wbuf[PIPE_BENCH_CHUNK] __attribute__((aligned(4096)));
+/** 管道测试的读缓冲区 */
+static char pipe_bench_rbuf[PIPE_BENCH_CHUNK];
+
+/**
+ * @brief 空系统调用测试
+ *
+ * getpid() 走 trapentry.S 中的快速路径；越界的系统调用号走完整路径
+ * （SAVE_ALL、trap_dispatch()、syscall_handler()）并返回 -ENOSYS，两者的差值
+ * 就是快速路径节省的开销。syscall() 会拒绝越界的系统调用号，这里直接用 ecall。
+ */
+void bench_syscall()
+{
+    uint64_t start = get_cycles();
+    for (int i = 0; i < BENCH_ROUNDS; ++i) {
+        syscall(NR_getpid);
+    }
+    uint64_t fast_cycles = (get_cycles() - start) / BENCH_ROUNDS;
+
+    start = get_cycles();
+    for (int i = 0; i < BENCH_ROUNDS; ++i) {
+        register long a7 asm("a7") = NR_syscalls;
+        register long a0 asm("a0");
+        __asm__ __volatile__ ("ecall\n\t"
+                :"=r"(a0), "+r"(a7)
+                :
+                :"memory", "ra", "t0", "t1", "t2", "t3", "t4", "t5", "t6",
+                 "a1", "a2", "a3", "a4", "a5", "a6");
+    }
+    uint64_t slow_cycles = (get_cycles() - start) / BENCH_ROUNDS;
+
+    printf("null syscall (fast path): %u cycles, %u ns\n", fast_cycles, cycles_to_nsec(fast_cycles));
+    printf("null syscall (full path): %u cycles, %u ns\n", slow_cycles, cycles_to_nsec(slow_cycles));
+}
+
+/**
+ * @brief vDSO 与系统调用的对比测试
+ *
+ * 分别通过系统调用和 vDSO 代码页获取 PID 和 CLOCK_MONOTONIC 时间。
+ */
+void bench_vdso()
+{
+    long (*vdso_getpid)(void) = VDSO_CALL(VDSO_GETPID);
+    long (*vdso_clock_gettime)(long, struct timespec *) = VDSO_CALL(VDSO_CLOCK_GETTIME);
+    struct timespec ts;
+    uint64_t cycles[4];
+
+    uint64_t start = get_cycles();
+    for (int i = 0; i < BENCH_ROUNDS; ++i) {
+        syscall(NR_getpid);
+    }
+    cycles[0] = (get_cycles() - start) / BENCH_ROUNDS;
+    start = get_cycles();
+    for (int i = 0; i < BENCH_ROUNDS; ++i) {
+        vdso_getpid();
+    }
+    cycles[1] = (get_cycles() - start) / BENCH_ROUNDS;
+    start = get_cycles();
+    for (int i = 0; i < BENCH_ROUNDS; ++i) {
+        syscall(NR_clock_gettime, CLOCK_MONOTONIC, &ts);
+    }
+    cycles[2] = (get_cycles() - start) / BENCH_ROUNDS;
+    start = get_cycles();
+    for (int i = 0; i < BENCH_ROUNDS; ++i) {
+        vdso_clock_gettime(CLOCK_MONOTONIC, &ts);
+    }
+    cycles[3] = (get_cycles() - start) / BENCH_ROUNDS;
+
+    if (vdso_getpid() != syscall(NR_getpid)) {
+        printf("vdso: getpid() mismatch\n");
+    }
+    printf("getpid() (syscall):        %u cycles, %u ns\n", cycles[0], cycles_to_nsec(cycles[0]));
+    printf("getpid() (vDSO):           %u cycles, %u ns\n", cycles[1], cycles_to_nsec(cycles[1]));
+    printf("clock_gettime() (syscall): %u cycles, %u ns\n", cycles[2], cycles_to_nsec(cycles[2]));
+    printf("clock_gettime() (vDSO):    %u cycles, %u ns\n", cycles[3], cycles_to_nsec(cycles[3]));
+}
+
+/**
+ * @brief fork() 出子进程，父子进程轮流调用 sched_yield()，返回每次 sched_yield() 的时钟周期数
+ *
+ * 父进程每调用一次都会切换到子进程再切换回来。
+ */
+static uint64_t yield_ping_pong()
+{
+    long pid = syscall(NR_fork);
+    if (!pid) {
+        for (int i = 0; i < BENCH_ROUNDS; ++i) {
+            syscall(NR_sched_yield);
+        }
+        syscall(NR_exit, 0);
+    }
+    uint64_t start = get_cycles();
+    for (int i = 0; i < BENCH_ROUNDS; ++i) {
+        syscall(NR_sched_yield);
+    }
+    uint64_t cycles = (get_cycles() - start) / (2 * BENCH_ROUNDS);
+    syscall(NR_waitpid, pid, NULL, 0);
+    return cycles;
+}
+
+/**
+ * @brief 进程切换 ping-pong 测试
+ *
+ * 先测空系统调用 getpid() 的开销，再分别用优化前经完整 trapframe 切换的
+ * __switch_full() 和只保存 callee-saved 寄存器的 __switch() 做 sched_yield()
+ * ping-pong。每次切换的开销约为一次 sched_yield() 减去一次空系统调用。
+ */
+void bench_context_switch()
+{
+    uint64_t start = get_cycles();
+    for (int i = 0; i < BENCH_ROUNDS; ++i) {
+        syscall(NR_getpid);
+    }
+    uint64_t syscall_cycles = (get_cycles() - start) / BENCH_ROUNDS;
+
+    const char *names[] = { "full trapframe", "callee-saved" };
+    uint64_t modes[] = { SWITCH_FULL_FRAME, SWITCH_CALLEE_SAVED };
+    printf("getpid():      %u cycles, %u ns\n", syscall_cycles, cycles_to_nsec(syscall_cycles));
+    for (int i = 0; i < 2; ++i) {
+        syscall(NR_sched_switch_mode, modes[i]);
+        uint64_t yield_cycles = yield_ping_pong();
+        printf("%s: sched_yield() %u cycles, %u ns", names[i], yield_cycles, cycles_to_nsec(yield_cycles));
+        if (yield_cycles > syscall_cycles) {
+            printf(", context switch %u cycles, %u ns", yield_cycles - syscall_cycles,
+                   cycles_to_nsec(yield_cycles - syscall_cycles));
+        }
+        printf("\n");
+    }
+    syscall(NR_sched_switch_mode, SWITCH_CALLEE_SAVED);
+}
+
+/**
+ * @brief 测量 loops 次 usleep() 的唤醒延迟并打印最小、平均、最大值
+ */
+static void cyclic_measure(const char *name, int loops)
+{
+    uint64_t min = -1, max = 0, sum = 0;
+    for (int i = 0; i < loops; ++i) {
+        uint64_t expected = get_cycles() + usec_to_cycles(CYCLIC_INTERVAL);
+        syscall(NR_usleep, CYCLIC_INTERVAL);
+        uint64_t now = get_cycles();
+        uint64_t latency = now > expected ? now - expected : 0;
+        min = latency < min ? latency : min;
+        max = latency > max ? latency : max;
+        sum += latency;
+    }
+    printf("%s: min %u ns, avg %u ns, max %u ns\n", name, cycles_to_nsec(min),
+           cycles_to_nsec(sum / loops), cycles_to_nsec(max));
+}
+
+/**
+ * @brief cyclictest 风格的唤醒延迟测试
+ *
+ * fork() 出一个一直占用处理器的普通子进程作为背景负载，当前进程分别以
+ * SCHED_FIFO 和普通进程身份周期性地 usleep()，测量实际唤醒时间与预期唤醒
+ * 时间之差。实时进程被唤醒时立即抢占负载进程；普通进程要等负载进程的时间片
+ * 耗尽，延迟可达一个时间片。
+ */
+void bench_cyclictest()
+{
+    uint64_t load_end = get_cycles() + usec_to_cycles(CYCLIC_LOAD_SECONDS * USEC_PER_SEC);
+    long pid = syscall(NR_fork);
+    if (!pid) {
+        while (get_cycles() < load_end) {
+            syscall(NR_getpid);
+        }
+        syscall(NR_exit, 0);
+    }
+
+    struct sched_param param = { .sched_priority = 80 };
+    syscall(NR_sched_setscheduler, 0, SCHED_FIFO, &param);
+    cyclic_measure("cyclictest (SCHED_FIFO)", CYCLIC_LOOPS);
+    param.sched_priority = 0;
+    syscall(NR_sched_setscheduler, 0, SCHED_NORMAL, &param);
+    cyclic_measure("cyclictest (SCHED_NORMAL)", CYCLIC_LOOPS_NORMAL);
+    syscall(NR_waitpid, pid, NULL, 0);
+}
+
+/**
+ * @brief 用 io_uring 提交 nr 个请求并等待它们全部完成
+ *
+ * 块设备请求依次读写第 0 ~ nr - 1 个扇区。
+ *
+ * @return 失败的请求数
+ */
+static int io_bench_batch(uint8_t opcode, int nr)
+{
+    struct io_uring_rings *rings = IO_URING_RINGS;
+    for (int i = 0; i < nr; ++i) {
+        struct io_uring_sqe *sqe = io_uring_get_sqe(rings);
+        sqe->opcode = opcode;
+        sqe->off = i;
+        sqe->addr = (uint64_t)io_bench_buffers[i];
+        sqe->len = IORING_BLOCK_SIZE;
+        sqe->user_data = i;
+    }
+    io_uring_sq_advance(rings, nr);
+    uint32_t flags = IORING_ENTER_GETEVENTS;
+    if (__atomic_load_n(&rings->sq_flags, __ATOMIC_SEQ_CST) & IORING_SQ_NEED_WAKEUP) {
+        flags |= IORING_ENTER_SQ_WAKEUP;
+    }
+    syscall(NR_io_uring_enter, nr, nr, flags);
+    int errors = 0;
+    for (int i = 0; i < nr; ++i) {
+        struct io_uring_cqe *cqe = io_uring_peek_cqe(rings);
+        if (!cqe) {
+            return errors + nr - i;
+        }
+        errors += cqe->res < 0;
+        io_uring_cq_advance(rings, 1);
+    }
+    return errors;
+}
+
+/**
+ * @brief 在子进程中建立 io_uring 并测量每个请求的平均开销
+ *
+ * 队列属于地址空间，随子进程退出释放，shell 可以反复运行测试。
+ */
+static void io_bench_run(const char *name, uint32_t setup_flags)
+{
+    long pid = syscall(NR_fork);
+    if (pid) {
+        syscall(NR_waitpid, pid, NULL, 0);
+        return;
+    }
+    struct io_uring_params p = { .flags = setup_flags, .sq_thread_idle = 10 };
+    if (syscall(NR_io_uring_setup, IO_BENCH_BATCH, &p) < 0) {
+        printf("%s: io_uring_setup() failed\n", name);
+        syscall(NR_exit, 1);
+    }
+    int errors = 0;
+    uint64_t start = get_cycles();
+    for (int i = 0; i < BENCH_ROUNDS / IO_BENCH_BATCH; ++i) {
+        errors += io_bench_batch(IORING_OP_NOP, IO_BENCH_BATCH);
+    }
+    uint64_t nop_cycles = (get_cycles() - start) / (BENCH_ROUNDS / IO_BENCH_BATCH * IO_BENCH_BATCH);
+    start = get_cycles();
+    for (int i = 0; i < IO_BENCH_ROUNDS * IO_BENCH_BATCH; ++i) {
+        errors += io_bench_batch(IORING_OP_BLOCK_READ, 1);
+    }
+    uint64_t qd1_cycles = (get_cycles() - start) / (IO_BENCH_ROUNDS * IO_BENCH_BATCH);
+    start = get_cycles();
+    for (int i = 0; i < IO_BENCH_ROUNDS; ++i) {
+        errors += io_bench_batch(IORING_OP_BLOCK_READ, IO_BENCH_BATCH);
+    }
+    uint64_t batch_cycles = (get_cycles() - start) / (IO_BENCH_ROUNDS * IO_BENCH_BATCH);
+
+    printf("%s: nop (batch %u):        %u cycles, %u ns\n", name, IO_BENCH_BATCH, nop_cycles, cycles_to_nsec(nop_cycles));
+    printf("%s: block read (batch 1):  %u cycles, %u ns\n", name, qd1_cycles, cycles_to_nsec(qd1_cycles));
+    printf("%s: block read (batch %u): %u cycles, %u ns\n", name, IO_BENCH_BATCH, batch_cycles, cycles_to_nsec(batch_cycles));
+    if (errors) {
+        printf("%s: %u requests failed\n", name, errors);
+    }
+    syscall(NR_exit, 0);
+}
+
+/**
+ * @brief io_uring 批量提交测试
+ *
+ * 比较每个请求一次系统调用与一次 io_uring_enter() 批量提交的平均开销：空操作
+ * 对比 getpid()，块设备读对比每批只有一个请求。再用轮询线程提交一遍，提交不需要
+ * 陷入内核，io_uring_enter() 只用于等待完成。
+ */
+void bench_io_uring()
+{
+    uint64_t start = get_cycles();
+    for (int i = 0; i < BENCH_ROUNDS; ++i) {
+        syscall(NR_getpid);
+    }
+    uint64_t syscall_cycles = (get_cycles() - start) / BENCH_ROUNDS;
+    printf("io_uring: getpid():            %u cycles, %u ns\n", syscall_cycles, cycles_to_nsec(syscall_cycles));
+    io_bench_run("io_uring", 0);
+    io_bench_run("io_uring (SQPOLL)", IORING_SETUP_SQPOLL);
+}
+
+/**
+ * @brief 分散读测试
+ *
+ * 从 ramfs 中的 hello 文件读 RECORD_BENCH_COUNT 条连续的定长记录，每条记录放在
+ * 单独的缓冲区中：逐条 pread() 每批需要 RECORD_BENCH_COUNT 次系统调用，preadv()
+ * 只需要一次。
+ */
+void bench_readv()
+{
+    int fd = syscall(NR_open, "/hello", O_RDONLY);
+    if (fd < 0) {
+        printf("readv: fail to open /hello\n");
+        return;
+    }
+    struct iovec iov[RECORD_BENCH_COUNT];
+    for (int i = 0; i < RECORD_BENCH_COUNT; ++i) {
+        iov[i].iov_base = record_bench_buffers[i];
+        iov[i].iov_len = RECORD_BENCH_SIZE;
+    }
+
+    long bytes = 0;
+    uint64_t start = get_cycles();
+    for (int round = 0; round < RECORD_BENCH_ROUNDS; ++round) {
+        for (int i = 0; i < RECORD_BENCH_COUNT; ++i) {
+            bytes += syscall(NR_pread, fd, record_bench_buffers[i], RECORD_BENCH_SIZE, i * RECORD_BENCH_SIZE);
+        }
+    }
+    uint64_t pread_cycles = (get_cycles() - start) / RECORD_BENCH_ROUNDS;
+
+    start = get_cycles();
+    for (int round = 0; round < RECORD_BENCH_ROUNDS; ++round) {
+        bytes -= syscall(NR_preadv, fd, iov, RECORD_BENCH_COUNT, 0);
+    }
+    uint64_t preadv_cycles = (get_cycles() - start) / RECORD_BENCH_ROUNDS;
+    syscall(NR_close, fd);
+
+    if (bytes) {
+        printf("readv: pread() and preadv() read different lengths\n");
+    }
+    printf("readv: %u x %u-byte records, pread():  %u cycles, %u ns per batch (%u syscalls)\n",
+           (uint64_t)RECORD_BENCH_COUNT, (uint64_t)RECORD_BENCH_SIZE, pread_cycles,
+           cycles_to_nsec(pread_cycles), (uint64_t)RECORD_BENCH_COUNT);
+    printf("readv: %u x %u-byte records, preadv(): %u cycles, %u ns per batch (1 syscall)\n",
+           (uint64_t)RECORD_BENCH_COUNT, (uint64_t)RECORD_BENCH_SIZE, preadv_cycles,
+           cycles_to_nsec(preadv_cycles));
+}
+
+/**
+ * @brief 就绪通知测试
+ *
+ * 复制 POLL_BENCH_FDS 个控制台描述符，没有输入时它们都不就绪。不等待的 poll()
+ * 每次都要检查所有描述符，epoll_wait() 只检查就绪链表，代价与描述符数无关。
+ */
+void bench_poll()
+{
+    int ep = syscall(NR_epoll_create, 1);
+    if (ep < 0) {
+        printf("poll: fail to create epoll instance\n");
+        return;
+    }
+    int nfds = 0;
+    for (; nfds < POLL_BENCH_FDS; ++nfds) {
+        int fd = syscall(NR_dup, 0);
+        if (fd < 0) {
+            break;
+        }
+        poll_bench_fds[nfds].fd = fd;
+        poll_bench_fds[nfds].events = POLLIN;
+        struct epoll_event event = { .events = EPOLLIN, .data = fd };
+        if (syscall(NR_epoll_ctl, ep, EPOLL_CTL_ADD, fd, &event) < 0) {
+            syscall(NR_close, fd);
+            break;
+        }
+    }
+
+    uint64_t start = get_cycles();
+    for (int i = 0; i < POLL_BENCH_ROUNDS; ++i) {
+        syscall(NR_poll, poll_bench_fds, nfds, 0);
+    }
+    uint64_t poll_cycles = (get_cycles() - start) / POLL_BENCH_ROUNDS;
+
+    struct epoll_event events[8];
+    start = get_cycles();
+    for (int i = 0; i < POLL_BENCH_ROUNDS; ++i) {
+        syscall(NR_epoll_wait, ep, events, 8, 0);
+    }
+    uint64_t epoll_cycles = (get_cycles() - start) / POLL_BENCH_ROUNDS;
+
+    for (int i = 0; i < nfds; ++i) {
+        syscall(NR_close, poll_bench_fds[i].fd);
+    }
+    syscall(NR_close, ep);
+    printf("poll: %u idle console fds, poll():       %u cycles, %u ns\n",
+           (uint64_t)nfds, poll_cycles, cycles_to_nsec(poll_cycles));
+    printf("poll: %u idle console fds, epoll_wait(): %u cycles, %u ns\n",
+           (uint64_t)nfds, epoll_cycles, cycles_to_nsec(epoll_cycles));
+}
+
+/**
+ * @brief 向管道写 PIPE_BENCH_ROUNDS 次，子进程读到文件结束
+ *
+ * @param use_vmsplice 为 1 时用 vmsplice() 把页交给管道，否则用 write() 拷贝
+ */
+static void pipe_bench_run(const char *name, int use_vmsplice)
+{
+    int fds[2];
+    if (syscall(NR_pipe2, fds, 0) < 0) {
+        printf("%s: pipe2() failed\n", name);
+        return;
+    }
+    long pid = syscall(NR_fork);
+    if (!pid) {
+        syscall(NR_close, fds[1]);
+        while (syscall(NR_read, fds[0], pipe_bench_rbuf, PIPE_BENCH_CHUNK) > 0) {
+        }
+        syscall(NR_exit, 0);
+    }
+    syscall(NR_close, fds[0]);
+    /* fork() 之后写一遍，缓冲区换成本进程私有的、计引用的页 */
+    memset(pipe_bench_wbuf, 'p', PIPE_BENCH_CHUNK);
+
+    struct iovec iov = { .iov_base = pipe_bench_wbuf, .iov_len = PIPE_BENCH_CHUNK };
+    uint64_t total = 0;
+    uint64_t start = get_cycles();
+    for (int i = 0; i < PIPE_BENCH_ROUNDS; ++i) {
+        long n = use_vmsplice ? syscall(NR_vmsplice, fds[1], &iov, 1, 0) :
+                                syscall(NR_write, fds[1], pipe_bench_wbuf, PIPE_BENCH_CHUNK);
+        if (n <= 0) {
+            break;
+        }
+        total += n;
+    }
+    syscall(NR_close, fds[1]);
+    syscall(NR_waitpid, pid, NULL, 0);
+    uint64_t ns = cycles_to_nsec(get_cycles() - start);
+    printf("%s: %u KiB in %u us, %u KiB/s\n", name, total / 1024, ns / 1000,
+           ns ? total / 1024 * 1000000000 / ns : 0);
+}
+
+/**
+ * @brief 管道吞吐量测试
+ *
+ * 比较 write() 拷贝和 vmsplice() 交出整页两种方式向管道写入同样数据的耗时，
+ * 计时包括子进程读完所有数据。
+ */
+void bench_pipe()
+{
+    pipe_bench_run("pipe write()", 0);
+    pipe_bench_run("pipe vmsplice()", 1);
+}
+
+/**
+ * @brief 子进程接收 SHM_BENCH_MSGS 条 8 字节消息，返回接收的时钟周期数
+ *
+ * @param ring 为 NULL 时用管道 fds 收发，否则用共享内存队列；队列空或满时让出处理器
+ */
+static uint64_t shm_bench_run(struct shm_ring *ring, int fds[2])
+{
+    long pid = syscall(NR_fork);
+    if (!pid) {
+        uint64_t sum = 0, v;
+        for (int i = 0; i < SHM_BENCH_MSGS; ++i) {
+            if (ring) {
+                const uint64_t *slot;
+                while (!(slot = shm_ring_peek(ring))) {
+                    syscall(NR_sched_yield);
+                }
+                v = *slot;
+                shm_ring_release(ring);
+            } else if (syscall(NR_read, fds[0], &v, sizeof(v)) != sizeof(v)) {
+                syscall(NR_exit, 1);
+            }
+            sum += v;
+        }
+        syscall(NR_exit, sum == (uint64_t)SHM_BENCH_MSGS * (SHM_BENCH_MSGS - 1) / 2 ? 0 : 1);
+    }
+    int status = 0;
+    uint64_t start = get_cycles();
+    for (uint64_t i = 0; i < SHM_BENCH_MSGS; ++i) {
+        if (ring) {
+            uint64_t *slot;
+            while (!(slot = shm_ring_reserve(ring))) {
+                syscall(NR_sched_yield);
+            }
+            *slot = i;
+            shm_ring_commit(ring);
+        } else {
+            syscall(NR_write, fds[1], &i, sizeof(i));
+        }
+    }
+    syscall(NR_waitpid, pid, &status, 0);
+    uint64_t cycles = get_cycles() - start;
+    if (WEXITSTATUS(status)) {
+        printf("shm: consumer received wrong data\n");
+    }
+    return cycles;
+}
+
+/**
+ * @brief 共享内存队列测试
+ *
+ * 父子进程通过共享内存中的单生产者单消费者队列传递 8 字节消息，只在队列空或满时
+ * 调用 sched_yield()，与同样的消息经过管道比较。
+ */
+void bench_shm()
+{
+    int fd = syscall(NR_shm_open, "/bench_ring", O_RDWR | O_CREAT | O_EXCL, SHM_BENCH_SIZE);
+    if (fd < 0) {
+        printf("shm: shm_open() failed\n");
+        return;
+    }
+    long addr = syscall(NR_mmap, 0, SHM_BENCH_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    syscall(NR_shm_unlink, "/bench_ring");
+    syscall(NR_close, fd);
+    if (addr < 0) {
+        printf("shm: mmap() failed\n");
+        return;
+    }
+    struct shm_ring *ring = shm_ring_init((void *)addr, SHM_BENCH_SIZE, sizeof(uint64_t));
+    uint64_t ring_cycles = shm_bench_run(ring, NULL) / SHM_BENCH_MSGS;
+    syscall(NR_munmap, addr, SHM_BENCH_SIZE);
+
+    int fds[2];
+    if (syscall(NR_pipe2, fds, 0) < 0) {
+        printf("shm: pipe2() failed\n");
+        return;
+    }
+    uint64_t pipe_cycles = shm_bench_run(NULL, fds) / SHM_BENCH_MSGS;
+    syscall(NR_close, fds[0]);
+    syscall(NR_close, fds[1]);
+    printf("shm ring: %u cycles, %u ns per message\n", ring_cycles, cycles_to_nsec(ring_cycles));
+    printf("pipe:     %u cycles, %u ns per message\n", pipe_cycles, cycles_to_nsec(pipe_cycles));
+}
+
+/**
+ * @brief 端口 IPC 测试的服务进程，把 w[0] 加一后回复，w[1] 不为 0 时回复后退出
+ */
+static void ipc_bench_server(int port)
+{
+    struct ipc_msg msg;
+    long token = ipc_receive(port, &msg);
+    while (token > 0) {
+        uint64_t quit = msg.w[1];
+        ++msg.w[0];
+        if (quit) {
+            ipc_reply(token, &msg);
+            syscall(NR_exit, 0);
+        }
+        token = ipc_reply_wait(port, token, &msg);
+    }
+    syscall(NR_exit, 1);
+}
+
+/**
+ * @brief 测试同步 IPC 的往返延迟
+ *
+ * 子进程作为服务进程，父进程 ipc_call() IPC_BENCH_ROUNDS 次，服务进程每次都已在
+ * 端口上等待，收发双方都走直接切换。与两条管道上 8 字节消息的往返比较，管道的
+ * 每次往返要经过两次唤醒和两次 schedule()。
+ */
+void bench_ipc()
+{
+    int port = syscall(NR_ipc_port_create);
+    if (port < 0) {
+        printf("ipc: ipc_port_create() failed\n");
+        return;
+    }
+    long pid = syscall(NR_fork);
+    if (!pid) {
+        ipc_bench_server(port);
+    }
+    struct ipc_msg msg = { { 0, 0, 0, 0 } };
+    uint64_t value = 0, errors = 0;
+    uint64_t start = get_cycles();
+    for (int i = 0; i < IPC_BENCH_ROUNDS; ++i) {
+        msg.w[0] = value;
+        if (ipc_call(port, &msg) < 0 || msg.w[0] != value + 1) {
+            ++errors;
+        }
+        value = msg.w[0];
+    }
+    uint64_t ipc_cycles = (get_cycles() - start) / IPC_BENCH_ROUNDS;
+    msg.w[1] = 1;
+    ipc_call(port, &msg);
+    syscall(NR_waitpid, pid, NULL, 0);
+    syscall(NR_close, port);
+
+    int req[2], resp[2];
+    if (syscall(NR_pipe2, req, 0) < 0 || syscall(NR_pipe2, resp, 0) < 0) {
+        printf("ipc: pipe2() failed\n");
+        return;
+    }
+    pid = syscall(NR_fork);
+    if (!pid) {
+        uint64_t v;
+        for (int i = 0; i < IPC_BENCH_ROUNDS; ++i) {
+            syscall(NR_read, req[0], &v, sizeof(v));
+            ++v;
+            syscall(NR_write, resp[1], &v, sizeof(v));
+        }
+        syscall(NR_exit, 0);
+    }
+    value = 0;
+    start = get_cycles();
+    for (int i = 0; i < IPC_BENCH_ROUNDS; ++i) {
+        uint64_t v = value;
+        syscall(NR_write, req[1], &v, sizeof(v));
+        if (syscall(NR_read, resp[0], &v, sizeof(v)) != sizeof(v) || v != value + 1) {
+            ++errors;
+        }
+        value = v;
+    }
+    uint64_t pipe_cycles = (get_cycles() - start) / IPC_BENCH_ROUNDS;
+    syscall(NR_waitpid, pid, NULL, 0);
+    syscall(NR_close, req[0]);
+    syscall(NR_close, req[1]);
+    syscall(NR_close, resp[0]);
+    syscall(NR_close, resp[1]);
+    if (errors) {
+        printf("ipc: %u round trips returned wrong data\n", errors);
+    }
+    printf("ipc_call(): %u cycles, %u ns per round trip\n", ipc_cycles, cycles_to_nsec(ipc_cycles));
+    printf("pipe:       %u cycles, %u ns per round trip\n", pipe_cycles, cycles_to_nsec(pipe_cycles));
+}
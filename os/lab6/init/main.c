@@ -4,10 +4,17 @@
 #include <trap.h>
 #include <sched.h>
 #include <clock.h>
+#include <timer.h>
+#include <kthread.h>
+#include <workqueue.h>
+#include <bench.h>
 #include <syscall.h>
 #include <device/loader.h>
 #include <fs/vfs.h>
-#include <lib/sleep.h>
+#include <fs/file.h>
+#include <vma.h>
+#include <futex.h>
+#include <syscall_stats.h>
 #include <lib/stdio.h>
 
 int main(const char* args, const struct fdt_header *fdt)
@@ -21,10 +28,16 @@ int main(const char* args, const struct fdt_header *fdt)
     fdt_loader(fdt, driver_list);
     set_stvec();
     vfs_init();
+    filemap_init();
+    futex_init();
     sched_init();
+    console_init();
+    kthread_init();
+    reaper_init();
+    workqueue_init();
+    timers_init();
     clock_init();
     kputs("Hello LZU OS");
-    usleep_queue_init();
 
     enable_interrupt();
     init_task0();
@@ -71,36 +84,86 @@ int main(const char* args, const struct fdt_header *fdt)
                 syscall(NR_reset, 0);   // #define SHUTDOWN_FUNCTION 0
             } else if (!strcmp(buffer, "r")) {
                 syscall(NR_reset, 1);   // #define REBOOT_FUNCTION 1
+            } else if (!strcmp(buffer, "bench")) {
+                bench_syscall();
+                bench_vdso();
+                bench_context_switch();
+                bench_cyclictest();
+                bench_io_uring();
+                bench_readv();
+                bench_poll();
+                bench_pipe();
+                bench_shm();
+                bench_ipc();
+            } else if (!strcmp(buffer, "sched")) {
+                syscall(NR_sched_stats);
             } else {
                 char *arg1 = (char *)strchr(buffer, ' ');
                 if (arg1) {
                     *arg1 = '\0';
                     arg1 += 1;
                 }
+                if (!strcmp(buffer, "sysstat") || !strcmp(buffer, "strace")) {
+                    /* sysstat [on|off|reset|PID]：控制或打印系统调用统计
+                     * strace [PID|off]：跟踪进程的系统调用，不带参数时打印跟踪记录 */
+                    int trace = !strcmp(buffer, "strace");
+                    uint64_t pid = 0;
+                    for (char *c = arg1; c && *c >= '0' && *c <= '9'; ++c) {
+                        pid = pid * 10 + *c - '0';
+                    }
+                    if (arg1 && !strcmp(arg1, "on") && !trace) {
+                        syscall(NR_syscall_stats, SYSCALL_STATS_ON, 0);
+                    } else if (arg1 && !strcmp(arg1, "off")) {
+                        syscall(NR_syscall_stats, trace ? SYSCALL_TRACE : SYSCALL_STATS_OFF, 0);
+                    } else if (arg1 && !strcmp(arg1, "reset") && !trace) {
+                        syscall(NR_syscall_stats, SYSCALL_STATS_RESET, 0);
+                    } else if (trace && pid) {
+                        syscall(NR_syscall_stats, SYSCALL_TRACE, pid);
+                    } else if (trace) {
+                        syscall(NR_syscall_stats, SYSCALL_TRACE_DUMP, 0);
+                    } else if (syscall(NR_syscall_stats, SYSCALL_STATS_DUMP, pid)) {
+                        puts("sysstat: no statistics\n");
+                    }
+                    continue;
+                }
                 if (!strcmp(buffer, "cat")) {
                     if (!arg1 || !strlen(arg1)) {
                         puts("Usage: cat [FILE]\n");
                         continue;
                     }
-                    int fd = syscall(NR_open, arg1);
+                    int fd = syscall(NR_open, arg1, O_RDONLY);
                     if (fd == -1) {
                         puts("cat: "); puts(arg1); puts(": No such file or directory\n");
                         continue;
                     }
-                    struct vfs_stat stat;
-                    syscall(NR_stat, fd, &stat);
                     char file_buffer[64];
-                    syscall(NR_read, fd, file_buffer, stat.size);
-                    puts(arg1); puts(": "); puts(file_buffer);
+                    long n;
+                    puts(arg1); puts(": ");
+                    while ((n = syscall(NR_read, fd, file_buffer, sizeof(file_buffer) - 1)) > 0) {
+                        file_buffer[n] = '\0';
+                        puts(file_buffer);
+                    }
                     syscall(NR_close, fd);
                     continue;
                 }
                 if (buffer[0]) {
-                    puts(buffer); puts(": command not found\n");
+                    /* 其他命令作为 ramfs 中的程序执行 */
+                    char *argv[] = { buffer, arg1, NULL };
+                    int status = 0;
+                    long pid = syscall(NR_fork);
+                    if (!pid) {
+                        syscall(NR_execve, buffer, argv, NULL);
+                        syscall(NR_exit, 127);
+                    }
+                    syscall(NR_waitpid, pid, &status, 0);
+                    if (WEXITSTATUS(status) == 127) {
+                        puts(buffer); puts(": command not found\n");
+                    }
                 }
             }
         }
     }
+    /* 进程 0 是空闲进程，孤儿进程和内核线程由回收线程回收，见 reaper_init() */
     while (1)
         ; /* infinite loop */
     return 0;
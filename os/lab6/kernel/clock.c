@@ -2,28 +2,40 @@
  * @file clock.c
  * @author Hanabichan (93yutf@gmail.com)
  * @brief 实现时钟中断
+ *
+ * 时钟中断有两个来源：固定频率（HZ）的调度时钟节拍和定时器（见 timer.c）到期。
+ * 每次时钟中断后，下一次中断被设置为两者中较早的一个，因此定时器的精度不受
+ * 调度时钟节拍的限制。
  */
 #include <clock.h>
+#include <timer.h>
 #include <sbi.h>
 #include <riscv.h>
 #include <kdebug.h>
+#include <errno.h>
+#include <trap.h>
+#include <device/loader.h>
+#include <device/rtc.h>
+#include <uaccess.h>
 
-/** 时钟中断发生次数 */
+/** 时钟节拍发生次数 */
 volatile size_t ticks;
 
-/** 每隔 timebase 次时钟周期发生一次时钟中断 */
+uint64_t timebase_freq = TIMEBASE_FREQ;
+uint64_t cyc2ns_mult = (NSEC_PER_SEC << 32) / TIMEBASE_FREQ;
+uint64_t ns2cyc_mult = ((uint64_t)TIMEBASE_FREQ << 32) / NSEC_PER_SEC;
+
+/** CLOCK_REALTIME 与 CLOCK_MONOTONIC 之差（纳秒） */
+uint64_t realtime_offset;
+
+/** 每隔 timebase 次时钟周期发生一次时钟节拍 */
 static uint64_t timebase;
 
-/**
- * @brief 获取开机后经过的时钟周期数
- * @return uint64_t
- */
-static inline uint64_t get_cycles()
-{
-    uint64_t n;
-    __asm__ __volatile__("rdtime %0" : "=r"(n));
-    return n;
-}
+/** 下一次时钟节拍的时间 */
+static uint64_t next_tick;
+
+/** 已向 SBI 设置的下一次时钟中断的时间 */
+static uint64_t next_event;
 
 /**
  * @brief 初始化时钟
@@ -31,19 +43,124 @@ static inline uint64_t get_cycles()
  */
 void clock_init()
 {
-    /* QEMU 的时钟频率为 10MHz，设置timebase = 100000表示时钟中断频率为100Hz */
-    timebase = 100000;
+    /* 时钟频率由设备树 /cpus 节点的 timebase-frequency 属性给出 */
+    struct fdt_node_header *cpus = g_fdt ? fdt_find_node_by_path(g_fdt, "/cpus") : NULL;
+    struct fdt_property *prop = cpus ? fdt_get_prop(g_fdt, cpus, "timebase-frequency") : NULL;
+    if (prop && fdt_get_prop_value_len(prop) == sizeof(fdt32_t)) {
+        timebase_freq = fdt_get_prop_num_value(prop, 0);
+    } else {
+        kputs("clock: timebase-frequency not found, assume 10MHz");
+        timebase_freq = TIMEBASE_FREQ;
+    }
+    cyc2ns_mult = (NSEC_PER_SEC << 32) / timebase_freq;
+    ns2cyc_mult = (timebase_freq << 32) / NSEC_PER_SEC;
+
+    /* 启动时用 RTC 校准 CLOCK_REALTIME，没有 RTC 时从 UNIX 纪元开始计时 */
+    struct rtc_device *rtc = get_rtc_device();
+    uint64_t now = ktime_get_ns();
+    realtime_offset = rtc ? rtc->read_time(rtc->dev) - now : 0;
+
+    /* 时钟节拍频率为 HZ */
+    timebase = timebase_freq / HZ;
     ticks = 0;
+    next_tick = get_cycles() + timebase;
+    /* 允许用户态使用 rdtime 读取时间 */
+    set_csr(scounteren, 1 << 1);
     /* 开启时钟中断（设置CSR_MIE） */
     set_csr(sie, 1 << IRQ_S_TIMER);
     clock_set_next_event();
     kputs("Setup Timer!");
 }
 
+/**
+ * @brief 时钟中断处理函数
+ *
+ * 处理到期的定时器并设置下一次时钟中断。
+ *
+ * @return 本次中断是否经过了时钟节拍（调度器只在时钟节拍时更新时间片）
+ */
+uint64_t clock_handler()
+{
+    uint64_t now = get_cycles();
+    uint64_t is_tick = now >= next_tick;
+    if (is_tick) {
+        ++ticks;
+        next_tick += timebase;
+        /* 中断被长时间关闭时不补发错过的节拍 */
+        if (next_tick <= now) {
+            next_tick = now + timebase;
+        }
+    }
+    timer_run(now);
+    clock_set_next_event();
+    return is_tick;
+}
+
 /**
  * @brief 设置下一次时钟中断
+ *
+ * 取下一次时钟节拍和最早到期的定时器中较早的一个。
  */
 void clock_set_next_event()
 {
-    sbi_set_timer(get_cycles() + timebase);
+    uint64_t deadline = timer_next_event();
+    if (deadline > next_tick) {
+        deadline = next_tick;
+    }
+    next_event = deadline;
+    sbi_set_timer(deadline);
+}
+
+/**
+ * @brief 确保在 deadline 之前发生一次时钟中断
+ *
+ * 新加入的定时器早于已设置的时钟中断时调用。
+ *
+ * @param deadline 时间（时钟周期数）
+ */
+void clock_program_event(uint64_t deadline)
+{
+    if (deadline < next_event) {
+        next_event = deadline;
+        sbi_set_timer(deadline);
+    }
+}
+
+/**
+ * @brief 获取 UNIX 时间
+ * @return 1970-01-01 00:00:00 UTC 以来的纳秒数
+ */
+uint64_t ktime_get_real_ns()
+{
+    return ktime_get_ns() + realtime_offset;
+}
+
+/**
+ * @brief 实现系统调用 clock_gettime()
+ *
+ * @param 参数1 clockid_t clk_id CLOCK_REALTIME 或 CLOCK_MONOTONIC
+ * @param 参数2 struct timespec *tp 写入时间
+ */
+long sys_clock_gettime(struct trapframe *tf)
+{
+    struct timespec *tp = (struct timespec *)tf->gpr.a1;
+    uint64_t ns;
+    switch (tf->gpr.a0) {
+    case CLOCK_REALTIME:
+        ns = ktime_get_real_ns();
+        break;
+    case CLOCK_MONOTONIC:
+        ns = ktime_get_ns();
+        break;
+    default:
+        return -EINVAL;
+    }
+    if (!tp) {
+        return -EINVAL;
+    }
+    struct timespec ts = {
+        .tv_sec = ns / NSEC_PER_SEC,
+        .tv_nsec = ns % NSEC_PER_SEC,
+    };
+    return copy_to_user(tp, &ts, sizeof(ts)) ? -EFAULT : 0;
 }
@@ -0,0 +1,384 @@
+/**
+ * @file exec.c
+ * @brief 实现系统调用 execve()
+ *
+ * execve() 从 VFS 读取静态链接的 ELF64 可执行文件，为每个 PT_LOAD 段和用户栈
+ * 建立 VMA，不预先读入任何段，程序运行时由缺页异常按需调入（见 vma.h）。
+ *
+ * 新程序的初始栈只占栈顶一页，布局遵循 RISC-V psABI：
+ * ```
+ * START_STACK ----> +----------------------+
+ *                   | 参数和环境变量字符串 |
+ *                   +----------------------+
+ *                   | 辅助向量，AT_NULL 结尾 |
+ *                   | envp[]，NULL 结尾    |
+ *                   | argv[]，NULL 结尾    |
+ *      sp --------> | argc                 |
+ *                   +----------------------+
+ * ```
+ * 此外 execve() 返回时 a0 = argc，a1 = argv，a2 = envp，简单的程序不需要解析栈。
+ */
+#include <elf.h>
+#include <errno.h>
+#include <mm.h>
+#include <sched.h>
+#include <string.h>
+#include <io_uring.h>
+#include <shm.h>
+#include <vdso.h>
+#include <vma.h>
+#include <uaccess.h>
+#include <fs/vfs.h>
+
+#define EXEC_STACK_SIZE    (8 * 1024 * 1024)                /**< 用户栈 VMA 大小 */
+#define EXEC_STACK_TOP     START_KERNEL                     /**< 用户栈 VMA 结束地址 */
+#define EXEC_MAX_PHNUM     (PAGE_SIZE / sizeof(Elf64_Phdr)) /**< 程序头个数上限 */
+#define EXEC_AUXV_WORDS    6                                /**< 辅助向量占用的字数 */
+
+/**
+ * @brief 检查 ELF 文件头
+ */
+static int64_t check_ehdr(const Elf64_Ehdr *ehdr)
+{
+    if (ehdr->e_ident[EI_MAG0] != ELFMAG0 || ehdr->e_ident[EI_MAG1] != ELFMAG1 ||
+        ehdr->e_ident[EI_MAG2] != ELFMAG2 || ehdr->e_ident[EI_MAG3] != ELFMAG3 ||
+        ehdr->e_ident[EI_CLASS] != ELFCLASS64 || ehdr->e_ident[EI_DATA] != ELFDATA2LSB ||
+        ehdr->e_type != ET_EXEC || ehdr->e_machine != EM_RISCV ||
+        ehdr->e_phentsize != sizeof(Elf64_Phdr) || !ehdr->e_phnum ||
+        ehdr->e_phnum > EXEC_MAX_PHNUM) {
+        return -ENOEXEC;
+    }
+    return 0;
+}
+
+/**
+ * @brief 检查 PT_LOAD 段
+ *
+ * 段必须位于共享内存映射区之下、互不重叠（按页计算）且按地址升序排列，文件偏移和
+ * 虚拟地址模页大小同余。
+ *
+ * @param prev_end 前一个段的结束地址（按页对齐）
+ * @param file_size 文件大小
+ */
+static int64_t check_phdr(const Elf64_Phdr *phdr, uint64_t prev_end, uint64_t file_size)
+{
+    uint64_t start = phdr->p_vaddr & ~(PAGE_SIZE - 1);
+    if (phdr->p_filesz > phdr->p_memsz || phdr->p_offset + phdr->p_filesz > file_size ||
+        phdr->p_offset + phdr->p_filesz < phdr->p_offset ||
+        (phdr->p_offset & (PAGE_SIZE - 1)) != (phdr->p_vaddr & (PAGE_SIZE - 1)) ||
+        start < START_CODE || start < prev_end ||
+        phdr->p_vaddr + phdr->p_memsz > SHM_BASE ||
+        phdr->p_vaddr + phdr->p_memsz < phdr->p_vaddr) {
+        return -ENOEXEC;
+    }
+    return 0;
+}
+
+/** 程序头的访问权限对应的 VMA 权限 */
+static uint64_t phdr_vm_flags(const Elf64_Phdr *phdr)
+{
+    uint64_t flags = 0;
+    if (phdr->p_flags & PF_R) {
+        flags |= VM_READ;
+    }
+    if (phdr->p_flags & PF_W) {
+        flags |= VM_READ | VM_WRITE;
+    }
+    if (phdr->p_flags & PF_X) {
+        flags |= VM_EXEC;
+    }
+    return flags;
+}
+
+/**
+ * @brief 统计字符串数组的元素个数和字符串总长度（含结尾的 '\0'）
+ *
+ * @param strv 用户态字符串数组，可以为 NULL
+ * @return 元素个数；数组或字符串不可读时返回 -EFAULT，总长度超过一页时返回 -E2BIG
+ */
+static int64_t count_strings(const char *const *strv, uint64_t *bytes)
+{
+    int64_t count = 0;
+    const char *str;
+    while (strv) {
+        if (get_user(str, &strv[count])) {
+            return -EFAULT;
+        }
+        if (!str) {
+            break;
+        }
+        uint64_t length = strnlen_user(str, PAGE_SIZE);
+        if (!length) {
+            return -EFAULT;
+        }
+        *bytes += length;
+        if (*bytes > PAGE_SIZE) {
+            return -E2BIG;
+        }
+        ++count;
+    }
+    return count;
+}
+
+/**
+ * @brief 将字符串数组拷贝到新的栈顶页，并填写指针数组
+ *
+ * 数组和字符串的长度以 count_strings() 的结果为准，其他线程在此期间修改它们
+ * 不会使拷贝越界。
+ *
+ * @param strv 用户态字符串数组，可以为 NULL
+ * @param count count_strings() 得到的元素个数
+ * @param ptrs 指针数组在栈顶页中的位置，写入新地址空间中的字符串地址，NULL 结尾
+ * @param str 字符串在栈顶页中的位置，返回时指向下一个字符串的位置
+ * @param end 字符串区域在栈顶页中的结束位置
+ * @param base 栈顶页映射的用户地址减去栈顶页的内核地址
+ * @return 成功返回 0，数组或字符串不可读时返回 -EFAULT
+ */
+static int64_t copy_strings(const char *const *strv, uint64_t count, uint64_t *ptrs, char **str,
+                            const char *end, uint64_t base)
+{
+    for (uint64_t i = 0; i < count; ++i) {
+        const char *ustr;
+        if (get_user(ustr, &strv[i])) {
+            return -EFAULT;
+        }
+        int64_t length = strncpy_from_user(*str, ustr, end - *str);
+        if (length < 0 || length == end - *str) {
+            return -EFAULT;
+        }
+        *ptrs++ = (uint64_t)*str + base;
+        *str += length + 1;
+    }
+    *ptrs = 0;
+    return 0;
+}
+
+/**
+ * @brief 当前进程与其他进程共享地址空间时换用新的地址空间
+ *
+ * 线程组中的其他线程已被 de_thread() 结束，仍共享地址空间的是 CLONE_VM 创建的
+ * 其他进程，它们继续使用原来的地址空间，由最后一个使用者释放。
+ *
+ * @param new_mm mm_alloc() 新建的地址空间，可以为 NULL
+ * @return 换用了新的地址空间时返回 1；当前进程独占地址空间时返回 0，new_mm 被释放
+ */
+static uint64_t exec_mmap(struct mm_struct *new_mm)
+{
+    if (!new_mm) {
+        return 0;
+    }
+    struct mm_struct *old_mm = current->mm;
+    uint64_t flag = irq_save();
+    if (old_mm->mm_users == 1) {
+        /* 其他线程在 mm_alloc() 期间都已退出 */
+        irq_restore(flag);
+        mmdrop(new_mm);
+        return 0;
+    }
+    --old_mm->mm_users;
+    --old_mm->mm_count;
+    current->mm = new_mm;
+    current->pg_dir = pg_dir = new_mm->pg_dir;
+    active_mapping();
+    irq_restore(flag);
+    return 1;
+}
+
+/**
+ * @brief 执行程序
+ *
+ * 成功时不返回调用者，当前进程的用户地址空间被替换为新程序，打开的文件和
+ * 调度参数保持不变。其他线程不受影响，继续使用原来的地址空间。
+ *
+ * @param tf 中断保存栈，返回时指向新程序的入口
+ * @param path 可执行文件路径
+ * @param argv 参数数组，NULL 结尾，可以为 NULL
+ * @param envp 环境变量数组，NULL 结尾，可以为 NULL
+ * @return 成功返回 argc；失败返回 -ENOENT、-EACCES、-ENOEXEC、-E2BIG、-EFAULT 或 -ENOMEM，
+ *         此时当前进程不受影响
+ */
+long do_execve(struct trapframe *tf, const char *path, const char *const *argv, const char *const *envp)
+{
+    struct vfs_inode *inode = vfs_get_inode(path, NULL);
+    if (!inode) {
+        return -ENOENT;
+    }
+    vfs_ref_inode(inode);
+    long ret = -EACCES;
+    Elf64_Phdr *phdrs = NULL;
+    uint64_t stack_page = 0;
+    uint64_t vdso_page = 0;
+    if (vfs_is_dir(inode)) {
+        goto out;
+    }
+
+    /* 读取并检查文件头和程序头 */
+    ret = -ENOEXEC;
+    Elf64_Ehdr ehdr;
+    uint64_t file_size = vfs_get_stat(inode)->size;
+    if (file_size < sizeof(ehdr)) {
+        goto out;
+    }
+    vfs_inode_request(inode, &ehdr, sizeof(ehdr), 0, 1);
+    uint64_t phdrs_size = ehdr.e_phnum * sizeof(Elf64_Phdr);
+    if (check_ehdr(&ehdr) || ehdr.e_phoff + phdrs_size > file_size) {
+        goto out;
+    }
+    ret = -ENOMEM;
+    if (!(phdrs = kmalloc(phdrs_size))) {
+        goto out;
+    }
+    vfs_inode_request(inode, phdrs, phdrs_size, ehdr.e_phoff, 1);
+    ret = -ENOEXEC;
+    uint64_t prev_end = 0;
+    for (uint64_t i = 0; i < ehdr.e_phnum; ++i) {
+        if (phdrs[i].p_type != PT_LOAD || !phdrs[i].p_memsz) {
+            continue;
+        }
+        if (check_phdr(&phdrs[i], prev_end, file_size)) {
+            goto out;
+        }
+        prev_end = (phdrs[i].p_vaddr + phdrs[i].p_memsz + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    }
+    if (!prev_end) {
+        goto out;
+    }
+
+    /* 旧地址空间释放之前把参数和环境变量拷贝到新的栈顶页 */
+    uint64_t bytes = 0;
+    int64_t argc = count_strings(argv, &bytes);
+    int64_t envc = argc < 0 ? argc : count_strings(envp, &bytes);
+    if ((ret = argc < 0 ? argc : envc) < 0) {
+        goto out;
+    }
+    uint64_t stack_base = START_STACK & ~(PAGE_SIZE - 1);
+    uint64_t sp = (START_STACK - bytes) & ~0xF;
+    sp = (sp - (1 + argc + 1 + envc + 1 + EXEC_AUXV_WORDS) * sizeof(uint64_t)) & ~0xF;
+    ret = -E2BIG;
+    if (sp < stack_base) {
+        goto out;
+    }
+    ret = -ENOMEM;
+    if (!(stack_page = get_free_page()) || !(vdso_page = get_free_page())) {
+        goto out;
+    }
+    uint64_t base = stack_base - VIRTUAL(stack_page);
+    uint64_t *words = (uint64_t *)(sp - base);
+    char *str = (char *)(START_STACK - bytes - base);
+    words[0] = argc;
+    char *str_end = (char *)(START_STACK - base);
+    ret = copy_strings(argv, argc, &words[1], &str, str_end, base);
+    if (ret || (ret = copy_strings(envp, envc, &words[1 + argc + 1], &str, str_end, base))) {
+        goto out;
+    }
+    uint64_t *auxv = &words[1 + argc + 1 + envc + 1];
+    auxv[0] = AT_PAGESZ;
+    auxv[1] = PAGE_SIZE;
+    auxv[2] = AT_ENTRY;
+    auxv[3] = ehdr.e_entry;
+    auxv[4] = AT_NULL;
+    auxv[5] = 0;
+
+    /* 先结束线程组中的其他线程，仍与其他进程（CLONE_VM 但不是 CLONE_THREAD）共享地址空间时换用新的地址空间 */
+    if ((ret = de_thread())) {
+        goto out;
+    }
+    ret = -ENOMEM;
+    struct mm_struct *new_mm = current->mm->mm_users > 1 ? mm_alloc() : NULL;
+    if (current->mm->mm_users > 1 && !new_mm) {
+        goto out;
+    }
+    if (!exec_mmap(new_mm)) {
+        /* 释放旧地址空间，此后出错只能结束进程 */
+        io_uring_release(current->mm);
+        current->mm->vdso_data = NULL;
+        exit_vmas(current->mm);
+        exit_shm_areas(current->mm);
+        free_page_tables(0, START_KERNEL);
+    }
+    put_page(stack_page, stack_base, USER_RW | PAGE_VALID);
+    vdso_map(current->mm, vdso_page);
+    vdso_update_ids(current);
+    stack_page = vdso_page = 0;
+
+    uint64_t start_code = -1, start_data = 0, end_data = 0;
+    for (uint64_t i = 0; i < ehdr.e_phnum; ++i) {
+        Elf64_Phdr *phdr = &phdrs[i];
+        if (phdr->p_type != PT_LOAD || !phdr->p_memsz) {
+            continue;
+        }
+        uint64_t start = phdr->p_vaddr & ~(PAGE_SIZE - 1);
+        uint64_t end = (phdr->p_vaddr + phdr->p_memsz + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        uint64_t flags = phdr_vm_flags(phdr);
+        if (insert_vma(current->mm, start, end, flags, inode, phdr->p_offset & ~(PAGE_SIZE - 1),
+                       phdr->p_vaddr + phdr->p_filesz)) {
+            goto fatal;
+        }
+        start_code = start < start_code ? start : start_code;
+        if ((flags & VM_WRITE) && !start_data) {
+            start_data = phdr->p_vaddr;
+        }
+        end_data = phdr->p_vaddr + phdr->p_filesz;
+    }
+    if (insert_vma(current->mm, EXEC_STACK_TOP - EXEC_STACK_SIZE, EXEC_STACK_TOP,
+                   VM_READ | VM_WRITE, NULL, 0, 0)) {
+        goto fatal;
+    }
+
+    current->start_code = start_code;
+    current->start_rodata = start_code;
+    current->start_data = start_data ? start_data : prev_end;
+    current->end_data = end_data;
+    current->brk = prev_end;
+    current->start_stack = START_STACK;
+
+    memset(&tf->gpr, 0, sizeof(tf->gpr));
+    tf->gpr.sp = sp;
+    tf->gpr.a1 = sp + sizeof(uint64_t);
+    tf->gpr.a2 = sp + (1 + argc + 1) * sizeof(uint64_t);
+    tf->epc = ehdr.e_entry;
+    ret = argc;
+
+out:
+    if (stack_page) {
+        free_page(stack_page);
+    }
+    if (vdso_page) {
+        free_page(vdso_page);
+    }
+    if (phdrs) {
+        kfree(phdrs);
+    }
+    vfs_free_inode(inode);
+    return ret;
+
+fatal:
+    kprintf("execve(): process %u is killed: out of memory\n", (uint64_t)current->pid);
+    kfree(phdrs);
+    vfs_free_inode(inode);
+    do_exit(-ENOMEM);
+}
+
+/**
+ * @brief 实现系统调用 execve()
+ *
+ * @param 参数1 const char *path 可执行文件路径
+ * @param 参数2 char *const argv[] 参数数组，NULL 结尾
+ * @param 参数3 char *const envp[] 环境变量数组，NULL 结尾
+ * @return 成功时从新程序的入口开始执行，a0 = argc
+ */
+long sys_execve(struct trapframe *tf)
+{
+    char *path = kmalloc(PATH_MAX);
+    if (!path) {
+        return -ENOMEM;
+    }
+    int64_t ret = strncpy_from_user(path, (const char *)tf->gpr.a0, PATH_MAX);
+    if (ret >= 0) {
+        ret = ret == PATH_MAX ? -ENAMETOOLONG
+                              : do_execve(tf, path, (const char *const *)tf->gpr.a1,
+                                          (const char *const *)tf->gpr.a2);
+    }
+    kfree(path);
+    return ret;
+}
@@ -0,0 +1,361 @@
+/**
+ * @file exit.c
+ * @brief 实现系统调用 exit()、exit_group() 和 waitpid()
+ *
+ * 进程退出时释放用户地址空间及其 VMA、打开的文件和间隔定时器，把子进程过继给
+ * 回收线程 child_reaper，然后进入僵尸状态并唤醒父进程。进程控制块、内核栈、页目录
+ * 和 PID 在父进程调用 waitpid() 回收时才释放，父进程同时累加子进程的 CPU 时间。
+ *
+ * 地址空间和文件表可能被 clone() 创建的多个任务共享，由最后一个使用者释放。
+ * exit() 只结束当前线程；线程组中组长以外的线程退出时把 CPU 时间累加到组长，
+ * 由回收线程回收。组长要等其他线程都退出后才能被父进程回收，因此 waitpid()
+ * 看到的是整个线程组的结束。
+ *
+ * 回收线程是 reaper_init() 创建的内核线程，它是孤儿进程、线程和内核线程的父进程，
+ * 阻塞在 waitpid() 中回收它们，没有子进程时在 wait_chldexit 上睡眠。进程 0 是
+ * 空闲进程，不参与回收。
+ */
+#include <assert.h>
+#include <errno.h>
+#include <sched.h>
+#include <mm.h>
+#include <riscv.h>
+#include <futex.h>
+#include <kthread.h>
+#include <ipc.h>
+#include <fs/vfs.h>
+#include <fs/file.h>
+#include <vdso.h>
+#include <vma.h>
+#include <syscall_stats.h>
+#include <uaccess.h>
+
+/** 回收孤儿进程、线程和内核线程的进程，reaper_init() 之前是进程 0 */
+struct task_struct *child_reaper = &init_task.task;
+
+/**
+ * @brief 回收线程，在 wait_chldexit 上睡眠，有子进程退出时被唤醒
+ */
+static int reaper_thread(void *arg)
+{
+    struct wait_queue_entry wait;
+    init_waitqueue_entry(&wait, current);
+    while (1) {
+        if (do_waitpid(-1, NULL, 0) != -ECHILD) {
+            continue;
+        }
+        /* 还没有子进程，等 forget_original_parent() 过继或新建线程 */
+        uint64_t flag = irq_save();
+        if (!current->p_cptr) {
+            prepare_to_wait(&current->wait_chldexit, &wait, TASK_INTERRUPTIBLE);
+            schedule();
+            finish_wait(&current->wait_chldexit, &wait);
+        }
+        irq_restore(flag);
+    }
+    return 0;
+}
+
+/**
+ * @brief 创建回收线程
+ *
+ * 进程 0 是空闲进程，不能睡眠，由回收线程阻塞在 waitpid() 中回收过继的孤儿进程、
+ * 线程和内核线程。需在创建其他内核线程之前调用。
+ */
+void reaper_init()
+{
+    struct task_struct *p = kthread_create(reaper_thread, NULL);
+    assert(p, "reaper_init(): fail to create reaper thread");
+    child_reaper = p;
+}
+
+/**
+ * @brief 将进程的所有子进程过继给回收线程，调用者需关中断
+ *
+ * @param father 退出的进程
+ */
+static void forget_original_parent(struct task_struct *father)
+{
+    struct task_struct *reaper = child_reaper;
+    if (father->p_cptr) {
+        wake_up(&reaper->wait_chldexit);    /* 过继的子进程可能已经退出 */
+    }
+    while (father->p_cptr) {
+        struct task_struct *p = father->p_cptr;
+        remove_links(p);
+        p->p_pptr = reaper;
+        set_links(p);
+        if (thread_group_leader(p)) {
+            vdso_update_ids(p);
+        }
+    }
+}
+
+/**
+ * @brief 减少文件表的引用计数，降为 0 时关闭所有文件并释放文件表
+ *
+ * @param files 文件表
+ */
+void put_files_struct(struct files_struct *files)
+{
+    uint64_t flag = irq_save();
+    uint64_t last = !--files->count;
+    irq_restore(flag);
+    if (!last) {
+        return;
+    }
+    close_files(files);
+    kfree(files);
+}
+
+/**
+ * @brief 组长以外的线程退出，调用者需关中断
+ *
+ * 线程离开线程组，CPU 时间累加到组长。组长已经退出且这是最后一个线程时，
+ * 唤醒组长的父进程回收组长。
+ *
+ * @param p 退出的线程
+ */
+static void exit_thread_group(struct task_struct *p)
+{
+    struct task_struct *leader = p->group_leader;
+    linked_list_remove(&p->thread_group);
+    linked_list_init(&p->thread_group);
+    leader->utime += p->utime;
+    leader->stime += p->stime;
+    p->utime = p->stime = 0;
+    if (leader->state == TASK_ZOMBIE && thread_group_empty(leader)) {
+        wake_up(&leader->p_pptr->wait_chldexit);
+    }
+}
+
+/**
+ * @brief 结束当前线程
+ *
+ * 内核线程共享 kernel_pg_dir，没有用户地址空间和文件表需要释放。
+ *
+ * @param code 返回码
+ */
+void do_exit(int code)
+{
+    struct task_struct *p = current;
+    assert(p != &init_task.task, "do_exit(): task 0 exits");
+
+    timer_del(&p->real_timer);
+    ipc_exit(p);                  /* 等待本线程回复的客户进程返回 -EPIPE */
+    if (p->files) {
+        put_files_struct(p->files);
+        p->files = NULL;
+    }
+    if (p->mm) {
+        if (p->clear_child_tid) {
+            futex_clear_tid(p->clear_child_tid);
+        }
+        mmput(p->mm);
+    }
+
+    disable_interrupt();
+    forget_original_parent(p);
+    if (!thread_group_leader(p)) {
+        exit_thread_group(p);
+    }
+    p->exit_code = code;
+    p->state = TASK_ZOMBIE;
+    rt_dequeue(p);
+    if (p->group_leader->group_exec_task) {
+        wake_up_process(p->group_leader->group_exec_task);
+    }
+    if (thread_group_empty(p)) {
+        wake_up(&p->p_pptr->wait_chldexit);
+    }
+    schedule();
+    panic("do_exit(): zombie task %u is scheduled", (uint64_t)p->pid);
+}
+
+/**
+ * @brief 标记线程组正在退出并唤醒可中断睡眠的线程，调用者需关中断
+ */
+static void zap_thread_group(struct task_struct *leader, int code)
+{
+    leader->group_exit = 1;
+    leader->group_exit_code = code;
+    struct linked_list_node *node;
+    for_each_linked_list_node(node, &leader->thread_group) {
+        struct task_struct *t = container_of(node, struct task_struct, thread_group);
+        if (t->state == TASK_INTERRUPTIBLE) {
+            wake_up_process(t);
+        }
+    }
+    if (leader->state == TASK_INTERRUPTIBLE) {
+        wake_up_process(leader);
+    }
+}
+
+/**
+ * @brief 结束当前线程组
+ *
+ * 标记线程组并唤醒可中断睡眠的线程，其他线程在返回用户态前退出，
+ * 见 group_exit_check()。
+ *
+ * @param code 返回码
+ */
+void do_group_exit(int code)
+{
+    struct task_struct *leader = current->group_leader;
+    uint64_t flag = irq_save();
+    if (!leader->group_exit) {
+        zap_thread_group(leader, code);
+    }
+    irq_restore(flag);
+    do_exit(leader->group_exit_code);
+}
+
+/**
+ * @brief 线程组中除当前线程外是否都已退出，调用者需关中断
+ *
+ * 退出的线程离开线程组，组长退出后作为僵尸留在组中。
+ */
+static uint64_t thread_group_alone(struct task_struct *leader)
+{
+    if (current == leader) {
+        return thread_group_empty(leader);
+    }
+    return leader->state == TASK_ZOMBIE && leader->thread_group.next == &current->thread_group &&
+           current->thread_group.next == &leader->thread_group;
+}
+
+/**
+ * @brief execve() 替换地址空间前结束线程组中的其他线程并等待它们退出
+ *
+ * 借用 exit_group() 的机制标记线程组，当前线程记为 group_exec_task，不受标记影响。
+ * 与 Linux 不同，调用者不是组长时不接管组长的 PID：组长作为僵尸留在组中，
+ * getpid() 仍返回原来的线程组 ID，gettid() 返回调用者自己的 TID。
+ *
+ * @return 成功返回 0；线程组已经在退出时返回 -EINTR
+ */
+int64_t de_thread()
+{
+    struct task_struct *leader = current->group_leader;
+    uint64_t flag = irq_save();
+    if (thread_group_alone(leader)) {
+        irq_restore(flag);
+        return 0;
+    }
+    if (leader->group_exit) {
+        irq_restore(flag);
+        return -EINTR;
+    }
+    leader->group_exec_task = current;
+    zap_thread_group(leader, 0);
+    while (!thread_group_alone(leader)) {
+        current->state = TASK_UNINTERRUPTIBLE;
+        schedule();
+    }
+    leader->group_exit = 0;
+    leader->group_exec_task = NULL;
+    irq_restore(flag);
+    return 0;
+}
+
+/**
+ * @brief 释放已被移出进程链表的僵尸进程
+ *
+ * @param p 僵尸进程
+ */
+static void release_task(struct task_struct *p)
+{
+    free_pid(p->pid);
+    syscall_stats_release(p);
+    if (p->mm) {
+        mmdrop(p->mm);
+    }
+    free_page(PHYSICAL((uint64_t)p));
+}
+
+/**
+ * @brief 等待子进程退出并回收
+ *
+ * @param pid 子进程 PID，-1 表示任意子进程
+ * @param stat_addr 写入退出状态，可以为 NULL
+ * @param options 0 或 WNOHANG
+ * @return 成功返回被回收的子进程 PID；指定 WNOHANG 且没有已退出的子进程时
+ *         返回 0；没有符合条件的子进程时返回 -ECHILD；线程组正在退出时返回 -EINTR；
+ *         stat_addr 不可写时子进程仍被回收，返回 -EFAULT
+ */
+long do_waitpid(int64_t pid, int *stat_addr, uint64_t options)
+{
+    if ((pid <= 0 && pid != -1) || (options & ~WNOHANG)) {
+        return -EINVAL;
+    }
+    struct wait_queue_entry wait;
+    init_waitqueue_entry(&wait, current);
+    uint64_t flag = irq_save();
+    while (1) {
+        uint64_t found = 0;
+        struct task_struct *p;
+        for (p = current->p_cptr; p; p = p->p_osptr) {
+            if (pid > 0 && p->pid != pid) {
+                continue;
+            }
+            found = 1;
+            /* 组长要等线程组中的其他线程都退出后才能回收 */
+            if (p->state == TASK_ZOMBIE && thread_group_empty(p)) {
+                break;
+            }
+        }
+        if (p) {
+            uint32_t nr = p->pid;
+            uint32_t code = p->group_exit ? p->group_exit_code : p->exit_code;
+            current->cutime += p->utime + p->cutime;
+            current->cstime += p->stime + p->cstime;
+            remove_links(p);
+            unregister_task(p);
+            finish_wait(&current->wait_chldexit, &wait);
+            irq_restore(flag);
+            release_task(p);
+            if (stat_addr && put_user((code & 0xFF) << 8, stat_addr)) {
+                return -EFAULT;
+            }
+            return nr;
+        }
+        if (!found || (options & WNOHANG) || group_exit_pending()) {
+            finish_wait(&current->wait_chldexit, &wait);
+            irq_restore(flag);
+            return !found ? -ECHILD : (options & WNOHANG) ? 0 : -EINTR;
+        }
+        prepare_to_wait(&current->wait_chldexit, &wait, TASK_INTERRUPTIBLE);
+        schedule();
+    }
+}
+
+/**
+ * @brief 实现系统调用 exit()，只结束当前线程
+ *
+ * @param 参数1 int code 返回码
+ */
+long sys_exit(struct trapframe *tf)
+{
+    do_exit(tf->gpr.a0);
+}
+
+/**
+ * @brief 实现系统调用 exit_group()
+ *
+ * @param 参数1 int code 返回码
+ */
+long sys_exit_group(struct trapframe *tf)
+{
+    do_group_exit(tf->gpr.a0);
+}
+
+/**
+ * @brief 实现系统调用 waitpid()
+ *
+ * @param 参数1 pid_t pid 子进程 PID，-1 表示任意子进程
+ * @param 参数2 int *status 写入退出状态，用 WEXITSTATUS() 取出返回码，可以为 NULL
+ * @param 参数3 int options 0 或 WNOHANG
+ */
+long sys_waitpid(struct trapframe *tf)
+{
+    return do_waitpid(tf->gpr.a0, (int *)tf->gpr.a1, tf->gpr.a2);
+}
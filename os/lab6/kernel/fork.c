@@ -10,17 +10,156 @@
 #include <clock.h>
 #include <mm.h>
 #include <string.h>
+#include <fs/vfs.h>
+#include <fs/file.h>
+#include <io_uring.h>
+#include <ipc.h>
+#include <shm.h>
+#include <vdso.h>
+#include <vma.h>
+#include <uaccess.h>
+
+extern void ret_from_fork(void);
+
+/**
+ * @brief 新建地址空间，内核区的映射拷贝自当前进程，用户区为空
+ *
+ * 每个地址空间单独分配内核区的页表，见 free_pg_dir()。
+ *
+ * @return 失败时返回 NULL
+ */
+struct mm_struct *mm_alloc()
+{
+    struct mm_struct *mm = kmalloc(sizeof(struct mm_struct));
+    if (!mm) {
+        return NULL;
+    }
+    uint64_t page = get_free_page();
+    if (!page) {
+        kfree(mm);
+        return NULL;
+    }
+    mm->mm_users = mm->mm_count = 1;
+    mm->pg_dir = (uint64_t *)VIRTUAL(page);
+    linked_list_init(&mm->mmap);
+    linked_list_init(&mm->shm_areas);
+    mm->vdso_data = NULL;
+    mm->io_uring = NULL;
+    copy_page_tables(current->start_kernel, mm->pg_dir, START_KERNEL, 0x100000000 - current->start_kernel);
+    return mm;
+}
 
 /**
- * @brief 将当前进程的虚拟地址空间拷贝给进程 p
+ * @brief 减少地址空间的使用者，最后一个使用者释放用户区的页和 VMA
+ *
+ * 只能由使用该地址空间的当前进程调用，free_page_tables() 作用于当前页目录。
+ * 页目录在 mmdrop() 中释放。
  *
- * @param p task_struct 指针
+ * @param mm 当前进程的地址空间
  */
-int copy_mem(struct task_struct * p)
+void mmput(struct mm_struct *mm)
 {
-    copy_page_tables(0, p->pg_dir, 0, current->start_kernel);
-    copy_page_tables(current->start_kernel, p->pg_dir, p->start_kernel, 0x100000000 - current->start_kernel);
-    return 1;
+    uint64_t flag = irq_save();
+    uint64_t last = !--mm->mm_users;
+    irq_restore(flag);
+    if (last) {
+        io_uring_release(mm);
+        mm->vdso_data = NULL;           /* 数据页随用户区释放 */
+        exit_vmas(mm);
+        exit_shm_areas(mm);
+        free_page_tables(0, START_KERNEL);
+    }
+}
+
+/**
+ * @brief 减少地址空间的引用计数，降为 0 时释放页目录
+ *
+ * @param mm 地址空间，不能是当前使用的
+ */
+void mmdrop(struct mm_struct *mm)
+{
+    uint64_t flag = irq_save();
+    uint64_t last = !--mm->mm_count;
+    irq_restore(flag);
+    if (last) {
+        free_pg_dir(mm->pg_dir);
+        kfree(mm);
+    }
+}
+
+/**
+ * @brief 为进程 p 准备地址空间
+ *
+ * 指定 CLONE_VM 时共享当前进程的地址空间，否则新建地址空间，以写时复制的方式
+ * 共享当前进程用户区的物理页并复制 VMA。
+ *
+ * @param p 新进程
+ * @return 成功返回 0，内存不足时返回 -ENOMEM
+ */
+static int64_t copy_mm(uint64_t clone_flags, struct task_struct *p)
+{
+    struct mm_struct *mm = current->mm;
+    if (clone_flags & CLONE_VM) {
+        uint64_t flag = irq_save();
+        ++mm->mm_users;
+        ++mm->mm_count;
+        irq_restore(flag);
+        p->mm = mm;
+        return 0;
+    }
+    uint64_t vdso_page = get_free_page();
+    if (!vdso_page) {
+        return -ENOMEM;
+    }
+    struct mm_struct *new_mm = mm_alloc();
+    if (!new_mm) {
+        free_page(vdso_page);
+        return -ENOMEM;
+    }
+    if (copy_vmas(new_mm, mm) || copy_shm_areas(new_mm, mm)) {
+        exit_vmas(new_mm);
+        exit_shm_areas(new_mm);
+        mmdrop(new_mm);
+        free_page(vdso_page);
+        return -ENOMEM;
+    }
+    copy_page_tables(0, new_mm->pg_dir, 0, current->start_kernel);
+    vdso_fork(new_mm, vdso_page);
+    io_uring_fork(new_mm);
+    shm_fork(new_mm);
+    p->mm = new_mm;
+    return 0;
+}
+
+/**
+ * @brief 为进程 p 准备打开的文件表
+ *
+ * 指定 CLONE_FILES 时共享当前进程的文件表，否则复制一份，打开的文件被继承。
+ *
+ * @param p 新进程
+ * @return 成功返回 0，内存不足时返回 -ENOMEM
+ */
+static int64_t copy_files(uint64_t clone_flags, struct task_struct *p)
+{
+    struct files_struct *files = current->files;
+    if (clone_flags & CLONE_FILES) {
+        uint64_t flag = irq_save();
+        ++files->count;
+        irq_restore(flag);
+        p->files = files;
+        return 0;
+    }
+    struct files_struct *new_files = kmalloc(sizeof(struct files_struct));
+    if (!new_files) {
+        return -ENOMEM;
+    }
+    new_files->count = 1;
+    if (dup_files(new_files, files)) {
+        kfree(new_files);
+        return -ENOMEM;
+    }
+    p->files = new_files;
+    return 0;
 }
 
 /**
@@ -40,72 +179,155 @@ void verify_area(uint64_t addr,int size)
     }
 }
 /**
- * @brief 获取可用的 PID
+ * @brief 创建进程或线程
  *
- * 返回的子进程 PID 不等于任何进程的 PID 和 PGID（进程组 ID）。
- * PID 被实现为`tasks[]`数组下标。
+ * 新任务从当前任务的系统调用返回处开始运行，返回值为 0。
  *
- * @return 返回可用的 PID;无可用 PID 则返回 NR_TASKS。
+ * @param clone_flags CLONE_* 标志，0 表示 fork()
+ * @param stack 新任务的用户栈指针，0 表示与当前任务相同
+ * @param tls 指定 CLONE_SETTLS 时新任务的 tp
+ * @param parent_tid 指定 CLONE_PARENT_SETTID 时写入新任务的 TID
+ * @param child_tid 指定 CLONE_CHILD_SETTID 时写入新任务的 TID，
+ *                  指定 CLONE_CHILD_CLEARTID 时在新任务退出时清零
+ * @param tf 当前任务的中断保存栈
+ * @return 成功返回新任务的 TID；标志组合不合法时返回 -EINVAL，资源不足时返回 -EAGAIN
  */
-static uint32_t find_empty_process()
+long do_fork(uint64_t clone_flags, uint64_t stack, uint64_t tls,
+             int *parent_tid, int *child_tid, struct trapframe *tf)
 {
-    uint32_t pid = 0;
-    size_t i;
-    while (++pid < NR_TASKS) {
-        for (i = 0; i < NR_TASKS; ++i) {
-            if (tasks[i] && (pid == i || pid == tasks[i]->pgid)) {
-                break;
-            }
-        }
-        if (i == NR_TASKS) {
-            break;
-        }
-    }
-    return pid;
-}
-
-/**
- * @brief 实现系统调用 fork()
- */
-long sys_fork(struct trapframe *tf)
-{
-    uint32_t nr = find_empty_process();
-    if (nr == NR_TASKS) {
+    if (((clone_flags & CLONE_THREAD) && !(clone_flags & CLONE_VM)) ||
+        (current->flags & PF_KTHREAD)) {
+        return -EINVAL;
+    }
+    uint32_t nr = alloc_pid();
+    if (!nr) {
         return -EAGAIN;
     }
     uint64_t page = get_free_page();
     if (!page) {
+        free_pid(nr);
         return -EAGAIN;
     }
     struct task_struct* p = (struct task_struct *)VIRTUAL(page);
 
-    uint64_t page_dir = get_free_page();
-    if (!page_dir) {
+    memcpy(p, current, sizeof(struct task_struct));
+    if (copy_files(clone_flags, p)) {
         free_page(page);
+        free_pid(nr);
+        return -EAGAIN;
+    }
+    if (copy_mm(clone_flags, p)) {
+        put_files_struct(p->files);
+        free_page(page);
+        free_pid(nr);
         return -EAGAIN;
     }
-
-    memcpy(p, current, sizeof(struct task_struct) - sizeof(struct trapframe));
-    p->context = *tf;
-    p->context.epc += INST_LEN(p->context.epc);
-    p->pg_dir = (uint64_t *)VIRTUAL(page_dir);
-    tasks[nr] = p;
-    kprintf("process %x forks process %x\n", (uint64_t)current->pid, (uint64_t)nr);
-
-    /* 在此之间发生错误，将不会创建进程，系统处于安全状态 */
-    copy_mem(p);
-
     p->state = TASK_UNINTERRUPTIBLE;
+    p->preempt_count = 0;
+    p->need_resched = 0;
+    p->prio = p->rt_priority;       /* 调度策略被继承，优先级继承不被继承 */
+    p->time_slice = RR_TIMESLICE;
+    p->blocked_on = NULL;
+    linked_list_init(&p->pi_mutexes);
+    linked_list_init(&p->rt_node);
+    p->utime = p->stime = p->cutime = p->cstime = 0;
+    memset(&p->sched_info, 0, sizeof(p->sched_info));
+    p->syscall_stats = NULL;
+    /* 子进程的 trapframe 位于其内核栈顶，第一次被调度时从 ret_from_fork 经中断返回路径回到用户态，
+     * epc 已由 syscall_handler() 指向 ecall 的下一条指令 */
+    struct trapframe *child_tf = task_pt_regs(p);
+    *child_tf = *tf;
+    if (stack) {
+        child_tf->gpr.sp = stack;
+    }
+    if (clone_flags & CLONE_SETTLS) {
+        child_tf->gpr.tp = tls;
+    }
+    child_tf->gpr.a0 = 0; /* 新进程 fork() 返回值 */
+    p->context.ra = (uint64_t)ret_from_fork;
+    p->context.sp = (uint64_t)child_tf;
+    p->pg_dir = p->mm->pg_dir;
     p->pid = nr;
+    p->set_child_tid = (clone_flags & CLONE_CHILD_SETTID) ? child_tid : NULL;
+    p->clear_child_tid = (clone_flags & CLONE_CHILD_CLEARTID) ? child_tid : NULL;
+    p->group_exit = 0;
+    p->group_exit_code = 0;
+    p->group_exec_task = NULL;
+
     p->counter = p->priority = 15;
     p->start_time = ticks;
-    p->p_pptr = current;
-    p->p_osptr = current->p_ysptr;
-    if (p->p_osptr) {
-        p->p_osptr->p_ysptr = current;
+    init_timer(&p->real_timer, it_real_fn, (uint64_t)p); /* 间隔定时器不被继承 */
+    p->it_real_incr = p->it_real_overrun = 0;
+    p->ipc_state = IPC_IDLE;
+    p->ipc_partner = NULL;
+    p->p_cptr = NULL;
+    init_waitqueue_head(&p->wait_chldexit);
+    /* 线程不是当前进程的子进程，由回收线程回收；线程组在组长被回收时才结束，见 exit.c */
+    uint64_t flag = irq_save();
+    if (clone_flags & CLONE_THREAD) {
+        p->tgid = current->tgid;
+        p->group_leader = current->group_leader;
+        linked_list_insert_before(&p->group_leader->thread_group, &p->thread_group);
+        p->p_pptr = child_reaper;
+    } else {
+        p->tgid = nr;
+        p->group_leader = p;
+        linked_list_init(&p->thread_group);
+        p->p_pptr = current;
+    }
+    set_links(p);
+    irq_restore(flag);
+    if (!(clone_flags & CLONE_VM)) {
+        vdso_update_ids(p);
+    }
+    register_task(p);
+    kprintf("process %x forks process %x\n", (uint64_t)current->pid, (uint64_t)nr);
+
+    /* 新任务可能共享地址空间，写入 TID 后再让它运行 */
+    if (clone_flags & CLONE_PARENT_SETTID) {
+        put_user(nr, parent_tid);
     }
-    current->p_cptr = p;
-    p->context.gpr.a0 = 0; /* 新进程 fork() 返回值 */
     p->state= TASK_RUNNING;
+    sched_info_queued(p, 0);
+    rt_enqueue(p);
     return nr;
 }
+
+/**
+ * @brief 新任务第一次被调度时回到用户态之前的处理，由 switch.S 中的 ret_from_fork 调用
+ *
+ * CLONE_CHILD_SETTID 的 TID 要写入新任务的地址空间，只能在新任务中写入。
+ */
+void schedule_tail()
+{
+    if (current->set_child_tid) {
+        put_user(current->pid, current->set_child_tid);
+    }
+    group_exit_check();
+}
+
+/**
+ * @brief 实现系统调用 fork()
+ */
+long sys_fork(struct trapframe *tf)
+{
+    return do_fork(0, 0, 0, NULL, NULL, tf);
+}
+
+/**
+ * @brief 实现系统调用 clone()
+ *
+ * 创建线程时通常指定 CLONE_VM | CLONE_FILES | CLONE_THREAD | CLONE_SETTLS，
+ * 并为新线程分配独立的用户栈。
+ *
+ * @param 参数1 unsigned long flags CLONE_* 标志
+ * @param 参数2 void *stack 新任务的用户栈指针，NULL 表示与当前任务相同
+ * @param 参数3 int *parent_tid 见 CLONE_PARENT_SETTID
+ * @param 参数4 unsigned long tls 见 CLONE_SETTLS
+ * @param 参数5 int *child_tid 见 CLONE_CHILD_SETTID、CLONE_CHILD_CLEARTID
+ * @return 成功时当前任务返回新任务的 TID，新任务返回 0
+ */
+long sys_clone(struct trapframe *tf)
+{
+    return do_fork(tf->gpr.a0, tf->gpr.a1, tf->gpr.a3, (int *)tf->gpr.a2, (int *)tf->gpr.a4, tf);
+}
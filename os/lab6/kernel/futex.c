@@ -0,0 +1,332 @@
+/**
+ * @file futex.c
+ * @brief 实现系统调用 futex()
+ *
+ * futex 以所在物理页的地址加页内偏移为键，映射同一物理页的线程和进程通过同一
+ * 个键同步。等待者按键散列到 FUTEX_HASH_SIZE 个桶中，每个桶是一个等待队列，
+ * 等待者以独占方式挂在队列上；唤醒时只遍历键所在的桶，只唤醒键相同的等待者。
+ *
+ * 计算键之前先对 futex 做一次原子加 0：这是一次写访问，futex 所在的页不在内存中
+ * 时由缺页异常调入，被 fork() 写保护时完成写时复制，此后该页是进程私有的可写页，
+ * 键不会因为写时复制而改变。计算键、比较 futex 的值和挂入等待队列都在关中断时
+ * 完成，FUTEX_WAKE 不会在它们之间发生，唤醒不会丢失。
+ */
+#include <futex.h>
+#include <errno.h>
+#include <mm.h>
+#include <riscv.h>
+#include <sched.h>
+#include <shm.h>
+#include <timer.h>
+#include <uaccess.h>
+#include <vma.h>
+#include <wait.h>
+
+#define FUTEX_HASH_BITS      6
+#define FUTEX_HASH_SIZE      (1 << FUTEX_HASH_BITS)     /**< 散列桶数 */
+
+/** futex 等待者，放在等待进程的内核栈上 */
+struct futex_q {
+    struct wait_queue_entry wait;
+    uint64_t key;                                       /**< futex 的物理地址 */
+};
+
+static struct wait_queue_head futex_queues[FUTEX_HASH_SIZE];
+
+/**
+ * @brief 初始化 futex 散列表
+ */
+void futex_init()
+{
+    for (size_t i = 0; i < FUTEX_HASH_SIZE; ++i) {
+        init_waitqueue_head(&futex_queues[i]);
+    }
+}
+
+/** 键所在的散列桶 */
+static struct wait_queue_head *futex_hash(uint64_t key)
+{
+    return &futex_queues[((key >> 2) * 0x9E3779B97F4A7C15ULL) >> (64 - FUTEX_HASH_BITS)];
+}
+
+/**
+ * @brief 检查 futex 是否位于当前进程可写的用户内存中
+ *
+ * 运行内核映像的进程没有 VMA，它们的数据段和栈都可写，但缺页异常不能为它们
+ * 调入未映射的页，futex 所在的页必须已经映射。共享内存映射（见 shm.h）不是 VMA，
+ * 它的页在 mmap() 时就已映射，按页表项判断是否可写，跨进程的 futex 通常放在其中。
+ *
+ * @return 合法返回 0；地址未对齐时返回 -EINVAL，不可写时返回 -EFAULT
+ */
+static int64_t futex_access_ok(int *uaddr)
+{
+    uint64_t addr = (uint64_t)uaddr;
+    if (addr & (sizeof(int) - 1)) {
+        return -EINVAL;
+    }
+    struct mm_struct *mm = current->mm;
+    if (!mm || addr >= START_KERNEL) {
+        return -EFAULT;
+    }
+    if (in_shm_area(mm, addr)) {
+        uint64_t *pte = find_pte(addr);
+        return pte && (*pte & PAGE_WRITABLE) ? 0 : -EFAULT;
+    }
+    if (linked_list_empty(&mm->mmap)) {
+        uint64_t *pte = find_pte(addr);
+        return addr >= current->start_data && pte && (*pte & PAGE_VALID) ? 0 : -EFAULT;
+    }
+    struct vm_area_struct *vma = find_vma(mm, addr);
+    return vma && (vma->vm_flags & VM_WRITE) ? 0 : -EFAULT;
+}
+
+/**
+ * @brief 计算 futex 的键，调用者需关中断
+ *
+ * @return futex 的物理地址；所在的页不在内存中或被写保护时返回 0，
+ *         调用者应开中断后调用 futex_fault_in() 再重试
+ */
+static uint64_t futex_key(int *uaddr)
+{
+    uint64_t *pte = find_pte((uint64_t)uaddr);
+    if (!pte || (*pte & (PAGE_VALID | PAGE_WRITABLE)) != (PAGE_VALID | PAGE_WRITABLE)) {
+        return 0;
+    }
+    return GET_PAGE_ADDR(*pte) + ((uint64_t)uaddr & (PAGE_SIZE - 1));
+}
+
+/**
+ * @brief 调入 futex 所在的页并完成写时复制
+ */
+static void futex_fault_in(int *uaddr)
+{
+    __atomic_fetch_add(uaddr, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief 关中断并计算 futex 的键
+ *
+ * @param flag 写入关中断前的中断状态，由调用者用 irq_restore() 恢复
+ */
+static uint64_t futex_lock_key(int *uaddr, uint64_t *flag)
+{
+    uint64_t key;
+    *flag = irq_save();
+    while (!(key = futex_key(uaddr))) {
+        irq_restore(*flag);
+        futex_fault_in(uaddr);
+        *flag = irq_save();
+    }
+    return key;
+}
+
+/**
+ * @brief 唤醒键为 key 的等待者，调用者需关中断
+ *
+ * 被唤醒的等待者被移出等待队列，等待者据此区分唤醒和超时。
+ *
+ * @return 唤醒的等待者个数
+ */
+static long futex_wake_key(uint64_t key, int nr_wake)
+{
+    struct wait_queue_head *head = futex_hash(key);
+    struct linked_list_node *node = head->task_list.next;
+    long woken = 0;
+    while (node != &head->task_list && woken < nr_wake) {
+        struct linked_list_node *next = node->next;
+        struct futex_q *q = container_of(node, struct futex_q, wait.entry);
+        if (q->key == key) {
+            linked_list_remove(node);
+            linked_list_init(node);
+            q->wait.func(&q->wait);
+            ++woken;
+        }
+        node = next;
+    }
+    return woken;
+}
+
+/**
+ * @brief *uaddr == val 时睡眠，直到被 FUTEX_WAKE 唤醒、超时或被间隔定时器打断
+ *
+ * @param timeout 相对超时时间，NULL 表示不超时
+ * @return 被唤醒返回 0；*uaddr != val 时返回 -EAGAIN，超时返回 -ETIMEDOUT，
+ *         被打断返回 -EINTR
+ */
+static long futex_wait(int *uaddr, int val, const struct timespec *timeout)
+{
+    uint64_t deadline = 0;
+    if (timeout) {
+        struct timespec ts;
+        if (copy_from_user(&ts, timeout, sizeof(ts))) {
+            return -EFAULT;
+        }
+        if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= NSEC_PER_SEC) {
+            return -EINVAL;
+        }
+        deadline = get_cycles() + (uint64_t)ts.tv_sec * timebase_freq + nsec_to_cycles(ts.tv_nsec);
+    }
+
+    struct futex_q q;
+    init_waitqueue_entry(&q.wait, current);
+    uint64_t flag;
+    q.key = futex_lock_key(uaddr, &flag);
+    if (*(volatile int *)uaddr != val) {
+        irq_restore(flag);
+        return -EAGAIN;
+    }
+    add_wait_queue_exclusive(futex_hash(q.key), &q.wait);
+    uint64_t left = 1;
+    if (timeout) {
+        left = sleep_until(deadline);
+    } else {
+        current->state = TASK_INTERRUPTIBLE;
+        schedule();
+    }
+    long ret = 0;
+    if (!linked_list_empty(&q.wait.entry)) {
+        /* 不是被 futex_wake_key() 唤醒的，FUTEX_REQUEUE 可能已把等待者移到其他桶 */
+        linked_list_remove(&q.wait.entry);
+        ret = left ? -EINTR : -ETIMEDOUT;
+    }
+    irq_restore(flag);
+    return ret;
+}
+
+/**
+ * @brief 最多唤醒 nr_wake 个在 uaddr 上等待的进程
+ *
+ * @return 唤醒的进程数；地址不合法时返回 -EINVAL 或 -EFAULT
+ */
+long futex_wake(int *uaddr, int nr_wake)
+{
+    int64_t ret = futex_access_ok(uaddr);
+    if (ret) {
+        return ret;
+    }
+    uint64_t flag;
+    uint64_t key = futex_lock_key(uaddr, &flag);
+    long woken = futex_wake_key(key, nr_wake);
+    irq_restore(flag);
+    return woken;
+}
+
+/**
+ * @brief 线程退出时处理 CLONE_CHILD_CLEARTID：将 TID 清零并唤醒一个等待者
+ *
+ * 等待者通常是 pthread_join()，它在 TID 不为 0 时以 FUTEX_WAIT 睡眠。
+ * 地址不合法时什么也不做。
+ */
+void futex_clear_tid(int *uaddr)
+{
+    if (futex_access_ok(uaddr)) {
+        return;
+    }
+    uint64_t flag;
+    uint64_t key = futex_lock_key(uaddr, &flag);
+    *uaddr = 0;
+    futex_wake_key(key, 1);
+    irq_restore(flag);
+}
+
+/**
+ * @brief 唤醒 uaddr 上的 nr_wake 个等待者，把最多 nr_requeue 个等待者移到 uaddr2 上
+ *
+ * 条件变量广播时只唤醒一个等待者，其余的移到互斥锁上，避免惊群。
+ *
+ * @param cmpval cmp 非 0 时要求 *uaddr == cmpval
+ * @return 唤醒和移动的等待者总数；比较失败时返回 -EAGAIN
+ */
+static long futex_requeue(int *uaddr, int *uaddr2, int nr_wake, int nr_requeue, int cmpval, uint64_t cmp)
+{
+    uint64_t flag, key1, key2;
+    while (1) {
+        flag = irq_save();
+        key1 = futex_key(uaddr);
+        key2 = futex_key(uaddr2);
+        if (key1 && key2) {
+            break;
+        }
+        irq_restore(flag);
+        futex_fault_in(uaddr);
+        futex_fault_in(uaddr2);
+    }
+    if (cmp && *(volatile int *)uaddr != cmpval) {
+        irq_restore(flag);
+        return -EAGAIN;
+    }
+    long ret = futex_wake_key(key1, nr_wake);
+    if (key1 != key2) {
+        struct wait_queue_head *head1 = futex_hash(key1);
+        struct wait_queue_head *head2 = futex_hash(key2);
+        struct linked_list_node *node = head1->task_list.next;
+        for (int moved = 0; node != &head1->task_list && moved < nr_requeue; ) {
+            struct linked_list_node *next = node->next;
+            struct futex_q *q = container_of(node, struct futex_q, wait.entry);
+            if (q->key == key1) {
+                linked_list_remove(node);
+                q->key = key2;
+                linked_list_push(&head2->task_list, node);
+                ++moved;
+                ++ret;
+            }
+            node = next;
+        }
+    }
+    irq_restore(flag);
+    return ret;
+}
+
+/**
+ * @brief futex 操作
+ *
+ * @param uaddr futex 地址，4 字节对齐
+ * @param op FUTEX_* 操作，可以带 FUTEX_PRIVATE_FLAG
+ * @param val FUTEX_WAIT 的期望值，FUTEX_WAKE、FUTEX_REQUEUE 唤醒的等待者数
+ * @param timeout FUTEX_WAIT 的相对超时时间，可以为 NULL
+ * @param uaddr2 FUTEX_REQUEUE 的目标 futex
+ * @param val2 FUTEX_REQUEUE 移动的等待者数上限
+ * @param val3 FUTEX_CMP_REQUEUE 的期望值
+ * @return 见各操作；不支持的操作返回 -ENOSYS
+ */
+long do_futex(int *uaddr, int op, int val, const struct timespec *timeout,
+              int *uaddr2, int val2, int val3)
+{
+    int cmd = op & FUTEX_CMD_MASK;
+    int64_t ret = futex_access_ok(uaddr);
+    if (!ret && (cmd == FUTEX_REQUEUE || cmd == FUTEX_CMP_REQUEUE)) {
+        ret = futex_access_ok(uaddr2);
+    }
+    if (ret) {
+        return ret;
+    }
+    switch (cmd) {
+    case FUTEX_WAIT:
+        return futex_wait(uaddr, val, timeout);
+    case FUTEX_WAKE:
+        return futex_wake(uaddr, val);
+    case FUTEX_REQUEUE:
+        return futex_requeue(uaddr, uaddr2, val, val2, 0, 0);
+    case FUTEX_CMP_REQUEUE:
+        return futex_requeue(uaddr, uaddr2, val, val2, val3, 1);
+    default:
+        return -ENOSYS;
+    }
+}
+
+/**
+ * @brief 实现系统调用 futex()
+ *
+ * @param 参数1 int *uaddr futex 地址
+ * @param 参数2 int op FUTEX_* 操作
+ * @param 参数3 int val 见 do_futex()
+ * @param 参数4 const struct timespec *timeout FUTEX_WAIT 的超时时间；
+ *              FUTEX_REQUEUE、FUTEX_CMP_REQUEUE 时为 int val2
+ * @param 参数5 int *uaddr2 FUTEX_REQUEUE 的目标 futex
+ * @param 参数6 int val3 FUTEX_CMP_REQUEUE 的期望值
+ */
+long sys_futex(struct trapframe *tf)
+{
+    return do_futex((int *)tf->gpr.a0, tf->gpr.a1, tf->gpr.a2, (const struct timespec *)tf->gpr.a3,
+                    (int *)tf->gpr.a4, tf->gpr.a3, tf->gpr.a5);
+}
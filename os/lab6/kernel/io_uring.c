@@ -0,0 +1,750 @@
+/**
+ * @file io_uring.c
+ * @brief 实现 io_uring 系统调用 io_uring_setup() 和 io_uring_enter()
+ *
+ * 队列的两页由 io_uring_setup() 分配并映射到用户地址空间的 IO_URING_BASE，内核
+ * 通过线性映射区访问它们，因此中断下半部、定时器和轮询线程都能在任意进程上下文
+ * 中写入 CQE。
+ *
+ * 请求分为两类：
+ * - 同步请求（NOP、读写 ramfs 文件、写串口）在提交时直接执行并写入 CQE；
+ * - 异步请求（读写块设备、读串口、超时）分配 io_kiocb 后交给设备驱动或定时器，
+ *   提交立即返回，完成回调关中断写入 CQE。设备直接访问用户缓冲区，提交时先调入
+ *   缓冲区所在的页并增加其引用计数，请求完成后再释放，缓冲区不能跨页。每个队列
+ *   同时最多有 cq_entries 个未完成的异步请求，超过时提交以 -EBUSY 失败。
+ *
+ * 读写 ramfs 文件用的文件描述符在 io_uring_setup() 调用者的文件表中查找。
+ *
+ * 指定 IORING_SETUP_SQPOLL 时由内核线程轮询提交队列：线程借用队列所在的地址空间，
+ * 以便访问用户缓冲区和处理缺页；空闲 sq_thread_idle 毫秒后设置 IORING_SQ_NEED_WAKEUP
+ * 并睡眠，等待 io_uring_enter(IORING_ENTER_SQ_WAKEUP) 唤醒。
+ */
+#include <io_uring.h>
+#include <clock.h>
+#include <device.h>
+#include <device/block.h>
+#include <device/serial.h>
+#include <device/serial/uart8250.h>
+#include <device/virtio.h>
+#include <errno.h>
+#include <fs/vfs.h>
+#include <fs/file.h>
+#include <kthread.h>
+#include <mm.h>
+#include <preempt.h>
+#include <riscv.h>
+#include <sched.h>
+#include <string.h>
+#include <timer.h>
+#include <uaccess.h>
+#include <vma.h>
+#include <wait.h>
+
+#define IORING_SQ_IDLE_DEFAULT 1000                 /**< 轮询线程默认空闲时间（毫秒） */
+#define IO_QUEUED              1                    /**< 请求已交给驱动或定时器，稍后完成 */
+
+/** 一对队列的内核状态，属于地址空间 */
+struct io_ring_ctx {
+    struct mm_struct *mm;                           /**< 队列所在的地址空间 */
+    struct files_struct *files;                     /**< 查找文件描述符用的文件表 */
+    struct io_uring_rings *rings;                   /**< 控制字段和 CQE 数组的内核地址 */
+    struct io_uring_sqe *sqes;                      /**< SQE 数组的内核地址 */
+    uint32_t sq_entries;
+    uint32_t cq_entries;
+    uint32_t sq_head;                               /**< 内核持有的 SQ head，用户态不能修改 */
+    uint32_t cq_tail;                               /**< 内核持有的 CQ tail */
+    uint32_t cq_seq;                                /**< 已完成的非超时请求数 */
+    struct wait_queue_head cq_wait;                 /**< 等待完成的进程 */
+    struct linked_list_node inflight;               /**< 尚未完成的异步请求 */
+    uint32_t nr_inflight;                           /**< inflight 链表中的请求数，不超过 cq_entries */
+    struct device *blk_dev;                         /**< virtio 块设备，不存在时为 NULL */
+    struct device *serial_dev;                      /**< 串口，不存在时为 NULL */
+    struct task_struct *sq_thread;                  /**< 轮询线程 */
+    struct wait_queue_head sq_wait;                 /**< 轮询线程在此睡眠 */
+    uint64_t sq_idle;                               /**< 轮询线程空闲时间（时钟周期数） */
+    uint64_t sq_stop;                               /**< 通知轮询线程退出 */
+    uint64_t start_data;                            /**< 创建者的数据段起始地址，轮询线程处理缺页时使用 */
+};
+
+/** 异步请求 */
+struct io_kiocb {
+    struct io_ring_ctx *ctx;
+    uint64_t user_data;
+    uint8_t opcode;
+    uint64_t page;                                  /**< 被固定的用户页的物理地址，没有时为 0 */
+    uint64_t has_target;                            /**< 超时请求是否同时等待 target */
+    uint32_t target;                                /**< 超时请求在 cq_seq 达到该值时结束 */
+    struct linked_list_node list;                   /**< inflight 链表节点 */
+    union {
+        struct block_request blk;
+        struct serial_request ser;
+        struct timer_list timer;
+    };
+};
+
+/** SQ 中尚未被内核取走的 SQE 数 */
+static uint32_t io_sqring_entries(struct io_ring_ctx *ctx)
+{
+    return __atomic_load_n(&ctx->rings->sq_tail, __ATOMIC_ACQUIRE) - ctx->sq_head;
+}
+
+/** CQ 中尚未被用户态读取的 CQE 数 */
+static uint32_t io_cqring_events(struct io_ring_ctx *ctx)
+{
+    return ctx->cq_tail - __atomic_load_n(&ctx->rings->cq_head, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief 写入一个 CQE，调用者需关中断
+ *
+ * CQ 已满时丢弃 CQE 并增加 cq_overflow。
+ */
+static void io_fill_cqe(struct io_ring_ctx *ctx, uint64_t user_data, int64_t res)
+{
+    if (io_cqring_events(ctx) >= ctx->cq_entries) {
+        ++ctx->rings->cq_overflow;
+        return;
+    }
+    struct io_uring_cqe *cqe = &ctx->rings->cqes[ctx->cq_tail & (ctx->cq_entries - 1)];
+    cqe->user_data = user_data;
+    cqe->res = res;
+    cqe->flags = 0;
+    __atomic_store_n(&ctx->rings->cq_tail, ++ctx->cq_tail, __ATOMIC_RELEASE);
+}
+
+/** 释放异步请求及其固定的页，调用者需关中断 */
+static void io_free_req(struct io_kiocb *req)
+{
+    linked_list_remove(&req->list);
+    --req->ctx->nr_inflight;
+    if (req->page) {
+        free_page(req->page);
+    }
+    kfree(req);
+}
+
+/**
+ * @brief 完成一个请求，调用者需关中断
+ *
+ * 非超时请求完成后检查等待完成数的超时请求，再唤醒等待完成的进程。
+ *
+ * @param req 异步请求，被释放；同步请求为 NULL
+ */
+static void io_complete(struct io_ring_ctx *ctx, struct io_kiocb *req, uint64_t user_data, int64_t res)
+{
+    io_fill_cqe(ctx, user_data, res);
+    uint64_t is_timeout = req && req->opcode == IORING_OP_TIMEOUT;
+    if (req) {
+        io_free_req(req);
+    }
+    if (!is_timeout) {
+        ++ctx->cq_seq;
+        struct linked_list_node *node = ctx->inflight.next;
+        while (node != &ctx->inflight) {
+            struct io_kiocb *t = container_of(node, struct io_kiocb, list);
+            node = node->next;
+            if (t->opcode == IORING_OP_TIMEOUT && t->has_target && (int32_t)(ctx->cq_seq - t->target) >= 0) {
+                timer_del(&t->timer);
+                io_fill_cqe(ctx, t->user_data, 0);
+                io_free_req(t);
+            }
+        }
+    }
+    wake_up_all(&ctx->cq_wait);
+}
+
+/**
+ * @brief 检查用户缓冲区，调入并固定它所在的页
+ *
+ * 先用 get_user() 读缓冲区的第一个字节调入页面，地址无效时返回 -EFAULT 而不是
+ * 在内核中出错；设备写缓冲区时再与 futex 相同，对所在的对齐的 32 位字做一次原子
+ * 加 0 的写访问完成写时复制。之后关中断检查页表项。mem_map[] 是 8 位计数，页的
+ * 引用数已达到 MAX_PAGE_REF 时不再固定它。
+ *
+ * @param req 异步请求，固定的页记录在 req->page
+ * @param addr 用户缓冲区地址
+ * @param len 缓冲区长度，缓冲区不能跨页
+ * @param write 设备是否写缓冲区
+ * @param kaddr 写入缓冲区在线性映射区的地址
+ * @return 成功返回 0；缓冲区跨页时返回 -EINVAL，不可访问时返回 -EFAULT，
+ *         页的引用数已达到上限时返回 -EAGAIN
+ */
+static int64_t io_pin_user(struct io_kiocb *req, uint64_t addr, uint64_t len, uint64_t write, void **kaddr)
+{
+    if (!len || (addr & ~(PAGE_SIZE - 1)) != ((addr + len - 1) & ~(PAGE_SIZE - 1))) {
+        return -EINVAL;
+    }
+    struct mm_struct *mm = current->mm;
+    if (addr >= START_KERNEL || (addr >= VDSO_BASE && addr < IO_URING_END)) {
+        return -EFAULT;
+    }
+    if (linked_list_empty(&mm->mmap)) {
+        /* 运行内核映像的进程没有 VMA，页必须已经映射 */
+        uint64_t *pte = find_pte(addr);
+        if (!pte || !(*pte & PAGE_VALID) || (write && addr < current->start_data)) {
+            return -EFAULT;
+        }
+    } else {
+        struct vm_area_struct *vma = find_vma(mm, addr);
+        if (!vma || !(vma->vm_flags & (write ? VM_WRITE : VM_READ))) {
+            return -EFAULT;
+        }
+    }
+
+    uint16_t need = write ? PAGE_VALID | PAGE_WRITABLE : PAGE_VALID;
+    uint64_t *pte;
+    uint64_t flag = irq_save();
+    while (!(pte = find_pte(addr)) || (*pte & need) != need) {
+        irq_restore(flag);
+        uint8_t c;
+        if (get_user(c, (const uint8_t *)addr)) {
+            return -EFAULT;
+        }
+        (void)c;
+        if (write) {
+            /* 子字原子操作在 RISC-V 上是 libatomic 的库函数，内核没有链接它 */
+            __atomic_fetch_add((uint32_t *)(addr & ~3UL), 0, __ATOMIC_RELAXED);
+        }
+        flag = irq_save();
+    }
+    uint64_t page = GET_PAGE_ADDR(*pte);
+    if (page >= LOW_MEM) {
+        if (mem_map[MAP_NR(page)] >= MAX_PAGE_REF) {
+            irq_restore(flag);
+            return -EAGAIN;
+        }
+        ++mem_map[MAP_NR(page)];
+        req->page = page;
+    }
+    irq_restore(flag);
+    *kaddr = (void *)(VIRTUAL(page) + (addr & (PAGE_SIZE - 1)));
+    return 0;
+}
+
+/** 块设备请求完成回调 */
+static void io_block_end_io(struct block_request *request)
+{
+    struct io_kiocb *req = request->private;
+    io_complete(req->ctx, req, req->user_data, request->error ? request->error : IORING_BLOCK_SIZE);
+}
+
+/**
+ * @brief 提交块设备请求
+ */
+static int64_t io_block(struct io_kiocb *req, const struct io_uring_sqe *sqe, uint64_t is_read)
+{
+    struct io_ring_ctx *ctx = req->ctx;
+    if (!ctx->blk_dev) {
+        return -ENODEV;
+    }
+    if (sqe->len != IORING_BLOCK_SIZE) {
+        return -EINVAL;
+    }
+    void *buffer;
+    int64_t ret = io_pin_user(req, sqe->addr, sqe->len, is_read, &buffer);
+    if (ret) {
+        return ret;
+    }
+    req->blk.is_read = is_read;
+    req->blk.sector = sqe->off;
+    req->blk.buffer = buffer;
+    req->blk.end_io = io_block_end_io;
+    req->blk.private = req;
+    struct block_device *blk = ctx->blk_dev->get_interface(ctx->blk_dev, BLOCK_INTERFACE_BIT);
+    return blk->submit(ctx->blk_dev, &req->blk);
+}
+
+/** 串口读请求完成回调 */
+static void io_char_end_io(struct serial_request *request)
+{
+    struct io_kiocb *req = request->private;
+    io_complete(req->ctx, req, req->user_data, request->actual);
+}
+
+/**
+ * @brief 提交串口读请求，有数据可读时即完成
+ */
+static int64_t io_char_read(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+{
+    struct io_ring_ctx *ctx = req->ctx;
+    if (!ctx->serial_dev) {
+        return -ENODEV;
+    }
+    void *buffer;
+    int64_t ret = io_pin_user(req, sqe->addr, sqe->len, 1, &buffer);
+    if (ret) {
+        return ret;
+    }
+    req->ser.buffer = buffer;
+    req->ser.size = sqe->len;
+    req->ser.end_io = io_char_end_io;
+    req->ser.private = req;
+    struct serial_device *serial = ctx->serial_dev->get_interface(ctx->serial_dev, SERIAL_INTERFACE_BIT);
+    return serial->submit(ctx->serial_dev, &req->ser);
+}
+
+/** 超时请求到期，在时钟中断中调用 */
+static void io_timeout_fn(struct timer_list *timer)
+{
+    struct io_kiocb *req = (struct io_kiocb *)timer->data;
+    io_complete(req->ctx, req, req->user_data, -ETIME);
+}
+
+/**
+ * @brief 提交超时请求
+ *
+ * 到期时以 -ETIME 完成；off 不为 0 时，在此之后又有 off 个非超时请求完成也会
+ * 以 0 提前完成。
+ */
+static int64_t io_timeout(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+{
+    struct timespec ts;
+    if (!sqe->addr || copy_from_user(&ts, (const void *)sqe->addr, sizeof(ts))) {
+        return -EFAULT;
+    }
+    if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= NSEC_PER_SEC) {
+        return -EINVAL;
+    }
+    uint64_t expires = get_cycles() + (uint64_t)ts.tv_sec * timebase_freq + nsec_to_cycles(ts.tv_nsec);
+    init_timer(&req->timer, io_timeout_fn, (uint64_t)req);
+    uint64_t flag = irq_save();
+    req->has_target = sqe->off != 0;
+    req->target = req->ctx->cq_seq + sqe->off;
+    timer_mod(&req->timer, expires);
+    irq_restore(flag);
+    return 0;
+}
+
+/**
+ * @brief 分配并提交异步请求
+ *
+ * 请求在交给驱动前就挂入 inflight 链表，驱动可能在提交过程中完成它。
+ *
+ * @return 提交成功返回 IO_QUEUED；未完成的请求已有 cq_entries 个时返回 -EBUSY，
+ *         其他失败返回负的错误码
+ */
+static int64_t io_queue_async(struct io_ring_ctx *ctx, const struct io_uring_sqe *sqe)
+{
+    struct io_kiocb *req = kmalloc(sizeof(struct io_kiocb));
+    if (!req) {
+        return -ENOMEM;
+    }
+    req->ctx = ctx;
+    req->user_data = sqe->user_data;
+    req->opcode = sqe->opcode;
+    req->page = 0;
+    req->has_target = 0;
+    uint64_t flag = irq_save();
+    if (ctx->nr_inflight >= ctx->cq_entries) {
+        irq_restore(flag);
+        kfree(req);
+        return -EBUSY;
+    }
+    ++ctx->nr_inflight;
+    linked_list_insert_before(&ctx->inflight, &req->list);
+    irq_restore(flag);
+
+    int64_t ret;
+    switch (sqe->opcode) {
+    case IORING_OP_BLOCK_READ:
+        ret = io_block(req, sqe, 1);
+        break;
+    case IORING_OP_BLOCK_WRITE:
+        ret = io_block(req, sqe, 0);
+        break;
+    case IORING_OP_CHAR_READ:
+        ret = io_char_read(req, sqe);
+        break;
+    default:
+        ret = io_timeout(req, sqe);
+        break;
+    }
+    if (ret) {
+        flag = irq_save();
+        io_free_req(req);
+        irq_restore(flag);
+        return ret;
+    }
+    return IO_QUEUED;
+}
+
+/**
+ * @brief 在 off 处读写打开的文件，同步完成，不使用也不更新文件的读写位置
+ *
+ * @return 读写的字节数
+ */
+static int64_t io_rw(struct io_ring_ctx *ctx, const struct io_uring_sqe *sqe, uint64_t is_read)
+{
+    if (!access_ok((const void *)sqe->addr, sqe->len)) {
+        return -EFAULT;
+    }
+    struct file *file = sqe->fd < 0 ? NULL : fget_files(ctx->files, sqe->fd);
+    if (!file) {
+        return -EBADF;
+    }
+    int64_t ret = is_read ? file_pread(file, (void *)sqe->addr, sqe->len, sqe->off) :
+                            file_pwrite(file, (const void *)sqe->addr, sqe->len, sqe->off);
+    fput(file);
+    return ret;
+}
+
+/**
+ * @brief 向串口写，同步完成
+ *
+ * 串口驱动轮询发送缓冲区，写操作不会睡眠。
+ */
+static int64_t io_char_write(struct io_ring_ctx *ctx, const struct io_uring_sqe *sqe)
+{
+    if (!ctx->serial_dev) {
+        return -ENODEV;
+    }
+    if (!access_ok((const void *)sqe->addr, sqe->len)) {
+        return -EFAULT;
+    }
+    struct serial_device *serial = ctx->serial_dev->get_interface(ctx->serial_dev, SERIAL_INTERFACE_BIT);
+    return serial->request(ctx->serial_dev, (void *)sqe->addr, sqe->len, 0);
+}
+
+/**
+ * @brief 执行一个 SQE，同步请求和提交失败的请求立即写入 CQE
+ */
+static void io_submit_sqe(struct io_ring_ctx *ctx, const struct io_uring_sqe *sqe)
+{
+    int64_t ret;
+    if (sqe->flags) {
+        ret = -EINVAL;
+    } else {
+        switch (sqe->opcode) {
+        case IORING_OP_NOP:
+            ret = 0;
+            break;
+        case IORING_OP_READ:
+            ret = io_rw(ctx, sqe, 1);
+            break;
+        case IORING_OP_WRITE:
+            ret = io_rw(ctx, sqe, 0);
+            break;
+        case IORING_OP_CHAR_WRITE:
+            ret = io_char_write(ctx, sqe);
+            break;
+        case IORING_OP_BLOCK_READ:
+        case IORING_OP_BLOCK_WRITE:
+        case IORING_OP_CHAR_READ:
+        case IORING_OP_TIMEOUT:
+            ret = io_queue_async(ctx, sqe);
+            break;
+        default:
+            ret = -EINVAL;
+            break;
+        }
+    }
+    if (ret != IO_QUEUED) {
+        uint64_t flag = irq_save();
+        io_complete(ctx, NULL, sqe->user_data, ret);
+        irq_restore(flag);
+    }
+}
+
+/**
+ * @brief 从 SQ 中取出并执行最多 nr 个 SQE
+ *
+ * 同一地址空间的多个线程和轮询线程可能同时提交，取 SQE 时关中断，每个 SQE
+ * 只被取走一次。SQE 先复制到内核栈上，执行期间用户态可以重用它的位置。
+ *
+ * @return 取出的 SQE 数
+ */
+static uint32_t io_submit_sqes(struct io_ring_ctx *ctx, uint32_t nr)
+{
+    uint32_t submitted = 0;
+    while (submitted < nr) {
+        struct io_uring_sqe sqe;
+        uint64_t flag = irq_save();
+        if (!io_sqring_entries(ctx)) {
+            irq_restore(flag);
+            break;
+        }
+        sqe = ctx->sqes[ctx->sq_head & (ctx->sq_entries - 1)];
+        __atomic_store_n(&ctx->rings->sq_head, ++ctx->sq_head, __ATOMIC_RELEASE);
+        irq_restore(flag);
+        io_submit_sqe(ctx, &sqe);
+        ++submitted;
+    }
+    return submitted;
+}
+
+/**
+ * @brief 轮询线程
+ *
+ * 有 SQE 时提交；空闲时让出处理器继续轮询，空闲超过 sq_idle 后睡眠。
+ * 退出前换回 kernel_pg_dir 并释放借用的地址空间。
+ */
+static int io_sq_thread(void *arg)
+{
+    struct io_ring_ctx *ctx = arg;
+    struct mm_struct *mm = ctx->mm;
+    uint64_t flag = irq_save();
+    current->mm = mm;
+    current->start_data = ctx->start_data;
+    current->pg_dir = pg_dir = mm->pg_dir;
+    active_mapping();
+    irq_restore(flag);
+
+    uint64_t idle_end = get_cycles() + ctx->sq_idle;
+    while (!__atomic_load_n(&ctx->sq_stop, __ATOMIC_ACQUIRE)) {
+        if (io_submit_sqes(ctx, ctx->sq_entries)) {
+            idle_end = get_cycles() + ctx->sq_idle;
+            cond_resched();
+        } else if (get_cycles() < idle_end) {
+            yield();
+        } else {
+            /* 先设置标志再检查 SQ，用户态要么看到标志，要么 SQE 被这里看到 */
+            __atomic_or_fetch(&ctx->rings->sq_flags, IORING_SQ_NEED_WAKEUP, __ATOMIC_SEQ_CST);
+            wait_event_interruptible(ctx->sq_wait, io_sqring_entries(ctx) || ctx->sq_stop);
+            __atomic_and_fetch(&ctx->rings->sq_flags, ~IORING_SQ_NEED_WAKEUP, __ATOMIC_SEQ_CST);
+            idle_end = get_cycles() + ctx->sq_idle;
+        }
+    }
+
+    flag = irq_save();
+    current->mm = NULL;
+    current->pg_dir = pg_dir = kernel_pg_dir;
+    active_mapping();
+    irq_restore(flag);
+    mmdrop(mm);
+    flag = irq_save();
+    ctx->sq_thread = NULL;
+    wake_up_all(&ctx->cq_wait);
+    irq_restore(flag);
+    return 0;
+}
+
+/**
+ * @brief 释放地址空间的队列
+ *
+ * 停止轮询线程，取消超时和串口读请求，等待已交给块设备的请求完成，再解除队列
+ * 页的映射。地址空间的最后一个使用者退出、execve() 释放地址空间时调用，可能睡眠。
+ *
+ * @param mm 地址空间
+ */
+void io_uring_release(struct mm_struct *mm)
+{
+    struct io_ring_ctx *ctx = mm->io_uring;
+    if (!ctx) {
+        return;
+    }
+    if (ctx->sq_thread) {
+        __atomic_store_n(&ctx->sq_stop, 1, __ATOMIC_RELEASE);
+        wake_up(&ctx->sq_wait);
+        wait_event(ctx->cq_wait, !ctx->sq_thread);
+    }
+
+    uint64_t flag = irq_save();
+    struct linked_list_node *node = ctx->inflight.next;
+    while (node != &ctx->inflight) {
+        struct io_kiocb *req = container_of(node, struct io_kiocb, list);
+        node = node->next;
+        if (req->opcode == IORING_OP_TIMEOUT) {
+            timer_del(&req->timer);
+            io_free_req(req);
+        } else if (req->opcode == IORING_OP_CHAR_READ) {
+            struct serial_device *serial = ctx->serial_dev->get_interface(ctx->serial_dev, SERIAL_INTERFACE_BIT);
+            if (serial->cancel(ctx->serial_dev, &req->ser)) {
+                io_free_req(req);
+            }
+        }
+    }
+    irq_restore(flag);
+    wait_event(ctx->cq_wait, linked_list_empty(&ctx->inflight));
+
+    flag = irq_save();
+    mm->io_uring = NULL;
+    for (uint64_t addr = IO_URING_BASE; addr < IO_URING_END; addr += PAGE_SIZE) {
+        uint64_t *pte = get_pte(mm->pg_dir, addr);
+        if (pte && (*pte & PAGE_VALID)) {
+            free_page(GET_PAGE_ADDR(*pte));
+            *pte = 0;
+        }
+    }
+    invalidate();
+    irq_restore(flag);
+    put_files_struct(ctx->files);
+    kfree(ctx);
+}
+
+/**
+ * @brief fork() 后撤销子进程中的队列映射
+ *
+ * copy_page_tables() 使子进程共享队列页并写保护了父进程的页表项。子进程没有
+ * 队列，父进程的队列页恢复可写，内核和用户态继续共享同一物理页。
+ *
+ * @param mm 子进程的地址空间，不是当前使用的
+ */
+void io_uring_fork(struct mm_struct *mm)
+{
+    if (!current->mm->io_uring) {
+        return;
+    }
+    for (uint64_t addr = IO_URING_BASE; addr < IO_URING_END; addr += PAGE_SIZE) {
+        uint64_t *pte = get_pte(mm->pg_dir, addr);
+        if (pte && (*pte & PAGE_VALID)) {
+            free_page(GET_PAGE_ADDR(*pte));
+            *pte = 0;
+        }
+        pte = find_pte(addr);
+        if (pte && (*pte & PAGE_VALID)) {
+            *pte |= PAGE_WRITABLE;
+        }
+    }
+    invalidate();
+}
+
+/** 向上取整到 2 的幂 */
+static uint32_t roundup_pow_of_two(uint32_t n)
+{
+    uint32_t v = 1;
+    while (v < n) {
+        v <<= 1;
+    }
+    return v;
+}
+
+/**
+ * @brief 实现系统调用 io_uring_setup()
+ *
+ * 为当前地址空间建立队列并映射到 IO_URING_BASE。
+ *
+ * @param 参数1 uint32_t entries SQ 长度，向上取整到 2 的幂，不超过 IORING_MAX_ENTRIES
+ * @param 参数2 struct io_uring_params *p 输入 flags 和 sq_thread_idle，输出队列长度和地址
+ * @return 成功返回 0；参数非法返回 -EINVAL，地址空间已有队列返回 -EBUSY，
+ *         内存不足返回 -ENOMEM
+ */
+long sys_io_uring_setup(struct trapframe *tf)
+{
+    uint32_t entries = tf->gpr.a0;
+    struct io_uring_params *up = (struct io_uring_params *)tf->gpr.a1;
+    struct io_uring_params params, *p = &params;
+    struct mm_struct *mm = current->mm;
+    if (!up || copy_from_user(p, up, sizeof(params))) {
+        return -EFAULT;
+    }
+    if (!entries || entries > IORING_MAX_ENTRIES || (p->flags & ~IORING_SETUP_SQPOLL)) {
+        return -EINVAL;
+    }
+    if (mm->io_uring) {
+        return -EBUSY;
+    }
+
+    struct io_ring_ctx *ctx = kmalloc(sizeof(struct io_ring_ctx));
+    uint64_t rings_page = ctx ? get_free_page() : 0;
+    uint64_t sqes_page = rings_page ? get_free_page() : 0;
+    if (!sqes_page) {
+        if (rings_page) {
+            free_page(rings_page);
+        }
+        if (ctx) {
+            kfree(ctx);
+        }
+        return -ENOMEM;
+    }
+    memset(ctx, 0, sizeof(struct io_ring_ctx));
+    ctx->mm = mm;
+    ctx->files = current->files;
+    ctx->rings = (struct io_uring_rings *)VIRTUAL(rings_page);
+    ctx->sqes = (struct io_uring_sqe *)VIRTUAL(sqes_page);
+    ctx->sq_entries = roundup_pow_of_two(entries);
+    ctx->cq_entries = 2 * ctx->sq_entries;
+    init_waitqueue_head(&ctx->cq_wait);
+    init_waitqueue_head(&ctx->sq_wait);
+    linked_list_init(&ctx->inflight);
+    ctx->blk_dev = get_dev_by_major_minor(VIRTIO_MAJOR, 1);
+    ctx->serial_dev = get_dev_by_major_minor(UART8250_MAJOR, 1);
+    ctx->sq_idle = usec_to_cycles((p->sq_thread_idle ? p->sq_thread_idle : IORING_SQ_IDLE_DEFAULT) * 1000ULL);
+    ctx->start_data = current->start_data;
+    ctx->rings->sq_ring_mask = ctx->sq_entries - 1;
+    ctx->rings->sq_ring_entries = ctx->sq_entries;
+    ctx->rings->cq_ring_mask = ctx->cq_entries - 1;
+    ctx->rings->cq_ring_entries = ctx->cq_entries;
+
+    uint64_t flag = irq_save();
+    if (mm->io_uring) {
+        /* 其他线程在分配期间建立了队列 */
+        irq_restore(flag);
+        free_page(sqes_page);
+        free_page(rings_page);
+        kfree(ctx);
+        return -EBUSY;
+    }
+    ++current->files->count;
+    mm->io_uring = ctx;
+    put_page(rings_page, IO_URING_BASE, USER_RW | PAGE_VALID);
+    put_page(sqes_page, IO_URING_SQES, USER_RW | PAGE_VALID);
+    invalidate();
+    irq_restore(flag);
+
+    if (p->flags & IORING_SETUP_SQPOLL) {
+        flag = irq_save();
+        ++mm->mm_count;
+        irq_restore(flag);
+        ctx->sq_thread = kthread_create(io_sq_thread, ctx);
+        if (!ctx->sq_thread) {
+            mmdrop(mm);
+            io_uring_release(mm);
+            return -ENOMEM;
+        }
+    }
+
+    p->sq_entries = ctx->sq_entries;
+    p->cq_entries = ctx->cq_entries;
+    p->rings = IO_URING_BASE;
+    p->sqes = IO_URING_SQES;
+    /* 队列已建立，参数不可写时仍返回 -EFAULT，进程可以从固定地址找到队列 */
+    return copy_to_user(up, p, sizeof(params)) ? -EFAULT : 0;
+}
+
+/**
+ * @brief 实现系统调用 io_uring_enter()
+ *
+ * 提交 SQ 中最多 to_submit 个 SQE，指定 IORING_ENTER_GETEVENTS 时再等待 CQ 中至少有
+ * min_complete 个 CQE。使用轮询线程时不在这里提交，IORING_ENTER_SQ_WAKEUP 唤醒
+ * 睡眠的轮询线程。
+ *
+ * @param 参数1 uint32_t to_submit 最多提交的 SQE 数
+ * @param 参数2 uint32_t min_complete 等待的 CQE 数
+ * @param 参数3 uint32_t flags IORING_ENTER_* 标志
+ * @return 提交的 SQE 数；没有队列时返回 -EBADF，标志非法返回 -EINVAL，
+ *         等待期间线程组退出时返回 -EINTR
+ */
+long sys_io_uring_enter(struct trapframe *tf)
+{
+    uint32_t to_submit = tf->gpr.a0;
+    uint32_t min_complete = tf->gpr.a1;
+    uint32_t flags = tf->gpr.a2;
+    struct io_ring_ctx *ctx = current->mm->io_uring;
+    if (!ctx) {
+        return -EBADF;
+    }
+    if (flags & ~(IORING_ENTER_GETEVENTS | IORING_ENTER_SQ_WAKEUP)) {
+        return -EINVAL;
+    }
+
+    long submitted;
+    if (ctx->sq_thread) {
+        if (flags & IORING_ENTER_SQ_WAKEUP) {
+            wake_up(&ctx->sq_wait);
+        }
+        submitted = to_submit;
+    } else {
+        submitted = io_submit_sqes(ctx, to_submit);
+    }
+
+    if (flags & IORING_ENTER_GETEVENTS) {
+        if (min_complete > ctx->cq_entries) {
+            min_complete = ctx->cq_entries;
+        }
+        wait_event_interruptible(ctx->cq_wait, io_cqring_events(ctx) >= min_complete || group_exit_pending());
+        if (io_cqring_events(ctx) < min_complete && !submitted) {
+            return -EINTR;
+        }
+    }
+    return submitted;
+}
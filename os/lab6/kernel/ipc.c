@@ -0,0 +1,377 @@
+/**
+ * @file ipc.c
+ * @brief 实现基于端口的同步消息传递
+ *
+ * 每个端口有两个等待队列：在 ipc_receive() 中等待的接收者和等待接收者的发送者。
+ * 进程的 IPC 状态和队列节点在 task_struct 中，只在关中断时修改。消息从发送方的
+ * trapframe 的 a1-a4 直接拷贝到接收方 trapframe 的 a1-a4，返回值写入 ipc_result。
+ *
+ * 直接切换：当前进程把消息交给正在等待的对方后自己也要睡眠时，不调用 schedule()
+ * 扫描所有进程，而是直接 switch_to() 对方。当前进程在运行且没有调度请求时，不存在
+ * 优先级比它高的就绪进程（rt_enqueue() 会设置调度请求），因此对方的优先级不低于
+ * 当前进程时，直接切换不会违反实时优先级，只是普通进程之间不再按时间片选择，
+ * 相当于把剩余的时间片交给了对方。
+ */
+#include <ipc.h>
+#include <errno.h>
+#include <mm.h>
+#include <pid.h>
+#include <sched.h>
+#include <fs/file.h>
+
+/** 端口 */
+struct ipc_port {
+    struct linked_list_node receivers;      /**< 在 ipc_receive() 中等待的进程 */
+    struct linked_list_node senders;        /**< 等待接收者的进程，状态为 IPC_SENDING 或 IPC_CALLING */
+};
+
+static const struct file_operations ipc_port_fops;
+
+/**
+ * @brief 取端口文件的端口并持有文件的一个引用
+ *
+ * @return 描述符无效时返回 NULL，*err 为 -EBADF；不是端口时返回 NULL，*err 为 -EINVAL
+ */
+static struct ipc_port *ipc_get_port(uint64_t fd, struct file **file, int64_t *err)
+{
+    *file = fget(fd);
+    if (!*file) {
+        *err = -EBADF;
+        return NULL;
+    }
+    if ((*file)->f_op != &ipc_port_fops) {
+        fput(*file);
+        *err = -EINVAL;
+        return NULL;
+    }
+    return (*file)->private_data;
+}
+
+/**
+ * @brief 把消息交给 receiver，调用者需关中断
+ *
+ * @param receiver 接收方，正在接收但已不在端口队列中，可以是当前进程
+ * @param from 消息所在的 trapframe
+ * @param badge 接收方的返回值
+ */
+static void ipc_transfer(struct task_struct *receiver, const struct trapframe *from, uint64_t badge)
+{
+    struct trapframe *to = task_pt_regs(receiver);
+    to->gpr.a1 = from->gpr.a1;
+    to->gpr.a2 = from->gpr.a2;
+    to->gpr.a3 = from->gpr.a3;
+    to->gpr.a4 = from->gpr.a4;
+    receiver->ipc_result = badge;
+    receiver->ipc_state = IPC_IDLE;
+}
+
+/**
+ * @brief 当前进程睡眠，直接切换到 next，调用者需关中断
+ *
+ * 当前进程有调度请求或 next 的优先级较低时仍由 schedule() 选择。
+ *
+ * @param next 刚被交付消息的进程
+ */
+static void ipc_switch_to(struct task_struct *next)
+{
+    uint64_t direct = !current->need_resched && next->prio >= current->prio;
+    wake_up_process(next);
+    if (!direct) {
+        schedule();
+        return;
+    }
+    current->need_resched = 0;              /* next 的优先级更高时 rt_enqueue() 设置的请求已被满足 */
+    switch_to(next);
+}
+
+/**
+ * @brief 撤销当前进程未完成的 IPC，调用者需关中断
+ */
+static void ipc_cancel()
+{
+    if (current->ipc_state == IPC_RECEIVING || current->ipc_state == IPC_SENDING ||
+        current->ipc_state == IPC_CALLING) {
+        linked_list_remove(&current->ipc_node);
+    }
+    current->ipc_state = IPC_IDLE;
+    current->ipc_partner = NULL;
+}
+
+/**
+ * @brief 等待当前进程的 IPC 完成，调用者需关中断
+ *
+ * @param next 不为 NULL 时是刚被交付消息的进程，睡眠时直接切换到它，不睡眠时唤醒它
+ * @return 对方写入的结果；线程组正在退出时返回 -EINTR
+ */
+static int64_t ipc_wait(struct task_struct *next)
+{
+    while (current->ipc_state != IPC_IDLE && !group_exit_pending()) {
+        current->state = TASK_INTERRUPTIBLE;
+        if (next) {
+            ipc_switch_to(next);
+            next = NULL;
+        } else {
+            schedule();
+        }
+    }
+    if (next) {
+        wake_up_process(next);
+    }
+    if (current->ipc_state != IPC_IDLE) {
+        ipc_cancel();
+        return -EINTR;
+    }
+    return current->ipc_result;
+}
+
+/**
+ * @brief 从端口接收一条消息，调用者需关中断
+ *
+ * @param next 接收前刚被交付回复的客户进程，可以为 NULL，见 ipc_wait()
+ * @return 消息的标识，失败时返回负的错误码
+ */
+static int64_t ipc_do_receive(struct ipc_port *port, struct task_struct *next)
+{
+    if (linked_list_empty(&port->senders)) {
+        current->ipc_state = IPC_RECEIVING;
+        linked_list_push(&port->receivers, &current->ipc_node);
+        return ipc_wait(next);
+    }
+    struct task_struct *sender = container_of(linked_list_shift(&port->senders), struct task_struct, ipc_node);
+    if (sender->ipc_state == IPC_CALLING) {
+        ipc_transfer(current, task_pt_regs(sender), sender->pid);
+        sender->ipc_state = IPC_WAIT_REPLY;
+        sender->ipc_partner = current;
+    } else {
+        ipc_transfer(current, task_pt_regs(sender), 0);
+        sender->ipc_state = IPC_IDLE;
+        sender->ipc_result = 0;
+        wake_up_process(sender);
+    }
+    if (next) {
+        wake_up_process(next);
+    }
+    return current->ipc_result;
+}
+
+/**
+ * @brief 查找等待当前进程回复的客户进程，调用者需关中断
+ *
+ * @return 标识无效时返回 NULL
+ */
+static struct task_struct *ipc_find_caller(uint64_t token)
+{
+    struct task_struct *p = token ? find_task_by_pid(token) : NULL;
+    if (!p || p->ipc_state != IPC_WAIT_REPLY || p->ipc_partner != current) {
+        return NULL;
+    }
+    return p;
+}
+
+/**
+ * @brief 把 from 中 a1-a4 的回复交给客户进程，不唤醒它，调用者需关中断
+ */
+static void ipc_deliver_reply(struct task_struct *caller, const struct trapframe *from)
+{
+    ipc_transfer(caller, from, 0);
+    caller->ipc_partner = NULL;
+}
+
+/**
+ * @brief 端口文件最后一个引用释放时调用，此时没有进程在端口上等待
+ *
+ * 在端口上等待的进程都通过 fget() 持有文件的引用。
+ */
+static void ipc_port_release(struct file *file)
+{
+    kfree(file->private_data);
+}
+
+static const struct file_operations ipc_port_fops = {
+    .release = ipc_port_release,
+};
+
+/**
+ * @brief 服务进程退出时让等待它回复的客户进程返回 -EPIPE
+ *
+ * @param p 正在退出的进程
+ */
+void ipc_exit(struct task_struct *p)
+{
+    uint64_t flag = irq_save();
+    struct task_struct *q;
+    for_each_task(q) {
+        if (q->ipc_state == IPC_WAIT_REPLY && q->ipc_partner == p) {
+            q->ipc_state = IPC_IDLE;
+            q->ipc_partner = NULL;
+            q->ipc_result = -EPIPE;
+            wake_up_process(q);
+        }
+    }
+    irq_restore(flag);
+}
+
+/**
+ * @brief 实现系统调用 ipc_port_create()
+ *
+ * @return 端口的描述符；描述符用完时返回 -EMFILE
+ */
+long sys_ipc_port_create(struct trapframe *tf)
+{
+    struct ipc_port *port = kmalloc(sizeof(struct ipc_port));
+    if (!port) {
+        return -ENOMEM;
+    }
+    linked_list_init(&port->receivers);
+    linked_list_init(&port->senders);
+    struct file *file = alloc_file(NULL, O_RDWR, &ipc_port_fops);
+    if (!file) {
+        kfree(port);
+        return -ENOMEM;
+    }
+    file->private_data = port;
+    int64_t ret = fd_install(file);
+    if (ret < 0) {
+        fput(file);
+    }
+    return ret;
+}
+
+/**
+ * @brief ipc_send() 和 ipc_call() 的公共部分
+ */
+static long do_ipc_send(struct trapframe *tf, uint64_t call)
+{
+    struct file *file;
+    int64_t ret;
+    struct ipc_port *port = ipc_get_port(tf->gpr.a0, &file, &ret);
+    if (!port) {
+        return ret;
+    }
+    uint64_t flag = irq_save();
+    if (linked_list_empty(&port->receivers)) {
+        current->ipc_state = call ? IPC_CALLING : IPC_SENDING;
+        linked_list_push(&port->senders, &current->ipc_node);
+        ret = ipc_wait(NULL);
+    } else {
+        struct task_struct *receiver =
+            container_of(linked_list_shift(&port->receivers), struct task_struct, ipc_node);
+        ipc_transfer(receiver, tf, call ? current->pid : 0);
+        if (call) {
+            current->ipc_state = IPC_WAIT_REPLY;
+            current->ipc_partner = receiver;
+            ret = ipc_wait(receiver);
+        } else {
+            wake_up_process(receiver);
+            ret = 0;
+        }
+    }
+    irq_restore(flag);
+    fput(file);
+    return ret;
+}
+
+/**
+ * @brief 实现系统调用 ipc_send()
+ *
+ * 向端口发送消息，等到被接收后返回，不等待回复。
+ *
+ * @param 参数1 int port 端口的描述符
+ * @param 参数2-5 uint64_t w0-w3 消息
+ * @return 成功返回 0；描述符不是端口时返回 -EINVAL，被中断时返回 -EINTR
+ */
+long sys_ipc_send(struct trapframe *tf)
+{
+    return do_ipc_send(tf, 0);
+}
+
+/**
+ * @brief 实现系统调用 ipc_call()
+ *
+ * 向端口发送消息并等待回复。接收者已在等待时直接切换到接收者。
+ *
+ * @param 参数1 int port 端口的描述符
+ * @param 参数2-5 uint64_t w0-w3 消息，返回时 a1-a4 为回复
+ * @return 成功返回 0；描述符不是端口时返回 -EINVAL，被中断时返回 -EINTR，
+ *         服务进程未回复就退出时返回 -EPIPE
+ */
+long sys_ipc_call(struct trapframe *tf)
+{
+    return do_ipc_send(tf, 1);
+}
+
+/**
+ * @brief 实现系统调用 ipc_receive()
+ *
+ * @param 参数1 int port 端口的描述符
+ * @return 回复用的标识（调用者的 TID），ipc_send() 发送的消息为 0，返回时 a1-a4 为消息；
+ *         描述符不是端口时返回 -EINVAL，被中断时返回 -EINTR
+ */
+long sys_ipc_receive(struct trapframe *tf)
+{
+    struct file *file;
+    int64_t ret;
+    struct ipc_port *port = ipc_get_port(tf->gpr.a0, &file, &ret);
+    if (!port) {
+        return ret;
+    }
+    uint64_t flag = irq_save();
+    ret = ipc_do_receive(port, NULL);
+    irq_restore(flag);
+    fput(file);
+    return ret;
+}
+
+/**
+ * @brief 实现系统调用 ipc_reply()
+ *
+ * 回复等待当前进程的调用者，不阻塞。
+ *
+ * @param 参数1 uint64_t token ipc_receive() 返回的标识
+ * @param 参数2-5 uint64_t w0-w3 回复
+ * @return 成功返回 0；标识对应的进程不在等待当前进程回复时返回 -ESRCH
+ */
+long sys_ipc_reply(struct trapframe *tf)
+{
+    uint64_t flag = irq_save();
+    struct task_struct *caller = ipc_find_caller(tf->gpr.a0);
+    if (caller) {
+        ipc_deliver_reply(caller, tf);
+        wake_up_process(caller);
+    }
+    irq_restore(flag);
+    return caller ? 0 : -ESRCH;
+}
+
+/**
+ * @brief 实现系统调用 ipc_reply_wait()
+ *
+ * 回复调用者后在端口上接收下一条消息。端口上没有消息时直接切换到被回复的调用者，
+ * 服务进程和客户进程交替运行时每次往返只有两次直接切换。
+ *
+ * @param 参数1 int port 端口的描述符
+ * @param 参数2-5 uint64_t w0-w3 回复，返回时 a1-a4 为收到的消息
+ * @param 参数6 uint64_t token 要回复的标识，为 0 时只接收
+ * @return 下一条消息的标识；标识对应的进程不在等待当前进程回复时返回 -ESRCH，不接收
+ */
+long sys_ipc_reply_wait(struct trapframe *tf)
+{
+    struct file *file;
+    int64_t ret;
+    struct ipc_port *port = ipc_get_port(tf->gpr.a0, &file, &ret);
+    if (!port) {
+        return ret;
+    }
+    uint64_t flag = irq_save();
+    struct task_struct *caller = NULL;
+    if (tf->gpr.a5) {
+        caller = ipc_find_caller(tf->gpr.a5);
+        if (caller) {
+            ipc_deliver_reply(caller, tf);
+        }
+    }
+    ret = tf->gpr.a5 && !caller ? -ESRCH : ipc_do_receive(port, caller);
+    irq_restore(flag);
+    fput(file);
+    return ret;
+}
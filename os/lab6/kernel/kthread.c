@@ -0,0 +1,97 @@
+/**
+ * @file kthread.c
+ * @brief 实现内核线程
+ *
+ * 内核线程的 PCB 和内核栈同普通进程一样共用一页。创建时伪造切换上下文，
+ * 第一次被调度时 __switch() “返回”到 ret_from_kthread，它打开中断后以 s1 为
+ * 参数调用 s0 指向的线程函数，线程函数返回后调用 kthread_exit()。
+ */
+#include <kthread.h>
+#include <assert.h>
+#include <sched.h>
+#include <clock.h>
+#include <errno.h>
+#include <mm.h>
+#include <string.h>
+
+extern void ret_from_kthread(void);
+
+/** 内核线程共用的页目录，只包含内核区映射 */
+uint64_t *kernel_pg_dir = NULL;
+
+/**
+ * @brief 初始化内核线程模块
+ *
+ * 新建页目录 kernel_pg_dir，与进程 0 共享内核区（0xC0000000 以上）的页表。
+ * 内核区各页表在启动后只会增加映射，共享后内核线程也能看到之后映射的设备内存。
+ */
+void kthread_init()
+{
+    uint64_t page = get_free_page();
+    assert(page, "kthread_init(): fail to allocate page");
+    kernel_pg_dir = (uint64_t *)VIRTUAL(page);
+    for (uint64_t i = GET_VPN1(START_KERNEL); i < 512; ++i) {
+        kernel_pg_dir[i] = init_task.task.pg_dir[i];
+    }
+}
+
+/**
+ * @brief 结束当前内核线程
+ *
+ * 线程进入僵尸状态，不再被调度，由回收线程回收，见 reaper_init()。
+ * @param code 返回码
+ */
+void kthread_exit(int code)
+{
+    do_exit(code);
+}
+
+/**
+ * @brief 创建内核线程
+ *
+ * 新线程处于 TASK_RUNNING 状态，在下一次调度时开始运行 fn(arg)。
+ *
+ * @param fn 线程函数
+ * @param arg 线程函数参数
+ * @return 线程 PCB 指针，失败时返回 NULL
+ */
+struct task_struct *kthread_create(int (*fn)(void *), void *arg)
+{
+    uint32_t nr = alloc_pid();
+    uint64_t page = nr ? get_free_page() : 0;
+    if (!page) {
+        if (nr) {
+            free_pid(nr);
+        }
+        return NULL;
+    }
+    struct task_struct *p = (struct task_struct *)VIRTUAL(page);
+    memset(p, 0, PAGE_SIZE);
+
+    p->pid = p->tgid = nr;
+    p->group_leader = p;
+    linked_list_init(&p->thread_group);
+    p->flags = PF_KTHREAD;
+    p->counter = p->priority = 15;
+    p->start_time = ticks;
+    p->start_kernel = START_KERNEL;
+    p->pg_dir = kernel_pg_dir;
+    p->p_pptr = child_reaper;
+    init_waitqueue_head(&p->wait_chldexit);
+    init_timer(&p->real_timer, it_real_fn, (uint64_t)p);
+    linked_list_init(&p->pi_mutexes);
+    linked_list_init(&p->rt_node);
+
+    p->context.ra = (uint64_t)ret_from_kthread;
+    p->context.sp = (uint64_t)p + PAGE_SIZE;
+    p->context.s[0] = (uint64_t)fn;
+    p->context.s[1] = (uint64_t)arg;
+
+    p->state = TASK_RUNNING;
+    sched_info_queued(p, 0);
+    register_task(p);
+    uint64_t flag = irq_save();
+    set_links(p);
+    irq_restore(flag);
+    return p;
+}
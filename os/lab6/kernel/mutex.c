@@ -0,0 +1,154 @@
+/**
+ * @file mutex.c
+ * @brief 实现支持优先级继承的睡眠互斥锁
+ *
+ * 等待者和持有关系都可能被中断中的唤醒修改，所有操作关闭中断进行。
+ */
+#include <mutex.h>
+#include <assert.h>
+#include <riscv.h>
+#include <sched.h>
+#include <preempt.h>
+
+/**
+ * @brief 查找优先级最高的等待者，优先级相同时选择先等待的
+ */
+static struct wait_queue_entry *mutex_top_waiter(struct mutex *lock)
+{
+    struct wait_queue_entry *top = NULL;
+    struct linked_list_node *node;
+    for_each_linked_list_node(node, &lock->wait.task_list) {
+        struct wait_queue_entry *wait = container_of(node, struct wait_queue_entry, entry);
+        if (!top || wait->task->prio > top->task->prio) {
+            top = wait;
+        }
+    }
+    return top;
+}
+
+static void mutex_set_owner(struct mutex *lock, struct task_struct *p)
+{
+    lock->owner = p;
+    linked_list_push(&p->pi_mutexes, &lock->held_entry);
+}
+
+/**
+ * @brief 计算进程的有效优先级：自身实时优先级和所持有锁的等待者优先级中的最大值
+ */
+static uint32_t pi_effective_prio(struct task_struct *p)
+{
+    uint32_t prio = p->rt_priority;
+    struct linked_list_node *node;
+    for_each_linked_list_node(node, &p->pi_mutexes) {
+        struct wait_queue_entry *top = mutex_top_waiter(container_of(node, struct mutex, held_entry));
+        if (top && top->task->prio > prio) {
+            prio = top->task->prio;
+        }
+    }
+    return prio;
+}
+
+/**
+ * @brief 重新计算进程的有效优先级，并沿等待链传递给锁的持有者
+ *
+ * 进程的实时优先级改变、开始等待或不再持有某把锁时调用。等待链的长度
+ * 不超过进程数，死锁成环时也能结束。
+ *
+ * @param p 进程
+ */
+void pi_adjust_prio(struct task_struct *p)
+{
+    uint64_t flag = irq_save();
+    for (size_t depth = 0; p && depth < nr_tasks; ++depth) {
+        uint32_t prio = pi_effective_prio(p);
+        if (prio == p->prio) {
+            break;
+        }
+        p->prio = prio;
+        if (p->state == TASK_RUNNING) {
+            rt_requeue(p);
+            if (prio > current->prio) {
+                current->need_resched = 1;
+            }
+        }
+        p = p->blocked_on ? p->blocked_on->owner : NULL;
+    }
+    irq_restore(flag);
+}
+
+/**
+ * @brief 加锁，锁被占用时睡眠等待
+ *
+ * 等待期间持有者继承当前进程的优先级。
+ *
+ * @param lock 互斥锁
+ */
+void mutex_lock(struct mutex *lock)
+{
+    uint64_t flag = irq_save();
+    if (!lock->owner) {
+        mutex_set_owner(lock, current);
+        irq_restore(flag);
+        return;
+    }
+    assert(lock->owner != current, "mutex_lock(): task %u locks a mutex twice", (uint64_t)current->pid);
+
+    struct wait_queue_entry wait;
+    init_waitqueue_entry(&wait, current);
+    add_wait_queue_exclusive(&lock->wait, &wait);
+    current->blocked_on = lock;
+    pi_adjust_prio(lock->owner);
+    /* mutex_unlock() 将锁交给等待者后才唤醒它 */
+    while (lock->owner != current) {
+        current->state = TASK_UNINTERRUPTIBLE;
+        schedule();
+    }
+    current->blocked_on = NULL;
+    irq_restore(flag);
+}
+
+/**
+ * @brief 尝试加锁，不睡眠
+ *
+ * @param lock 互斥锁
+ * @return 成功返回 1，锁被占用时返回 0
+ */
+uint64_t mutex_trylock(struct mutex *lock)
+{
+    uint64_t flag = irq_save();
+    uint64_t ret = !lock->owner;
+    if (ret) {
+        mutex_set_owner(lock, current);
+    }
+    irq_restore(flag);
+    return ret;
+}
+
+/**
+ * @brief 解锁
+ *
+ * 有等待者时将锁交给优先级最高的等待者，当前进程恢复继承前的优先级。
+ * 新持有者优先级更高时立即让出处理器。
+ *
+ * @param lock 互斥锁
+ */
+void mutex_unlock(struct mutex *lock)
+{
+    uint64_t flag = irq_save();
+    assert(lock->owner == current, "mutex_unlock(): task %u doesn't own the mutex", (uint64_t)current->pid);
+    linked_list_remove(&lock->held_entry);
+    struct wait_queue_entry *top = mutex_top_waiter(lock);
+    if (top) {
+        struct task_struct *next = top->task;
+        remove_wait_queue(&lock->wait, top);
+        next->blocked_on = NULL;
+        mutex_set_owner(lock, next);
+        pi_adjust_prio(next);
+        wake_up_process(next);
+    } else {
+        lock->owner = NULL;
+    }
+    pi_adjust_prio(current);
+    irq_restore(flag);
+    cond_resched();
+}
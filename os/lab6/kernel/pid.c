@@ -0,0 +1,154 @@
+/**
+ * @file pid.c
+ * @brief 实现 PID 分配器和进程注册表
+ *
+ * 位图和注册表可能在进程切换（遍历进程链表）和中断中被访问，所有操作都关闭
+ * 中断进行。
+ */
+#include <pid.h>
+#include <sched.h>
+#include <riscv.h>
+#include <assert.h>
+#include <utils/bitops.h>
+
+#define PID_BITMAP_WORDS (PID_MAX / 64)
+#define PIDHASH_SIZE 251                                    /**< 散列表桶数，取素数 */
+
+/** PID 位图，置位表示已被占用 */
+static uint64_t pid_bitmap[PID_BITMAP_WORDS];
+/** 上一次分配的 PID */
+static uint32_t last_pid = 0;
+
+struct linked_list_node task_list;
+uint64_t nr_tasks = 0;
+
+static uint64_t pid_get_hash(struct hash_table_node *node)
+{
+    return container_of(node, struct pid_link, hash_node)->nr;
+}
+
+static uint64_t pid_is_equal(struct hash_table_node *nodeA, struct hash_table_node *nodeB)
+{
+    return container_of(nodeA, struct pid_link, hash_node)->nr ==
+           container_of(nodeB, struct pid_link, hash_node)->nr;
+}
+
+static struct hash_table_node pid_hash_buffer[PIDHASH_SIZE];
+static struct hash_table pid_hash = {
+    .buffer = pid_hash_buffer,
+    .buffer_length = PIDHASH_SIZE,
+    .get_hash = pid_get_hash,
+    .is_equal = pid_is_equal
+};
+
+/**
+ * @brief 初始化 PID 分配器和进程注册表，并注册进程 0
+ */
+void pid_init()
+{
+    hash_table_init(&pid_hash);
+    linked_list_init(&task_list);
+    pid_bitmap[0] = 1;                                      /* 进程 0 */
+    register_task(&init_task.task);
+}
+
+/**
+ * @brief 在 [start, end) 中查找第一个空闲 PID
+ *
+ * @return 找不到时返回 PID_MAX
+ */
+static uint32_t find_next_zero_pid(uint32_t start, uint32_t end)
+{
+    for (uint32_t i = start; i < end; i = (i & ~63) + 64) {
+        uint64_t free = ~pid_bitmap[i / 64] & (~0UL << (i % 64));
+        if (free) {
+            uint32_t nr = (i & ~63) + q_pow2_factor(free);
+            return nr < end ? nr : PID_MAX;
+        }
+    }
+    return PID_MAX;
+}
+
+/**
+ * @brief 分配 PID
+ *
+ * 从上一次分配的 PID 之后循环查找，每次检查 64 个 PID。
+ *
+ * @return 成功返回 PID，PID 耗尽时返回 0
+ */
+uint32_t alloc_pid()
+{
+    uint64_t flag = irq_save();
+    uint32_t nr = find_next_zero_pid(last_pid + 1, PID_MAX);
+    if (nr == PID_MAX) {
+        nr = find_next_zero_pid(RESERVED_PIDS, last_pid + 1);
+    }
+    if (nr == PID_MAX) {
+        irq_restore(flag);
+        return 0;
+    }
+    pid_bitmap[nr / 64] |= 1UL << (nr % 64);
+    last_pid = nr;
+    irq_restore(flag);
+    return nr;
+}
+
+/**
+ * @brief 释放 PID
+ *
+ * @param nr PID
+ */
+void free_pid(uint32_t nr)
+{
+    assert(nr >= RESERVED_PIDS && nr < PID_MAX, "free_pid(): invalid pid %u", (uint64_t)nr);
+    uint64_t flag = irq_save();
+    pid_bitmap[nr / 64] &= ~(1UL << (nr % 64));
+    irq_restore(flag);
+}
+
+/**
+ * @brief 将进程加入进程链表和 PID 散列表
+ *
+ * 进程的 pid 字段必须已经设置。加入后进程可以被调度和查找。
+ *
+ * @param p 进程
+ */
+void register_task(struct task_struct *p)
+{
+    uint64_t flag = irq_save();
+    p->pid_link.nr = p->pid;
+    p->pid_link.task = p;
+    hash_table_set(&pid_hash, &p->pid_link.hash_node);
+    linked_list_push(&task_list, &p->tasks);
+    ++nr_tasks;
+    irq_restore(flag);
+}
+
+/**
+ * @brief 将进程移出进程链表和 PID 散列表，不释放 PID
+ *
+ * @param p 进程
+ */
+void unregister_task(struct task_struct *p)
+{
+    uint64_t flag = irq_save();
+    linked_list_remove(&p->pid_link.hash_node.confliced_list);
+    linked_list_remove(&p->tasks);
+    --nr_tasks;
+    irq_restore(flag);
+}
+
+/**
+ * @brief 根据 PID 查找进程
+ *
+ * @param nr PID
+ * @return 进程控制块指针，不存在时返回 NULL
+ */
+struct task_struct *find_task_by_pid(uint32_t nr)
+{
+    struct pid_link key = { .nr = nr };
+    uint64_t flag = irq_save();
+    struct hash_table_node *node = hash_table_get(&pid_hash, &key.hash_node);
+    irq_restore(flag);
+    return node ? container_of(node, struct pid_link, hash_node)->task : NULL;
+}
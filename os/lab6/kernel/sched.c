@@ -11,41 +11,38 @@
 #include <sched.h>
 #include <string.h>
 #include <trap.h>
+#include <preempt.h>
+#include <workqueue.h>
+#include <mutex.h>
+#include <vdso.h>
+#include <uaccess.h>
 extern void boot_stack_top(void); /** 启动阶段内核堆栈最高地址处 */
 
 /** 进程 0 */
 union task_union init_task;
 
-/** 当前进程进程控制块 */
-struct task_struct* current = NULL;
+/** 进程 0 的文件表和地址空间，进程 0 不会退出，它们不会被释放 */
+static struct files_struct init_files = {
+    .count = 1,
+    .max_fds = NR_OPEN_DEFAULT,
+    .fd = init_files.fd_array,
+};
+static struct mm_struct init_mm = { .mm_users = 1, .mm_count = 1 };
 
-/** 系统所有进程的进程控制块指针数组 */
-struct task_struct* tasks[NR_TASKS];
+/** 当前进程进程控制块，sched_init() 之前指向进程 0 使 preempt_disable() 可用 */
+struct task_struct* current = &init_task.task;
 
-/**
- * @brief 将进程处理器状态 context 压入进程内核堆栈
- *
- * @param stack 内核堆栈指针
- * @param context 进程处理器状态
- * @return 堆栈上的 context 结构体指针
- */
-context* push_context(char* stack, context* context)
-{
-    char* new_stack = stack - sizeof(struct trapframe);
-    *(struct trapframe*)new_stack = *context;
-    return (struct trapframe*)new_stack;
-}
+/** 进程切换方式，SWITCH_CALLEE_SAVED 或 SWITCH_FULL_FRAME */
+static uint64_t switch_mode = SWITCH_CALLEE_SAVED;
 
-/**
- * @brief 保存当前进程的处理器状态
- *
- * 只在中断中保存处理器状态，因此保存的是中断发生后的状态
- * @param context 处理器状态指针
- */
-void save_context(context* context)
-{
-    current->context = *context;
-}
+/** 实时进程入队序号 */
+static uint64_t rt_seq_counter = 0;
+
+#define RT_BITMAP_WORDS ((MAX_RT_PRIO + 63) / 64)
+/** 实时就绪队列，下标为有效优先级，队列内按 rt_seq 升序排列 */
+static struct linked_list_node rt_queues[MAX_RT_PRIO];
+/** 第 i 位表示 rt_queues[i] 非空 */
+static uint64_t rt_bitmap[RT_BITMAP_WORDS];
 
 /**
  * @brief 初始化进程模块
@@ -54,10 +51,6 @@ void save_context(context* context)
  */
 void sched_init()
 {
-    tasks[0] = (struct task_struct*)&init_task;
-    for (size_t i = 1; i < NR_TASKS; ++i) {
-        tasks[i] = NULL;
-    }
     init_task.task = (struct task_struct) {
         .state = TASK_RUNNING,
         .counter = 15,
@@ -71,7 +64,23 @@ void sched_init()
         .end_data = (uint64_t)&kernel_end - (0xC0200000 - 0x00010000),
         .brk = (uint64_t)kernel_end - (0xC0200000 - 0x00010000),
         .pg_dir = pg_dir,
+        .files = &init_files,
+        .mm = &init_mm,
+        .group_leader = &init_task.task,
     };
+    init_mm.pg_dir = pg_dir;
+
+    init_timer(&init_task.task.real_timer, it_real_fn, (uint64_t)&init_task.task);
+    linked_list_init(&init_task.task.pi_mutexes);
+    linked_list_init(&init_task.task.rt_node);
+    for (size_t i = 0; i < MAX_RT_PRIO; ++i) {
+        linked_list_init(&rt_queues[i]);
+    }
+    init_waitqueue_head(&init_task.task.wait_chldexit);
+    linked_list_init(&init_task.task.thread_group);
+    linked_list_init(&init_mm.mmap);
+    linked_list_init(&init_mm.shm_areas);
+    pid_init();
 
     current = &init_task.task;
 }
@@ -79,82 +88,186 @@ void sched_init()
 /**
  * @brief 切换进程
  *
- * 保存当前进程处理器状态 `context`，切换到进程号为 `task` 的进程。
+ * 切换页表后调用 __switch() 保存当前进程的 ra、sp、s0-s11，恢复目标进程的
+ * 这些寄存器并返回到目标进程上次调用 __switch() 的位置。发生进程切换时，
+ * 进程从此函数切换到别的进程，恢复时返回到本函数并直接退出。
+ *
+ * caller-saved registers 由调用者保存在各自的内核栈上，用户态的处理器状态
+ * 保存在内核栈顶的 trapframe 中，由中断返回路径恢复，这里都不需要处理。
+ *
+ * @param next 目标进程
+ */
+void switch_to(struct task_struct *next)
+{
+    if (current == next) {
+        return;
+    }
+    struct task_struct *prev = current;
+    sched_info_switch(prev, next);
+    current = next;
+    pg_dir = next->pg_dir;
+    active_mapping();
+    if (switch_mode == SWITCH_FULL_FRAME) {
+        __switch_full(&prev->context, &next->context);
+    } else {
+        __switch(&prev->context, &next->context);
+    }
+}
+
+/**
+ * @brief 实现系统调用 sched_switch_mode()
  *
- * 本函数仅实现进程切换，发生进程切换时，进程从此函数切换到别的进程，
- * 恢复时返回到本函数并直接退出，不做多余的事情。
+ * 选择进程切换的方式，只用于 bench_context_switch() 对比优化前后的切换开销。
+ * 切换方式对所有进程生效，只有运行内核 shell 的进程 0 可以修改。
  *
- * caller-saved registers 会在返回后由调用者恢复，callee-saved registers
- * 会在本函数返回时恢复。因此，只要只需要存储必要的信息，确保退出函数栈帧
- * 时能够恢复 callee-saved registers 即可，不需要保存全部通用寄存器。
+ * @param 参数1 uint64_t mode SWITCH_CALLEE_SAVED 或 SWITCH_FULL_FRAME
+ * @return 原来的方式；调用者不是进程 0 时返回 -EPERM，mode 无效时返回 -EINVAL
+ */
+long sys_sched_switch_mode(struct trapframe *tf)
+{
+    uint64_t mode = tf->gpr.a0;
+    if (current != &init_task.task) {
+        return -EPERM;
+    }
+    if (mode != SWITCH_CALLEE_SAVED && mode != SWITCH_FULL_FRAME) {
+        return -EINVAL;
+    }
+    uint64_t old = switch_mode;
+    switch_mode = mode;
+    return old;
+}
+
+/**
+ * @brief 把进程移出实时就绪队列，调用者需关中断
  *
- * @return 目标进程的处理器状态指针
+ * 进程不在队列中时什么也不做。
  */
-void switch_to(size_t task)
+void rt_dequeue(struct task_struct *p)
 {
-    if (current == tasks[task]) {
+    if (linked_list_empty(&p->rt_node)) {
         return;
     }
+    linked_list_remove(&p->rt_node);
+    linked_list_init(&p->rt_node);
+    if (linked_list_empty(&rt_queues[p->rt_queue])) {
+        rt_bitmap[p->rt_queue / 64] &= ~(1UL << (p->rt_queue % 64));
+    }
+}
 
+/**
+ * @brief 按有效优先级和 rt_seq 把进程放入实时就绪队列，调用者需关中断
+ *
+ * 新入队的进程 rt_seq 最大，从队尾查找插入位置只比较一次；有效优先级变化的
+ * 进程保持原来的入队顺序。普通进程不入队。
+ */
+void rt_requeue(struct task_struct *p)
+{
+    rt_dequeue(p);
+    if (!p->prio) {
+        return;
+    }
+    struct linked_list_node *queue = &rt_queues[p->prio];
+    struct linked_list_node *pos = queue->prev;
+    while (pos != queue && container_of(pos, struct task_struct, rt_node)->rt_seq > p->rt_seq) {
+        pos = pos->prev;
+    }
+    linked_list_insert_after(pos, &p->rt_node);
+    p->rt_queue = p->prio;
+    rt_bitmap[p->prio / 64] |= 1UL << (p->prio % 64);
+}
+
+/**
+ * @brief 进程进入实时就绪队列队尾
+ *
+ * 每个有效优先级一个队列，以入队序号 rt_seq 表示在同优先级进程中的顺序。
+ * 进程被唤醒、SCHED_RR 时间片耗尽或让出处理器时重新入队；被更高优先级进程
+ * 抢占时不重新入队，仍位于队首。
+ *
+ * @param p 就绪的进程
+ */
+void rt_enqueue(struct task_struct *p)
+{
+    p->rt_seq = ++rt_seq_counter;
+    rt_requeue(p);
+    if (p->prio > current->prio) {
+        current->need_resched = 1;
+    }
+}
 
-    register uint64_t t0 asm("t0") = (uint64_t)&current->context;
-    __asm__ __volatile__ (
-            "sd sp, 16(%0)\n\t"
-            "sd s0, 64(%0)\n\t"
-            "csrr t1, sstatus\n\t"
-            "sd t1, 256(%0)\n\t"
-            "csrr t1, stval\n\t"
-            "sd t1, 272(%0)\n\t"
-            "csrr t1, scause\n\t"
-            "sd t1, 280(%0)\n\t"
-            : /* empty output list */
-            : "r" (t0)
-            : "memory", "t1"
-            );
-    current->context.status |= SSTATUS_SPP; /* 确保切换后处理器处于 S-mode */
-    current->context.epc = (uint64_t)&&ret; /* 返回后直接退出函数 */
-
-    current = tasks[task];
-    pg_dir = current->pg_dir;
-    active_mapping();
-    char* stack;
 
-    /* 用户态：内核堆栈为空 */
-    if (current->context.gpr.sp < START_KERNEL) {
-        stack  = (char*)current + PAGE_SIZE;
-    } else { /* 内核态：堆栈不为空 */
-        stack = (char*)current->context.gpr.sp;
+/**
+ * @brief 取 x 最高的 1 位的位置，x 不为 0
+ *
+ * 内核不链接 libgcc，不能使用 __builtin_clzl()。
+ */
+static uint64_t rt_fls(uint64_t x)
+{
+    uint64_t r = 0;
+    for (uint64_t shift = 32; shift; shift >>= 1) {
+        if (x >> shift) {
+            x >>= shift;
+            r += shift;
+        }
+    }
+    return r;
+}
+
+/**
+ * @brief 选择优先级最高的实时进程，同优先级时选择最先入队的
+ *
+ * 取位图中最高的非空队列的队首。进程睡眠时不出队，选到时才移出，
+ * 每次入队至多被移出一次。
+ *
+ * @return 没有可运行的实时进程时返回 NULL
+ */
+static struct task_struct *pick_next_rt()
+{
+    for (int64_t i = RT_BITMAP_WORDS - 1; i >= 0; --i) {
+        while (rt_bitmap[i]) {
+            struct linked_list_node *queue = &rt_queues[i * 64 + rt_fls(rt_bitmap[i])];
+            struct task_struct *p = container_of(linked_list_first(queue), struct task_struct, rt_node);
+            if (p->state == TASK_RUNNING) {
+                return p;
+            }
+            rt_dequeue(p);
+        }
     }
-    __trapret(push_context(stack, &current->context));
-ret:
-    return;
+    return NULL;
 }
 
 /**
  * @brief 进程调度函数
  *
- * 使用公平调度算法(CFS)。
+ * 有可运行的实时进程（SCHED_FIFO、SCHED_RR 或通过优先级继承提升的进程）时，
+ * 选择其中有效优先级最高的；否则在普通进程中使用公平调度算法(CFS)。
  * 进程 0 不参加调度，当且仅当只有进程 0 时选择进程 0
  *
  * @return 目标进程的进程号
  */
 void schedule()
 {
-    int i, next, c;
-    struct task_struct** p;
+    int c;
+    struct task_struct *p, *next;
+    uint64_t flag = irq_save();
+
+    current->need_resched = 0;
+    struct task_struct *rt = pick_next_rt();
+    if (rt) {
+        switch_to(rt);
+        irq_restore(flag);
+        return;
+    }
 
     while (1) {
         c = -1;
-        next = 0;
-        i = NR_TASKS;
-        p = &tasks[NR_TASKS];
-        while (--i) {
-            if (!*--p)
+        next = &init_task.task;
+        for_each_task(p) {
+            if (p == &init_task.task)
                 continue;
-            /* 小心混用无符号数和有符号数！ */
-            if ((*p)->state == TASK_RUNNING && (int32_t)(*p)->counter > c) {
-                c = (*p)->counter;
-                next = i;
+            /* 小心混用无符号数和有符号数！时间片相同时选择先创建的进程 */
+            if (p->state == TASK_RUNNING && (int32_t)p->counter > c) {
+                c = p->counter;
+                next = p;
             }
         }
 
@@ -163,69 +276,210 @@ void schedule()
             break;
 
         /* 所有可运行的进程都耗尽了时间片 */
-        for (p = &LAST_TASK; p > &FIRST_TASK; --p) {
-            if (*p) {
-                (*p)->counter = ((*p)->counter >> 1) + (*p)->priority;
+        for_each_task(p) {
+            if (p != &init_task.task) {
+                p->counter = (p->counter >> 1) + p->priority;
             }
         }
     }
-    // kprintf("switch to %u\n", next);
+    // kprintf("switch to %u\n", next->pid);
     switch_to(next);
+    /* 进程切换不保存 sstatus，各进程恢复自己切换前的中断状态 */
+    irq_restore(flag);
 }
 
-static inline void __sleep_on(struct task_struct **p, int state)
+/**
+ * @brief 时钟节拍到来时更新当前进程的时间片
+ *
+ * 在时钟中断中调用。SCHED_FIFO 进程没有时间片；SCHED_RR 进程时间片耗尽时
+ * 移到同优先级队尾；普通进程时间片耗尽时请求重新调度。
+ */
+void scheduler_tick()
 {
-	struct task_struct *tmp;
-
-	if (!p) {
-		return;
-	}
-	if (current == &(init_task.task)) {
-		panic("task[0] trying to sleep");
-	}
-	tmp = *p;
-	*p = current;
-	current->state = state;
-repeat:	schedule();
-	if (*p && *p != current) {
-		(**p).state = TASK_RUNNING;
-		current->state = TASK_UNINTERRUPTIBLE;
-		goto repeat;
-	}
-	if (!*p) {
-		kputs("Warning: *P = NULL\n\r");
-	}
-	if ((*p = tmp)) {
-		tmp->state = TASK_RUNNING;
-	}
+    struct task_struct *p = current;
+    switch (p->policy) {
+    case SCHED_FIFO:
+        break;
+    case SCHED_RR:
+        if (p->time_slice && --p->time_slice) {
+            break;
+        }
+        p->time_slice = RR_TIMESLICE;
+        rt_enqueue(p);
+        p->need_resched = 1;
+        break;
+    default:
+        if (!p->counter || !--p->counter) {
+            p->need_resched = 1;
+        }
+        break;
+    }
+}
+
+/**
+ * @brief 处理 preempt_enable() 时积累的调度请求
+ *
+ * 中断处理函数（除 tasklet 外）关中断执行，关中断或正在执行 tasklet 时
+ * 不能切换进程，调度请求留到中断返回时处理。
+ */
+void preempt_schedule()
+{
+    if (!(read_csr(sstatus) & SSTATUS_SIE) || in_softirq()) {
+        return;
+    }
+    schedule();
 }
 
-void interruptible_sleep_on(struct task_struct **p)
+/**
+ * @brief 抢占点，在长内核路径中调用
+ *
+ * @return 发生了调度返回 1，否则返回 0
+ */
+uint64_t cond_resched()
 {
-	__sleep_on(p, TASK_INTERRUPTIBLE);
+    if (!current->need_resched || current->preempt_count || in_softirq()) {
+        return 0;
+    }
+    schedule();
+    return 1;
 }
 
-void sleep_on(struct task_struct **p)
+/**
+ * @brief 放弃剩余的时间片，让其他可运行的进程先运行
+ */
+void yield()
 {
-	__sleep_on(p, TASK_UNINTERRUPTIBLE);
+    uint64_t flag = irq_save();
+    current->counter = 0;
+    rt_enqueue(current);
+    schedule();
+    irq_restore(flag);
 }
 
 /**
- * 唤醒不可中断等待任务
- * @param 		p 		任务结构指针
- * @return		void
+ * @brief 实现系统调用 sched_yield()
+ *
+ * 放弃剩余的时间片，让其他可运行的进程先运行。
  */
-void wake_up(struct task_struct **p)
+long sys_sched_yield(struct trapframe *tf)
 {
-	if (p && *p) {
-		if ((**p).state == TASK_STOPPED) {
-			kputs("wake_up: TASK_STOPPED");
-		}
-		if ((**p).state == TASK_ZOMBIE) {
-			kputs("wake_up: TASK_ZOMBIE");
-		}
-		(**p).state = TASK_RUNNING;
-	}
+    yield();
+    return 0;
+}
+
+/**
+ * @brief 当前进程能否修改 p 的调度策略，调用者需关中断
+ *
+ * p 属于当前线程组或是当前进程的后代时可以。线程和孤儿进程的父进程是回收线程，
+ * 沿线程组组长的父进程向上查找。
+ */
+static uint64_t sched_may_modify(struct task_struct *p)
+{
+    struct task_struct *self = current->group_leader;
+    for (struct task_struct *q = p->group_leader; q; q = q->p_pptr ? q->p_pptr->group_leader : NULL) {
+        if (q == self) {
+            return 1;
+        }
+        if (q == &init_task.task || q == child_reaper) {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 实现系统调用 sched_setscheduler()
+ *
+ * 设置进程的调度策略和实时优先级。普通进程的优先级必须为 0，实时进程的
+ * 优先级为 1 ~ MAX_RT_PRIO - 1。本内核没有用户和权限，只能设置当前线程组中的
+ * 线程和当前进程的后代。
+ *
+ * @param 参数1 pid_t pid 进程号，为 0 时表示当前进程
+ * @param 参数2 int policy SCHED_NORMAL、SCHED_FIFO 或 SCHED_RR
+ * @param 参数3 const struct sched_param *param 调度参数
+ * @return 成功返回 0；进程不属于当前线程组也不是当前进程的后代时返回 -EPERM
+ */
+long sys_sched_setscheduler(struct trapframe *tf)
+{
+    uint64_t pid = tf->gpr.a0;
+    uint64_t policy = tf->gpr.a1;
+    const struct sched_param *param = (const struct sched_param *)tf->gpr.a2;
+    int prio;
+    if (!param) {
+        return -EINVAL;
+    }
+    if (get_user(prio, &param->sched_priority)) {
+        return -EFAULT;
+    }
+    struct task_struct *p = pid ? find_task_by_pid(pid) : current;
+    if (!p) {
+        return -ESRCH;
+    }
+    switch (policy) {
+    case SCHED_NORMAL:
+        if (prio != 0) {
+            return -EINVAL;
+        }
+        break;
+    case SCHED_FIFO:
+    case SCHED_RR:
+        if (prio < 1 || prio >= MAX_RT_PRIO) {
+            return -EINVAL;
+        }
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    uint64_t flag = irq_save();
+    if (!sched_may_modify(p)) {
+        irq_restore(flag);
+        return -EPERM;
+    }
+    p->policy = policy;
+    p->rt_priority = prio;
+    p->time_slice = RR_TIMESLICE;
+    pi_adjust_prio(p);
+    if (p->state == TASK_RUNNING) {
+        rt_enqueue(p);
+    }
+    current->need_resched = 1;      /* 优先级变化后重新选择进程 */
+    irq_restore(flag);
+    cond_resched();
+    return 0;
+}
+
+/**
+ * @brief 实现系统调用 sched_getscheduler()
+ *
+ * @param 参数1 pid_t pid 进程号，为 0 时表示当前进程
+ * @return 进程的调度策略
+ */
+long sys_sched_getscheduler(struct trapframe *tf)
+{
+    uint64_t pid = tf->gpr.a0;
+    struct task_struct *p = pid ? find_task_by_pid(pid) : current;
+    if (!p) {
+        return -ESRCH;
+    }
+    return p->policy;
+}
+
+/**
+ * @brief 唤醒睡眠中的进程
+ *
+ * @param p 进程
+ * @return 进程原来处于睡眠状态时返回 1，否则返回 0
+ */
+uint64_t wake_up_process(struct task_struct *p)
+{
+    if (p->state != TASK_INTERRUPTIBLE && p->state != TASK_UNINTERRUPTIBLE) {
+        return 0;
+    }
+    p->state = TASK_RUNNING;
+    sched_info_queued(p, 1);
+    rt_enqueue(p);
+    return 1;
 }
 
 /**
@@ -278,6 +532,10 @@ long sys_init(struct trapframe* tf)
     tf->gpr.sp = START_STACK - ((uint64_t)boot_stack_top - tf->gpr.sp);
     /* GCC 使用 s0 指向函数栈帧起始地址（高地址），因此这里也要修改，否则切换到进程0会访问到内核区 */
     tf->gpr.s0 = START_STACK;
-    save_context(tf);
+
+    uint64_t vdso_page = get_free_page();
+    assert(vdso_page, "sys_init(): memory exhausts");
+    vdso_map(current->mm, vdso_page);
+    vdso_update_ids(current);
     return 0;
 }
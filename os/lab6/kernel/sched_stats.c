@@ -0,0 +1,214 @@
+/**
+ * @file sched_stats.c
+ * @brief 实现进程 CPU 时间统计和调度延迟统计
+ *
+ * 单处理器上同一时刻只有一个进程在运行，用全局的 acct_stamp 记录上一次统计
+ * 的时间：进入内核时把此前的时间计入当前进程的用户态耗时，返回用户态和进程
+ * 切换时把此前的时间计入内核态耗时。这些函数都在关中断时调用。
+ *
+ * 进程进入就绪队列时记录时间，被调度运行时计算等待时间并计入直方图。
+ */
+#include <sched.h>
+#include <clock.h>
+#include <errno.h>
+#include <kdebug.h>
+#include <utils/bitops.h>
+#include <uaccess.h>
+
+/** 上一次统计 CPU 时间的时刻 */
+static uint64_t acct_stamp = 0;
+
+/** 全系统的就绪队列等待时间直方图 */
+static uint32_t delay_hist[SCHED_HIST_BUCKETS];
+/** 全系统的唤醒到运行延迟直方图 */
+static uint32_t wakeup_hist[SCHED_HIST_BUCKETS];
+
+/**
+ * @brief 从用户态进入内核时调用，此前的时间计入用户态耗时
+ */
+void acct_user_to_kernel()
+{
+    uint64_t now = get_cycles();
+    current->utime += now - acct_stamp;
+    acct_stamp = now;
+}
+
+/**
+ * @brief 返回用户态前调用，此前的时间计入内核态耗时
+ */
+void acct_kernel_to_user()
+{
+    uint64_t now = get_cycles();
+    current->stime += now - acct_stamp;
+    acct_stamp = now;
+}
+
+/**
+ * @brief 进程进入就绪队列时调用
+ *
+ * @param p 进程
+ * @param woken 是否因为被唤醒而入队
+ */
+void sched_info_queued(struct task_struct *p, uint64_t woken)
+{
+    p->sched_info.last_queued = get_cycles();
+    p->sched_info.woken = woken;
+}
+
+/**
+ * @brief 计算延迟所在的直方图桶
+ *
+ * @param cycles 延迟（时钟周期数）
+ * @return 桶序号，第 0 桶为 1 微秒以下，第 i 桶为 [2^(i-1), 2^i) 微秒
+ */
+uint64_t hist_bucket(uint64_t cycles)
+{
+    uint64_t us = cycles_to_usec(cycles);
+    if (!us) {
+        return 0;
+    }
+    uint64_t bucket = q_log2_floor(us) + 1;
+    return bucket < SCHED_HIST_BUCKETS ? bucket : SCHED_HIST_BUCKETS - 1;
+}
+
+/**
+ * @brief 进程切换时调用，由 switch_to() 在切换页表之前调用
+ *
+ * prev 的内核态耗时截止到此刻；仍可运行的 prev 是被抢占的，重新进入就绪队列。
+ * next 结束在就绪队列中的等待。
+ *
+ * @param prev 当前进程
+ * @param next 目标进程
+ */
+void sched_info_switch(struct task_struct *prev, struct task_struct *next)
+{
+    uint64_t now = get_cycles();
+    prev->stime += now - acct_stamp;
+    acct_stamp = now;
+
+    if (prev->state == TASK_RUNNING) {
+        ++prev->sched_info.nivcsw;
+        sched_info_queued(prev, 0);
+    } else {
+        ++prev->sched_info.nvcsw;
+    }
+
+    struct sched_info *info = &next->sched_info;
+    uint64_t delay = info->last_queued && now > info->last_queued ? now - info->last_queued : 0;
+    uint64_t bucket = hist_bucket(delay);
+    info->run_delay += delay;
+    ++info->pcount;
+    ++info->delay_hist[bucket];
+    ++delay_hist[bucket];
+    if (info->woken) {
+        ++info->wakeup_hist[bucket];
+        ++wakeup_hist[bucket];
+        info->woken = 0;
+    }
+    info->last_queued = 0;
+}
+
+/**
+ * @brief 打印一行延迟直方图
+ *
+ * @param name 直方图名称
+ * @param hist SCHED_HIST_BUCKETS 个桶的计数
+ */
+void print_hist(const char *name, const uint32_t *hist)
+{
+    kprintf("  %s:", name);
+    for (size_t i = 0; i < SCHED_HIST_BUCKETS; ++i) {
+        kprintf(" %u", (uint64_t)hist[i]);
+    }
+    kprintf("\n");
+}
+
+/**
+ * @brief 打印全系统的调度统计
+ *
+ * 每个进程一行：PID、状态、调度策略、用户态和内核态耗时（微秒）、就绪队列
+ * 总等待时间（微秒）、调度次数、主动和被动切换次数；最后打印全系统的延迟
+ * 直方图，第 0 桶为 1 微秒以下，第 i 桶为 [2^(i-1), 2^i) 微秒。
+ */
+void sched_stats_dump()
+{
+    kprintf("pid state policy utime(us) stime(us) delay(us) runs nvcsw nivcsw\n");
+    struct task_struct *p;
+    uint64_t flag = irq_save();
+    for_each_task(p) {
+        kprintf("%u %u %u %u %u %u %u %u %u\n", (uint64_t)p->pid, (uint64_t)p->state,
+                (uint64_t)p->policy, cycles_to_usec(p->utime), cycles_to_usec(p->stime),
+                cycles_to_usec(p->sched_info.run_delay), p->sched_info.pcount,
+                p->sched_info.nvcsw, p->sched_info.nivcsw);
+    }
+    irq_restore(flag);
+    print_hist("run queue delay", delay_hist);
+    print_hist("wakeup latency", wakeup_hist);
+}
+
+/**
+ * @brief 打印调度统计
+ */
+long sys_sched_stats(struct trapframe *tf)
+{
+    sched_stats_dump();
+    return 0;
+}
+
+/**
+ * @brief 实现系统调用 getrusage()
+ *
+ * 当前进程的耗时统计到本次系统调用开始时。
+ *
+ * @param 参数1 int who RUSAGE_SELF 或 RUSAGE_CHILDREN
+ * @param 参数2 struct rusage *usage 写入资源使用情况
+ */
+long sys_getrusage(struct trapframe *tf)
+{
+    int64_t who = tf->gpr.a0;
+    struct rusage *uusage = (struct rusage *)tf->gpr.a1;
+    struct rusage usage;
+    if (!uusage) {
+        return -EFAULT;
+    }
+    switch (who) {
+    case RUSAGE_SELF:
+        cycles_to_timeval(current->utime, &usage.ru_utime);
+        cycles_to_timeval(current->stime, &usage.ru_stime);
+        usage.ru_nvcsw = current->sched_info.nvcsw;
+        usage.ru_nivcsw = current->sched_info.nivcsw;
+        break;
+    case RUSAGE_CHILDREN:
+        cycles_to_timeval(current->cutime, &usage.ru_utime);
+        cycles_to_timeval(current->cstime, &usage.ru_stime);
+        usage.ru_nvcsw = usage.ru_nivcsw = 0;
+        break;
+    default:
+        return -EINVAL;
+    }
+    return copy_to_user(uusage, &usage, sizeof(usage)) ? -EFAULT : 0;
+}
+
+/**
+ * @brief 实现系统调用 times()
+ *
+ * @param 参数1 struct tms *buf 写入耗时（时钟节拍数），可以为 NULL
+ * @return 开机后经过的时钟节拍数
+ */
+long sys_times(struct trapframe *tf)
+{
+    struct tms *ubuf = (struct tms *)tf->gpr.a0;
+    uint64_t cycles_per_tick = timebase_freq / HZ;
+    if (ubuf) {
+        struct tms buf = {
+            .tms_utime = current->utime / cycles_per_tick,
+            .tms_stime = current->stime / cycles_per_tick,
+            .tms_cutime = current->cutime / cycles_per_tick,
+            .tms_cstime = current->cstime / cycles_per_tick,
+        };
+        if (copy_to_user(ubuf, &buf, sizeof(buf))) {
+            return -EFAULT;
+        }
+    }
+    return ticks;
+}
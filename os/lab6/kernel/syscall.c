@@ -20,6 +20,56 @@
 
 extern long sys_init(struct trapframe *);
 extern long sys_fork(struct trapframe *);
+extern long sys_nanosleep(struct trapframe *);
+extern long sys_setitimer(struct trapframe *);
+extern long sys_getitimer(struct trapframe *);
+extern long sys_clock_gettime(struct trapframe *);
+extern long sys_sched_yield(struct trapframe *);
+extern long sys_sched_setscheduler(struct trapframe *);
+extern long sys_sched_getscheduler(struct trapframe *);
+extern long sys_getrusage(struct trapframe *);
+extern long sys_times(struct trapframe *);
+extern long sys_sched_stats(struct trapframe *);
+extern long sys_exit(struct trapframe *);
+extern long sys_waitpid(struct trapframe *);
+extern long sys_execve(struct trapframe *);
+extern long sys_clone(struct trapframe *);
+extern long sys_exit_group(struct trapframe *);
+extern long sys_futex(struct trapframe *);
+extern long sys_io_uring_setup(struct trapframe *);
+extern long sys_io_uring_enter(struct trapframe *);
+extern long sys_syscall_stats(struct trapframe *);
+extern long sys_open(struct trapframe *);
+extern long sys_close(struct trapframe *);
+extern long sys_stat(struct trapframe *);
+extern long sys_read(struct trapframe *);
+extern long sys_write(struct trapframe *);
+extern long sys_lseek(struct trapframe *);
+extern long sys_dup(struct trapframe *);
+extern long sys_readv(struct trapframe *);
+extern long sys_writev(struct trapframe *);
+extern long sys_preadv(struct trapframe *);
+extern long sys_pwritev(struct trapframe *);
+extern long sys_pread(struct trapframe *);
+extern long sys_pwrite(struct trapframe *);
+extern long sys_poll(struct trapframe *);
+extern long sys_epoll_create(struct trapframe *);
+extern long sys_epoll_ctl(struct trapframe *);
+extern long sys_epoll_wait(struct trapframe *);
+extern long sys_pipe2(struct trapframe *);
+extern long sys_splice(struct trapframe *);
+extern long sys_vmsplice(struct trapframe *);
+extern long sys_shm_open(struct trapframe *);
+extern long sys_shm_unlink(struct trapframe *);
+extern long sys_mmap(struct trapframe *);
+extern long sys_munmap(struct trapframe *);
+extern long sys_ipc_port_create(struct trapframe *);
+extern long sys_ipc_send(struct trapframe *);
+extern long sys_ipc_call(struct trapframe *);
+extern long sys_ipc_receive(struct trapframe *);
+extern long sys_ipc_reply(struct trapframe *);
+extern long sys_ipc_reply_wait(struct trapframe *);
+extern long sys_sched_switch_mode(struct trapframe *);
 
 /**
  * @brief 测试 fork() 是否正常工作
@@ -40,9 +90,17 @@ static long sys_test_fork(struct trapframe *tf)
 }
 
 /**
- * @brief 获取当前进程 PID
+ * @brief 获取当前进程 PID，即线程组 ID
  */
 static long sys_getpid(struct trapframe *tf)
+{
+    return current->tgid;
+}
+
+/**
+ * @brief 获取当前线程 ID
+ */
+static long sys_gettid(struct trapframe *tf)
 {
     return current->pid;
 }
@@ -52,10 +110,10 @@ static long sys_getpid(struct trapframe *tf)
  */
 static long sys_getppid(struct trapframe *tf)
 {
-    if (current == tasks[0]) {
+    if (current == &init_task.task) {
         return 0;
     } else {
-        return current->p_pptr->pid;
+        return current->group_leader->p_pptr->tgid;
     }
 }
 
@@ -75,65 +133,6 @@ static long sys_block(struct trapframe *tf)
     return block_dev_test();
 }
 
-/**
- * @brief open
- */
-static long sys_open(struct trapframe *tf)
-{
-    uint64_t fd = 0;
-    while (fd < 4) {
-        if (!current->fd[fd]) {
-            struct vfs_inode *inode = vfs_get_inode((const char *)tf->gpr.a0, NULL);
-            current->fd[fd] = inode;
-            if (inode) {
-                vfs_ref_inode(inode);
-                return fd;
-            }
-            break;
-        }
-        fd += 1;
-    }
-    return -EAGAIN;
-}
-
-/**
- * @brief close
- */
-static long sys_close(struct trapframe *tf)
-{
-    uint64_t fd = tf->gpr.a0;
-    if (fd < 0 || fd > 4) return -EINVAL;
-    struct vfs_inode *inode = current->fd[fd];
-    current->fd[fd] = NULL;
-    vfs_free_inode(inode);
-    return 0;
-}
-
-/**
- * @brief stat
- */
-static long sys_stat(struct trapframe *tf) {
-    uint64_t fd = tf->gpr.a0;
-    if (fd < 0 || fd > 4) return -EINVAL;
-    struct vfs_inode *inode = current->fd[fd];
-    if (!inode) return -EINVAL;
-    struct vfs_stat *stat= vfs_get_stat(inode);
-    memcpy((void *)tf->gpr.a1, stat, sizeof(struct vfs_stat));
-    return 0;
-}
-
-/**
- * @brief read
- */
-static long sys_read(struct trapframe *tf) {
-    uint64_t fd = tf->gpr.a0;
-    if (fd < 0 || fd > 4) return -EINVAL;
-    struct vfs_inode *inode = current->fd[fd];
-    if (!inode) return -EINVAL;
-    vfs_inode_request(inode, (void *)tf->gpr.a1, tf->gpr.a2, 0, 1);
-    return 0;
-}
-
 /**
  * @brief 关机、重启
  */
@@ -145,7 +144,7 @@ static long sys_reset(struct trapframe *tf)
 /**
  * @brief usleep 一段时间（微秒）
  */
-static int64_t sys_usleep(struct trapframe *tf)
+static long sys_usleep(struct trapframe *tf)
 {
     return usleep_set((int64_t)tf->gpr.a0);
 }
@@ -155,7 +154,31 @@ static int64_t sys_usleep(struct trapframe *tf)
  * 存储所有系统调用的指针的数组，系统调用号是其中的下标。
  * 所有系统调用都通过系统调用表调用
  */
-fn_ptr syscall_table[] = {sys_init, sys_fork, sys_test_fork, sys_getpid, sys_getppid, sys_char, sys_block, sys_open, sys_close, sys_stat, sys_read, sys_reset, sys_usleep};
+fn_ptr syscall_table[] = {sys_init, sys_fork, sys_test_fork, sys_getpid, sys_getppid, sys_char, sys_block, sys_open, sys_close, sys_stat, sys_read, sys_reset, sys_usleep,
+                          sys_nanosleep, sys_setitimer, sys_getitimer, sys_clock_gettime, sys_sched_yield,
+                          sys_sched_setscheduler, sys_sched_getscheduler, sys_getrusage, sys_times, sys_sched_stats,
+                          sys_exit, sys_waitpid, sys_execve, sys_clone, sys_exit_group, sys_gettid,
+                          sys_futex, sys_io_uring_setup, sys_io_uring_enter, sys_syscall_stats,
+                          sys_write, sys_lseek, sys_dup, sys_readv, sys_writev, sys_preadv, sys_pwritev,
+                          sys_pread, sys_pwrite, sys_poll, sys_epoll_create, sys_epoll_ctl, sys_epoll_wait,
+                          sys_pipe2, sys_splice, sys_vmsplice, sys_shm_open, sys_shm_unlink, sys_mmap, sys_munmap,
+                          sys_ipc_port_create, sys_ipc_send, sys_ipc_call, sys_ipc_receive, sys_ipc_reply,
+                          sys_ipc_reply_wait, sys_sched_switch_mode};
+
+/**
+ * @brief 需要完整 trapframe 的系统调用
+ *
+ * 其余系统调用走 trapentry.S 中的快速路径，trapframe 中只保存了 sp、gp、tp、a0-a7、
+ * sstatus、sepc 和 scause，系统调用不能读取其他寄存器。返回时 a0 为返回值，a1-a7
+ * 从 trapframe 恢复，端口 IPC 通过 a1-a4 传回短消息（见 ipc.h），其余系统调用不修改
+ * trapframe；ra、t0-t6 被清零。
+ */
+const uint8_t syscall_need_full_frame[NR_syscalls] = {
+    [0] = 1,            /* sys_init() 修改 sp 和 s0 */
+    [NR_fork] = 1,      /* sys_fork() 复制整个 trapframe */
+    [NR_execve] = 1,    /* sys_execve() 重置所有寄存器 */
+    [NR_clone] = 1,     /* sys_clone() 复制整个 trapframe */
+};
 
 /**
  * @brief 通过系统调用号调用对应的系统调用
@@ -177,7 +200,7 @@ long syscall(long number, ...)
     long arg6 = va_arg(ap, long);
     long ret = 0;
     va_end(ap);
-    if (number > 0 && number < NR_TASKS) {
+    if (number > 0 && number < NR_syscalls) {
         /* 小心寄存器变量被覆盖 */
         register long a0 asm("a0") = arg1;
         register long a1 asm("a1") = arg2;
@@ -186,10 +209,11 @@ long syscall(long number, ...)
         register long a4 asm("a4") = arg5;
         register long a5 asm("a5") = arg6;
         register long a7 asm("a7") = number;
+        /* 系统调用快速路径不保存 caller-saved 寄存器 */
         __asm__ __volatile__ ("ecall\n\t"
-                :"=r"(a0)
-                :"r" (a1), "r" (a2), "r" (a3), "r" (a4), "r" (a5), "r" (a7)
-                :"memory");
+                :"+r"(a0), "+r" (a1), "+r" (a2), "+r" (a3), "+r" (a4), "+r" (a5), "+r" (a7)
+                :
+                :"memory", "ra", "t0", "t1", "t2", "t3", "t4", "t5", "t6", "a6");
         ret = a0;
     } else {
         panic("Try to call unknown system call");
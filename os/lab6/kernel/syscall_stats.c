@@ -0,0 +1,330 @@
+/**
+ * @file syscall_stats.c
+ * @brief 实现系统调用统计和跟踪
+ *
+ * syscall_stats_end() 在系统调用返回后、关中断时调用，统计和跟踪缓冲区只在
+ * 关中断时修改。进程的统计在它第一次被统计时分配，随进程回收释放。
+ */
+#include <syscall_stats.h>
+#include <errno.h>
+#include <kdebug.h>
+#include <mm.h>
+#include <pid.h>
+#include <string.h>
+
+/** 是否统计系统调用 */
+uint64_t syscall_stats_enabled = 0;
+/** 被跟踪的进程或线程组，0 表示不跟踪 */
+uint32_t syscall_trace_pid = 0;
+
+/** 全系统的统计，各段指向 global_stat，第一次打开统计时设置 */
+static struct syscall_stat global_stat[NR_syscalls];
+static struct syscall_stats global_stats;
+
+/** 跟踪缓冲区，trace_head 和 trace_tail 只增不减，取模得到下标 */
+static struct syscall_trace_entry trace_buf[SYSCALL_TRACE_SIZE];
+static uint64_t trace_head = 0;         /**< 下一条未读记录 */
+static uint64_t trace_tail = 0;         /**< 下一条记录写入的位置 */
+static uint64_t trace_lost = 0;         /**< 因缓冲区满被覆盖的记录数 */
+
+/** 系统调用名，用于打印 */
+static const char *const syscall_names[NR_syscalls] = {
+    [0] = "init",
+    [NR_fork] = "fork",
+    [NR_test_fork] = "test_fork",
+    [NR_getpid] = "getpid",
+    [NR_getppid] = "getppid",
+    [NR_char] = "char",
+    [NR_block] = "block",
+    [NR_open] = "open",
+    [NR_close] = "close",
+    [NR_stat] = "stat",
+    [NR_read] = "read",
+    [NR_reset] = "reset",
+    [NR_usleep] = "usleep",
+    [NR_nanosleep] = "nanosleep",
+    [NR_setitimer] = "setitimer",
+    [NR_getitimer] = "getitimer",
+    [NR_clock_gettime] = "clock_gettime",
+    [NR_sched_yield] = "sched_yield",
+    [NR_sched_setscheduler] = "sched_setscheduler",
+    [NR_sched_getscheduler] = "sched_getscheduler",
+    [NR_getrusage] = "getrusage",
+    [NR_times] = "times",
+    [NR_sched_stats] = "sched_stats",
+    [NR_exit] = "exit",
+    [NR_waitpid] = "waitpid",
+    [NR_execve] = "execve",
+    [NR_clone] = "clone",
+    [NR_exit_group] = "exit_group",
+    [NR_gettid] = "gettid",
+    [NR_futex] = "futex",
+    [NR_io_uring_setup] = "io_uring_setup",
+    [NR_io_uring_enter] = "io_uring_enter",
+    [NR_syscall_stats] = "syscall_stats",
+    [NR_write] = "write",
+    [NR_lseek] = "lseek",
+    [NR_dup] = "dup",
+    [NR_readv] = "readv",
+    [NR_writev] = "writev",
+    [NR_preadv] = "preadv",
+    [NR_pwritev] = "pwritev",
+    [NR_pread] = "pread",
+    [NR_pwrite] = "pwrite",
+    [NR_poll] = "poll",
+    [NR_epoll_create] = "epoll_create",
+    [NR_epoll_ctl] = "epoll_ctl",
+    [NR_epoll_wait] = "epoll_wait",
+    [NR_pipe2] = "pipe2",
+    [NR_splice] = "splice",
+    [NR_vmsplice] = "vmsplice",
+    [NR_shm_open] = "shm_open",
+    [NR_shm_unlink] = "shm_unlink",
+    [NR_mmap] = "mmap",
+    [NR_munmap] = "munmap",
+    [NR_ipc_port_create] = "ipc_port_create",
+    [NR_ipc_send] = "ipc_send",
+    [NR_ipc_call] = "ipc_call",
+    [NR_ipc_receive] = "ipc_receive",
+    [NR_ipc_reply] = "ipc_reply",
+    [NR_ipc_reply_wait] = "ipc_reply_wait",
+    [NR_sched_switch_mode] = "sched_switch_mode",
+};
+
+static const char *syscall_name(uint64_t nr)
+{
+    return nr < NR_syscalls && syscall_names[nr] ? syscall_names[nr] : "?";
+}
+
+static void stat_add(struct syscall_stat *stat, uint64_t latency, uint64_t bucket, long ret)
+{
+    ++stat->count;
+    if (ret < 0) {
+        ++stat->errors;
+    }
+    stat->total += latency;
+    if (latency > stat->max) {
+        stat->max = latency;
+    }
+    ++stat->hist[bucket];
+}
+
+/**
+ * @brief 取进程中系统调用号 nr 的统计，需要时分配，调用者需关中断
+ *
+ * @return 内存不足时返回 NULL，本次不统计
+ */
+static struct syscall_stat *task_stat(struct task_struct *p, uint64_t nr)
+{
+    if (!p->syscall_stats) {
+        if (!(p->syscall_stats = kmalloc(sizeof(struct syscall_stats)))) {
+            return NULL;
+        }
+        memset(p->syscall_stats, 0, sizeof(struct syscall_stats));
+    }
+    struct syscall_stat **part = &p->syscall_stats->part[nr / SYSCALL_STATS_PER_PART];
+    if (!*part) {
+        uint64_t size = SYSCALL_STATS_PER_PART * sizeof(struct syscall_stat);
+        if (!(*part = kmalloc(size))) {
+            return NULL;
+        }
+        memset(*part, 0, size);
+    }
+    return syscall_stat_of(p->syscall_stats, nr);
+}
+
+static void trace_add(uint64_t nr, const struct trapframe *tf, uint64_t start, uint64_t latency, long ret)
+{
+    if (trace_tail - trace_head == SYSCALL_TRACE_SIZE) {
+        ++trace_head;
+        ++trace_lost;
+    }
+    struct syscall_trace_entry *entry = &trace_buf[trace_tail++ & (SYSCALL_TRACE_SIZE - 1)];
+    entry->stamp = start;
+    entry->pid = current->pid;
+    entry->nr = nr;
+    entry->args[0] = tf->gpr.a0;
+    entry->args[1] = tf->gpr.a1;
+    entry->args[2] = tf->gpr.a2;
+    entry->ret = ret;
+    entry->latency = latency;
+}
+
+/**
+ * @brief 系统调用返回后调用，关中断执行
+ *
+ * 必须在 tf->gpr.a0 被改写为返回值之前调用，跟踪记录从 tf 中读取参数。
+ *
+ * @param nr 系统调用号
+ * @param tf 中断保存栈
+ * @param start syscall_stats_begin() 的返回值，为 0 时不做任何事
+ * @param ret 系统调用返回值
+ */
+void syscall_stats_end(uint64_t nr, const struct trapframe *tf, uint64_t start, long ret)
+{
+    if (!start) {
+        return;
+    }
+    uint64_t now = get_cycles();
+    uint64_t latency = now > start ? now - start : 0;
+    if (syscall_stats_enabled) {
+        uint64_t bucket = hist_bucket(latency);
+        stat_add(syscall_stat_of(&global_stats, nr), latency, bucket, ret);
+        struct syscall_stat *stat = task_stat(current, nr);
+        if (stat) {
+            stat_add(stat, latency, bucket, ret);
+        }
+    }
+    if (syscall_trace_pid && (current->pid == syscall_trace_pid || current->tgid == syscall_trace_pid)) {
+        trace_add(nr, tf, start, latency, ret);
+    }
+}
+
+/**
+ * @brief 回收进程时释放它的统计
+ *
+ * @param p 被回收的进程
+ */
+void syscall_stats_release(struct task_struct *p)
+{
+    if (p->syscall_stats) {
+        for (size_t i = 0; i < SYSCALL_STATS_PARTS; ++i) {
+            if (p->syscall_stats->part[i]) {
+                kfree(p->syscall_stats->part[i]);
+            }
+        }
+        kfree(p->syscall_stats);
+        p->syscall_stats = NULL;
+    }
+}
+
+/**
+ * @brief 打印统计
+ *
+ * 按总耗时从多到少每个被调用过的系统调用一行：调用次数、出错次数、总耗时（微秒）、
+ * 平均和最大耗时（纳秒），下一行为耗时直方图。
+ *
+ * @param stats 统计
+ */
+static void stats_dump(const struct syscall_stats *stats)
+{
+    uint8_t order[NR_syscalls];
+    size_t n = 0;
+    for (size_t nr = 0; nr < NR_syscalls; ++nr) {
+        const struct syscall_stat *stat = syscall_stat_of(stats, nr);
+        if (!stat || !stat->count) {
+            continue;
+        }
+        size_t i = n++;
+        for (; i && syscall_stat_of(stats, order[i - 1])->total < stat->total; --i) {
+            order[i] = order[i - 1];
+        }
+        order[i] = nr;
+    }
+
+    kprintf("nr name calls errors total(us) avg(ns) max(ns)\n");
+    for (size_t i = 0; i < n; ++i) {
+        const struct syscall_stat *stat = syscall_stat_of(stats, order[i]);
+        kprintf("%u %s %u %u %u %u %u\n", (uint64_t)order[i], syscall_name(order[i]),
+                (uint64_t)stat->count, (uint64_t)stat->errors, cycles_to_usec(stat->total),
+                cycles_to_nsec(stat->total / stat->count), cycles_to_nsec(stat->max));
+        print_hist(syscall_name(order[i]), stat->hist);
+    }
+}
+
+/**
+ * @brief 打印并清空跟踪缓冲区
+ *
+ * 每条记录一行：开始时间（微秒）、线程 ID、系统调用名和前三个参数、返回值、
+ * 耗时（纳秒）。
+ */
+static void trace_dump()
+{
+    uint64_t flag = irq_save();
+    if (trace_lost) {
+        kprintf("(%u records lost)\n", trace_lost);
+        trace_lost = 0;
+    }
+    while (trace_head != trace_tail) {
+        struct syscall_trace_entry entry = trace_buf[trace_head++ & (SYSCALL_TRACE_SIZE - 1)];
+        irq_restore(flag);
+        kprintf("[%u] %u %s(%x, %x, %x) = %s%u <%u ns>\n", cycles_to_usec(entry.stamp),
+                (uint64_t)entry.pid, syscall_name(entry.nr),
+                entry.args[0], entry.args[1], entry.args[2],
+                entry.ret < 0 ? "-" : "", entry.ret < 0 ? (uint64_t)-entry.ret : (uint64_t)entry.ret,
+                cycles_to_nsec(entry.latency));
+        flag = irq_save();
+    }
+    irq_restore(flag);
+}
+
+/**
+ * @brief 清空全系统和所有进程的统计以及跟踪缓冲区
+ */
+static void stats_reset()
+{
+    struct task_struct *p;
+    uint64_t flag = irq_save();
+    memset(global_stat, 0, sizeof(global_stat));
+    for_each_task(p) {
+        if (!p->syscall_stats) {
+            continue;
+        }
+        for (size_t i = 0; i < SYSCALL_STATS_PARTS; ++i) {
+            if (p->syscall_stats->part[i]) {
+                memset(p->syscall_stats->part[i], 0, SYSCALL_STATS_PER_PART * sizeof(struct syscall_stat));
+            }
+        }
+    }
+    trace_head = trace_tail = trace_lost = 0;
+    irq_restore(flag);
+}
+
+/**
+ * @brief 实现系统调用 syscall_stats()
+ *
+ * @param 参数1 uint64_t cmd SYSCALL_STATS_* 或 SYSCALL_TRACE*
+ * @param 参数2 uint64_t pid SYSCALL_STATS_DUMP 和 SYSCALL_TRACE 的 PID
+ * @return 成功返回 0；命令无效时返回 -EINVAL，进程不存在或没有统计时返回 -ESRCH
+ */
+long sys_syscall_stats(struct trapframe *tf)
+{
+    uint64_t cmd = tf->gpr.a0;
+    uint32_t pid = tf->gpr.a1;
+    switch (cmd) {
+    case SYSCALL_STATS_OFF:
+    case SYSCALL_STATS_ON:
+        for (size_t i = 0; i < SYSCALL_STATS_PARTS; ++i) {
+            global_stats.part[i] = &global_stat[i * SYSCALL_STATS_PER_PART];
+        }
+        syscall_stats_enabled = cmd == SYSCALL_STATS_ON;
+        return 0;
+    case SYSCALL_STATS_RESET:
+        stats_reset();
+        return 0;
+    case SYSCALL_STATS_DUMP:
+        if (!pid) {
+            stats_dump(&global_stats);
+            return 0;
+        } else {
+            /* 关中断打印，防止进程在打印期间被回收 */
+            uint64_t flag = irq_save();
+            struct task_struct *p = find_task_by_pid(pid);
+            if (!p || !p->syscall_stats) {
+                irq_restore(flag);
+                return -ESRCH;
+            }
+            stats_dump(p->syscall_stats);
+            irq_restore(flag);
+            return 0;
+        }
+    case SYSCALL_TRACE:
+        syscall_trace_pid = pid;
+        return 0;
+    case SYSCALL_TRACE_DUMP:
+        trace_dump();
+        return 0;
+    default:
+        return -EINVAL;
+    }
+}
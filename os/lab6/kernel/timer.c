@@ -0,0 +1,456 @@
+/**
+ * @file timer.c
+ * @brief 实现基于分层时间轮的内核定时器
+ *
+ * 时间轮的最小刻度为 2^TIMER_SHIFT 个时钟周期，共五层：
+ * - 第一层 tv1 有 256 个槽位，每个槽位对应一个刻度；
+ * - 之后四层各有 64 个槽位，每个槽位对应上一层转一圈的时间。
+ *
+ * 添加定时器时根据到期时间与当前刻度的差值直接算出所在的层和槽位，删除定时器
+ * 只需从槽位链表中摘除，二者都是 O(1) 的。tv1 转完一圈时，把上一层对应槽位中
+ * 的定时器重新分配（cascade）到下层。
+ *
+ * tv1 还维护一张位图记录非空槽位，使得处理到期定时器时能跳过空槽位，
+ * 也能快速求出下一个到期时间，用于设置下一次时钟中断。
+ */
+#include <timer.h>
+#include <clock.h>
+#include <errno.h>
+#include <riscv.h>
+#include <sched.h>
+#include <utils/bitops.h>
+#include <uaccess.h>
+
+#define TIMER_SHIFT  10                                     /**< 时间轮最小刻度为 2^10 个时钟周期（10MHz 下约 0.1ms） */
+#define TVR_BITS     8
+#define TVN_BITS     6
+#define TVR_SIZE     (1 << TVR_BITS)                        /**< tv1 槽位数 */
+#define TVN_SIZE     (1 << TVN_BITS)                        /**< tv2 ~ tv5 槽位数 */
+#define TVR_MASK     (TVR_SIZE - 1)
+#define TVN_MASK     (TVN_SIZE - 1)
+#define TVN_LEVELS   4
+#define MAX_TVAL     ((1ULL << (TVR_BITS + TVN_LEVELS * TVN_BITS)) - 1) /**< 时间轮能表示的最大刻度差 */
+
+/** 第 n 层（tv2 为第 0 层）中刻度 clk 对应的槽位 */
+#define TVN_INDEX(clk, n) (((clk) >> (TVR_BITS + (n) * TVN_BITS)) & TVN_MASK)
+
+static struct {
+    uint64_t clk;                                           /**< 下一个要处理的刻度 */
+    uint64_t tv1_bitmap[TVR_SIZE / 64];                     /**< tv1 非空槽位位图 */
+    uint64_t tvn_bitmap[TVN_LEVELS];                        /**< tv2 ~ tv5 非空槽位位图 */
+    struct linked_list_node tv1[TVR_SIZE];
+    struct linked_list_node tvn[TVN_LEVELS][TVN_SIZE];
+} base;
+
+/**
+ * @brief 初始化时间轮
+ */
+void timers_init()
+{
+    for (uint64_t i = 0; i < TVR_SIZE; ++i) {
+        linked_list_init(&base.tv1[i]);
+    }
+    for (uint64_t n = 0; n < TVN_LEVELS; ++n) {
+        for (uint64_t i = 0; i < TVN_SIZE; ++i) {
+            linked_list_init(&base.tvn[n][i]);
+        }
+        base.tvn_bitmap[n] = 0;
+    }
+    for (uint64_t i = 0; i < TVR_SIZE / 64; ++i) {
+        base.tv1_bitmap[i] = 0;
+    }
+    base.clk = get_cycles() >> TIMER_SHIFT;
+}
+
+/**
+ * @brief 将定时器挂入时间轮
+ * @note 调用者需关闭中断
+ */
+static void internal_add_timer(struct timer_list *timer)
+{
+    /* 向上取整，保证定时器不会提前到期 */
+    uint64_t expires = (timer->expires + (1 << TIMER_SHIFT) - 1) >> TIMER_SHIFT;
+    uint64_t idx = expires - base.clk;
+    struct linked_list_node *vec;
+
+    if ((int64_t)idx < 0) {
+        /* 已经到期，在下一个刻度处理 */
+        expires = base.clk;
+        idx = 0;
+    }
+    if (idx < TVR_SIZE) {
+        uint64_t i = expires & TVR_MASK;
+        base.tv1_bitmap[i / 64] |= 1ULL << (i % 64);
+        vec = &base.tv1[i];
+    } else {
+        uint64_t n = 0;
+        if (idx > MAX_TVAL) {
+            expires = base.clk + MAX_TVAL;
+            idx = MAX_TVAL;
+        }
+        while (n < TVN_LEVELS - 1 && idx >= 1ULL << (TVR_BITS + (n + 1) * TVN_BITS)) {
+            ++n;
+        }
+        uint64_t i = TVN_INDEX(expires, n);
+        base.tvn_bitmap[n] |= 1ULL << i;
+        vec = &base.tvn[n][i];
+    }
+    linked_list_push(vec, &timer->entry);
+}
+
+/**
+ * @brief 将定时器从时间轮中摘除，槽位变空时清除位图
+ * @note 调用者需关闭中断
+ */
+static void detach_timer(struct timer_list *timer)
+{
+    struct linked_list_node *prev = timer->entry.prev;
+    linked_list_remove(&timer->entry);
+    timer->entry.next = NULL;
+    timer->entry.prev = NULL;
+    if (!linked_list_empty(prev)) {
+        return;
+    }
+    /* prev 是槽位链表头 */
+    if (prev >= base.tv1 && prev < base.tv1 + TVR_SIZE) {
+        uint64_t i = prev - base.tv1;
+        base.tv1_bitmap[i / 64] &= ~(1ULL << (i % 64));
+    } else if (prev >= base.tvn[0] && prev < base.tvn[0] + TVN_LEVELS * TVN_SIZE) {
+        uint64_t i = prev - base.tvn[0];
+        base.tvn_bitmap[i / TVN_SIZE] &= ~(1ULL << (i % TVN_SIZE));
+    }
+}
+
+/**
+ * @brief 添加定时器
+ *
+ * 定时器的 expires 需事先设置好。
+ *
+ * @param timer 未挂入时间轮的定时器
+ */
+void timer_add(struct timer_list *timer)
+{
+    uint64_t flag = irq_save();
+    if (timer_pending(timer)) {
+        detach_timer(timer);
+    }
+    internal_add_timer(timer);
+    clock_program_event(timer->expires);
+    irq_restore(flag);
+}
+
+/**
+ * @brief 删除定时器
+ *
+ * @param timer 定时器
+ * @return 定时器删除前是否在等待到期
+ */
+uint64_t timer_del(struct timer_list *timer)
+{
+    uint64_t flag = irq_save();
+    uint64_t pending = timer_pending(timer);
+    if (pending) {
+        detach_timer(timer);
+    }
+    irq_restore(flag);
+    return pending;
+}
+
+/**
+ * @brief 修改定时器的到期时间，定时器不在时间轮中时添加之
+ *
+ * @param timer 定时器
+ * @param expires 新的到期时间（时钟周期数）
+ * @return 修改前定时器是否在等待到期
+ */
+uint64_t timer_mod(struct timer_list *timer, uint64_t expires)
+{
+    uint64_t flag = irq_save();
+    uint64_t pending = timer_pending(timer);
+    if (pending) {
+        detach_timer(timer);
+    }
+    timer->expires = expires;
+    internal_add_timer(timer);
+    clock_program_event(expires);
+    irq_restore(flag);
+    return pending;
+}
+
+/**
+ * @brief 将第 n 层（tv2 为第 0 层）槽位 i 的定时器重新分配到下层
+ * @return 槽位 i
+ */
+static uint64_t cascade(uint64_t n, uint64_t i)
+{
+    struct linked_list_node *head = &base.tvn[n][i];
+    while (!linked_list_empty(head)) {
+        struct timer_list *timer = container_of(linked_list_first(head), struct timer_list, entry);
+        linked_list_remove(&timer->entry);
+        internal_add_timer(timer);
+    }
+    base.tvn_bitmap[n] &= ~(1ULL << i);
+    return i;
+}
+
+/**
+ * @brief 在 tv1 位图中查找不小于 start 的第一个非空槽位
+ * @return 槽位下标，不存在时返回 TVR_SIZE
+ */
+static uint64_t tv1_find_next(uint64_t start)
+{
+    for (uint64_t word = start / 64; word < TVR_SIZE / 64; ++word) {
+        uint64_t bits = base.tv1_bitmap[word];
+        if (word == start / 64) {
+            bits &= ~0ULL << (start % 64);
+        }
+        if (bits) {
+            return word * 64 + q_pow2_factor(bits);
+        }
+    }
+    return TVR_SIZE;
+}
+
+/**
+ * @brief 处理所有在 now 之前到期的定时器
+ *
+ * 在时钟中断中调用。
+ *
+ * @param now 当前时间（时钟周期数）
+ */
+void timer_run(uint64_t now)
+{
+    uint64_t target = now >> TIMER_SHIFT;
+    while ((int64_t)(target - base.clk) >= 0) {
+        uint64_t index = base.clk & TVR_MASK;
+        if (!index) {
+            for (uint64_t n = 0; n < TVN_LEVELS; ++n) {
+                if (cascade(n, TVN_INDEX(base.clk, n))) {
+                    break;
+                }
+            }
+        }
+        if (!(base.tv1_bitmap[index / 64] & (1ULL << (index % 64)))) {
+            /* 跳过空槽位，但不越过 tv1 的一圈，以免错过 cascade */
+            uint64_t step = tv1_find_next(index) - index;
+            if (step > target - base.clk + 1) {
+                step = target - base.clk + 1;
+            }
+            base.clk += step;
+            continue;
+        }
+
+        /* 先将槽位链表整体摘下，回调函数重新添加的定时器不会被本轮处理 */
+        struct linked_list_node *head = &base.tv1[index];
+        struct linked_list_node work_list;
+        work_list.next = head->next;
+        work_list.prev = head->prev;
+        work_list.next->prev = &work_list;
+        work_list.prev->next = &work_list;
+        linked_list_init(head);
+        base.tv1_bitmap[index / 64] &= ~(1ULL << (index % 64));
+        ++base.clk;
+
+        while (!linked_list_empty(&work_list)) {
+            struct timer_list *timer = container_of(linked_list_first(&work_list), struct timer_list, entry);
+            linked_list_remove(&timer->entry);
+            timer->entry.next = NULL;
+            timer->entry.prev = NULL;
+            timer->function(timer);
+        }
+    }
+}
+
+/**
+ * @brief 获取下一个定时器的到期时间
+ *
+ * 若 tv1 本圈内没有定时器但上层有，返回 tv1 转完本圈的时间，届时 cascade
+ * 后再求下一个到期时间。
+ *
+ * @return 到期时间（时钟周期数），没有定时器时返回 UINT64_MAX
+ */
+uint64_t timer_next_event()
+{
+    uint64_t index = base.clk & TVR_MASK;
+    uint64_t next = tv1_find_next(index);
+    if (next < TVR_SIZE) {
+        return (base.clk + next - index) << TIMER_SHIFT;
+    }
+    uint64_t pending = 0;
+    for (uint64_t n = 0; n < TVN_LEVELS; ++n) {
+        pending |= base.tvn_bitmap[n];
+    }
+    /* tv1 中下标小于 index 的槽位属于下一圈，同样在本圈结束之后 */
+    if (pending || tv1_find_next(0) < TVR_SIZE) {
+        return (base.clk + TVR_SIZE - index) << TIMER_SHIFT;
+    }
+    return ~0ULL;
+}
+
+static void sleep_timeout(struct timer_list *timer)
+{
+    wake_up_process((struct task_struct *)timer->data);
+}
+
+/**
+ * @brief 当前进程睡眠到 deadline
+ *
+ * 进程处于可中断睡眠状态，可能被提前唤醒。
+ *
+ * @param deadline 唤醒时间（时钟周期数）
+ * @return 剩余未睡眠的时钟周期数，到时唤醒时为 0
+ */
+uint64_t sleep_until(uint64_t deadline)
+{
+    struct timer_list timer;
+    uint64_t flag = irq_save();
+    init_timer(&timer, sleep_timeout, (uint64_t)current);
+    timer_mod(&timer, deadline);
+    current->state = TASK_INTERRUPTIBLE;
+    schedule();
+    timer_del(&timer);
+    irq_restore(flag);
+    uint64_t now = get_cycles();
+    return deadline > now ? deadline - now : 0;
+}
+
+/**
+ * @brief 实现系统调用 nanosleep()
+ *
+ * @param 参数1 const struct timespec *req 睡眠时间
+ * @param 参数2 struct timespec *rem 被提前唤醒时写入剩余时间，可以为 NULL
+ * @return 成功返回 0，被提前唤醒返回 -EINTR
+ */
+long sys_nanosleep(struct trapframe *tf)
+{
+    const struct timespec *ureq = (const struct timespec *)tf->gpr.a0;
+    struct timespec *urem = (struct timespec *)tf->gpr.a1;
+    struct timespec req;
+    if (!ureq) {
+        return -EINVAL;
+    }
+    if (copy_from_user(&req, ureq, sizeof(req))) {
+        return -EFAULT;
+    }
+    if (req.tv_sec < 0 || req.tv_nsec < 0 || req.tv_nsec >= NSEC_PER_SEC) {
+        return -EINVAL;
+    }
+    uint64_t cycles = (uint64_t)req.tv_sec * timebase_freq + nsec_to_cycles(req.tv_nsec);
+    uint64_t left = sleep_until(get_cycles() + cycles);
+    if (!left) {
+        return 0;
+    }
+    if (urem) {
+        struct timespec rem = {
+            .tv_sec = left / timebase_freq,
+            .tv_nsec = cycles_to_nsec(left % timebase_freq),
+        };
+        if (copy_to_user(urem, &rem, sizeof(rem))) {
+            return -EFAULT;
+        }
+    }
+    return -EINTR;
+}
+
+/**
+ * @brief ITIMER_REAL 到期回调函数
+ *
+ * 本内核没有信号机制，间隔定时器到期时累计到期次数（由 getitimer() 返回），
+ * 并唤醒处于可中断睡眠的进程，相当于 SIGALRM 打断了睡眠。
+ */
+void it_real_fn(struct timer_list *timer)
+{
+    struct task_struct *p = (struct task_struct *)timer->data;
+    ++p->it_real_overrun;
+    if (p->state == TASK_INTERRUPTIBLE) {
+        wake_up_process(p);
+    }
+    if (p->it_real_incr) {
+        uint64_t now = get_cycles();
+        timer->expires += p->it_real_incr;
+        /* 关中断时间过长时错过的周期也计入到期次数 */
+        while (timer->expires <= now) {
+            timer->expires += p->it_real_incr;
+            ++p->it_real_overrun;
+        }
+        timer_add(timer);
+    }
+}
+
+static void itimer_get(struct itimerval *value)
+{
+    uint64_t now = get_cycles();
+    uint64_t expires = current->real_timer.expires;
+    cycles_to_timeval(current->it_real_incr, &value->it_interval);
+    cycles_to_timeval(timer_pending(&current->real_timer) && expires > now ? expires - now : 0, &value->it_value);
+}
+
+/** 秒数非负且微秒数在 0..999999 之内，否则换算成时钟周期数会溢出 */
+static int timeval_valid(const struct timeval *tv)
+{
+    return tv->tv_sec >= 0 && tv->tv_usec >= 0 && tv->tv_usec < USEC_PER_SEC;
+}
+
+/**
+ * @brief 实现系统调用 setitimer()
+ *
+ * @param 参数1 int which 只支持 ITIMER_REAL
+ * @param 参数2 const struct itimerval *value 新的定时器设置
+ * @param 参数3 struct itimerval *ovalue 写入原来的定时器设置，可以为 NULL
+ * @return 成功返回 0；秒数为负或微秒数不在 0..999999 之内时返回 -EINVAL
+ */
+long sys_setitimer(struct trapframe *tf)
+{
+    const struct itimerval *uvalue = (const struct itimerval *)tf->gpr.a1;
+    struct itimerval *uovalue = (struct itimerval *)tf->gpr.a2;
+    struct itimerval value;
+    if (tf->gpr.a0 != ITIMER_REAL || !uvalue) {
+        return -EINVAL;
+    }
+    if (copy_from_user(&value, uvalue, sizeof(value))) {
+        return -EFAULT;
+    }
+    if (!timeval_valid(&value.it_value) || !timeval_valid(&value.it_interval)) {
+        return -EINVAL;
+    }
+    if (uovalue) {
+        struct itimerval ovalue;
+        itimer_get(&ovalue);
+        if (copy_to_user(uovalue, &ovalue, sizeof(ovalue))) {
+            return -EFAULT;
+        }
+    }
+    timer_del(&current->real_timer);
+    current->it_real_incr = timeval_to_cycles(&value.it_interval);
+    current->it_real_overrun = 0;
+    uint64_t cycles = timeval_to_cycles(&value.it_value);
+    if (cycles) {
+        timer_mod(&current->real_timer, get_cycles() + cycles);
+    }
+    return 0;
+}
+
+/**
+ * @brief 实现系统调用 getitimer()
+ *
+ * @param 参数1 int which 只支持 ITIMER_REAL
+ * @param 参数2 struct itimerval *value 写入当前的定时器设置
+ * @return 上次调用以来定时器到期的次数
+ */
+long sys_getitimer(struct trapframe *tf)
+{
+    struct itimerval *uvalue = (struct itimerval *)tf->gpr.a1;
+    struct itimerval value;
+    if (tf->gpr.a0 != ITIMER_REAL || !uvalue) {
+        return -EINVAL;
+    }
+    itimer_get(&value);
+    if (copy_to_user(uvalue, &value, sizeof(value))) {
+        return -EFAULT;
+    }
+    uint64_t flag = irq_save();
+    long overrun = current->it_real_overrun;
+    current->it_real_overrun = 0;
+    irq_restore(flag);
+    return overrun;
+}
@@ -21,7 +21,11 @@
 #include <syscall.h>
 #include <trap.h>
 #include <device/irq.h>
-#include <lib/sleep.h>
+#include <workqueue.h>
+#include <preempt.h>
+#include <vma.h>
+#include <syscall_stats.h>
+#include <uaccess.h>
 
 static inline struct trapframe* trap_dispatch(struct trapframe* tf);
 static struct trapframe* interrupt_handler(struct trapframe* tf);
@@ -29,36 +33,155 @@ static struct trapframe* exception_handler(struct trapframe* tf);
 static struct trapframe* syscall_handler(struct trapframe* tf);
 
 /**
- *@brief 写保护异常处理函数
+ * @brief 查找异常修复表，出错的指令有修复地址时从修复地址继续执行
+ *
+ * 修复表只有 uaccess.S 中的几十项，顺序查找。
+ *
+ * @param tf 中断保存栈
+ * @return 找到修复地址时返回 1
+ */
+static uint64_t fixup_exception(struct trapframe* tf)
+{
+    for (const struct exception_table_entry *e = __start___ex_table; e < __stop___ex_table; ++e) {
+        if (e->insn == tf->epc) {
+            tf->epc = e->fixup;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 缺页异常处理函数
+ *
+ * 调入页或处理写时复制；访问非法地址的用户进程被结束，返回码与 shell 报告
+ * SIGSEGV 的方式相同。内核中只有 copy_to_user() 等函数可以访问非法地址，
+ * 经异常修复表返回失败。
+ */
+static void page_fault_handler(struct trapframe* tf)
+{
+    if (!do_page_fault(tf->badvaddr, tf->cause)) {
+        return;
+    }
+    if (trap_in_kernel(tf)) {
+        if (fixup_exception(tf)) {
+            return;
+        }
+        print_trapframe(tf);
+        panic("page fault at %p in kernel", tf->badvaddr);
+    }
+    kprintf("process %u: segmentation fault at %p, epc %p\n", (uint64_t)current->pid, tf->badvaddr, tf->epc);
+    enable_interrupt();
+    do_exit(128 + 11);
+}
+
+/**
+ * @brief 中断返回前处理调度请求
+ *
+ * 被中断的是用户态时总可以调度；被中断的是内核态时，只有抢占计数为 0 且
+ * 不在执行 tasklet 时才能抢占。
+ *
+ * @param tf 中断保存栈
  */
-void wp_page_handler(struct trapframe* tf)
+static void irq_exit_resched(struct trapframe* tf)
 {
-    uint64_t badvaddr = tf->badvaddr;
-    if (badvaddr < current->start_data)
-        panic("Try to write read-only memory");
-    write_verify(badvaddr);
+    if (!current->need_resched) {
+        return;
+    }
+    if (!trap_in_kernel(tf) || (!current->preempt_count && !in_softirq())) {
+        schedule();
+    }
 }
 
-static struct trapframe* external_handler(struct trapframe* tf)
+/**
+ * @brief 时钟中断处理函数，由 trapentry.S 中的 __timer_entry 直接调用
+ *
+ * __timer_entry 只保存了调用者保存寄存器，tf 中只有 ra、gp、tp、t0-t6、a0-a7、sp、
+ * status、epc、cause 有效。
+ *
+ * @param tf 中断保存栈
+ */
+struct trapframe* timer_interrupt_handler(struct trapframe* tf)
 {
+    uint64_t from_user = !trap_in_kernel(tf);
+    if (from_user) {
+        acct_user_to_kernel();
+    }
+    if (clock_handler()) {
+        scheduler_tick();
+    }
+    tasklet_action();
+    irq_exit_resched(tf);
+    if (from_user) {
+        group_exit_check();
+        acct_kernel_to_user();
+    }
+    return tf;
+}
+
+/**
+ * @brief 外部中断处理函数，由 trapentry.S 中的 __external_entry 直接调用
+ *
+ * 与 timer_interrupt_handler() 相同，tf 中只有调用者保存寄存器有效。
+ *
+ * @param tf 中断保存栈
+ */
+struct trapframe* external_interrupt_handler(struct trapframe* tf)
+{
+    uint64_t from_user = !trap_in_kernel(tf);
+    if (from_user) {
+        acct_user_to_kernel();
+    }
     irq_handle();
+    tasklet_action();
+    irq_exit_resched(tf);
+    if (from_user) {
+        group_exit_check();
+        acct_kernel_to_user();
+    }
     return tf;
 }
 
+/**
+ * @brief 系统调用快速路径的处理函数，由 trapentry.S 中的 __syscall_fast 调用
+ *
+ * 系统调用号已在 __alltraps 中检查过，tf 中只有 sp、gp、tp、a0-a7、status、epc、
+ * cause 有效。系统调用开中断执行，返回前处理系统调用期间积累的调度请求。
+ *
+ * @param tf 中断保存栈
+ * @return 系统调用返回值
+ */
+long syscall_fast_handler(struct trapframe* tf)
+{
+    acct_user_to_kernel();
+    uint64_t start = syscall_stats_begin();
+    enable_interrupt();
+    long ret = syscall_table[tf->gpr.a7](tf);
+    disable_interrupt();
+    syscall_stats_end(tf->gpr.a7, tf, start, ret);
+    if (current->need_resched) {
+        schedule();
+    }
+    group_exit_check();
+    acct_kernel_to_user();
+    return ret;
+}
 
 /**
  * @brief 初始化中断
- * 设置 STVEC（中断向量表）的值为 __alltraps 的地址
+ * 设置 STVEC（中断向量表）的值为 __vectors 的地址，使用向量模式
  *
+ * 向量模式下时钟中断和外部中断直接进入各自的入口，只保存调用者保存寄存器；
+ * 异常和其他中断仍进入 __alltraps。
  * 在 SSTATUS 中启用 interrupt
  * 注：下面的CSR操作均为宏定义，寄存器名直接以字符串形式传递，并没有相应的变量
  */
 void set_stvec()
 {
-    /* 引入 trapentry.s 中定义的外部函数，便于下面取地址 */
-    extern void __alltraps(void);
-    /* 设置STVEC的值，MODE=00，因为地址的最后两位四字节对齐后必为0，因此不用单独设置MODE */
-    write_csr(stvec, &__alltraps);
+    /* 引入 trapentry.s 中定义的中断向量表，便于下面取地址 */
+    extern void __vectors(void);
+    /* 设置STVEC的值，MODE=01，__vectors 按 256 字节对齐，低两位可以直接放 MODE */
+    write_csr(stvec, (uint64_t)&__vectors | STVEC_MODE_VECTORED);
     set_csr(sie, 1 << IRQ_S_EXT);
 }
 
@@ -68,7 +191,16 @@ void set_stvec()
  */
 struct trapframe* trap(struct trapframe* tf)
 {
-    return trap_dispatch(tf);
+    uint64_t from_user = !trap_in_kernel(tf);
+    if (from_user) {
+        acct_user_to_kernel();
+    }
+    tf = trap_dispatch(tf);
+    if (from_user) {
+        group_exit_check();
+        acct_kernel_to_user();
+    }
+    return tf;
 }
 
 /**
@@ -104,20 +236,7 @@ struct trapframe* interrupt_handler(struct trapframe* tf)
         break;
     case IRQ_U_TIMER:
     case IRQ_S_TIMER:
-        clock_set_next_event();
-        usleep_handler();
-        // enable_interrupt(); /* 允许嵌套中断 */
-        if (trap_in_kernel(tf)) {
-            ++current->cstime;
-        } else {
-            ++current->cutime;
-        }
-        if (current->counter && --current->counter)
-            return tf;
-        if (!trap_in_kernel(tf)) {
-            schedule();
-        }
-        break;
+        return timer_interrupt_handler(tf);
     case IRQ_H_TIMER:
         kputs("Hypervisor timer interrupt\n");
         break;
@@ -128,8 +247,7 @@ struct trapframe* interrupt_handler(struct trapframe* tf)
         kputs("User external interrupt\n");
         break;
     case IRQ_S_EXT:
-        external_handler(tf);
-        break;
+        return external_interrupt_handler(tf);
     case IRQ_H_EXT:
         kputs("Hypervisor external interrupt\n");
         break;
@@ -174,6 +292,9 @@ struct trapframe* exception_handler(struct trapframe* tf)
         sbi_shutdown();
         break;
     case CAUSE_FAULT_LOAD:
+        if (trap_in_kernel(tf) && fixup_exception(tf)) {
+            break; /* 访问用户内存的指令遇到 PMP 等访问错误 */
+        }
         kputs("fault load");
         print_trapframe(tf);
         sbi_shutdown();
@@ -184,6 +305,9 @@ struct trapframe* exception_handler(struct trapframe* tf)
         sbi_shutdown();
         break;
     case CAUSE_FAULT_STORE:
+        if (trap_in_kernel(tf) && fixup_exception(tf)) {
+            break; /* 访问用户内存的指令遇到 PMP 等访问错误 */
+        }
         kputs("fault store");
         print_trapframe(tf);
         sbi_shutdown();
@@ -207,17 +331,9 @@ struct trapframe* exception_handler(struct trapframe* tf)
         sbi_shutdown();
         break;
     case CAUSE_INSTRUCTION_PAGE_FAULT:
-        kputs("instruction page fault");
-        print_trapframe(tf);
-        sbi_shutdown();
-        break;
     case CAUSE_LOAD_PAGE_FAULT:
-        kputs("load page fault");
-        print_trapframe(tf);
-        sbi_shutdown();
-        break;
     case CAUSE_STORE_PAGE_FAULT:
-        wp_page_handler(tf);
+        page_fault_handler(tf);
         break;
     default:
         kputs("unknown exception");
@@ -232,18 +348,28 @@ struct trapframe* exception_handler(struct trapframe* tf)
  * @brief 系统调用处理函数
  *
  * 检测系统调用号，调用响应的系统调用。
- * 当接收到错误的系统调用号时，设置 errno 为 ENOSY 并返回错误码 -1
+ * 当接收到错误的系统调用号时，与其他系统调用一样直接返回负的错误码 -ENOSYS
  */
 static struct trapframe* syscall_handler(struct trapframe* tf)
 {
     uint64_t syscall_nr = tf->gpr.a7;
+    tf->epc += INST_LEN(tf->epc); /* 执行下一条指令，execve() 会改写 epc */
     if (syscall_nr >= NR_syscalls) {
-        tf->gpr.a0 = -1;
-        errno = ENOSYS;
+        tf->gpr.a0 = -ENOSYS;
     } else {
-        tf->gpr.a0 = syscall_table[syscall_nr](tf);
+        /* 系统调用开中断执行，可以被抢占；sys_init() 要拷贝当前内核栈，关中断执行 */
+        uint64_t start = syscall_stats_begin();
+        if (syscall_nr) {
+            enable_interrupt();
+        }
+        long ret = syscall_table[syscall_nr](tf);
+        disable_interrupt();
+        syscall_stats_end(syscall_nr, tf, start, ret);
+        tf->gpr.a0 = ret;
+        if (current->need_resched) {
+            schedule();
+        }
     }
-    tf->epc += INST_LEN(tf->epc); /* 执行下一条指令 */
     return tf;
 }
 
@@ -0,0 +1,113 @@
+/**
+ * @file vdso.c
+ * @brief 实现 vDSO 数据页的建立和更新
+ *
+ * 数据页是地址空间用户区的普通物理页，随地址空间由 free_page_tables() 释放；
+ * 代码页是内核映像中的页（见 vdso_text.S），不受引用计数管理。
+ */
+#include <vdso.h>
+#include <clock.h>
+#include <mm.h>
+#include <riscv.h>
+#include <sched.h>
+
+extern char __vdso_start[];
+
+/** 顺序锁写者开始更新 */
+static void vdso_write_begin(struct vdso_data *vd)
+{
+    ++vd->seq;
+    __sync_synchronize();
+}
+
+/** 顺序锁写者结束更新 */
+static void vdso_write_end(struct vdso_data *vd)
+{
+    __sync_synchronize();
+    ++vd->seq;
+}
+
+/**
+ * @brief 更新数据页中的计时参数
+ *
+ * @param vd 数据页
+ */
+void vdso_update_clock(struct vdso_data *vd)
+{
+    vdso_write_begin(vd);
+    vd->timebase_freq = timebase_freq;
+    vd->cyc2ns_mult = cyc2ns_mult;
+    vd->realtime_offset = realtime_offset;
+    vdso_write_end(vd);
+}
+
+/**
+ * @brief 将 page 作为地址空间的数据页并填写计时参数
+ *
+ * 本内核只在一个处理器上运行，CPU 编号总是 0。
+ */
+static void vdso_init_data(struct mm_struct *mm, uint64_t page)
+{
+    struct vdso_data *vd = (struct vdso_data *)VIRTUAL(page);
+    vd->cpu = 0;
+    vdso_update_clock(vd);
+    mm->vdso_data = vd;
+}
+
+/**
+ * @brief 在当前页目录中映射 vDSO
+ *
+ * 进程 0 初始化和 execve() 时调用，PID 由 vdso_update_ids() 填写。
+ *
+ * @param mm 当前进程的地址空间
+ * @param page 数据页，get_free_page() 分配的清零页
+ */
+void vdso_map(struct mm_struct *mm, uint64_t page)
+{
+    vdso_init_data(mm, page);
+    put_page(page, VDSO_DATA, USER_R | PAGE_VALID);
+    put_page(PHYSICAL((uint64_t)__vdso_start), VDSO_TEXT, USER_RX | PAGE_VALID);
+    invalidate();
+}
+
+/**
+ * @brief fork() 后为子进程换上自己的数据页
+ *
+ * copy_page_tables() 使子进程与父进程共享数据页，内核直接写数据页，不会触发写时复制，
+ * 因此子进程需要单独的数据页。代码页继续共享。
+ *
+ * @param mm 子进程的地址空间，不是当前使用的
+ * @param page 子进程的数据页，get_free_page() 分配的清零页
+ */
+void vdso_fork(struct mm_struct *mm, uint64_t page)
+{
+    uint64_t *pte = get_pte(mm->pg_dir, VDSO_DATA);
+    if (!pte || !(*pte & PAGE_VALID)) {
+        /* 父进程没有映射 vDSO */
+        free_page(page);
+        mm->vdso_data = NULL;
+        return;
+    }
+    free_page(GET_PAGE_ADDR(*pte));
+    *pte = (page >> 2) | USER_R | PAGE_VALID;
+    vdso_init_data(mm, page);
+}
+
+/**
+ * @brief 更新数据页中的 PID 和 PPID
+ *
+ * 进程创建、execve() 以及进程被过继时调用。PID 和 PPID 都是对齐的 4 字节，
+ * 读者总能读到完整的值，不需要顺序锁。
+ *
+ * @param p 进程，数据页属于 p->mm
+ */
+void vdso_update_ids(struct task_struct *p)
+{
+    struct vdso_data *vd = p->mm ? p->mm->vdso_data : NULL;
+    if (!vd) {
+        return;
+    }
+    struct task_struct *parent = p->group_leader->p_pptr;
+    vd->pid = p->tgid;
+    vd->ppid = parent ? parent->tgid : 0;
+}
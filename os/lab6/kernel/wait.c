@@ -0,0 +1,119 @@
+/**
+ * @file wait.c
+ * @brief 实现等待队列
+ *
+ * 等待队列可能在中断处理函数中被唤醒，因此所有操作都关闭中断进行。
+ */
+#include <wait.h>
+#include <riscv.h>
+#include <sched.h>
+
+/**
+ * @brief 默认唤醒回调函数，唤醒等待的进程
+ */
+uint64_t default_wake_function(struct wait_queue_entry *wait)
+{
+    return wake_up_process(wait->task);
+}
+
+/**
+ * @brief 将非独占等待者加入队首
+ */
+void add_wait_queue(struct wait_queue_head *wq, struct wait_queue_entry *wait)
+{
+    uint64_t flag = irq_save();
+    wait->flags &= ~WQ_FLAG_EXCLUSIVE;
+    linked_list_unshift(&wq->task_list, &wait->entry);
+    irq_restore(flag);
+}
+
+/**
+ * @brief 将独占等待者加入队尾
+ *
+ * 非独占等待者总在独占等待者之前，保证唤醒时它们都能被唤醒。
+ */
+void add_wait_queue_exclusive(struct wait_queue_head *wq, struct wait_queue_entry *wait)
+{
+    uint64_t flag = irq_save();
+    wait->flags |= WQ_FLAG_EXCLUSIVE;
+    linked_list_push(&wq->task_list, &wait->entry);
+    irq_restore(flag);
+}
+
+/**
+ * @brief 将等待者移出等待队列
+ */
+void remove_wait_queue(struct wait_queue_head *wq, struct wait_queue_entry *wait)
+{
+    uint64_t flag = irq_save();
+    linked_list_remove(&wait->entry);
+    linked_list_init(&wait->entry);
+    irq_restore(flag);
+}
+
+/**
+ * @brief 准备睡眠：等待者不在队列中时加入队列，并设置当前进程状态
+ *
+ * @param wq 等待队列
+ * @param wait 等待者
+ * @param state TASK_INTERRUPTIBLE 或 TASK_UNINTERRUPTIBLE
+ */
+void prepare_to_wait(struct wait_queue_head *wq, struct wait_queue_entry *wait, uint64_t state)
+{
+    uint64_t flag = irq_save();
+    if (linked_list_empty(&wait->entry)) {
+        add_wait_queue(wq, wait);
+    }
+    current->state = state;
+    irq_restore(flag);
+}
+
+/**
+ * @brief 同 prepare_to_wait()，但以独占方式等待
+ */
+void prepare_to_wait_exclusive(struct wait_queue_head *wq, struct wait_queue_entry *wait, uint64_t state)
+{
+    uint64_t flag = irq_save();
+    if (linked_list_empty(&wait->entry)) {
+        add_wait_queue_exclusive(wq, wait);
+    }
+    current->state = state;
+    irq_restore(flag);
+}
+
+/**
+ * @brief 结束等待：恢复当前进程为运行状态并移出等待队列
+ */
+void finish_wait(struct wait_queue_head *wq, struct wait_queue_entry *wait)
+{
+    uint64_t flag = irq_save();
+    current->state = TASK_RUNNING;
+    if (!linked_list_empty(&wait->entry)) {
+        remove_wait_queue(wq, wait);
+    }
+    irq_restore(flag);
+}
+
+/**
+ * @brief 唤醒等待队列
+ *
+ * 依次调用等待者的回调函数，回调函数可以将等待者移出队列。
+ *
+ * @param wq 等待队列
+ * @param nr_exclusive 最多唤醒的独占等待者个数，为 0 时唤醒全部
+ */
+void __wake_up(struct wait_queue_head *wq, uint64_t nr_exclusive)
+{
+    uint64_t flag = irq_save();
+    struct linked_list_node *node = wq->task_list.next;
+    while (node != &wq->task_list) {
+        struct linked_list_node *next = node->next;
+        struct wait_queue_entry *wait = container_of(node, struct wait_queue_entry, entry);
+        uint64_t flags = wait->flags;
+        if (wait->func(wait) && (flags & WQ_FLAG_EXCLUSIVE) && !--nr_exclusive) {
+            break;
+        }
+        node = next;
+    }
+    irq_restore(flag);
+}
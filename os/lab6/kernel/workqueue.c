@@ -0,0 +1,155 @@
+/**
+ * @file workqueue.c
+ * @brief 实现工作队列和 tasklet
+ */
+#include <workqueue.h>
+#include <kthread.h>
+#include <assert.h>
+#include <riscv.h>
+#include <sched.h>
+#include <mm.h>
+
+/** 系统工作队列，供 schedule_work() 使用 */
+struct workqueue_struct *system_wq = NULL;
+
+/** 等待执行的 tasklet 链表 */
+static struct tasklet_struct *tasklet_head = NULL;
+static struct tasklet_struct **tasklet_tail = &tasklet_head;
+
+/** 是否正在执行 tasklet */
+static uint64_t softirq_running = 0;
+
+/**
+ * @brief 工作队列内核线程
+ *
+ * 依次取出工作并执行，没有工作时睡眠。
+ */
+static int worker_thread(void *arg)
+{
+    struct workqueue_struct *wq = arg;
+    while (1) {
+        wait_event_interruptible(wq->more_work, !linked_list_empty(&wq->worklist));
+        uint64_t flag = irq_save();
+        struct work_struct *work = container_of(linked_list_shift(&wq->worklist), struct work_struct, entry);
+        linked_list_init(&work->entry);
+        work->pending = 0;      /* 执行期间可以再次加入工作队列 */
+        irq_restore(flag);
+        work->func(work);
+    }
+    return 0;
+}
+
+/**
+ * @brief 创建工作队列及其内核线程
+ * @return 工作队列，失败时返回 NULL
+ */
+struct workqueue_struct *create_workqueue()
+{
+    struct workqueue_struct *wq = kmalloc(sizeof(struct workqueue_struct));
+    if (!wq) {
+        return NULL;
+    }
+    linked_list_init(&wq->worklist);
+    init_waitqueue_head(&wq->more_work);
+    wq->worker = kthread_create(worker_thread, wq);
+    if (!wq->worker) {
+        kfree(wq);
+        return NULL;
+    }
+    return wq;
+}
+
+/**
+ * @brief 初始化工作队列模块，创建系统工作队列
+ */
+void workqueue_init()
+{
+    system_wq = create_workqueue();
+    assert(system_wq, "workqueue_init(): fail to create system workqueue");
+}
+
+/**
+ * @brief 将工作加入工作队列
+ *
+ * 可以在中断处理函数中调用。
+ *
+ * @param wq 工作队列
+ * @param work 工作
+ * @return 工作已在等待执行时返回 0，否则返回 1
+ */
+uint64_t queue_work(struct workqueue_struct *wq, struct work_struct *work)
+{
+    uint64_t flag = irq_save();
+    if (work->pending) {
+        irq_restore(flag);
+        return 0;
+    }
+    work->pending = 1;
+    linked_list_push(&wq->worklist, &work->entry);
+    wake_up(&wq->more_work);
+    irq_restore(flag);
+    return 1;
+}
+
+/**
+ * @brief 将工作加入系统工作队列
+ */
+uint64_t schedule_work(struct work_struct *work)
+{
+    return queue_work(system_wq, work);
+}
+
+/**
+ * @brief 调度 tasklet，tasklet 将在中断返回前执行
+ *
+ * tasklet 已在等待执行时不会重复加入。
+ */
+void tasklet_schedule(struct tasklet_struct *t)
+{
+    uint64_t flag = irq_save();
+    if (!(t->state & TASKLET_STATE_SCHED)) {
+        t->state |= TASKLET_STATE_SCHED;
+        t->next = NULL;
+        *tasklet_tail = t;
+        tasklet_tail = &t->next;
+    }
+    irq_restore(flag);
+}
+
+/**
+ * @brief 是否正在执行 tasklet
+ *
+ * tasklet 执行时打开了中断，嵌套的中断不能在此时调度进程。
+ */
+uint64_t in_softirq()
+{
+    return softirq_running;
+}
+
+/**
+ * @brief 执行所有等待执行的 tasklet
+ *
+ * 在中断处理函数返回前调用，调用时中断关闭。tasklet 执行期间打开中断，
+ * 嵌套的中断不会重复执行 tasklet，其间调度的 tasklet 在本轮循环中执行。
+ */
+void tasklet_action()
+{
+    if (softirq_running) {
+        return;
+    }
+    softirq_running = 1;
+    while (tasklet_head) {
+        struct tasklet_struct *list = tasklet_head;
+        tasklet_head = NULL;
+        tasklet_tail = &tasklet_head;
+        enable_interrupt();
+        while (list) {
+            struct tasklet_struct *t = list;
+            list = list->next;
+            t->state = 0;                       /* 执行期间可以再次调度 */
+            t->func(t->data);
+        }
+        disable_interrupt();
+    }
+    softirq_running = 0;
+}
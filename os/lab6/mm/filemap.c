@@ -0,0 +1,161 @@
+/**
+ * @file filemap.c
+ * @brief 实现页缓存
+ *
+ * 页缓存以（文件系统，inode 号，页号）为键缓存文件内容，只读的文件映射页都
+ * 来自页缓存，运行同一程序的多个进程共享代码段的物理页。
+ *
+ * 缓存的页常驻内存：页缓存持有页的一个引用，映射它的进程各持有一个引用。
+ * 文件被 write() 修改后 filemap_update() 把新内容写入已缓存的页（写穿），
+ * 映射和 splice() 引用的页看到的数据与 read() 一致，缓存不需要失效。
+ */
+#include <vma.h>
+#include <mm.h>
+#include <riscv.h>
+#include <utils/hash_table.h>
+
+#define PAGE_CACHE_HASH_SIZE 127                            /**< 散列表桶数，取素数 */
+
+/** 页缓存项 */
+struct page_cache_entry {
+    struct hash_table_node hash_node;
+    struct vfs_interface *fs;                               /**< 文件系统 */
+    uint64_t inode_idx;                                     /**< inode 号 */
+    uint64_t index;                                         /**< 文件中的页号 */
+    uint64_t page;                                          /**< 物理页地址 */
+};
+
+static uint64_t page_cache_get_hash(struct hash_table_node *node)
+{
+    struct page_cache_entry *entry = container_of(node, struct page_cache_entry, hash_node);
+    return (uint64_t)entry->fs ^ (entry->inode_idx << 16) ^ entry->index;
+}
+
+static uint64_t page_cache_is_equal(struct hash_table_node *nodeA, struct hash_table_node *nodeB)
+{
+    struct page_cache_entry *a = container_of(nodeA, struct page_cache_entry, hash_node);
+    struct page_cache_entry *b = container_of(nodeB, struct page_cache_entry, hash_node);
+    return a->fs == b->fs && a->inode_idx == b->inode_idx && a->index == b->index;
+}
+
+/** 写文件的次数，读入新页期间有写入时重新读，见 filemap_get_page() */
+static uint64_t page_cache_write_seq;
+
+static struct hash_table_node page_cache_buffer[PAGE_CACHE_HASH_SIZE];
+static struct hash_table page_cache = {
+    .buffer = page_cache_buffer,
+    .buffer_length = PAGE_CACHE_HASH_SIZE,
+    .get_hash = page_cache_get_hash,
+    .is_equal = page_cache_is_equal
+};
+
+/**
+ * @brief 初始化页缓存
+ */
+void filemap_init()
+{
+    hash_table_init(&page_cache);
+}
+
+/**
+ * @brief 在页缓存中查找页并增加引用计数，调用者需关中断
+ *
+ * @return 物理页地址，不在缓存中时返回 0
+ */
+static uint64_t page_cache_lookup(struct page_cache_entry *key)
+{
+    struct hash_table_node *node = hash_table_get(&page_cache, &key->hash_node);
+    if (!node) {
+        return 0;
+    }
+    uint64_t page = container_of(node, struct page_cache_entry, hash_node)->page;
+    ++mem_map[MAP_NR(page)];
+    return page;
+}
+
+/**
+ * @brief 获取文件第 index 页的缓存页
+ *
+ * 页不在缓存中时读入文件内容，超出文件大小的部分清零。读文件时可能被调度，
+ * 加入缓存前再次查找，其他进程已经读入同一页时使用已有的页；期间文件被写过时
+ * 重新读，避免把旧内容加入缓存。
+ *
+ * @param inode 文件
+ * @param index 文件中的页号
+ * @return 物理页地址，已为调用者增加一个引用；内存不足时返回 0
+ */
+uint64_t filemap_get_page(struct vfs_inode *inode, uint64_t index)
+{
+    struct page_cache_entry key = { .fs = inode->fs, .inode_idx = inode->inode_idx, .index = index };
+    uint64_t flag = irq_save();
+    uint64_t page = page_cache_lookup(&key);
+    irq_restore(flag);
+    if (page) {
+        return page;
+    }
+
+    page = get_free_page();
+    if (!page) {
+        return 0;
+    }
+    struct page_cache_entry *entry = kmalloc(sizeof(struct page_cache_entry));
+    if (!entry) {
+        free_page(page);
+        return 0;
+    }
+    uint64_t size = vfs_get_stat(inode)->size;
+    uint64_t offset = index * PAGE_SIZE;
+    while (1) {
+        uint64_t seq = page_cache_write_seq;
+        if (offset < size) {
+            uint64_t length = size - offset < PAGE_SIZE ? size - offset : PAGE_SIZE;
+            vfs_inode_request(inode, (void *)VIRTUAL(page), length, offset, 1);
+        }
+        flag = irq_save();
+        if (seq == page_cache_write_seq) {
+            break;
+        }
+        irq_restore(flag);
+    }
+
+    uint64_t cached = page_cache_lookup(&key);
+    if (cached) {
+        irq_restore(flag);
+        free_page(page);
+        kfree(entry);
+        return cached;
+    }
+    *entry = key;
+    entry->page = page;
+    hash_table_set(&page_cache, &entry->hash_node);
+    ++mem_map[MAP_NR(page)];                                /* 页缓存和调用者各持有一个引用 */
+    irq_restore(flag);
+    return page;
+}
+
+/**
+ * @brief 文件 [offset, offset + count) 被写入后更新已缓存的页
+ *
+ * 缓存的页不会被移出缓存，放开中断后仍然有效。
+ */
+void filemap_update(struct vfs_inode *inode, uint64_t offset, uint64_t count)
+{
+    struct page_cache_entry key = { .fs = inode->fs, .inode_idx = inode->inode_idx };
+    uint64_t end = offset + count;
+    uint64_t flag = irq_save();
+    ++page_cache_write_seq;
+    irq_restore(flag);
+    while (offset < end) {
+        key.index = offset / PAGE_SIZE;
+        uint64_t length = PAGE_SIZE - offset % PAGE_SIZE;
+        length = length < end - offset ? length : end - offset;
+        flag = irq_save();
+        struct hash_table_node *node = hash_table_get(&page_cache, &key.hash_node);
+        irq_restore(flag);
+        if (node) {
+            uint64_t page = container_of(node, struct page_cache_entry, hash_node)->page;
+            vfs_inode_request(inode, (void *)VIRTUAL(page + offset % PAGE_SIZE), length, offset, 1);
+        }
+        offset += length;
+    }
+}
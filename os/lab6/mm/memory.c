@@ -9,6 +9,7 @@
 #include <kdebug.h>
 #include <mm.h>
 #include <stddef.h>
+#include <preempt.h>
 
 /** 内核页目录（定义在 entry.s 中）*/
 extern uint64_t boot_pg_dir[512];
@@ -124,7 +125,9 @@ void free_page(uint64_t addr)
         panic("free_page(): trying to free nonexistent page");
     assert(mem_map[MAP_NR(addr)] != 0,
            "free_page(): trying to free free page");
+    uint64_t flag = irq_save();
     --mem_map[MAP_NR(addr)];
+    irq_restore(flag);
 }
 
 /**
@@ -135,15 +138,19 @@ void free_page(uint64_t addr)
 uint64_t get_free_page(void)
 {
     /* fix warrning !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+    /* 查找和占用空闲页之间不能被其他进程或中断打断 */
+    uint64_t flag = irq_save();
     size_t i = MAP_NR(HIGH_MEM) - 1;
     for (; i >= MAP_NR(LOW_MEM); --i) {
         if (mem_map[i] == 0) {
             mem_map[i] = 1;
+            irq_restore(flag);
             uint64_t ret = MEM_START + i * PAGE_SIZE;
             memset((void *)VIRTUAL(ret), 0, PAGE_SIZE);
             return ret;
         }
     }
+    irq_restore(flag);
     return 0;
 }
 
@@ -244,6 +251,7 @@ void free_page_tables(uint64_t from, uint64_t size)
                 (uint64_t *)VIRTUAL(GET_PAGE_ADDR(*pg_tb1));
             /* 用户地址空间：释放页表和指向的物理页 */
             /* 内核地址空间：仅释放页表 */
+            preempt_disable();
             if (is_user_space) {
                 for (size_t nr = 512; nr-- > 0; pg_tb2++) {
                     if (*pg_tb2) {
@@ -255,6 +263,8 @@ void free_page_tables(uint64_t from, uint64_t size)
             }
             free_page(GET_PAGE_ADDR(*pg_tb1));
             *pg_tb1 = 0;
+            preempt_enable();
+            cond_resched();     /* 每释放 2M 地址空间检查一次调度请求 */
         }
         /* 释放二级页表 */
         if (vpns[1] == 0 && pg_tb1 > (uint64_t *)VIRTUAL(GET_PAGE_ADDR(
@@ -268,6 +278,34 @@ void free_page_tables(uint64_t from, uint64_t size)
     invalidate();
 }
 
+/**
+ * @brief 释放进程的页目录和其中所有页表
+ *
+ * 只释放页表本身，不释放页表映射的物理页：用户区的物理页必须已由
+ * free_page_tables() 释放，内核区的物理页属于内核。mm_alloc() 为每个地址空间
+ * 单独分配内核区的页表，地址空间的最后一个引用被释放时由 mmdrop() 调用本函数释放。
+ *
+ * @param dir 页目录 **线性映射虚拟地址**，不能是当前使用的页目录
+ * @see free_page_tables(), mm_alloc(), mmdrop()
+ */
+void free_pg_dir(uint64_t *dir)
+{
+    assert(dir != pg_dir, "free_pg_dir(): trying to free page directory in use");
+    for (size_t i = 0; i < 512; ++i) {
+        if (!dir[i]) {
+            continue;
+        }
+        uint64_t *pg_tb1 = (uint64_t *)VIRTUAL(GET_PAGE_ADDR(dir[i]));
+        for (size_t j = 0; j < 512; ++j) {
+            if (pg_tb1[j]) {
+                free_page(GET_PAGE_ADDR(pg_tb1[j]));
+            }
+        }
+        free_page(GET_PAGE_ADDR(dir[i]));
+    }
+    free_page(PHYSICAL((uint64_t)dir));
+}
+
 /**
  * @brief 将虚拟地址 from 开始的 size 字节虚拟地址空间拷贝到另一进程虚拟地址 to 处
  *
@@ -287,7 +325,7 @@ void free_page_tables(uint64_t from, uint64_t size)
  * @param size 要共享的字节数
  * @return 由于滥用`assert()`，导致返回值失效，暂时返回 1
  * @todo  重构，解决滥用`assert()`的问题，当出错时清理资源并返回 0
- * @see free_page_tables(), map_kernel()，copy_mem()
+ * @see free_page_tables(), map_kernel()，mm_alloc()
  * @note
  * - `to`开始的 N * 2M 虚拟地址空间必须是 **未映射的**,否则 panic。
  * - 两虚拟地址空间要么都是用户空间，要么都是内核空间
@@ -383,6 +421,8 @@ int copy_page_tables(uint64_t from, uint64_t *to_pg_dir, uint64_t to,
                 (uint64_t *)VIRTUAL(GET_PAGE_ADDR(*src_pg_tb1));
             uint64_t *dest_pg_tb2 = (uint64_t *)VIRTUAL(
                 GET_PAGE_ADDR(*dest_pg_tb1));
+            /* 拷贝一张页表期间禁止抢占，避免 mem_map 引用计数被其他进程同时修改 */
+            preempt_disable();
             for (size_t nr = 512; nr-- > 0;
                  ++src_pg_tb2, ++dest_pg_tb2) {
                 if (!*src_pg_tb2) {
@@ -401,6 +441,8 @@ int copy_page_tables(uint64_t from, uint64_t *to_pg_dir, uint64_t to,
                     *src_pg_tb2 &= ~PAGE_WRITABLE;
                 }
             }
+            preempt_enable();
+            cond_resched();     /* 每拷贝 2M 地址空间检查一次调度请求 */
             ++dest_pg_tb1;
             ++dest_vpns[1];
             assert(dest_vpns[0] == dest_dir_idx,
@@ -444,6 +486,39 @@ void un_wp_page(uint64_t *table_entry)
     invalidate();
 }
 
+/**
+ * @brief 查找当前进程中虚拟地址 addr 对应的页表项
+ *
+ * @param addr 虚拟地址
+ * @return 页表项指针（虚拟地址），页表不存在时返回 NULL
+ */
+uint64_t *find_pte(uint64_t addr)
+{
+    return get_pte(pg_dir, addr);
+}
+
+/**
+ * @brief 查找页目录 dir 中虚拟地址 addr 对应的页表项
+ *
+ * @param dir 页目录 **线性映射虚拟地址**
+ * @param addr 虚拟地址
+ * @return 页表项指针（虚拟地址），页表不存在时返回 NULL
+ */
+uint64_t *get_pte(uint64_t *dir, uint64_t addr)
+{
+    uint64_t vpns[3] = { GET_VPN1(addr), GET_VPN2(addr), GET_VPN3(addr) };
+    uint64_t *page_table = dir;
+    for (size_t level = 0; level < 2; ++level) {
+        uint64_t idx = vpns[level];
+        if (!(page_table[idx] & PAGE_VALID)) {
+            return NULL;
+        }
+        page_table =
+            (uint64_t *)VIRTUAL(GET_PAGE_ADDR(page_table[idx]));
+    }
+    return &page_table[vpns[2]];
+}
+
 /**
  * @brief 取消某地址的写保护
  *
@@ -0,0 +1,496 @@
+/**
+ * @file shm.c
+ * @brief 实现命名共享内存对象和共享映射
+ *
+ * 对象挂在全局链表 shm_objects 上，按名字查找，由 shm_mutex 保护。对象持有
+ * 每页的一个引用，打开它的文件持有对象的引用；名字被删除且最后一个文件关闭时
+ * 释放页的引用和对象。
+ *
+ * 每个地址空间的共享映射按地址升序挂在 mm_struct::shm_areas 链表上，只在关中断
+ * 时修改。映射的页表项指向对象的页并各持有一个引用，因此 free_page_tables() 释放
+ * 地址空间时会一并释放，这里只需释放链表节点。
+ */
+#include <shm.h>
+#include <errno.h>
+#include <mutex.h>
+#include <sched.h>
+#include <string.h>
+#include <uaccess.h>
+#include <vma.h>
+#include <fs/file.h>
+
+/** 共享内存对象 */
+struct shm_object {
+    struct linked_list_node list;           /**< shm_objects 链表节点，名字删除后移出 */
+    char name[SHM_NAME_MAX];
+    uint32_t count;                         /**< 打开它的文件数 */
+    uint32_t linked;                        /**< 名字尚未被删除 */
+    uint64_t nr_pages;
+    uint64_t *pages;                        /**< 物理页地址，对象持有每页的一个引用 */
+};
+
+/** 地址空间中的一个共享映射 */
+struct shm_area {
+    uint64_t start;                         /**< 起始地址，按页对齐 */
+    uint64_t end;                           /**< 结束地址（不含），按页对齐 */
+    uint64_t prot;                          /**< PROT_* */
+    struct linked_list_node list;           /**< mm_struct::shm_areas 链表节点，按地址升序排列 */
+};
+
+static DEFINE_MUTEX(shm_mutex);
+static struct linked_list_node shm_objects = { &shm_objects, &shm_objects };
+
+static const struct file_operations shm_fops;
+
+/**
+ * @brief 按名字查找对象，调用者需持有 shm_mutex
+ */
+static struct shm_object *shm_lookup(const char *name)
+{
+    struct linked_list_node *node;
+    for_each_linked_list_node(node, &shm_objects) {
+        struct shm_object *obj = container_of(node, struct shm_object, list);
+        if (!strcmp(obj->name, name)) {
+            return obj;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 名字已删除且没有文件打开时释放对象，调用者需持有 shm_mutex
+ */
+static void shm_put_object(struct shm_object *obj)
+{
+    if (obj->count || obj->linked) {
+        return;
+    }
+    for (uint64_t i = 0; i < obj->nr_pages; ++i) {
+        free_page(obj->pages[i]);
+    }
+    kfree(obj->pages);
+    kfree(obj);
+}
+
+/**
+ * @brief 新建对象并加入 shm_objects，调用者需持有 shm_mutex
+ *
+ * @param size 字节数，向上取整到页
+ * @return 内存不足时返回 NULL
+ */
+static struct shm_object *shm_create(const char *name, uint64_t size)
+{
+    struct shm_object *obj = kmalloc(sizeof(struct shm_object));
+    if (!obj) {
+        return NULL;
+    }
+    obj->nr_pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    obj->pages = kmalloc(obj->nr_pages * sizeof(uint64_t));
+    if (!obj->pages) {
+        kfree(obj);
+        return NULL;
+    }
+    for (uint64_t i = 0; i < obj->nr_pages; ++i) {
+        if (!(obj->pages[i] = get_free_page())) {
+            while (i-- > 0) {
+                free_page(obj->pages[i]);
+            }
+            kfree(obj->pages);
+            kfree(obj);
+            return NULL;
+        }
+    }
+    memcpy(obj->name, name, SHM_NAME_MAX);
+    obj->count = 0;
+    obj->linked = 1;
+    linked_list_push(&shm_objects, &obj->list);
+    return obj;
+}
+
+static void shm_release(struct file *file)
+{
+    struct shm_object *obj = file->private_data;
+    mutex_lock(&shm_mutex);
+    --obj->count;
+    shm_put_object(obj);
+    mutex_unlock(&shm_mutex);
+}
+
+static const struct file_operations shm_fops = {
+    .release = shm_release,
+};
+
+/**
+ * @brief 从用户内存取对象名
+ *
+ * @return 成功返回 0；名字为空时返回 -EINVAL，太长时返回 -ENAMETOOLONG
+ */
+static int64_t shm_get_name(char *name, const char *uname)
+{
+    int64_t ret = strncpy_from_user(name, uname, SHM_NAME_MAX);
+    if (ret < 0) {
+        return ret;
+    }
+    if (ret == SHM_NAME_MAX) {
+        return -ENAMETOOLONG;
+    }
+    return ret ? 0 : -EINVAL;
+}
+
+/**
+ * @brief 实现系统调用 shm_open()
+ *
+ * Linux 的 shm_open() 用 ftruncate() 设置对象大小，这里没有 ftruncate()，创建时
+ * 由第 3 个参数给出大小，之后不能改变。
+ *
+ * @param 参数1 const char *name 对象名，最长 SHM_NAME_MAX - 1 个字符
+ * @param 参数2 uint32_t flags O_RDONLY 或 O_RDWR，可以或上 O_CREAT、O_EXCL
+ * @param 参数3 uint64_t size 创建时的大小，向上取整到页，最多 SHM_MAX_PAGES 页；打开已有对象时忽略
+ * @return 成功返回描述符；对象不存在且没有 O_CREAT 时返回 -ENOENT，对象已存在且有 O_CREAT | O_EXCL
+ *         时返回 -EEXIST，标志或大小无效时返回 -EINVAL，描述符用完时返回 -EMFILE
+ */
+long sys_shm_open(struct trapframe *tf)
+{
+    uint32_t flags = tf->gpr.a1;
+    uint64_t size = tf->gpr.a2;
+    uint32_t mode = flags & O_ACCMODE;
+    if ((flags & ~(O_ACCMODE | O_CREAT | O_EXCL)) || (mode != O_RDONLY && mode != O_RDWR)) {
+        return -EINVAL;
+    }
+    char name[SHM_NAME_MAX];
+    int64_t ret = shm_get_name(name, (const char *)tf->gpr.a0);
+    if (ret) {
+        return ret;
+    }
+    struct file *file = alloc_file(NULL, mode, &shm_fops);
+    if (!file) {
+        return -ENOMEM;
+    }
+
+    mutex_lock(&shm_mutex);
+    struct shm_object *obj = shm_lookup(name);
+    if (obj && (flags & O_CREAT) && (flags & O_EXCL)) {
+        ret = -EEXIST;
+    } else if (!obj && !(flags & O_CREAT)) {
+        ret = -ENOENT;
+    } else if (!obj && (!size || size > SHM_MAX_PAGES * PAGE_SIZE)) {
+        ret = -EINVAL;
+    } else if (!obj && !(obj = shm_create(name, size))) {
+        ret = -ENOMEM;
+    }
+    if (ret) {
+        mutex_unlock(&shm_mutex);
+        kfree(file);
+        return ret;
+    }
+    ++obj->count;
+    file->private_data = obj;
+    mutex_unlock(&shm_mutex);
+
+    ret = fd_install(file);
+    if (ret < 0) {
+        fput(file);
+    }
+    return ret;
+}
+
+/**
+ * @brief 实现系统调用 shm_unlink()
+ *
+ * 删除对象名，之后 shm_open() 同名对象会创建新对象。已打开的描述符和已建立的映射不受影响。
+ *
+ * @param 参数1 const char *name 对象名
+ * @return 成功返回 0；对象不存在时返回 -ENOENT
+ */
+long sys_shm_unlink(struct trapframe *tf)
+{
+    char name[SHM_NAME_MAX];
+    int64_t ret = shm_get_name(name, (const char *)tf->gpr.a0);
+    if (ret) {
+        return ret;
+    }
+    mutex_lock(&shm_mutex);
+    struct shm_object *obj = shm_lookup(name);
+    if (obj) {
+        linked_list_remove(&obj->list);
+        obj->linked = 0;
+        shm_put_object(obj);
+    }
+    mutex_unlock(&shm_mutex);
+    return obj ? 0 : -ENOENT;
+}
+
+/**
+ * @brief 检查地址 addr 是否在共享映射中
+ *
+ * 缺页处理用它拒绝对只读共享映射的写，vmsplice() 用它避免写保护共享的页。
+ */
+uint64_t in_shm_area(struct mm_struct *mm, uint64_t addr)
+{
+    if (addr < SHM_BASE || addr >= SHM_END) {
+        return 0;
+    }
+    uint64_t found = 0;
+    uint64_t flag = irq_save();
+    struct linked_list_node *node;
+    for_each_linked_list_node(node, &mm->shm_areas) {
+        struct shm_area *area = container_of(node, struct shm_area, list);
+        if (addr < area->start) {
+            break;
+        }
+        if (addr < area->end) {
+            found = 1;
+            break;
+        }
+    }
+    irq_restore(flag);
+    return found;
+}
+
+/**
+ * @brief 在共享内存映射区中为 [addr, addr + len) 找位置，调用者需关中断
+ *
+ * @param addr 为 0 时取第一个足够大的空闲区间，否则必须是空闲的
+ * @param next 写入新映射在链表中的后继节点
+ * @return 起始地址，找不到时返回 0
+ */
+static uint64_t shm_get_unmapped_area(struct mm_struct *mm, uint64_t addr, uint64_t len,
+                                      struct linked_list_node **next)
+{
+    uint64_t start = addr ? addr : SHM_BASE;
+    struct linked_list_node *node, *vnode;
+    for_each_linked_list_node(node, &mm->shm_areas) {
+        struct shm_area *area = container_of(node, struct shm_area, list);
+        if (start + len <= area->start) {
+            break;
+        }
+        if (start < area->end) {
+            if (addr) {
+                return 0;
+            }
+            start = area->end;
+        }
+    }
+    if (start + len > SHM_END) {
+        return 0;
+    }
+    /* 映射区是保留给共享映射的，execve() 加载的段也不应落在其中 */
+    for_each_linked_list_node(vnode, &mm->mmap) {
+        struct vm_area_struct *vma = container_of(vnode, struct vm_area_struct, vm_list);
+        if (vma->vm_start < start + len && start < vma->vm_end) {
+            return 0;
+        }
+    }
+    *next = node;
+    return start;
+}
+
+/**
+ * @brief 实现系统调用 mmap()
+ *
+ * 只支持把共享内存对象映射到 [SHM_BASE, SHM_END)，所有页立即映射，访问不会缺页。
+ *
+ * @param 参数1 void *addr 为 NULL 时由内核选择地址，否则是页对齐的地址，映射必须完全在空闲区间中
+ * @param 参数2 uint64_t length 字节数，向上取整到页
+ * @param 参数3 int prot PROT_READ，可以或上 PROT_WRITE
+ * @param 参数4 int flags 必须为 MAP_SHARED
+ * @param 参数5 int fd shm_open() 返回的描述符
+ * @param 参数6 uint64_t offset 对象中的偏移，按页对齐
+ * @return 映射的地址；fd 不是共享内存对象时返回 -ENODEV，以只读打开却要求可写时返回 -EACCES，
+ *         参数无效或超出对象大小时返回 -EINVAL，没有足够的空闲地址时返回 -ENOMEM，
+ *         对象的页已被映射 MAX_PAGE_REF 次（mem_map[] 是 8 位计数）时也返回 -ENOMEM
+ */
+long sys_mmap(struct trapframe *tf)
+{
+    uint64_t addr = tf->gpr.a0;
+    uint64_t len = (tf->gpr.a1 + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    uint64_t prot = tf->gpr.a2;
+    uint64_t offset = tf->gpr.a5;
+    if (tf->gpr.a3 != MAP_SHARED || !len || (prot & ~(PROT_READ | PROT_WRITE)) || !(prot & PROT_READ) ||
+        (offset & (PAGE_SIZE - 1)) || (addr & (PAGE_SIZE - 1)) || (addr && (addr < SHM_BASE || addr >= SHM_END))) {
+        return -EINVAL;
+    }
+    struct file *file = fget(tf->gpr.a4);
+    if (!file) {
+        return -EBADF;
+    }
+    int64_t ret = 0;
+    struct shm_object *obj = file->private_data;
+    if (file->f_op != &shm_fops) {
+        ret = -ENODEV;
+    } else if ((prot & PROT_WRITE) && (file->f_flags & O_ACCMODE) != O_RDWR) {
+        ret = -EACCES;
+    } else if (offset / PAGE_SIZE > obj->nr_pages || len / PAGE_SIZE > obj->nr_pages - offset / PAGE_SIZE) {
+        ret = -EINVAL;
+    }
+    struct shm_area *area = ret ? NULL : kmalloc(sizeof(struct shm_area));
+    if (!ret && !area) {
+        ret = -ENOMEM;
+    }
+    if (ret) {
+        fput(file);
+        return ret;
+    }
+
+    struct mm_struct *mm = current->mm;
+    struct linked_list_node *next;
+    uint64_t flag = irq_save();
+    uint64_t start = shm_get_unmapped_area(mm, addr, len, &next);
+    if (!start) {
+        irq_restore(flag);
+        kfree(area);
+        fput(file);
+        return addr ? -EINVAL : -ENOMEM;
+    }
+    for (uint64_t i = 0; i < len / PAGE_SIZE; ++i) {
+        if (mem_map[MAP_NR(obj->pages[offset / PAGE_SIZE + i])] >= MAX_PAGE_REF) {
+            irq_restore(flag);
+            kfree(area);
+            fput(file);
+            return -ENOMEM;
+        }
+    }
+    area->start = start;
+    area->end = start + len;
+    area->prot = prot;
+    linked_list_insert_before(next, &area->list);
+    uint16_t pte_flags = ((prot & PROT_WRITE) ? USER_RW : USER_R) | PAGE_VALID;
+    for (uint64_t i = 0; i < len / PAGE_SIZE; ++i) {
+        uint64_t page = obj->pages[offset / PAGE_SIZE + i];
+        ++mem_map[MAP_NR(page)];
+        put_page(page, start + i * PAGE_SIZE, pte_flags);
+    }
+    invalidate();
+    irq_restore(flag);
+    fput(file);
+    return start;
+}
+
+/**
+ * @brief 撤销当前地址空间中的一个共享映射并释放页表项持有的引用，调用者需关中断
+ */
+static void shm_unmap_area(struct shm_area *area)
+{
+    for (uint64_t addr = area->start; addr < area->end; addr += PAGE_SIZE) {
+        uint64_t *pte = find_pte(addr);
+        if (pte && (*pte & PAGE_VALID)) {
+            free_page(GET_PAGE_ADDR(*pte));
+            *pte = 0;
+        }
+    }
+    linked_list_remove(&area->list);
+}
+
+/**
+ * @brief 实现系统调用 munmap()
+ *
+ * 撤销完全落在 [addr, addr + length) 中的共享映射，不支持只撤销映射的一部分。
+ *
+ * @param 参数1 void *addr 页对齐的地址
+ * @param 参数2 uint64_t length 字节数，向上取整到页
+ * @return 成功返回 0；区间只覆盖某个映射的一部分时返回 -EINVAL
+ */
+long sys_munmap(struct trapframe *tf)
+{
+    uint64_t start = tf->gpr.a0;
+    uint64_t end = start + ((tf->gpr.a1 + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+    if ((start & (PAGE_SIZE - 1)) || end <= start || end > START_KERNEL) {
+        return -EINVAL;
+    }
+    struct mm_struct *mm = current->mm;
+    struct linked_list_node freed;
+    linked_list_init(&freed);
+    uint64_t flag = irq_save();
+    struct linked_list_node *node;
+    for_each_linked_list_node(node, &mm->shm_areas) {
+        struct shm_area *area = container_of(node, struct shm_area, list);
+        if (area->end > start && area->start < end && (area->start < start || area->end > end)) {
+            irq_restore(flag);
+            return -EINVAL;
+        }
+    }
+    node = mm->shm_areas.next;
+    while (node != &mm->shm_areas) {
+        struct shm_area *area = container_of(node, struct shm_area, list);
+        node = node->next;
+        if (area->start >= start && area->end <= end) {
+            shm_unmap_area(area);
+            linked_list_push(&freed, &area->list);
+        }
+    }
+    invalidate();
+    irq_restore(flag);
+    while (!linked_list_empty(&freed)) {
+        kfree(container_of(linked_list_shift(&freed), struct shm_area, list));
+    }
+    return 0;
+}
+
+/**
+ * @brief fork() 时复制父进程的共享映射描述
+ *
+ * 在 copy_page_tables() 之前调用，页表项由 copy_page_tables() 复制，之后由
+ * shm_fork() 恢复可写。
+ *
+ * @param to 子进程的地址空间，shm_areas 链表已初始化为空
+ * @param from 父进程的地址空间
+ * @return 成功返回 0，内存不足时返回 -ENOMEM，已复制的描述由调用者用 exit_shm_areas() 释放
+ */
+int64_t copy_shm_areas(struct mm_struct *to, struct mm_struct *from)
+{
+    struct linked_list_node *node;
+    for_each_linked_list_node(node, &from->shm_areas) {
+        struct shm_area *area = container_of(node, struct shm_area, list);
+        struct shm_area *copy = kmalloc(sizeof(struct shm_area));
+        if (!copy) {
+            return -ENOMEM;
+        }
+        *copy = *area;
+        linked_list_push(&to->shm_areas, &copy->list);
+    }
+    return 0;
+}
+
+/**
+ * @brief fork() 后恢复共享映射的写权限
+ *
+ * copy_page_tables() 已为子进程的页表项增加了页的引用，并把父子进程的页表项都
+ * 写保护以便写时复制。共享映射不能复制，可写的映射在父子进程中都恢复可写。
+ *
+ * @param mm 子进程的地址空间，不是当前使用的
+ */
+void shm_fork(struct mm_struct *mm)
+{
+    struct linked_list_node *node;
+    for_each_linked_list_node(node, &mm->shm_areas) {
+        struct shm_area *area = container_of(node, struct shm_area, list);
+        if (!(area->prot & PROT_WRITE)) {
+            continue;
+        }
+        for (uint64_t addr = area->start; addr < area->end; addr += PAGE_SIZE) {
+            uint64_t *pte = get_pte(mm->pg_dir, addr);
+            if (pte && (*pte & PAGE_VALID)) {
+                *pte |= PAGE_WRITABLE;
+            }
+            pte = find_pte(addr);
+            if (pte && (*pte & PAGE_VALID)) {
+                *pte |= PAGE_WRITABLE;
+            }
+        }
+    }
+    invalidate();
+}
+
+/**
+ * @brief 释放地址空间的所有共享映射描述
+ *
+ * 不释放映射的页，它们由 free_page_tables() 随用户地址空间释放。
+ *
+ * @param mm 地址空间
+ */
+void exit_shm_areas(struct mm_struct *mm)
+{
+    while (!linked_list_empty(&mm->shm_areas)) {
+        kfree(container_of(linked_list_shift(&mm->shm_areas), struct shm_area, list));
+    }
+}
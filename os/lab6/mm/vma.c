@@ -0,0 +1,227 @@
+/**
+ * @file vma.c
+ * @brief 实现虚拟内存区域管理和缺页处理
+ *
+ * 每个地址空间的 VMA 按地址升序挂在 mm_struct::mmap 链表上。VMA 只由 execve()、
+ * 地址空间的最后一个使用者退出时或创建它的 fork() 修改，execve() 会先让调用者
+ * 独占地址空间（见 exec.c），因此缺页处理查找 VMA 时不需要加锁。
+ */
+#include <vma.h>
+#include <assert.h>
+#include <errno.h>
+#include <mm.h>
+#include <riscv.h>
+#include <sched.h>
+#include <io_uring.h>
+#include <shm.h>
+
+/**
+ * @brief 查找包含地址 addr 的 VMA
+ *
+ * @param mm 地址空间
+ * @param addr 虚拟地址
+ * @return 找不到时返回 NULL
+ */
+struct vm_area_struct *find_vma(struct mm_struct *mm, uint64_t addr)
+{
+    struct linked_list_node *node;
+    for_each_linked_list_node(node, &mm->mmap) {
+        struct vm_area_struct *vma = container_of(node, struct vm_area_struct, vm_list);
+        if (addr < vma->vm_start) {
+            break;
+        }
+        if (addr < vma->vm_end) {
+            return vma;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 在地址空间中新建 VMA
+ *
+ * 文件映射的 VMA 持有文件的一个引用。
+ *
+ * @param mm 地址空间
+ * @param start 起始地址，按页对齐
+ * @param end 结束地址（不含），按页对齐
+ * @param flags 访问权限
+ * @param file 映射的文件，匿名映射为 NULL
+ * @param pgoff start 对应的文件偏移，按页对齐
+ * @param file_end 文件内容在区域中的结束地址
+ * @return 成功返回 0；与已有 VMA 重叠时返回 -EINVAL，内存不足时返回 -ENOMEM
+ */
+int64_t insert_vma(struct mm_struct *mm, uint64_t start, uint64_t end, uint64_t flags,
+                   struct vfs_inode *file, uint64_t pgoff, uint64_t file_end)
+{
+    assert(!(start & (PAGE_SIZE - 1)) && !(end & (PAGE_SIZE - 1)) && start < end,
+           "insert_vma(): invalid area [%p, %p)", start, end);
+    struct linked_list_node *node;
+    for_each_linked_list_node(node, &mm->mmap) {
+        struct vm_area_struct *vma = container_of(node, struct vm_area_struct, vm_list);
+        if (end <= vma->vm_start) {
+            break;
+        }
+        if (start < vma->vm_end) {
+            return -EINVAL;
+        }
+    }
+    struct vm_area_struct *vma = kmalloc(sizeof(struct vm_area_struct));
+    if (!vma) {
+        return -ENOMEM;
+    }
+    vma->vm_start = start;
+    vma->vm_end = end;
+    vma->vm_flags = flags;
+    vma->vm_file = file;
+    vma->vm_pgoff = pgoff;
+    vma->vm_file_end = file_end;
+    if (file) {
+        vfs_ref_inode(file);
+    }
+    linked_list_insert_before(node, &vma->vm_list);
+    return 0;
+}
+
+/**
+ * @brief fork() 时复制父进程的 VMA
+ *
+ * 页表由 copy_mm() 以写时复制的方式共享，这里只复制区域描述。
+ *
+ * @param to 子进程的地址空间，mmap 链表已初始化为空
+ * @param from 父进程的地址空间
+ * @return 成功返回 0，内存不足时返回 -ENOMEM，已复制的 VMA 由调用者用 exit_vmas() 释放
+ */
+int64_t copy_vmas(struct mm_struct *to, struct mm_struct *from)
+{
+    struct linked_list_node *node;
+    for_each_linked_list_node(node, &from->mmap) {
+        struct vm_area_struct *vma = container_of(node, struct vm_area_struct, vm_list);
+        int64_t ret = insert_vma(to, vma->vm_start, vma->vm_end, vma->vm_flags,
+                                 vma->vm_file, vma->vm_pgoff, vma->vm_file_end);
+        if (ret) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 释放地址空间的所有 VMA 和它们持有的文件引用
+ *
+ * 不释放映射的物理页，用户地址空间由 free_page_tables() 释放。
+ *
+ * @param mm 地址空间
+ */
+void exit_vmas(struct mm_struct *mm)
+{
+    while (!linked_list_empty(&mm->mmap)) {
+        struct vm_area_struct *vma = container_of(linked_list_first(&mm->mmap), struct vm_area_struct, vm_list);
+        linked_list_remove(&vma->vm_list);
+        if (vma->vm_file) {
+            vfs_free_inode(vma->vm_file);
+        }
+        kfree(vma);
+    }
+}
+
+/** VMA 访问权限对应的用户态页表项标志位 */
+static uint16_t vma_page_flags(struct vm_area_struct *vma)
+{
+    uint16_t flags = PAGE_USER | PAGE_VALID;
+    if (vma->vm_flags & VM_READ) {
+        flags |= PAGE_READABLE;
+    }
+    if (vma->vm_flags & VM_WRITE) {
+        flags |= PAGE_WRITABLE;
+    }
+    if (vma->vm_flags & VM_EXEC) {
+        flags |= PAGE_EXECUTABLE;
+    }
+    return flags;
+}
+
+/**
+ * @brief 调入 VMA 中地址 addr 所在的页
+ *
+ * 读文件时可能被调度，映射前再次检查页表项，页已被调入时放弃本次分配的页。
+ *
+ * @param vma 包含 addr 的 VMA
+ * @param addr 页起始地址
+ */
+static int64_t do_no_page(struct vm_area_struct *vma, uint64_t addr)
+{
+    uint64_t offset = vma->vm_pgoff + (addr - vma->vm_start);
+    uint64_t page;
+    if (vma->vm_file && !(vma->vm_flags & VM_WRITE)) {
+        page = filemap_get_page(vma->vm_file, offset / PAGE_SIZE);
+    } else {
+        page = get_free_page();
+        if (page && vma->vm_file && addr < vma->vm_file_end) {
+            uint64_t length = vma->vm_file_end - addr < PAGE_SIZE ? vma->vm_file_end - addr : PAGE_SIZE;
+            vfs_inode_request(vma->vm_file, (void *)VIRTUAL(page), length, offset, 1);
+        }
+    }
+    if (!page) {
+        return -ENOMEM;
+    }
+
+    uint64_t flag = irq_save();
+    uint64_t *pte = find_pte(addr);
+    if (pte && (*pte & PAGE_VALID)) {
+        irq_restore(flag);
+        free_page(page);
+        return 0;
+    }
+    put_page(page, addr, vma_page_flags(vma));
+    invalidate();
+    irq_restore(flag);
+    return 0;
+}
+
+/**
+ * @brief 处理当前进程用户地址空间中的缺页异常
+ *
+ * 用户态和内核态（系统调用访问用户缓冲区）的缺页都由这里处理。
+ *
+ * @param addr 出错的虚拟地址
+ * @param cause 异常原因 CAUSE_*_PAGE_FAULT
+ * @return 成功返回 0；地址不在 VMA 中或访问权限不符时返回 -EFAULT，内存不足时返回 -ENOMEM
+ */
+int64_t do_page_fault(uint64_t addr, uint64_t cause)
+{
+    struct mm_struct *mm = current->mm;
+    if (addr >= START_KERNEL || !mm || (addr >= VDSO_BASE && addr < IO_URING_END)) {
+        return -EFAULT;
+    }
+    /* 共享映射的页总是在页表中，缺页只可能是写只读映射，不能按写时复制处理 */
+    if (in_shm_area(mm, addr)) {
+        return -EFAULT;
+    }
+    struct vm_area_struct *vma = find_vma(mm, addr);
+    if (!vma) {
+        /* 运行内核映像的进程没有 VMA，只有数据段的写时复制 */
+        if (linked_list_empty(&mm->mmap) && cause == CAUSE_STORE_PAGE_FAULT &&
+            addr >= current->start_data) {
+            write_verify(addr);
+            return 0;
+        }
+        return -EFAULT;
+    }
+
+    uint64_t access = cause == CAUSE_STORE_PAGE_FAULT ? VM_WRITE :
+                      cause == CAUSE_INSTRUCTION_PAGE_FAULT ? VM_EXEC : VM_READ;
+    if (!(vma->vm_flags & access)) {
+        return -EFAULT;
+    }
+    uint64_t *pte = find_pte(addr);
+    if (pte && (*pte & PAGE_VALID)) {
+        /* 页已存在，只可能是 fork() 后对共享页的写 */
+        if (cause != CAUSE_STORE_PAGE_FAULT) {
+            return -EFAULT;
+        }
+        un_wp_page(pte);
+        return 0;
+    }
+    return do_no_page(vma, addr & ~(PAGE_SIZE - 1));
+}
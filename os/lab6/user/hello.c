@@ -0,0 +1,24 @@
+/**
+ * @file hello.c
+ * @brief 由 execve() 从 ramfs 加载的示例程序
+ *
+ * 打印自己的参数，PPID 从 vDSO 数据页读取。.bss 中的大数组只有被访问的页才会被调入。
+ */
+#include <syscall.h>
+#include <vdso.h>
+#include <lib/stdio.h>
+
+static char buffer[16 * 4096];
+static int runs = 1;
+
+int main(int argc, char *argv[])
+{
+    long (*vdso_getppid)(void) = VDSO_CALL(VDSO_GETPPID);
+    printf("hello from process %u (parent %u), argc = %u\n", syscall(NR_getpid), vdso_getppid(),
+           (uint64_t)argc);
+    for (int i = 0; i < argc; ++i) {
+        printf("argv[%u] = %s\n", (uint64_t)i, argv[i]);
+    }
+    buffer[sizeof(buffer) - 1] = runs++;
+    return 0;
+}
@@ -0,0 +1,49 @@
+/**
+ * @file shmmap.c
+ * @brief 反复映射同一个共享内存对象的测试程序
+ *
+ * 每个映射都持有对象页的一个引用，mem_map[] 只是 8 位计数。程序把一页的对象
+ * 一次次映射，直到 mmap() 失败，检查失败发生在计数回绕之前且错误码为 ENOMEM；
+ * 然后撤销全部映射，再映射一次，确认页没有被提前释放，写入的数据还在。
+ */
+#include <syscall.h>
+#include <errno.h>
+#include <shm.h>
+#include <fs/file.h>
+#include <lib/stdio.h>
+
+#define MAX_MAPS     256                        /* 超过 8 位计数的范围 */
+
+static long maps[MAX_MAPS];
+
+int main(int argc, char *argv[])
+{
+    int fd = syscall(NR_shm_open, "/shmmap", O_RDWR | O_CREAT | O_EXCL, PAGE_SIZE);
+    if (fd < 0) {
+        printf("shmmap: shm_open() failed\n");
+        return 1;
+    }
+    syscall(NR_shm_unlink, "/shmmap");
+    uint64_t n = 0;
+    long addr;
+    while (n < MAX_MAPS &&
+           (addr = syscall(NR_mmap, 0, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) != -1) {
+        maps[n++] = addr;
+    }
+    int ok = n < MAX_MAPS && errno == ENOMEM;
+    printf("shmmap: %u mappings, then %s\n", n, ok ? "ENOMEM" : "no error");
+    if (n) {
+        *(volatile uint64_t *)maps[n - 1] = 0x5348;
+    }
+    for (uint64_t i = 0; i < n; ++i) {
+        syscall(NR_munmap, maps[i], PAGE_SIZE);
+    }
+    addr = syscall(NR_mmap, 0, PAGE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == -1 || *(volatile uint64_t *)addr != 0x5348) {
+        printf("shmmap: object page lost after munmap()\n");
+        ok = 0;
+    }
+    syscall(NR_close, fd);
+    printf("shmmap: %s\n", ok ? "passed" : "FAILED");
+    return !ok;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file threads.c
+ * @brief clone() 创建线程和 futex 的示例程序
+ *
+ * 创建若干共享地址空间的线程，每个线程有自己的用户栈和 tp，在基于 futex 的
+ * 互斥锁保护下累加共享的计数器。主线程在 CLONE_CHILD_CLEARTID 清零的 TID 上
+ * 以 FUTEX_WAIT 等待线程退出，最后调用 exit_group()。
+ */
+#include <syscall.h>
+#include <sched.h>
+#include <futex.h>
+#include <lib/stdio.h>
+
+#define NR_THREADS   4
+#define STACK_SIZE   4096
+#define LOOPS        1000
+
+long __clone(int (*fn)(void *), void *stack, unsigned long flags, void *arg,
+             int *parent_tid, void *tls, int *child_tid);
+
+static char stacks[NR_THREADS][STACK_SIZE] __attribute__((aligned(16)));
+static uint64_t tls[NR_THREADS];
+static int tids[NR_THREADS];
+static int lock;                    /* 0：空闲，1：被持有，2：被持有且可能有等待者 */
+static uint64_t counter;
+
+static void mutex_lock(int *f)
+{
+    int c = 0;
+    if (__atomic_compare_exchange_n(f, &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+    while (__atomic_exchange_n(f, 2, __ATOMIC_ACQUIRE) != 0) {
+        syscall(NR_futex, f, FUTEX_WAIT, 2, NULL);
+    }
+}
+
+static void mutex_unlock(int *f)
+{
+    if (__atomic_exchange_n(f, 0, __ATOMIC_RELEASE) == 2) {
+        syscall(NR_futex, f, FUTEX_WAKE, 1);
+    }
+}
+
+static int worker(void *arg)
+{
+    uint64_t tp;
+    __asm__ __volatile__("mv %0, tp" : "=r"(tp));
+    for (int i = 0; i < LOOPS; ++i) {
+        mutex_lock(&lock);
+        ++counter;
+        mutex_unlock(&lock);
+    }
+    printf("thread %u of process %u: tp = %p\n", syscall(NR_gettid), syscall(NR_getpid), tp);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t flags = CLONE_VM | CLONE_FILES | CLONE_THREAD | CLONE_SETTLS |
+                     CLONE_PARENT_SETTID | CLONE_CHILD_CLEARTID;
+    for (uint64_t i = 0; i < NR_THREADS; ++i) {
+        /* TID 在新线程运行之前写入，线程退出时清零 */
+        if (__clone(worker, stacks[i] + STACK_SIZE, flags, (void *)i,
+                    &tids[i], &tls[i], &tids[i]) < 0) {
+            printf("clone() failed\n");
+            syscall(NR_exit_group, 1);
+        }
+    }
+    for (uint64_t i = 0; i < NR_THREADS; ++i) {
+        int tid;
+        while ((tid = __atomic_load_n(&tids[i], __ATOMIC_ACQUIRE))) {
+            syscall(NR_futex, &tids[i], FUTEX_WAIT, tid, NULL);
+        }
+    }
+    printf("process %u: %u threads done, counter = %u\n", syscall(NR_getpid),
+           (uint64_t)NR_THREADS, counter);
+    syscall(NR_exit_group, 0);
+    return 0;
+}
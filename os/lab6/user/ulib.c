@@ -0,0 +1,41 @@
+/**
+ * @file ulib.c
+ * @brief 用户程序的系统调用接口
+ *
+ * 与内核映像中的 syscall() 相同，用户程序链接 lib/libstd.a 中的 printf() 等函数时
+ * 使用这里的实现。
+ */
+#include <stdarg.h>
+#include <syscall.h>
+#include <errno.h>
+
+/**
+ * @brief 通过系统调用号调用对应的系统调用
+ *
+ * @param number 系统调用号
+ * @param ... 系统调用参数
+ * @return 失败时设置 errno 并返回 -1
+ */
+long syscall(long number, ...)
+{
+    va_list ap;
+    va_start(ap, number);
+    register long a0 asm("a0") = va_arg(ap, long);
+    register long a1 asm("a1") = va_arg(ap, long);
+    register long a2 asm("a2") = va_arg(ap, long);
+    register long a3 asm("a3") = va_arg(ap, long);
+    register long a4 asm("a4") = va_arg(ap, long);
+    register long a5 asm("a5") = va_arg(ap, long);
+    register long a7 asm("a7") = number;
+    va_end(ap);
+    /* 系统调用快速路径不保存 caller-saved 寄存器 */
+    __asm__ __volatile__ ("ecall\n\t"
+            :"+r"(a0), "+r" (a1), "+r" (a2), "+r" (a3), "+r" (a4), "+r" (a5), "+r" (a7)
+            :
+            :"memory", "ra", "t0", "t1", "t2", "t3", "t4", "t5", "t6", "a6");
+    if (a0 < 0) {
+        errno = -a0;
+        return -1;
+    }
+    return a0;
+}